@@ -1,21 +1,62 @@
 #include "kzrjson.h"
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if !defined(__STDC_NO_THREADS__) && !defined(KZRJSON_NO_THREADS)
+#include <threads.h>
+#define KZRJSON_THREADS
+#endif
 
-static kzrjson_errno_t g_errno;
+/*
+ * Variants of the lexer of kzrjson_parse, selected at compile time:
+ * - KZRJSON_RELAXED accepts numbers and strings which RFC 8259 does not,
+ *   like "01", "1.", ".5", "\u12" and control characters in strings.
+ * - KZRJSON_VALIDATE_UTF8 rejects strings which are not well-formed UTF-8.
+ * Checks which the variant does not make are not compiled.
+ */
+#if !defined(KZRJSON_RELAXED)
+#define KZRJSON_STRICT
+#endif
+
+/*
+ * Every piece of mutable state in this file is thread local,
+ * so independent threads can parse and build JSON at the same time.
+ */
+#if defined(_MSC_VER) && !defined(__clang__)
+#define KZRJSON_THREAD_LOCAL __declspec(thread)
+#else
+#define KZRJSON_THREAD_LOCAL _Thread_local
+#endif
+
+static KZRJSON_THREAD_LOCAL kzrjson_errno_t g_errno;
+
+// byte offset from the head of the text being parsed at the first error
+static KZRJSON_THREAD_LOCAL size_t g_error_offset;
 
 static void kzrjson_set_success(void) {
 	g_errno = kzrjson_success;
+	g_error_offset = 0;
 }
 
 kzrjson_errno_t kzrjson_errno(void) {
 	return g_errno;
 }
 
+static void record_error_offset(void);
+
+/*
+ * The first error wins: callers unwinding after a failure
+ * must not overwrite its code and position.
+ */
 static void set_kzrjson_errno(const kzrjson_errno_t err) {
+	if (g_errno != kzrjson_success) return;
+	record_error_offset();
 	g_errno = err;
 }
 
@@ -26,21 +67,11 @@ static const char end_object = '}';
 static const char name_separator = ':';
 static const char value_separator = ',';
 
-/*
-ws = *(
-	%x20 / ; Space
-	%x09 / ; Horizontal tab
-	%x0A / ; Line feed or New line
-	%x0D ) ; Carriage return
-*/
-static const char white_spaces[] = {' ', 0x09, 0x0A, 0x0D, '\0'};
 static const char *literal_false = "false";
 static const char *literal_null = "null";
 static const char *literal_true = "true";
 static const char decimal_point = '.';
-		
-static const char *digit0_9 = "0123456789";
-static const char e[] = {'e', 'E', '\0'};
+
 static const char minus = '-';
 static const char plus = '+';
 static const char zero = '0';
@@ -68,16 +99,18 @@ typedef enum {
 	kzrjson_token_escape,
 	kzrjson_token_quotation_mark,
 	kzrjson_token_string,
+	kzrjson_token_number,
 	kzrjson_token_end_of_text,
 } kzrjson_token_type;
 
-static struct {
+static KZRJSON_THREAD_LOCAL struct {
 	kzrjson_token_type type;
 	const char *begin;
 	size_t length;
+	kzrjson_number_type number_type;
 } current_token;
 
-static struct {
+static KZRJSON_THREAD_LOCAL struct {
 	const char *text;
 	const char *pos;
 } lexer;
@@ -87,12 +120,33 @@ static void set_lexer(const char *json_text) {
 	lexer.pos = lexer.text;
 }
 
-static void next(void) {
-	lexer.pos++;
+static void record_error_offset(void) {
+	if (lexer.text == NULL || lexer.pos == NULL) {
+		g_error_offset = 0;
+		return;
+	}
+	g_error_offset = (size_t)(lexer.pos - lexer.text);
 }
 
-static bool end_of_text(void) {
-	return *lexer.pos == '\0';
+/*
+ * Fill line and column (both 1-origin) of result->offset.
+ * Only called when parsing failed, so the success path never counts lines.
+ */
+static void set_error_position(kzrjson_result_t *result, const char *json_text) {
+	result->line = 1;
+	result->column = 1;
+	for (size_t i = 0; i < result->offset && json_text[i] != '\0'; i++) {
+		if (json_text[i] == 0x0A) {
+			result->line++;
+			result->column = 1;
+		} else {
+			result->column++;
+		}
+	}
+}
+
+static void next(void) {
+	lexer.pos++;
 }
 
 static kzrjson_token_type set_token(
@@ -106,40 +160,123 @@ static kzrjson_token_type set_token(
 	return type;
 }
 
-static kzrjson_token_type set_token_char(kzrjson_token_type type) {
-	return set_token(type, current_token.begin, 1);
-}
-
 static kzrjson_token_type set_token_eot(void) {
 	return set_token(kzrjson_token_end_of_text, NULL, 0);
 }
 
-static bool consume_if(const char c) {
-	if (*lexer.pos == c) {
-		next();
-		return true;
-	}
-	return false;
-}
+/*
+ * Class of each byte, as the type of the token which begins with it.
+ * White spaces and characters inside numbers are classes of their own.
+ */
+static const unsigned char token_classes[256] = {
+	['\0'] = kzrjson_token_end_of_text,
+	// ws = %x20 / %x09 / %x0A / %x0D
+	[' '] = kzrjson_token_white_space,
+	[0x09] = kzrjson_token_white_space,
+	[0x0A] = kzrjson_token_white_space,
+	[0x0D] = kzrjson_token_white_space,
+	['['] = kzrjson_token_begin_array,
+	['{'] = kzrjson_token_begin_object,
+	[']'] = kzrjson_token_end_array,
+	['}'] = kzrjson_token_end_object,
+	[':'] = kzrjson_token_name_separator,
+	[','] = kzrjson_token_value_separator,
+	['"'] = kzrjson_token_quotation_mark,
+	['f'] = kzrjson_token_literal_false,
+	['n'] = kzrjson_token_null,
+	['t'] = kzrjson_token_literal_true,
+	['-'] = kzrjson_token_minus,
+	['+'] = kzrjson_token_plus,
+	['.'] = kzrjson_token_decimal_point,
+	['e'] = kzrjson_token_e,
+	['E'] = kzrjson_token_e,
+	['0'] = kzrjson_token_digit0_9,
+	['1'] = kzrjson_token_digit0_9,
+	['2'] = kzrjson_token_digit0_9,
+	['3'] = kzrjson_token_digit0_9,
+	['4'] = kzrjson_token_digit0_9,
+	['5'] = kzrjson_token_digit0_9,
+	['6'] = kzrjson_token_digit0_9,
+	['7'] = kzrjson_token_digit0_9,
+	['8'] = kzrjson_token_digit0_9,
+	['9'] = kzrjson_token_digit0_9,
+};
 
-static bool contained(const char *chars) {
-	return strchr(chars, *lexer.pos) != NULL;
-}
+/*
+ * Class of each byte inside a string.
+ * Bytes of string_plain are skipped without looking into them.
+ */
+enum {
+	string_plain = 0,
+	string_end_of_text,
+	string_quotation_mark,
+	string_escape,
+	string_control,
+	string_utf8,
+};
 
-static bool consume_if_contained(const char *chars) {
-	if (contained(chars)) {
-		next();
-		return true;
-	}
-	return false;
-}
+#ifdef KZRJSON_STRICT
+#define STRING_CONTROL string_control
+#else
+#define STRING_CONTROL string_plain
+#endif
 
-static bool consume_literal(const char *literal) {
-	if (strstr(lexer.pos, literal) == lexer.pos) {
-		lexer.pos += strlen(literal);
-		return true;
-	}
-	return false;
+#ifdef KZRJSON_VALIDATE_UTF8
+#define STRING_UTF8 string_utf8
+#else
+#define STRING_UTF8 string_plain
+#endif
+
+#define STRING_ROW(c) c, c, c, c, c, c, c, c, c, c, c, c, c, c, c, c
+
+static const unsigned char string_classes[256] = {
+	string_end_of_text, STRING_CONTROL, STRING_CONTROL, STRING_CONTROL,
+	STRING_CONTROL, STRING_CONTROL, STRING_CONTROL, STRING_CONTROL,
+	STRING_CONTROL, STRING_CONTROL, STRING_CONTROL, STRING_CONTROL,
+	STRING_CONTROL, STRING_CONTROL, STRING_CONTROL, STRING_CONTROL,
+	STRING_ROW(STRING_CONTROL),
+	string_plain, string_plain, string_quotation_mark, string_plain,
+	string_plain, string_plain, string_plain, string_plain,
+	string_plain, string_plain, string_plain, string_plain,
+	string_plain, string_plain, string_plain, string_plain,
+	STRING_ROW(string_plain),
+	STRING_ROW(string_plain),
+	string_plain, string_plain, string_plain, string_plain,
+	string_plain, string_plain, string_plain, string_plain,
+	string_plain, string_plain, string_plain, string_plain,
+	string_escape, string_plain, string_plain, string_plain,
+	STRING_ROW(string_plain),
+	STRING_ROW(string_plain),
+	STRING_ROW(STRING_UTF8), STRING_ROW(STRING_UTF8),
+	STRING_ROW(STRING_UTF8), STRING_ROW(STRING_UTF8),
+	STRING_ROW(STRING_UTF8), STRING_ROW(STRING_UTF8),
+	STRING_ROW(STRING_UTF8), STRING_ROW(STRING_UTF8),
+};
+
+#undef STRING_ROW
+#undef STRING_UTF8
+#undef STRING_CONTROL
+
+/*
+ * A check which only the strict lexer makes.
+ * If the condition is false, the error is at the position.
+ */
+#ifdef KZRJSON_STRICT
+#define STRICT_MUST(condition, position) \
+	do { \
+		if (!(condition)) { \
+			lexer.pos = (const char *)(position); \
+			goto throw_exp; \
+		} \
+	} while (0)
+#else
+#define STRICT_MUST(condition, position) ((void)(position))
+#endif
+
+static bool validate_utf8(const unsigned char **pos, const unsigned char *end);
+
+static bool is_hex(const unsigned char c) {
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
 }
 
 /*
@@ -157,36 +294,123 @@ static bool consume_literal(const char *literal) {
  *   %x75 4HEXDIG )  ; uXXXX                U+XXXX
  * unescaped = %x20-21 / %x23-5B / %x5D-10FFFF
  * 
- * err: kzrjson_err_tokenize
+ * lexer.pos is next to the opening quotation-mark.
+ *
+ * [exception] kzrjson_err_tokenize
+ *    return kzrjson_token_error
  */
-static kzrjson_token_type set_token_string(void) {
-	const char *begin = lexer.pos;
-	int length = 0;
-	for (; *lexer.pos != quotation_mark; next()) {
-		if (end_of_text()) {
-			set_kzrjson_errno(kzrjson_err_tokenize);
-			return 0;
-		}
-		static const char escape_targets[] = {
-			0x22, 0x5C, 0x2F, 0x62, 0x66, 0x6E, 0x72, 0x74, 0x75, '\0'
-		};
-		if (*lexer.pos == escape) {
-			next();
-			if (end_of_text()) {
-				set_kzrjson_errno(kzrjson_err_tokenize);
-				return 0;
+static kzrjson_token_type scan_string(void) {
+	const unsigned char *begin = (const unsigned char *)lexer.pos;
+	const unsigned char *p = begin;
+	for (;;) {
+		while (string_classes[*p] == string_plain) p++;
+		switch (string_classes[*p]) {
+		case string_quotation_mark:
+			lexer.pos = (const char *)p + 1;
+			return set_token(kzrjson_token_string, (const char *)begin, (size_t)(p - begin));
+		case string_escape:
+			p++;
+			switch (*p) {
+			case 0x22: case 0x5C: case 0x2F: case 0x62:
+			case 0x66: case 0x6E: case 0x72: case 0x74:
+				p++;
+				break;
+			case 0x75: {
+				const unsigned char *hex = ++p;
+				while (p < hex + 4 && is_hex(*p)) p++;
+				STRICT_MUST(p == hex + 4, p);
+				break;
 			}
-			if (strchr(escape_targets, *lexer.pos) == NULL) {
-				set_kzrjson_errno(kzrjson_err_tokenize);
-				return 0;
+			default:
+				lexer.pos = (const char *)p;
+				goto throw_exp;
 			}
-			length += 2;
-		} else {
-			length++;
+			break;
+		case string_utf8:
+			// the text ends with '\0', where validate_utf8 stops
+			if (!validate_utf8(&p, p + 4)) {
+				lexer.pos = (const char *)p;
+				goto throw_exp;
+			}
+			break;
+		default: // end of text, control character
+			lexer.pos = (const char *)p;
+			goto throw_exp;
 		}
 	}
-	next(); // consume quotation_mark
-	return set_token(kzrjson_token_string, begin, length);
+
+throw_exp:
+	set_kzrjson_errno(kzrjson_err_tokenize);
+	return kzrjson_token_error;
+}
+
+static const unsigned char *scan_digits(const unsigned char *p) {
+	while (token_classes[*p] == kzrjson_token_digit0_9) p++;
+	return p;
+}
+
+/*
+ * number = [ minus ] int [ frac ] [ exp ]
+ * The whole number is a token, with current_token.number_type.
+ *
+ * [exception] kzrjson_err_tokenize
+ *    return kzrjson_token_error
+ */
+static kzrjson_token_type scan_number(void) {
+	const unsigned char *begin = (const unsigned char *)lexer.pos;
+	const unsigned char *p = begin;
+	kzrjson_number_type type = kzrjson_uint;
+	if (*p == minus) {
+		type = kzrjson_int;
+		p++;
+	}
+
+	// int = zero / ( digit1-9 *DIGIT )
+	const unsigned char *digits = p;
+	p = scan_digits(p);
+	STRICT_MUST(p != digits, p);
+	STRICT_MUST(*digits != zero || p == digits + 1, digits + 1);
+
+	// frac = decimal-point 1*DIGIT
+	if (*p == decimal_point) {
+		type = kzrjson_double;
+		digits = ++p;
+		p = scan_digits(p);
+		STRICT_MUST(p != digits, p);
+	}
+
+	// exp = e [ minus / plus ] 1*DIGIT
+	if (token_classes[*p] == kzrjson_token_e) {
+		type = kzrjson_exp;
+		p++;
+		if (*p == minus || *p == plus) p++;
+		digits = p;
+		p = scan_digits(p);
+		STRICT_MUST(p != digits, p);
+	}
+	lexer.pos = (const char *)p;
+	current_token.number_type = type;
+	return set_token(kzrjson_token_number, (const char *)begin, (size_t)(p - begin));
+
+#ifdef KZRJSON_STRICT
+throw_exp:
+	set_kzrjson_errno(kzrjson_err_tokenize);
+	return kzrjson_token_error;
+#endif
+}
+
+/*
+ * [exception] kzrjson_err_tokenize
+ *    return kzrjson_token_error
+ */
+static kzrjson_token_type scan_literal(const kzrjson_token_type type, const char *literal) {
+	const size_t length = strlen(literal);
+	if (strncmp(lexer.pos, literal, length) != 0) {
+		set_kzrjson_errno(kzrjson_err_tokenize);
+		return kzrjson_token_error;
+	}
+	lexer.pos += length;
+	return set_token(type, literal, length);
 }
 
 /*
@@ -197,846 +421,6087 @@ static kzrjson_token_type set_token_string(void) {
  *    return kzrjson_token_error
  */
 static kzrjson_token_type get_token(void) {
-	if (end_of_text()) return set_token_eot();
-	while (consume_if_contained(white_spaces)) {
-		if (end_of_text()) return set_token_eot();
-	}
-	if (consume_if(begin_array)) {
-		return set_token_char(kzrjson_token_begin_array);
-	} else if (consume_if(begin_object)) {
-		return set_token_char(kzrjson_token_begin_object);
-	} else if (consume_if(end_array)) {
-		return set_token_char(kzrjson_token_end_array);
-	} else if (consume_if(end_object)) {
-		return set_token_char(kzrjson_token_end_object);
-	} else if (consume_if(name_separator)) {
-		return set_token_char(kzrjson_token_name_separator);
-	} else if (consume_if(value_separator)) {
-		return set_token_char(kzrjson_token_value_separator);
-	} else if (consume_if(decimal_point)) {
-		return set_token_char(kzrjson_token_decimal_point);
-	} else if (contained(digit0_9)) {
-		set_token_char(kzrjson_token_digit0_9);
+	const unsigned char *p = (const unsigned char *)lexer.pos;
+	while (token_classes[*p] == kzrjson_token_white_space) p++;
+	lexer.pos = (const char *)p;
+	const kzrjson_token_type type = token_classes[*p];
+	switch (type) {
+	case kzrjson_token_end_of_text:
+		return set_token_eot();
+	case kzrjson_token_begin_array:
+	case kzrjson_token_begin_object:
+	case kzrjson_token_end_array:
+	case kzrjson_token_end_object:
+	case kzrjson_token_name_separator:
+	case kzrjson_token_value_separator:
 		next();
-		return kzrjson_token_digit0_9;
-	} else if (consume_if_contained(e)) {
-		set_token_char(kzrjson_token_e);
+		return set_token(type, (const char *)p, 1);
+	case kzrjson_token_quotation_mark:
 		next();
-		return kzrjson_token_e;
-	} else if (consume_if(minus)) {
-		return set_token_char(kzrjson_token_minus);
-	} else if (consume_if(plus)) {
-		return set_token_char(kzrjson_token_plus);
-	} else if (consume_if(escape)) {
-		return set_token_char(kzrjson_token_escape);
-	} else if (consume_if(quotation_mark)) {
-		const kzrjson_token_type type = set_token_string();
-		if (kzrjson_errno() != kzrjson_success) return kzrjson_token_error;
-		return type;
-	} else {
-		if (consume_literal(literal_false)) {
-			return set_token(kzrjson_token_literal_false, literal_false, strlen(literal_false));
-		} else if (consume_literal(literal_true)) {
-			return set_token(kzrjson_token_literal_true, literal_true, strlen(literal_true));
-		} else if (consume_literal(literal_null)) {
-			return set_token(kzrjson_token_null, literal_null, strlen(literal_null));
-		} else {
-			set_kzrjson_errno(kzrjson_err_tokenize);
-			return kzrjson_token_error;
-		}
+		return scan_string();
+#ifndef KZRJSON_STRICT
+	case kzrjson_token_decimal_point:
+#endif
+	case kzrjson_token_minus:
+	case kzrjson_token_digit0_9:
+		return scan_number();
+	case kzrjson_token_literal_false:
+		return scan_literal(type, literal_false);
+	case kzrjson_token_literal_true:
+		return scan_literal(type, literal_true);
+	case kzrjson_token_null:
+		return scan_literal(type, literal_null);
+	default:
+		set_kzrjson_errno(kzrjson_err_tokenize);
+		return kzrjson_token_error;
 	}
 }
 
+#undef STRICT_MUST
+
+/*****************************************************************************
+ * Document
+ *****************************************************************************/
 /*
- * Add the element to the array or object.
- * 
- * [exception] kzrjson_err_calloc
+ * A document owns an arena and a scratch stack.
+ * Every kzrjson_t parsed into a document, its strings and its element arrays
+ * are carved out of the arena, so they are released all at once by
+ * kzrjson_doc_reset or kzrjson_doc_free.
+ * Chunks of the arena and the scratch stack are retained across resets.
  */
-static void add_element(kzrjson_t array_or_object, kzrjson_t element) {
-	if (array_or_object == NULL) return;
-	if (element == NULL) return;
-	array_or_object->elements_size++;
-	if (array_or_object->elements_size == 1) {
-		array_or_object->elements = calloc(1, sizeof(struct kzrjson_t));
-		if (array_or_object->elements == NULL) {
-			goto throw_exp;
-		}
-		*array_or_object->elements = element;
-	} else {
-		array_or_object->elements = realloc(array_or_object->elements, array_or_object->elements_size * sizeof(struct kzrjson_t));
-		if (array_or_object->elements == NULL) {
-			goto throw_exp;
-		}
-		*(array_or_object->elements + array_or_object->elements_size - 1) = element;
-	}
-	return;
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t capacity;
+	size_t used;
+	max_align_t data[];
+};
 
-throw_exp:
-	set_kzrjson_errno(kzrjson_err_calloc);
-}
+/*
+ * Stack of parsed elements which are not yet stored in their array or object.
+ * parse_object and parse_array push children here, then move them
+ * to an exactly sized elements array when the container is closed.
+ */
+struct scratch {
+	kzrjson_t *data;
+	size_t size;
+	size_t capacity;
+
+	// values of an array being packed, while its elements are released
+	void *values;
+	size_t values_capacity;
+};
 
 /*
- * [no exception]
+ * Hash table of interned keys or shapes of a document.
+ * Open addressing with linear probing, kept at most half full.
+ * Entries are in the arena, and slots are kept across resets.
  */
-static void add_value(kzrjson_t member, kzrjson_t value) {
-	if (member == NULL) return;
-	if (value == NULL) return;
-	member->value = value;
+struct doc_table_slot {
+	uint64_t hash;
+	void *entry;
+};
+
+struct doc_table {
+	struct doc_table_slot *slots;
+	size_t capacity;
+	size_t size;
+};
+
+struct kzrjson_doc {
+	kzrjson_allocator_t allocator;
+	struct arena_chunk *chunks;
+	struct arena_chunk *current;
+	struct scratch scratch;
+	struct doc_table keys;
+	struct doc_table shapes;
+
+	// shape of the last parsed root object, for kzrjson_option_predict_keys
+	struct kzrjson_shape *root_shape;
+
+	// block made by kzrjson_compact, whose size is not a step of the growth
+	struct arena_chunk *compacted;
+
+	// entry of kzrjson_cache_t which holds this document, or NULL
+	struct cache_entry *cache_entry;
+};
+
+static const size_t arena_chunk_min_capacity = 4096;
+
+// document which the parser is building, NULL when building on heap memory
+static KZRJSON_THREAD_LOCAL struct kzrjson_doc *g_doc;
+
+// scratch stack which the parser is using
+static KZRJSON_THREAD_LOCAL struct scratch *g_scratch;
+
+static void *default_allocate(size_t size, void *context) {
+	(void)context;
+	return malloc(size);
+}
+
+static void default_deallocate(void *pointer, size_t size, void *context) {
+	(void)size;
+	(void)context;
+	free(pointer);
+}
+
+static size_t align_size(const size_t size) {
+	const size_t align = sizeof(max_align_t);
+	return (size + align - 1) / align * align;
+}
+
+static void *doc_allocate(struct kzrjson_doc *doc, const size_t size) {
+	return doc->allocator.allocate(size, doc->allocator.context);
+}
+
+static void doc_deallocate(struct kzrjson_doc *doc, void *pointer, const size_t size) {
+	if (pointer == NULL) return;
+	doc->allocator.deallocate(pointer, size, doc->allocator.context);
+}
+
+static struct arena_chunk *make_arena_chunk(struct kzrjson_doc *doc, const size_t capacity) {
+	struct arena_chunk *chunk = doc_allocate(doc, sizeof(struct arena_chunk) + capacity);
+	if (chunk == NULL) return NULL;
+	chunk->next = NULL;
+	chunk->capacity = capacity;
+	chunk->used = 0;
+	return chunk;
+}
+
+static void free_arena_chunks(struct kzrjson_doc *doc) {
+	struct arena_chunk *chunk = doc->chunks;
+	while (chunk != NULL) {
+		struct arena_chunk *next = chunk->next;
+		doc_deallocate(doc, chunk, sizeof(struct arena_chunk) + chunk->capacity);
+		chunk = next;
+	}
+	doc->chunks = NULL;
+	doc->current = NULL;
+	doc->compacted = NULL;
 }
 
 /*
- * Make new kzrjson_t.
- * 
+ * Allocate zero-filled memory from the arena of the document.
+ *
  * [exception] kzrjson_err_calloc
  *    return NULL
  */
-static kzrjson_t make_json(const kzrjson_type type, char *string) {
-	kzrjson_t any = calloc(1, sizeof(struct kzrjson_t));
-	if (any == NULL) {
-		set_kzrjson_errno(kzrjson_err_calloc);
-		return NULL;
+static void *arena_allocate(struct kzrjson_doc *doc, size_t size) {
+	size = align_size(size);
+	struct arena_chunk *chunk = doc->current;
+	struct arena_chunk *last = NULL;
+	for (; chunk != NULL; chunk = chunk->next) {
+		if (chunk->capacity - chunk->used >= size) break;
+		last = chunk;
 	}
-	any->type = type;
-	any->string = string;
-	any->elements = NULL;
-	any->elements_size = 0;
-	any->key = NULL;
-	return any;
+	if (chunk == NULL) {
+		size_t capacity = arena_chunk_min_capacity;
+		if (last != NULL && last != doc->compacted && capacity < last->capacity * 2) {
+			capacity = last->capacity * 2;
+		}
+		if (capacity < size) capacity = size;
+		chunk = make_arena_chunk(doc, capacity);
+		if (chunk == NULL) {
+			set_kzrjson_errno(kzrjson_err_calloc);
+			return NULL;
+		}
+		if (last != NULL) {
+			last->next = chunk;
+		} else {
+			doc->chunks = chunk;
+		}
+	}
+	doc->current = chunk;
+	void *memory = (char *)chunk->data + chunk->used;
+	chunk->used += size;
+	memset(memory, 0, size);
+	return memory;
 }
 
 /*
- * Make new string kzrjson_t.
+ * Position of the arena, to release everything allocated after it.
+ */
+typedef struct {
+	struct arena_chunk *chunk;
+	size_t used;
+} arena_mark;
+
+static arena_mark arena_get_mark(struct kzrjson_doc *doc) {
+	arena_mark mark = {NULL, 0};
+	if (doc != NULL && doc->current != NULL) {
+		mark.chunk = doc->current;
+		mark.used = doc->current->used;
+	}
+	return mark;
+}
+
+/*
+ * Release memory allocated after the mark.
+ * Chunks after the current one are always empty, so the chunks after
+ * the marked one hold only memory allocated after the mark.
  *
- * [exception] kzrjson_err_calloc
- *    return NULL
+ * [no exception]
  */
-static kzrjson_t make_string(const char *string) {
-	return make_json(kzrjson_string, (char *)string);
+static void arena_rewind(struct kzrjson_doc *doc, const arena_mark mark) {
+	if (doc == NULL || mark.chunk == NULL) return;
+	for (struct arena_chunk *chunk = mark.chunk->next; chunk != NULL; chunk = chunk->next) {
+		chunk->used = 0;
+	}
+	mark.chunk->used = mark.used;
+	doc->current = mark.chunk;
 }
 
 /*
- * Make new number kzrjson_t.
+ * Allocate zero-filled memory owned by the document,
+ * or by the caller when doc is NULL.
  *
  * [exception] kzrjson_err_calloc
  *    return NULL
- * [exception] kzrjson_err_not_number
- *    return NULL
  */
-static kzrjson_t make_number(char *number, kzrjson_number_type type) {
-	kzrjson_t data = make_json(kzrjson_number, number);
-	if (data == NULL) {
+static void *allocate(struct kzrjson_doc *doc, const size_t size) {
+	if (doc != NULL) return arena_allocate(doc, size);
+	void *memory = calloc(1, size);
+	if (memory == NULL) {
 		set_kzrjson_errno(kzrjson_err_calloc);
-		return NULL;
-	}
-	data->number_type = type;
-	char *end;
-	switch (data->number_type) {
-	case kzrjson_int:
-		data->number_int = strtoll(data->string, &end, 10);
-		if (data->string == end) goto throw_exp;
-		break;
-	case kzrjson_uint:
-		data->number_uint = strtoull(data->string, &end, 10);
-		if (data->string == end) goto throw_exp;
-		break;
-	case kzrjson_double:
-	case kzrjson_exp:
-		data->number_double = strtod(data->string, &end);
-		if (data->string == end) goto throw_exp;
-		break;
 	}
-	return data;
-
-throw_exp:
-	set_kzrjson_errno(kzrjson_err_not_number);
-	return NULL;
+	return memory;
 }
 
 /*
- * Make new boolean kzrjson_t.
+ * Release memory from allocate. Memory owned by a document is kept
+ * until the document is reset.
  *
- * [exception] kzrjson_err_calloc
- *    return NULL
+ * [no exception]
  */
-static kzrjson_t make_boolean(const bool boolean) {
-	kzrjson_t json = make_json(kzrjson_bool,
-		(char *)(boolean ? literal_true : literal_false)
-	);
-	json->boolean = boolean;
-	return json;
+static void release(struct kzrjson_doc *doc, void *memory) {
+	if (doc != NULL) return;
+	free(memory);
 }
 
+static void kzrjson_any_free(kzrjson_t any);
+
 /*
- * Make new null kzrjson_t.
- *
  * [exception] kzrjson_err_calloc
- *    return NULL
  */
-static kzrjson_t make_null(void) {
-	return make_json(kzrjson_null, (char *)literal_null);
+static void scratch_push(struct scratch *scratch, kzrjson_t element) {
+	if (scratch->size == scratch->capacity) {
+		const size_t capacity = scratch->capacity == 0 ? 64 : scratch->capacity * 2;
+		kzrjson_t *data;
+		if (g_doc != NULL) {
+			data = doc_allocate(g_doc, capacity * sizeof(kzrjson_t));
+			if (data != NULL && scratch->size != 0) {
+				memcpy(data, scratch->data, scratch->size * sizeof(kzrjson_t));
+			}
+			if (data != NULL) {
+				doc_deallocate(g_doc, scratch->data, scratch->capacity * sizeof(kzrjson_t));
+			}
+		} else {
+			data = realloc(scratch->data, capacity * sizeof(kzrjson_t));
+		}
+		if (data == NULL) {
+			set_kzrjson_errno(kzrjson_err_calloc);
+			kzrjson_any_free(element);
+			return;
+		}
+		scratch->data = data;
+		scratch->capacity = capacity;
+	}
+	scratch->data[scratch->size++] = element;
 }
 
 /*
- * Make new object kzrjson_t.
+ * Discard elements pushed after mark, e.g. when parsing failed.
  *
- * [exception] kzrjson_err_calloc
- *    return NULL
+ * [no exception]
  */
-static kzrjson_t make_object(void) {
-	return make_json(kzrjson_object, NULL);
+static void scratch_discard(struct scratch *scratch, const size_t mark) {
+	for (size_t i = mark; i < scratch->size; i++) {
+		kzrjson_any_free(scratch->data[i]);
+	}
+	scratch->size = mark;
 }
 
 /*
- * Make new array kzrjson_t.
+ * Make room for at least size bytes in values of the scratch stack.
  *
  * [exception] kzrjson_err_calloc
- *    return NULL
  */
-static kzrjson_t make_array(void) {
-	return make_json(kzrjson_array, NULL);
+static bool scratch_reserve_values(struct scratch *scratch, const size_t size) {
+	if (size <= scratch->values_capacity) return true;
+	size_t capacity = scratch->values_capacity == 0 ? 512 : scratch->values_capacity * 2;
+	while (capacity < size) capacity *= 2;
+	void *values = g_doc != NULL ? doc_allocate(g_doc, capacity) : malloc(capacity);
+	if (values == NULL) {
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return false;
+	}
+	if (g_doc != NULL) {
+		doc_deallocate(g_doc, scratch->values, scratch->values_capacity);
+	} else {
+		free(scratch->values);
+	}
+	scratch->values = values;
+	scratch->values_capacity = capacity;
+	return true;
 }
 
 /*
- * Make new member kzrjson_t.
+ * Move elements pushed after mark to the array or object.
  *
  * [exception] kzrjson_err_calloc
- *    return NULL
  */
-static kzrjson_t make_member(const char *key) {
-	kzrjson_t data = make_json(kzrjson_member, NULL);
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	data->key = (char *)key;
-	return data;
+static void scratch_pop_to(struct scratch *scratch, const size_t mark, kzrjson_t array_or_object) {
+	const size_t size = scratch->size - mark;
+	if (size == 0) return;
+	kzrjson_t *elements = allocate(array_or_object->doc, size * sizeof(kzrjson_t));
+	if (elements == NULL) {
+		scratch_discard(scratch, mark);
+		return;
+	}
+	memcpy(elements, scratch->data + mark, size * sizeof(kzrjson_t));
+	array_or_object->elements = elements;
+	array_or_object->elements_size = size;
+	array_or_object->elements_capacity = size;
+	scratch->size = mark;
 }
 
-static kzrjson_t parse_object(void);
-static kzrjson_t parse_array(void);
-static kzrjson_t parse_number(void);
-static kzrjson_t parse_member(void);
-static kzrjson_t parse_value(void);
-
+/*****************************************************************************
+ * Object index
+ *****************************************************************************/
 /*
- * [no exception]
+ * Hash table from key to the index of the member in elements.
+ * Open addressing with linear probing. A slot holds the index + 1,
+ * and 0 means empty. The table is kept at most half full.
+ * When an object has members with the same key, the first one is indexed.
  */
-static bool current_is(const kzrjson_token_type type) {
-	return current_token.type == type;
+struct kzrjson_index {
+	size_t mask;
+	bool has_duplicates;
+	size_t slots[];
+};
+
+uint32_t kzrjson_hash_key(const char *key, const size_t length) {
+	uint32_t hash = 2166136261u; // FNV-1a
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (unsigned char)key[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static bool member_key_equals(kzrjson_t member, const char *key, const size_t length) {
+	return member->key_length == length && memcmp(member->key, key, length) == 0;
 }
 
 /*
- * Current token must be the type. If not, throw exception.
- * 
- * [exception] kzrjson_err_parse
+ * Return the slot of the key, or the empty slot where it would be.
+ *
+ * [no exception]
  */
-static void current_must(const kzrjson_token_type type) {
-	if (!current_is(type)) {
-		set_kzrjson_errno(kzrjson_err_parse);
+static size_t index_find_slot(kzrjson_t object, const char *key, const size_t length, const uint32_t hash) {
+	const struct kzrjson_index *index = object->index;
+	size_t slot = hash & index->mask;
+	while (index->slots[slot] != 0) {
+		if (member_key_equals(object->elements[index->slots[slot] - 1], key, length)) break;
+		slot = (slot + 1) & index->mask;
+	}
+	return slot;
+}
+
+static void index_insert(kzrjson_t object, const size_t position) {
+	kzrjson_t member = object->elements[position];
+	const size_t slot = index_find_slot(object, member->key, member->key_length,
+		kzrjson_hash_key(member->key, member->key_length));
+	if (object->index->slots[slot] != 0) {
+		object->index->has_duplicates = true;
 		return;
 	}
+	object->index->slots[slot] = position + 1;
+}
+
+static void index_free(kzrjson_t object) {
+	release(object->doc, object->index);
+	object->index = NULL;
 }
 
 /*
- * Copy string to heap memory.
- * 
+ * (Re)build the index of the object for its current members.
+ *
  * [exception] kzrjson_err_calloc
- *   return NULL
  */
-static char *copy_string(const char *from, const size_t length) {
-	char *buffer = calloc(length + 1, sizeof(char));
-	if (buffer == NULL) {
-		set_kzrjson_errno(kzrjson_err_calloc);
-		return NULL;
+static bool index_build(kzrjson_t object) {
+	size_t capacity = 8;
+	while (capacity < object->elements_size * 2) capacity *= 2;
+	index_free(object);
+	struct kzrjson_index *index = allocate(object->doc, sizeof(struct kzrjson_index) + capacity * sizeof(size_t));
+	if (index == NULL) return false;
+	index->mask = capacity - 1;
+	object->index = index;
+	for (size_t i = 0; i < object->elements_size; i++) {
+		index_insert(object, i);
 	}
-	strncpy_s(buffer, length + 1, from, length);
-	return buffer;
+	return true;
 }
 
 /*
- * parse-JSON-text = ws value ws
- * 
- * [exception] kzrjson_err_calloc
- * [exception] kzrjson_err_parse
- * [exception] kzrjson_err_tokenize
- * [exception] kzrjson_err_not_number
+ * Remove the member at position from the index,
+ * shifting back following entries of the probe sequence.
+ *
+ * [no exception]
  */
-static kzrjson_t parse_json_text(void) {
-	get_token();
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	return parse_value();
+static void index_erase(kzrjson_t object, const size_t position) {
+	struct kzrjson_index *index = object->index;
+	kzrjson_t member = object->elements[position];
+	size_t slot = index_find_slot(object, member->key, member->key_length,
+		kzrjson_hash_key(member->key, member->key_length));
+	if (index->slots[slot] != position + 1) return;
+	index->slots[slot] = 0;
+	for (size_t next = (slot + 1) & index->mask; index->slots[next] != 0; next = (next + 1) & index->mask) {
+		kzrjson_t moved = object->elements[index->slots[next] - 1];
+		const size_t home = kzrjson_hash_key(moved->key, moved->key_length) & index->mask;
+		// move the entry to the hole if the hole is between its home and next
+		if (((next - home) & index->mask) >= ((next - slot) & index->mask)) {
+			index->slots[slot] = index->slots[next];
+			index->slots[next] = 0;
+			slot = next;
+		}
+	}
 }
 
 /*
- * value = false / null / true / string / object / array / number
- * 
+ * The index is updated in O(1) when a member is appended or swap-removed,
+ * and rebuilt when members are shifted.
+ *
  * [exception] kzrjson_err_calloc
- * [exception] kzrjson_err_parse
- * [exception] kzrjson_err_tokenize
- * [exception] kzrjson_err_not_number
  */
-static kzrjson_t parse_value(void) {
-	if (current_is(kzrjson_token_literal_false)) {
-		kzrjson_t data = make_boolean(false);
-		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
-		get_token();
-		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
-		return data;
-	} else if (current_is(kzrjson_token_literal_true)) {
-		kzrjson_t data = make_boolean(true);
-		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
-		get_token();
-		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
-		return data;
-	} else if (current_is(kzrjson_token_null)) {
-		kzrjson_t data = make_null();
-		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
-		get_token();
-		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
-		return data;
-	} else if (current_is(kzrjson_token_string)) {
-		char *string = copy_string(current_token.begin, current_token.length);
-		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
-		kzrjson_t data = make_string(string);
-		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
-		get_token();
-		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
-		return data;
-	} else if (current_is(kzrjson_token_begin_object)) {
-		return parse_object();
-	} else if (current_is(kzrjson_token_begin_array)) {
-		return parse_array();
-	} else {
-		return parse_number();
+static void index_on_append(kzrjson_t object) {
+	if (object->index == NULL) return;
+	if (object->elements_size * 2 > object->index->mask + 1) {
+		index_build(object);
+		return;
 	}
-
-throw_exp:
-	return NULL;
+	index_insert(object, object->elements_size - 1);
 }
 
-// object = begin-object [ member *( value-separator member ) ] end-object
-// [exception] kzrjson_err_calloc
-static kzrjson_t parse_object(void) {
-	kzrjson_t object = make_object();
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	current_must(kzrjson_token_begin_object);
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	get_token();
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	add_element(object, parse_member());
-	while (!current_is(kzrjson_token_end_object)) {
-		current_must(kzrjson_token_value_separator);
-		if (kzrjson_errno() != kzrjson_success) return NULL;
-		get_token();
-		if (kzrjson_errno() != kzrjson_success) return NULL;
-		add_element(object, parse_member());
+static void index_on_swap_remove(kzrjson_t object, const size_t position) {
+	if (object->index == NULL) return;
+	if (object->index->has_duplicates) {
+		index_build(object);
+		return;
 	}
-	get_token();
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	return object;
+	// Put both members back to where the index knows them while updating it.
+	kzrjson_t *elements = object->elements;
+	const size_t last = object->elements_size;
+	kzrjson_t moved = elements[position];
+	kzrjson_t removed = elements[last];
+	elements[position] = removed;
+	elements[last] = moved;
+	index_erase(object, position);
+	if (position != last) {
+		const size_t slot = index_find_slot(object, moved->key, moved->key_length,
+			kzrjson_hash_key(moved->key, moved->key_length));
+		object->index->slots[slot] = position + 1;
+	}
+	elements[position] = moved;
+	elements[last] = removed;
 }
 
-// array = begin-array [ value *( value-separator value ) ] end-array
-static kzrjson_t parse_array(void) {
-	kzrjson_t array = make_array();
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	current_must(kzrjson_token_begin_array);
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	get_token();
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	add_element(array, parse_value());
-	while (!current_is(kzrjson_token_end_array)) {
-		current_must(kzrjson_token_value_separator);
-		if (kzrjson_errno() != kzrjson_success) return NULL;
-		get_token();
-		if (kzrjson_errno() != kzrjson_success) return NULL;
-		add_element(array, parse_value());
+/*****************************************************************************
+ * Shapes
+ *****************************************************************************/
+/*
+ * With kzrjson_option_share_shapes, a document interns keys, so that members
+ * with the same key point to one string, and objects with the same sequence
+ * of keys share one shape. The shape holds the keys and their index, which
+ * every object of the shape uses as its own index.
+ * An object leaves its shape with a copy of the index before its members change.
+ */
+struct interned_key {
+	size_t length;
+	char string[];
+};
+
+struct kzrjson_shape {
+	size_t size;
+	struct kzrjson_index *index;
+	const struct interned_key *keys[];
+};
+
+/*
+ * Make room for one more entry.
+ *
+ * [exception] kzrjson_err_calloc
+ */
+static bool doc_table_reserve(struct kzrjson_doc *doc, struct doc_table *table) {
+	if ((table->size + 1) * 2 <= table->capacity) return true;
+	const size_t capacity = table->capacity == 0 ? 64 : table->capacity * 2;
+	struct doc_table_slot *slots = doc_allocate(doc, capacity * sizeof(struct doc_table_slot));
+	if (slots == NULL) {
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return false;
 	}
-	get_token();
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	return array;
+	memset(slots, 0, capacity * sizeof(struct doc_table_slot));
+	for (size_t i = 0; i < table->capacity; i++) {
+		if (table->slots[i].entry == NULL) continue;
+		size_t slot = table->slots[i].hash & (capacity - 1);
+		while (slots[slot].entry != NULL) slot = (slot + 1) & (capacity - 1);
+		slots[slot] = table->slots[i];
+	}
+	doc_deallocate(doc, table->slots, table->capacity * sizeof(struct doc_table_slot));
+	table->slots = slots;
+	table->capacity = capacity;
+	return true;
 }
 
-// member = string name-separator value
-static kzrjson_t parse_member(void) {
-	current_must(kzrjson_token_string);
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	char *buffer = copy_string(current_token.begin, current_token.length);
-	kzrjson_t member = make_member(buffer);
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	get_token();
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	current_must(kzrjson_token_name_separator);
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	get_token();
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	add_value(member, parse_value());
-	return member;
+static void doc_table_clear(struct doc_table *table) {
+	if (table->slots != NULL) {
+		memset(table->slots, 0, table->capacity * sizeof(struct doc_table_slot));
+	}
+	table->size = 0;
 }
 
-// number = [ minus ] int [ frac ] [ exp ]
-static kzrjson_t parse_number(void) {
-	const char *begin = lexer.pos - 1;
-	kzrjson_token_type token = current_token.type;
-	kzrjson_number_type type = kzrjson_uint;
-	if (token == kzrjson_token_minus) {
-		type = kzrjson_int;
-		token = get_token();
-		if (kzrjson_errno() != kzrjson_success) return NULL;
+/*
+ * Return the interned copy of the key in the document which is parsing.
+ *
+ * [exception] kzrjson_err_calloc
+ *    return NULL
+ */
+static char *intern_key(const char *key, const size_t length) {
+	struct doc_table *table = &g_doc->keys;
+	if (!doc_table_reserve(g_doc, table)) return NULL;
+	const uint64_t hash = kzrjson_hash_key(key, length);
+	const size_t mask = table->capacity - 1;
+	size_t slot = hash & mask;
+	for (; table->slots[slot].entry != NULL; slot = (slot + 1) & mask) {
+		struct interned_key *interned = table->slots[slot].entry;
+		if (table->slots[slot].hash == hash && interned->length == length
+			&& memcmp(interned->string, key, length) == 0) {
+			return interned->string;
+		}
 	}
+	struct interned_key *interned = arena_allocate(g_doc, sizeof(struct interned_key) + length + 1);
+	if (interned == NULL) return NULL;
+	interned->length = length;
+	memcpy(interned->string, key, length);
+	table->slots[slot].hash = hash;
+	table->slots[slot].entry = interned;
+	table->size++;
+	return interned->string;
+}
 
-	// int = zero / ( digit1-9 *DIGIT )
-	for (; token == kzrjson_token_digit0_9; token = get_token()) {
-		if (kzrjson_errno() != kzrjson_success) return NULL;
+/*
+ * Give the object the shape of its keys, making the shape if it is new.
+ * Keys of the object must be interned, so they are compared as pointers.
+ *
+ * [exception] kzrjson_err_calloc
+ */
+static void share_shape(kzrjson_t object) {
+	struct kzrjson_doc *doc = object->doc;
+	const size_t size = object->elements_size;
+	uint64_t hash = 14695981039346656037ull; // FNV-1a of the pointers
+	for (size_t i = 0; i < size; i++) {
+		hash ^= (uintptr_t)object->elements[i]->key;
+		hash *= 1099511628211ull;
 	}
+	hash ^= hash >> 32;
 
-	// frac = decimal-point 1*DIGIT
-	if (token == kzrjson_token_decimal_point) {
-		type = kzrjson_double;
-		for (token = get_token(); token == kzrjson_token_digit0_9; token = get_token()) {
-			if (kzrjson_errno() != kzrjson_success) return NULL;
+	struct doc_table *table = &doc->shapes;
+	if (!doc_table_reserve(doc, table)) return;
+	const size_t mask = table->capacity - 1;
+	size_t slot = hash & mask;
+	for (; table->slots[slot].entry != NULL; slot = (slot + 1) & mask) {
+		struct kzrjson_shape *shape = table->slots[slot].entry;
+		if (table->slots[slot].hash != hash || shape->size != size) continue;
+		size_t i = 0;
+		while (i < size && shape->keys[i]->string == object->elements[i]->key) i++;
+		if (i == size) {
+			object->shape = shape;
+			object->index = shape->index;
+			return;
 		}
 	}
 
-	// exp = e [ minus / plus ] 1*DIGIT
-	if (token == kzrjson_token_e) {
-		type = kzrjson_exp;
-		token = get_token();
-		if (token == kzrjson_token_minus || token == kzrjson_token_plus) {
-			token = get_token();
-			if (kzrjson_errno() != kzrjson_success) return NULL;
-		}
-		for (; token == kzrjson_token_digit0_9; token = get_token()) {
-			if (kzrjson_errno() != kzrjson_success) return NULL;
-		}
-	}
-	size_t length = lexer.pos - begin - 1;
-	char *number = copy_string(begin, length);
-	if (number == NULL) {
-		set_kzrjson_errno(kzrjson_err_calloc);
-		return NULL;
+	if (!index_build(object)) return;
+	struct kzrjson_shape *shape = arena_allocate(doc, sizeof(struct kzrjson_shape) + size * sizeof(struct interned_key *));
+	if (shape == NULL) return;
+	shape->size = size;
+	shape->index = object->index;
+	for (size_t i = 0; i < size; i++) {
+		const char *key = object->elements[i]->key;
+		shape->keys[i] = (const struct interned_key *)(key - offsetof(struct interned_key, string));
 	}
-	return make_number(number, type);
+	table->slots[slot].hash = hash;
+	table->slots[slot].entry = shape;
+	table->size++;
+	object->shape = shape;
 }
 
-static int g_indent = 0;
-static void print_indent(void) {
-	for (int i = 0; i < g_indent; i++) {
-		printf("  "); // 2 space
-	}
+/*
+ * Leave the shape before the members change, with a copy of its index.
+ * If the copy can not be allocated, the object is left without index.
+ *
+ * [exception] kzrjson_err_calloc
+ */
+static bool shape_leave(kzrjson_t object) {
+	if (object->shape == NULL) return true;
+	const struct kzrjson_index *shared = object->shape->index;
+	const size_t size = sizeof(struct kzrjson_index) + (shared->mask + 1) * sizeof(size_t);
+	struct kzrjson_index *index = allocate(object->doc, size);
+	object->shape = NULL;
+	object->index = index;
+	if (index == NULL) return false;
+	memcpy(index, shared, size);
+	return true;
 }
 
-static void kzrjson_any_print(kzrjson_t any) {
-	if (any == NULL) return;
-	switch (any->type) {
-	case kzrjson_object: {
-		printf("%c\n", begin_object);
-		g_indent++;
-		for (size_t i = 0; i < any->elements_size; i++) {
-			print_indent();
-			kzrjson_any_print(*(any->elements + i));
-			if (i + 1 != any->elements_size) {
-				printf("%c\n", value_separator);
-			}
+/*
+ * Make room for at least size elements in the array or object.
+ * Capacity grows by doubling, so appending is amortized O(1).
+ *
+ * [exception] kzrjson_err_calloc
+ */
+static bool reserve_elements(kzrjson_t array_or_object, const size_t size) {
+	if (size <= array_or_object->elements_capacity) return true;
+	size_t capacity = array_or_object->elements_capacity == 0 ? 4 : array_or_object->elements_capacity * 2;
+	if (capacity < size) capacity = size;
+	kzrjson_t *elements;
+	if (array_or_object->doc != NULL) {
+		// arena memory can not be reallocated, so copy to a new block
+		elements = arena_allocate(array_or_object->doc, capacity * sizeof(kzrjson_t));
+		if (elements == NULL) return false;
+		if (array_or_object->elements_size != 0) {
+			memcpy(elements, array_or_object->elements, array_or_object->elements_size * sizeof(kzrjson_t));
 		}
-		puts("");
-		g_indent--;
-		print_indent();
-		printf("%c", end_object);
-		break;
-	}
-	case kzrjson_array: {
-		printf("%c\n", begin_array);
-		g_indent++;
-		for (size_t i = 0; i < any->elements_size; i++) {
-			print_indent();
-			kzrjson_any_print(*(any->elements + i));
-			if (i + 1 != any->elements_size) {
-				printf("%c\n", value_separator);
-			}
+	} else {
+		elements = realloc(array_or_object->elements, capacity * sizeof(kzrjson_t));
+		if (elements == NULL) {
+			set_kzrjson_errno(kzrjson_err_calloc);
+			return false;
 		}
-		puts("");
-		g_indent--;
-		print_indent();
-		printf("%c", end_array);
-		break;
-	}
-	case kzrjson_member:
-		printf("%c%s%c%c ", quotation_mark, any->key, quotation_mark, name_separator);
-		kzrjson_any_print(any->value);
-		break;
-	case kzrjson_string:
-		printf("%c%s%c", quotation_mark, any->string, quotation_mark);
-		break;
-	case kzrjson_number:
-	case kzrjson_bool:
-	case kzrjson_null:
-		printf("%s", any->string);
-		break;
 	}
+	array_or_object->elements = elements;
+	array_or_object->elements_capacity = capacity;
+	return true;
 }
 
-static void kzrjson_any_free(kzrjson_t any) {
-	if (any == NULL) return;
-	switch (any->type) {
-	case kzrjson_array:
-	case kzrjson_object:
-		for (size_t i = 0; i < any->elements_size; i++) {
-			kzrjson_any_free(*(any->elements + i));
+/*
+ * Insert the element to the array or object at index (<= elements_size).
+ *
+ * [exception] kzrjson_err_calloc
+ */
+static bool insert_element(kzrjson_t array_or_object, const size_t index, kzrjson_t element) {
+	if (!shape_leave(array_or_object)) return false;
+	if (!reserve_elements(array_or_object, array_or_object->elements_size + 1)) return false;
+	kzrjson_t *elements = array_or_object->elements;
+	memmove(elements + index + 1, elements + index,
+		(array_or_object->elements_size - index) * sizeof(kzrjson_t));
+	elements[index] = element;
+	array_or_object->elements_size++;
+	if (array_or_object->index != NULL) {
+		if (index + 1 == array_or_object->elements_size) {
+			index_on_append(array_or_object);
+		} else {
+			index_build(array_or_object);
 		}
-		free(any->elements);
-		break;
-	case kzrjson_member:
-		free(any->key);
-		kzrjson_any_free(any->value);
-		break;
-	case kzrjson_string:
-		free(any->string);
-		break;
-	case kzrjson_number:
-		free(any->string);
-		break;
-	case kzrjson_bool:
-	case kzrjson_null:
-		break;
 	}
-	free(any);
+	return true;
 }
 
-static struct {
-	size_t length;
+/*
+ * Remove the element at index from the array or object, keeping the order.
+ *
+ * [no exception]
+ */
+static kzrjson_t remove_element(kzrjson_t array_or_object, const size_t index) {
+	shape_leave(array_or_object);
+	kzrjson_t *elements = array_or_object->elements;
+	kzrjson_t element = elements[index];
+	memmove(elements + index, elements + index + 1,
+		(array_or_object->elements_size - index - 1) * sizeof(kzrjson_t));
+	array_or_object->elements_size--;
+	if (array_or_object->index != NULL) {
+		index_build(array_or_object);
+	}
+	return element;
+}
+
+/*
+ * Remove the element at index from the array or object in O(1)
+ * by moving the last element to index.
+ *
+ * [no exception]
+ */
+static kzrjson_t swap_remove_element(kzrjson_t array_or_object, const size_t index) {
+	shape_leave(array_or_object);
+	kzrjson_t *elements = array_or_object->elements;
+	kzrjson_t element = elements[index];
+	array_or_object->elements_size--;
+	elements[index] = elements[array_or_object->elements_size];
+	// keep the removed one after the end until the index forgets it
+	elements[array_or_object->elements_size] = element;
+	index_on_swap_remove(array_or_object, index);
+	return element;
+}
+
+/*
+ * Add the element to the array or object.
+ * 
+ * [exception] kzrjson_err_calloc
+ */
+static void add_element(kzrjson_t array_or_object, kzrjson_t element) {
+	if (array_or_object == NULL) return;
+	if (element == NULL) return;
+	insert_element(array_or_object, array_or_object->elements_size, element);
+}
+
+/*
+ * [no exception]
+ */
+static void add_value(kzrjson_t member, kzrjson_t value) {
+	if (member == NULL) return;
+	if (value == NULL) return;
+	member->value = value;
+}
+
+/*
+ * Make new kzrjson_t.
+ * 
+ * [exception] kzrjson_err_calloc
+ *    return NULL
+ */
+static kzrjson_t make_json(const kzrjson_type type, char *string) {
+	kzrjson_t any = allocate(g_doc, sizeof(struct kzrjson_t));
+	if (any == NULL) return NULL;
+	any->doc = g_doc;
+	any->type = type;
+	any->string = string;
+	any->elements = NULL;
+	any->elements_size = 0;
+	any->elements_capacity = 0;
+	any->packed_type = kzrjson_packed_none;
+	any->index = NULL;
+	any->shape = NULL;
+	any->key = NULL;
+	return any;
+}
+
+/*
+ * Make new string kzrjson_t.
+ *
+ * [exception] kzrjson_err_calloc
+ *    return NULL
+ */
+static kzrjson_t make_string(const char *string) {
+	return make_json(kzrjson_string, (char *)string);
+}
+
+/*
+ * Make new number kzrjson_t.
+ *
+ * [exception] kzrjson_err_calloc
+ *    return NULL
+ * [exception] kzrjson_err_not_number
+ *    return NULL
+ */
+static kzrjson_t make_number(char *number, kzrjson_number_type type) {
+	kzrjson_t data = make_json(kzrjson_number, number);
+	if (data == NULL) {
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return NULL;
+	}
+	data->number_type = type;
+	char *end;
+	switch (data->number_type) {
+	case kzrjson_int:
+		data->number_int = strtoll(data->string, &end, 10);
+		if (data->string == end) goto throw_exp;
+		break;
+	case kzrjson_uint:
+		data->number_uint = strtoull(data->string, &end, 10);
+		if (data->string == end) goto throw_exp;
+		break;
+	case kzrjson_double:
+	case kzrjson_exp:
+		data->number_double = strtod(data->string, &end);
+		if (data->string == end) goto throw_exp;
+		break;
+	}
+	return data;
+
+throw_exp:
+	set_kzrjson_errno(kzrjson_err_not_number);
+	kzrjson_any_free(data);
+	return NULL;
+}
+
+/*
+ * Make new boolean kzrjson_t.
+ *
+ * [exception] kzrjson_err_calloc
+ *    return NULL
+ */
+static kzrjson_t make_boolean(const bool boolean) {
+	kzrjson_t json = make_json(kzrjson_bool,
+		(char *)(boolean ? literal_true : literal_false)
+	);
+	json->boolean = boolean;
+	return json;
+}
+
+/*
+ * Make new null kzrjson_t.
+ *
+ * [exception] kzrjson_err_calloc
+ *    return NULL
+ */
+static kzrjson_t make_null(void) {
+	return make_json(kzrjson_null, (char *)literal_null);
+}
+
+/*
+ * Make new object kzrjson_t.
+ *
+ * [exception] kzrjson_err_calloc
+ *    return NULL
+ */
+static kzrjson_t make_object(void) {
+	return make_json(kzrjson_object, NULL);
+}
+
+/*
+ * Make new array kzrjson_t.
+ *
+ * [exception] kzrjson_err_calloc
+ *    return NULL
+ */
+static kzrjson_t make_array(void) {
+	return make_json(kzrjson_array, NULL);
+}
+
+/*
+ * Make new member kzrjson_t.
+ *
+ * [exception] kzrjson_err_calloc
+ *    return NULL
+ */
+static kzrjson_t make_member(const char *key, const size_t key_length) {
+	kzrjson_t data = make_json(kzrjson_member, NULL);
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+	data->key = (char *)key;
+	data->key_length = key_length;
+	return data;
+}
+
+/*
+ * Copy string to heap memory.
+ * 
+ * [exception] kzrjson_err_calloc
+ *   return NULL
+ */
+static char *copy_string(const char *from, const size_t length) {
+	char *buffer = allocate(g_doc, length + 1);
+	if (buffer == NULL) return NULL;
+	strncpy_s(buffer, length + 1, from, length);
+	return buffer;
+}
+
+/*****************************************************************************
+ * Packed arrays
+ *****************************************************************************/
+// options of the parse in progress
+static KZRJSON_THREAD_LOCAL unsigned g_options;
+
+// integers up to this magnitude are exact in double
+static const int64_t double_exact_max = (int64_t)1 << 53;
+
+// enough for "%lld", "%llu" and "%.17g"
+#define PACKED_FORMAT_SIZE 32
+
+/*
+ * A number as int64, uint64 or double.
+ */
+typedef struct {
+	kzrjson_packed_type type;
+	union {
+		int64_t int64;
+		uint64_t uint64;
+		double number;
+	};
+} packed_value;
+
+static size_t packed_size(const kzrjson_packed_type type) {
+	switch (type) {
+	case kzrjson_packed_int64: return sizeof(int64_t);
+	case kzrjson_packed_uint64: return sizeof(uint64_t);
+	case kzrjson_packed_double: return sizeof(double);
+	default: return 0;
+	}
+}
+
+/*
+ * Value of a number kzrjson_t.
+ * type is kzrjson_packed_none if the integer is out of range of int64_t or
+ * uint64_t (strtoll and strtoull saturate), or the double is not finite.
+ *
+ * [no exception]
+ */
+static packed_value number_value(kzrjson_t number) {
+	packed_value value = {.type = kzrjson_packed_none};
+	switch (number->number_type) {
+	case kzrjson_int:
+		if (number->number_int == INT64_MIN) {
+			errno = 0;
+			(void)strtoll(number->string, NULL, 10);
+			if (errno == ERANGE) return value;
+		}
+		value.type = kzrjson_packed_int64;
+		value.int64 = number->number_int;
+		break;
+	case kzrjson_uint:
+		if (number->number_uint == UINT64_MAX) {
+			errno = 0;
+			(void)strtoull(number->string, NULL, 10);
+			if (errno == ERANGE) return value;
+		}
+		value.type = kzrjson_packed_uint64;
+		value.uint64 = number->number_uint;
+		break;
+	case kzrjson_double:
+	case kzrjson_exp:
+		if (!isfinite(number->number_double)) return value;
+		value.type = kzrjson_packed_double;
+		value.number = number->number_double;
+		break;
+	}
+	return value;
+}
+
+/*
+ * Value at the index of a packed array.
+ *
+ * [no exception]
+ */
+static packed_value packed_at(kzrjson_t array, const size_t index) {
+	packed_value value = {.type = array->packed_type};
+	switch (array->packed_type) {
+	case kzrjson_packed_int64:
+		value.int64 = array->packed_int64[index];
+		break;
+	case kzrjson_packed_uint64:
+		value.uint64 = array->packed_uint64[index];
+		break;
+	case kzrjson_packed_double:
+		value.number = array->packed_double[index];
+		break;
+	default:
+		break;
+	}
+	return value;
+}
+
+static double value_to_double(const packed_value value) {
+	switch (value.type) {
+	case kzrjson_packed_int64: return (double)value.int64;
+	case kzrjson_packed_uint64: return (double)value.uint64;
+	default: return value.number;
+	}
+}
+
+/*
+ * [no exception]
+ *    return false if the value is not an integer in int64_t
+ */
+static bool value_to_int64(const packed_value value, int64_t *out) {
+	switch (value.type) {
+	case kzrjson_packed_int64:
+		*out = value.int64;
+		return true;
+	case kzrjson_packed_uint64:
+		*out = (int64_t)value.uint64;
+		return value.uint64 <= INT64_MAX;
+	case kzrjson_packed_double:
+		if (!(value.number >= -9223372036854775808.0 && value.number < 9223372036854775808.0)) return false;
+		*out = (int64_t)value.number;
+		return (double)*out == value.number;
+	default:
+		return false;
+	}
+}
+
+/*
+ * [no exception]
+ *    return false if the value is not an integer in uint64_t
+ */
+static bool value_to_uint64(const packed_value value, uint64_t *out) {
+	switch (value.type) {
+	case kzrjson_packed_int64:
+		*out = (uint64_t)value.int64;
+		return value.int64 >= 0;
+	case kzrjson_packed_uint64:
+		*out = value.uint64;
+		return true;
+	case kzrjson_packed_double:
+		if (!(value.number >= 0.0 && value.number < 18446744073709551616.0)) return false;
+		*out = (uint64_t)value.number;
+		return (double)*out == value.number;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Type which all the elements can be packed in without loss:
+ * int64 if all are integers in int64_t, uint64 if all are in uint64_t,
+ * double if there is a fraction or exponent and all integers are exact in double.
+ * kzrjson_packed_none if an element is not a number or no type fits.
+ *
+ * [no exception]
+ */
+static kzrjson_packed_type packable_type(const kzrjson_t *elements, const size_t size) {
+	bool negative = false;
+	bool over_int64 = false;
+	bool over_double = false;
+	bool fraction = false;
+	for (size_t i = 0; i < size; i++) {
+		if (elements[i]->type != kzrjson_number) return kzrjson_packed_none;
+		const packed_value value = number_value(elements[i]);
+		switch (value.type) {
+		case kzrjson_packed_int64:
+			negative = true;
+			if (value.int64 < -double_exact_max) over_double = true;
+			break;
+		case kzrjson_packed_uint64:
+			if (value.uint64 > INT64_MAX) over_int64 = true;
+			if (value.uint64 > (uint64_t)double_exact_max) over_double = true;
+			break;
+		case kzrjson_packed_double:
+			fraction = true;
+			break;
+		default:
+			return kzrjson_packed_none;
+		}
+	}
+	if (fraction) return over_double ? kzrjson_packed_none : kzrjson_packed_double;
+	if (over_int64) return negative ? kzrjson_packed_none : kzrjson_packed_uint64;
+	return kzrjson_packed_int64;
+}
+
+/*
+ * Store the elements to values as the type from packable_type.
+ *
+ * [no exception]
+ */
+static void pack_values(const kzrjson_t *elements, const size_t size, const kzrjson_packed_type type, void *values) {
+	for (size_t i = 0; i < size; i++) {
+		const packed_value value = number_value(elements[i]);
+		switch (type) {
+		case kzrjson_packed_int64:
+			value_to_int64(value, (int64_t *)values + i);
+			break;
+		case kzrjson_packed_uint64:
+			value_to_uint64(value, (uint64_t *)values + i);
+			break;
+		default:
+			((double *)values)[i] = value_to_double(value);
+			break;
+		}
+	}
+}
+
+/*
+ * Shortest text of the double which is read back as the same value.
+ * out must have PACKED_FORMAT_SIZE bytes. Return the length.
+ *
+ * [no exception]
+ */
+static size_t format_double(char *out, const double number) {
+	int length = 0;
+	for (int precision = 1; precision <= 17; precision++) {
+		length = snprintf(out, PACKED_FORMAT_SIZE, "%.*g", precision, number);
+		if (strtod(out, NULL) == number) break;
+	}
+	return (size_t)length;
+}
+
+/*
+ * Write the value at the index of a packed array as in JSON text.
+ * A double is written in the shortest digits which read back the same.
+ * out must have PACKED_FORMAT_SIZE bytes. Return the length.
+ *
+ * [no exception]
+ */
+static size_t format_packed(char *out, kzrjson_t array, const size_t index) {
+	const packed_value value = packed_at(array, index);
+	int length = 0;
+	switch (value.type) {
+	case kzrjson_packed_int64:
+		length = snprintf(out, PACKED_FORMAT_SIZE, "%lld", (long long)value.int64);
+		break;
+	case kzrjson_packed_uint64:
+		length = snprintf(out, PACKED_FORMAT_SIZE, "%llu", (unsigned long long)value.uint64);
+		break;
+	default:
+		return format_double(out, value.number);
+	}
+	return (size_t)length;
+}
+
+/*
+ * Pack the numbers pushed after mark to the array, if they can be packed.
+ * The numbers are released, and in a document the arena is rewound to
+ * the position before them, so that only the values remain.
+ *
+ * [exception] kzrjson_err_calloc
+ */
+static void pack_scratch(struct scratch *scratch, const size_t mark, kzrjson_t array, const arena_mark arena) {
+	const size_t size = scratch->size - mark;
+	const kzrjson_packed_type type = packable_type(scratch->data + mark, size);
+	if (type == kzrjson_packed_none) return;
+	if (!scratch_reserve_values(scratch, size * packed_size(type))) return;
+	pack_values(scratch->data + mark, size, type, scratch->values);
+	scratch_discard(scratch, mark);
+	arena_rewind(array->doc, arena);
+	void *values = allocate(array->doc, size * packed_size(type));
+	if (values == NULL) return;
+	memcpy(values, scratch->values, size * packed_size(type));
+	array->packed_type = type;
+	array->packed_int64 = values;
+	array->elements_size = size;
+	array->elements_capacity = size;
+}
+
+/*
+ * Make kzrjson_t of each value of a packed array.
+ *
+ * [exception] kzrjson_err_calloc
+ */
+static bool unpack(kzrjson_t array) {
+	if (array->packed_type == kzrjson_packed_none) return true;
+	const size_t size = array->elements_size;
+	kzrjson_t *elements = NULL;
+	if (size > 0) {
+		elements = allocate(array->doc, size * sizeof(kzrjson_t));
+		if (elements == NULL) return false;
+	}
+
+	// make_json allocates in g_doc
+	struct kzrjson_doc *doc = g_doc;
+	g_doc = array->doc;
+	size_t made = 0;
+	for (; made < size; made++) {
+		char buffer[PACKED_FORMAT_SIZE];
+		const size_t length = format_packed(buffer, array, made);
+		kzrjson_number_type type = kzrjson_uint;
+		if (array->packed_type == kzrjson_packed_double) {
+			type = strpbrk(buffer, "eE") != NULL ? kzrjson_exp : kzrjson_double;
+		} else if (buffer[0] == minus) {
+			type = kzrjson_int;
+		}
+		char *string = copy_string(buffer, length);
+		if (string == NULL) break;
+		elements[made] = make_number(string, type);
+		if (elements[made] == NULL) {
+			release(g_doc, string);
+			break;
+		}
+	}
+	g_doc = doc;
+	if (made < size) {
+		for (size_t i = 0; i < made; i++) {
+			kzrjson_any_free(elements[i]);
+		}
+		release(array->doc, elements);
+		return false;
+	}
+	release(array->doc, array->packed_int64);
+	array->packed_type = kzrjson_packed_none;
+	array->elements = elements;
+	array->elements_capacity = size;
+	return true;
+}
+
+static kzrjson_t parse_object(const struct kzrjson_shape *predicted);
+static kzrjson_t parse_array(void);
+static kzrjson_t parse_number(void);
+static kzrjson_t parse_member(const struct interned_key *key);
+static kzrjson_t parse_value(void);
+
+// shape expected of the object which parse_value parses next
+static KZRJSON_THREAD_LOCAL const struct kzrjson_shape *g_predicted_shape;
+
+/*
+ * Shape expected of the next element of an array: the shape of
+ * the last element parsed, if it is an object.
+ *
+ * [no exception]
+ */
+static const struct kzrjson_shape *predict_shape(const struct scratch *scratch, const size_t mark) {
+	if (!(g_options & kzrjson_option_predict_keys) || scratch->size == mark) return NULL;
+	const kzrjson_t previous = scratch->data[scratch->size - 1];
+	return previous->type == kzrjson_object ? previous->shape : NULL;
+}
+
+/*
+ * Get a token, expecting it to be the key at the position of the shape.
+ * If the text has the key there, it is compared with the interned key
+ * instead of being scanned, and *key is set to the interned key.
+ * Otherwise, *key is NULL and the token is got as usual.
+ *
+ * [exception] kzrjson_err_tokenize
+ *    return kzrjson_token_error
+ */
+static kzrjson_token_type get_key_token(const struct kzrjson_shape *shape, const size_t position,
+	const struct interned_key **key)
+{
+	*key = NULL;
+	if (shape == NULL || position >= shape->size) return get_token();
+	const char *pos = lexer.pos;
+	while (token_classes[(unsigned char)*pos] == kzrjson_token_white_space) pos++;
+	const struct interned_key *predicted = shape->keys[position];
+	// strncmp stops at the end of text, where memcmp would read over it
+	if (*pos != quotation_mark || strncmp(pos + 1, predicted->string, predicted->length) != 0
+		|| pos[predicted->length + 1] != quotation_mark) {
+		return get_token();
+	}
+	lexer.pos = pos + predicted->length + 2;
+	*key = predicted;
+	return set_token(kzrjson_token_string, pos + 1, predicted->length);
+}
+
+/*
+ * [no exception]
+ */
+static bool current_is(const kzrjson_token_type type) {
+	return current_token.type == type;
+}
+
+/*
+ * Current token must be the type. If not, throw exception.
+ * 
+ * [exception] kzrjson_err_parse
+ */
+static void current_must(const kzrjson_token_type type) {
+	if (!current_is(type)) {
+		set_kzrjson_errno(kzrjson_err_parse);
+		return;
+	}
+}
+
+/*
+ * parse-JSON-text = ws value ws
+ * 
+ * [exception] kzrjson_err_calloc
+ * [exception] kzrjson_err_parse
+ * [exception] kzrjson_err_tokenize
+ * [exception] kzrjson_err_not_number
+ */
+static kzrjson_t parse_json_text(void) {
+	get_token();
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+	return parse_value();
+}
+
+/*
+ * value = false / null / true / string / object / array / number
+ * 
+ * [exception] kzrjson_err_calloc
+ * [exception] kzrjson_err_parse
+ * [exception] kzrjson_err_tokenize
+ * [exception] kzrjson_err_not_number
+ */
+static kzrjson_t parse_value(void) {
+	const struct kzrjson_shape *predicted = g_predicted_shape;
+	g_predicted_shape = NULL;
+	kzrjson_t data = NULL;
+	if (current_is(kzrjson_token_literal_false)) {
+		data = make_boolean(false);
+		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+		get_token();
+		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+		return data;
+	} else if (current_is(kzrjson_token_literal_true)) {
+		data = make_boolean(true);
+		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+		get_token();
+		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+		return data;
+	} else if (current_is(kzrjson_token_null)) {
+		data = make_null();
+		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+		get_token();
+		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+		return data;
+	} else if (current_is(kzrjson_token_string)) {
+		char *string = copy_string(current_token.begin, current_token.length);
+		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+		data = make_string(string);
+		if (kzrjson_errno() != kzrjson_success) {
+			release(g_doc, string);
+			goto throw_exp;
+		}
+		get_token();
+		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+		return data;
+	} else if (current_is(kzrjson_token_begin_object)) {
+		return parse_object(predicted);
+	} else if (current_is(kzrjson_token_begin_array)) {
+		return parse_array();
+	} else {
+		return parse_number();
+	}
+
+throw_exp:
+	kzrjson_any_free(data);
+	return NULL;
+}
+
+// object = begin-object [ member *( value-separator member ) ] end-object
+// [exception] kzrjson_err_calloc
+static kzrjson_t parse_object(const struct kzrjson_shape *predicted) {
+	const size_t mark = g_scratch->size;
+	const struct interned_key *key = NULL;
+	size_t hits = 0; // members whose key was predicted
+	kzrjson_t object = make_object();
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+	current_must(kzrjson_token_begin_object);
+	if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+	get_key_token(predicted, 0, &key);
+	if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+	if (!current_is(kzrjson_token_end_object)) {
+		if (key != NULL) hits++;
+		scratch_push(g_scratch, parse_member(key));
+		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+		while (!current_is(kzrjson_token_end_object)) {
+			current_must(kzrjson_token_value_separator);
+			if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+			get_key_token(predicted, g_scratch->size - mark, &key);
+			if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+			if (key != NULL) hits++;
+			scratch_push(g_scratch, parse_member(key));
+			if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+		}
+	}
+	scratch_pop_to(g_scratch, mark, object);
+	if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+	if (predicted != NULL && hits == predicted->size && object->elements_size == hits) {
+		object->shape = (struct kzrjson_shape *)predicted;
+		object->index = predicted->index;
+	} else if (g_doc != NULL && (g_options & kzrjson_option_share_shapes) && object->elements_size > 0) {
+		share_shape(object);
+		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+	}
+	get_token();
+	if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+	return object;
+
+throw_exp:
+	scratch_discard(g_scratch, mark);
+	kzrjson_any_free(object);
+	return NULL;
+}
+
+// array = begin-array [ value *( value-separator value ) ] end-array
+static kzrjson_t parse_array(void) {
+	const size_t mark = g_scratch->size;
+	kzrjson_t array = make_array();
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+	const arena_mark arena = arena_get_mark(g_doc);
+	current_must(kzrjson_token_begin_array);
+	if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+	get_token();
+	if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+	if (!current_is(kzrjson_token_end_array)) {
+		scratch_push(g_scratch, parse_value());
+		if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+		while (!current_is(kzrjson_token_end_array)) {
+			current_must(kzrjson_token_value_separator);
+			if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+			get_token();
+			if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+			g_predicted_shape = predict_shape(g_scratch, mark);
+			scratch_push(g_scratch, parse_value());
+			if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+		}
+		if (g_options & kzrjson_option_pack_arrays) {
+			pack_scratch(g_scratch, mark, array, arena);
+			if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+		}
+	}
+	scratch_pop_to(g_scratch, mark, array);
+	if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+	get_token();
+	if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+	return array;
+
+throw_exp:
+	scratch_discard(g_scratch, mark);
+	kzrjson_any_free(array);
+	return NULL;
+}
+
+// member = string name-separator value
+// key is the interned key if the key was predicted, otherwise NULL
+static kzrjson_t parse_member(const struct interned_key *key) {
+	current_must(kzrjson_token_string);
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+	char *buffer;
+	if (key != NULL) {
+		buffer = (char *)key->string;
+	} else if (g_doc != NULL && (g_options & kzrjson_option_share_shapes)) {
+		buffer = intern_key(current_token.begin, current_token.length);
+	} else {
+		buffer = copy_string(current_token.begin, current_token.length);
+	}
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+	kzrjson_t member = make_member(buffer, current_token.length);
+	if (kzrjson_errno() != kzrjson_success) {
+		release(g_doc, buffer);
+		return NULL;
+	}
+	get_token();
+	if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+	current_must(kzrjson_token_name_separator);
+	if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+	get_token();
+	if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+	add_value(member, parse_value());
+	if (kzrjson_errno() != kzrjson_success) goto throw_exp;
+	return member;
+
+throw_exp:
+	kzrjson_any_free(member);
+	return NULL;
+}
+
+/*
+ * The number token was scanned by scan_number.
+ *
+ * [exception] kzrjson_err_calloc
+ * [exception] kzrjson_err_parse
+ * [exception] kzrjson_err_not_number
+ */
+static kzrjson_t parse_number(void) {
+	current_must(kzrjson_token_number);
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+	char *number = copy_string(current_token.begin, current_token.length);
+	if (number == NULL) {
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return NULL;
+	}
+	kzrjson_t data = make_number(number, current_token.number_type);
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+	get_token();
+	if (kzrjson_errno() != kzrjson_success) {
+		kzrjson_any_free(data);
+		return NULL;
+	}
+	return data;
+}
+
+static KZRJSON_THREAD_LOCAL int g_indent = 0;
+static void print_indent(void) {
+	for (int i = 0; i < g_indent; i++) {
+		printf("  "); // 2 space
+	}
+}
+
+static void kzrjson_any_print(kzrjson_t any) {
+	if (any == NULL) return;
+	switch (any->type) {
+	case kzrjson_object: {
+		printf("%c\n", begin_object);
+		g_indent++;
+		for (size_t i = 0; i < any->elements_size; i++) {
+			print_indent();
+			kzrjson_any_print(*(any->elements + i));
+			if (i + 1 != any->elements_size) {
+				printf("%c\n", value_separator);
+			}
+		}
+		puts("");
+		g_indent--;
+		print_indent();
+		printf("%c", end_object);
+		break;
+	}
+	case kzrjson_array: {
+		printf("%c\n", begin_array);
+		g_indent++;
+		for (size_t i = 0; i < any->elements_size; i++) {
+			print_indent();
+			if (any->packed_type != kzrjson_packed_none) {
+				char buffer[PACKED_FORMAT_SIZE];
+				format_packed(buffer, any, i);
+				printf("%s", buffer);
+			} else {
+				kzrjson_any_print(*(any->elements + i));
+			}
+			if (i + 1 != any->elements_size) {
+				printf("%c\n", value_separator);
+			}
+		}
+		puts("");
+		g_indent--;
+		print_indent();
+		printf("%c", end_array);
+		break;
+	}
+	case kzrjson_member:
+		printf("%c%s%c%c ", quotation_mark, any->key, quotation_mark, name_separator);
+		kzrjson_any_print(any->value);
+		break;
+	case kzrjson_string:
+		printf("%c%s%c", quotation_mark, any->string, quotation_mark);
+		break;
+	case kzrjson_number:
+	case kzrjson_bool:
+	case kzrjson_null:
+		printf("%s", any->string);
+		break;
+	}
+}
+
+static void kzrjson_any_free(kzrjson_t any) {
+	if (any == NULL) return;
+	if (any->doc != NULL) return; // released with the document
+	switch (any->type) {
+	case kzrjson_array:
+	case kzrjson_object:
+		if (any->packed_type == kzrjson_packed_none) {
+			for (size_t i = 0; i < any->elements_size; i++) {
+				kzrjson_any_free(*(any->elements + i));
+			}
+		}
+		free(any->elements);
+		free(any->index);
+		break;
+	case kzrjson_member:
+		free(any->key);
+		kzrjson_any_free(any->value);
+		break;
+	case kzrjson_string:
+		free(any->string);
+		break;
+	case kzrjson_number:
+		free(any->string);
+		break;
+	case kzrjson_bool:
+	case kzrjson_null:
+		break;
+	}
+	free(any);
+}
+
+static KZRJSON_THREAD_LOCAL struct {
+	size_t length;
 	char *begin;
 	char *pos;
 } g_converter;
 
-static size_t kzrjson_any_length(kzrjson_t any) {
+static size_t kzrjson_any_length(kzrjson_t any) {
+	switch (any->type) {
+	case kzrjson_object:
+		g_converter.length++; // begin-object
+		for (size_t i = 0; i < any->elements_size; i++) {
+			kzrjson_any_length(*(any->elements + i));
+			if (i + 1 != any->elements_size) {
+				g_converter.length++; // value-separator
+			}
+		}
+		g_converter.length++; // end-object
+		break;
+	case kzrjson_array:
+		g_converter.length++; // begin-array
+		for (size_t i = 0; i < any->elements_size; i++) {
+			if (any->packed_type != kzrjson_packed_none) {
+				char buffer[PACKED_FORMAT_SIZE];
+				g_converter.length += format_packed(buffer, any, i);
+			} else {
+				kzrjson_any_length(*(any->elements + i));
+			}
+			if (i + 1 != any->elements_size) {
+				g_converter.length++; // value-separator
+			}
+		}
+		g_converter.length++; // end-array
+		break;
+	case kzrjson_member:
+		g_converter.length++; // quatation-mark
+		g_converter.length += strlen(any->key);
+		g_converter.length++; // quatation-mark
+		g_converter.length++; // name-separator
+		kzrjson_any_length(any->value);
+		break;
+	case kzrjson_string:
+		g_converter.length++; // quatation-mark
+		g_converter.length += strlen(any->string);
+		g_converter.length++; // quatation-mark
+		break;
+	case kzrjson_number:
+		g_converter.length += strlen(any->string);
+		break;
+	case kzrjson_bool:
+		g_converter.length += strlen(any->string);
+		break;
+	case kzrjson_null:
+		g_converter.length += strlen(any->string);
+		break;
+	}
+	return g_converter.length;
+}
+
+static void converter_add_char(const char c) {
+	*g_converter.pos = c;
+	g_converter.pos++;
+}
+
+static void converter_add_string(const char *string) {
+	const size_t remain = g_converter.length - (g_converter.pos - g_converter.begin);
+	strcpy_s(g_converter.pos, remain, string);
+	g_converter.pos += strlen(string);
+}
+
+static void kzrjson_any_to_string(kzrjson_t any) {
+	switch (any->type) {
+	case kzrjson_object:
+		converter_add_char(begin_object);
+		for (size_t i = 0; i < any->elements_size; i++) {
+			kzrjson_any_to_string(*(any->elements + i));
+			if (i + 1 != any->elements_size) {
+				converter_add_char(value_separator);
+			}
+		}
+		converter_add_char(end_object);
+		break;
+	case kzrjson_array:
+		converter_add_char(begin_array);
+		for (size_t i = 0; i < any->elements_size; i++) {
+			if (any->packed_type != kzrjson_packed_none) {
+				char buffer[PACKED_FORMAT_SIZE];
+				format_packed(buffer, any, i);
+				converter_add_string(buffer);
+			} else {
+				kzrjson_any_to_string(*(any->elements + i));
+			}
+			if (i + 1 != any->elements_size) {
+				converter_add_char(value_separator);
+			}
+		}
+		converter_add_char(end_array);
+		break;
+	case kzrjson_member:
+		converter_add_char(quotation_mark);
+		converter_add_string(any->key);
+		converter_add_char(quotation_mark);
+		converter_add_char(name_separator);
+		kzrjson_any_to_string(any->value);
+		break;
+	case kzrjson_string:
+		converter_add_char(quotation_mark);
+		converter_add_string(any->string);
+		converter_add_char(quotation_mark);
+		break;
+	case kzrjson_number:
+		converter_add_string(any->string);
+		break;
+	case kzrjson_bool:
+		converter_add_string(any->string);
+		break;
+	case kzrjson_null:
+		converter_add_string(any->string);
+		break;
+	}
+}
+
+/*
+ * Canonical JSON text (RFC 8785)
+ */
+static bool is_digit(const char c);
+static size_t put_utf8(char *out, const uint32_t code_point);
+static uint32_t read_hex4(const char *hex);
+
+typedef struct {
+	kzrjson_sink_t sink;
+	kzrjson_errno_t error;
+	size_t length;
+	char buffer[256];
+} canonical_writer;
+
+static void canonical_flush(canonical_writer *writer) {
+	if (writer->length == 0 || writer->error != kzrjson_success) return;
+	if (!writer->sink.write(writer->buffer, writer->length, writer->sink.context)) {
+		writer->error = kzrjson_err_sink;
+	}
+	writer->length = 0;
+}
+
+static void canonical_put(canonical_writer *writer, const char *data, const size_t length) {
+	if (writer->length + length > sizeof(writer->buffer)) {
+		canonical_flush(writer);
+		if (length > sizeof(writer->buffer)) {
+			if (writer->error == kzrjson_success && !writer->sink.write(data, length, writer->sink.context)) {
+				writer->error = kzrjson_err_sink;
+			}
+			return;
+		}
+	}
+	memcpy(writer->buffer + writer->length, data, length);
+	writer->length += length;
+}
+
+static void canonical_put_char(canonical_writer *writer, const char c) {
+	canonical_put(writer, &c, 1);
+}
+
+/*
+ * Read a character of a string as in JSON text at *i, and return its code point.
+ * Escape sequences are decoded, and a surrogate pair makes a code point.
+ * A byte not in UTF-8 is returned as it is.
+ */
+static uint32_t next_code_point(const char *string, const size_t length, size_t *i) {
+	const unsigned char *s = (const unsigned char *)string;
+	const unsigned char c = s[*i];
+	if (c == escape && *i + 1 < length) {
+		const char e = string[*i + 1];
+		*i += 2;
+		switch (e) {
+		case 0x62: return 0x08;
+		case 0x66: return 0x0C;
+		case 0x6E: return 0x0A;
+		case 0x72: return 0x0D;
+		case 0x74: return 0x09;
+		case 0x75: {
+			if (*i + 4 > length) return e;
+			uint32_t code_point = read_hex4(string + *i);
+			*i += 4;
+			if (code_point >= 0xD800 && code_point <= 0xDBFF && *i + 6 <= length
+				&& s[*i] == escape && s[*i + 1] == 0x75)
+			{
+				const uint32_t low = read_hex4(string + *i + 2);
+				if (low >= 0xDC00 && low <= 0xDFFF) {
+					code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+					*i += 6;
+				}
+			}
+			return code_point;
+		}
+		default:
+			return (unsigned char)e;
+		}
+	}
+	size_t size = 1;
+	uint32_t code_point = c;
+	if (c >= 0xC0 && c < 0xE0) {
+		size = 2;
+		code_point = c & 0x1F;
+	} else if (c >= 0xE0 && c < 0xF0) {
+		size = 3;
+		code_point = c & 0x0F;
+	} else if (c >= 0xF0 && c < 0xF8) {
+		size = 4;
+		code_point = c & 0x07;
+	}
+	if (size == 1 || *i + size > length) {
+		(*i)++;
+		return c;
+	}
+	for (size_t k = 1; k < size; k++) {
+		if ((s[*i + k] & 0xC0) != 0x80) {
+			(*i)++;
+			return c;
+		}
+		code_point = (code_point << 6) | (s[*i + k] & 0x3F);
+	}
+	*i += size;
+	return code_point;
+}
+
+/*
+ * UTF-16 code units of a string, one by one.
+ */
+typedef struct {
+	const char *string;
+	size_t length;
+	size_t pos;
+	uint32_t low_surrogate;
+} utf16_units;
+
+// next code unit, or -1 at the end
+static int32_t next_utf16_unit(utf16_units *units) {
+	if (units->low_surrogate != 0) {
+		const int32_t unit = (int32_t)units->low_surrogate;
+		units->low_surrogate = 0;
+		return unit;
+	}
+	if (units->pos >= units->length) return -1;
+	const uint32_t code_point = next_code_point(units->string, units->length, &units->pos);
+	if (code_point < 0x10000) return (int32_t)code_point;
+	units->low_surrogate = 0xDC00 + ((code_point - 0x10000) & 0x3FF);
+	return (int32_t)(0xD800 + ((code_point - 0x10000) >> 10));
+}
+
+typedef struct {
+	// the first 4 code units, to compare most keys without decoding them again
+	uint64_t prefix;
+	const char *key;
+	size_t key_length;
+	kzrjson_t member;
+} canonical_member;
+
+static int compare_canonical_members(const void *a, const void *b) {
+	const canonical_member *x = a;
+	const canonical_member *y = b;
+	if (x->prefix != y->prefix) return x->prefix < y->prefix ? -1 : 1;
+	utf16_units ux = {x->key, x->key_length, 0, 0};
+	utf16_units uy = {y->key, y->key_length, 0, 0};
+	for (;;) {
+		const int32_t cx = next_utf16_unit(&ux);
+		const int32_t cy = next_utf16_unit(&uy);
+		if (cx != cy) return cx < cy ? -1 : 1;
+		if (cx < 0) return 0;
+	}
+}
+
+static void canonical_string(canonical_writer *writer, const char *string, const size_t length) {
+	static const char hex[] = "0123456789abcdef";
+	canonical_put_char(writer, quotation_mark);
+	size_t i = 0;
+	while (i < length) {
+		// copy characters which need no change at once
+		size_t run = i;
+		while (run < length) {
+			const unsigned char c = (unsigned char)string[run];
+			if (c == escape || c == quotation_mark || c < 0x20) break;
+			run++;
+		}
+		canonical_put(writer, string + i, run - i);
+		i = run;
+		if (i >= length) break;
+
+		const size_t begin = i;
+		const uint32_t code_point = next_code_point(string, length, &i);
+		char out[6] = {escape};
+		switch (code_point) {
+		case 0x08: out[1] = 'b'; canonical_put(writer, out, 2); break;
+		case 0x09: out[1] = 't'; canonical_put(writer, out, 2); break;
+		case 0x0A: out[1] = 'n'; canonical_put(writer, out, 2); break;
+		case 0x0C: out[1] = 'f'; canonical_put(writer, out, 2); break;
+		case 0x0D: out[1] = 'r'; canonical_put(writer, out, 2); break;
+		case 0x22: out[1] = '"'; canonical_put(writer, out, 2); break;
+		case 0x5C: out[1] = '\\'; canonical_put(writer, out, 2); break;
+		default:
+			if (code_point < 0x20) {
+				out[1] = 'u';
+				out[2] = '0';
+				out[3] = '0';
+				out[4] = hex[code_point >> 4];
+				out[5] = hex[code_point & 0xF];
+				canonical_put(writer, out, 6);
+			} else if (string[begin] == escape) {
+				// a surrogate left alone is not a character (RFC 8785 3.2.2.2)
+				if (code_point >= 0xD800 && code_point <= 0xDFFF) {
+					if (writer->error == kzrjson_success) writer->error = kzrjson_err_tokenize;
+					return;
+				}
+				char utf8[4];
+				canonical_put(writer, utf8, put_utf8(utf8, code_point));
+			} else {
+				canonical_put(writer, string + begin, i - begin);
+			}
+			break;
+		}
+	}
+	canonical_put_char(writer, quotation_mark);
+}
+
+/*
+ * Number::toString of ECMAScript: the shortest digits which round trip,
+ * without exponent if the decimal point is in -6 < n <= 21.
+ */
+static void canonical_number(canonical_writer *writer, const double number) {
+	if (number == 0) { // also -0
+		canonical_put_char(writer, zero);
+		return;
+	}
+	char buffer[32];
+	for (int precision = 1; precision <= 17; precision++) {
+		snprintf(buffer, sizeof(buffer), "%.*e", precision - 1, number);
+		if (strtod(buffer, NULL) == number) break;
+	}
+
+	// buffer is [-]d[.ddd]e(+|-)xx
+	const char *p = buffer;
+	if (*p == minus) {
+		canonical_put_char(writer, minus);
+		p++;
+	}
+	char digits[20];
+	int k = 0;
+	for (; *p != 'e'; p++) {
+		if (is_digit(*p)) digits[k++] = *p;
+	}
+	const int n = atoi(p + 1) + 1; // number = 0.digits * 10^n
+
+	if (k <= n && n <= 21) {
+		canonical_put(writer, digits, (size_t)k);
+		for (int i = k; i < n; i++) canonical_put_char(writer, zero);
+	} else if (0 < n && n <= 21) {
+		canonical_put(writer, digits, (size_t)n);
+		canonical_put_char(writer, decimal_point);
+		canonical_put(writer, digits + n, (size_t)(k - n));
+	} else if (-6 < n && n <= 0) {
+		canonical_put(writer, "0.", 2);
+		for (int i = n; i < 0; i++) canonical_put_char(writer, zero);
+		canonical_put(writer, digits, (size_t)k);
+	} else {
+		canonical_put_char(writer, digits[0]);
+		if (k > 1) {
+			canonical_put_char(writer, decimal_point);
+			canonical_put(writer, digits + 1, (size_t)(k - 1));
+		}
+		char exponent[8];
+		const int length = snprintf(exponent, sizeof(exponent), "e%c%d", n - 1 < 0 ? minus : plus, abs(n - 1));
+		canonical_put(writer, exponent, (size_t)length);
+	}
+}
+
+static void kzrjson_any_write_canonical(canonical_writer *writer, kzrjson_t any) {
+	if (writer->error != kzrjson_success) return;
+	switch (any->type) {
+	case kzrjson_object: {
+		canonical_put_char(writer, begin_object);
+		canonical_member *members = NULL;
+		if (any->elements_size > 0) {
+			members = calloc(any->elements_size, sizeof(canonical_member));
+			if (members == NULL) {
+				writer->error = kzrjson_err_calloc;
+				return;
+			}
+		}
+		for (size_t i = 0; i < any->elements_size; i++) {
+			kzrjson_t member = *(any->elements + i);
+			canonical_member *m = members + i;
+			m->key = member->key;
+			m->key_length = member->key_length;
+			m->member = member;
+			utf16_units units = {m->key, m->key_length, 0, 0};
+			for (int u = 0; u < 4; u++) {
+				const int32_t unit = next_utf16_unit(&units);
+				m->prefix = (m->prefix << 16) | (unit < 0 ? 0 : (uint64_t)unit);
+			}
+		}
+		if (any->elements_size > 1) {
+			qsort(members, any->elements_size, sizeof(canonical_member), compare_canonical_members);
+		}
+		for (size_t i = 0; i < any->elements_size; i++) {
+			if (i != 0) canonical_put_char(writer, value_separator);
+			canonical_string(writer, members[i].key, members[i].key_length);
+			canonical_put_char(writer, name_separator);
+			kzrjson_any_write_canonical(writer, members[i].member->value);
+		}
+		free(members);
+		canonical_put_char(writer, end_object);
+		break;
+	}
+	case kzrjson_array:
+		canonical_put_char(writer, begin_array);
+		for (size_t i = 0; i < any->elements_size; i++) {
+			if (i != 0) canonical_put_char(writer, value_separator);
+			if (any->packed_type != kzrjson_packed_none) {
+				canonical_number(writer, value_to_double(packed_at(any, i)));
+			} else {
+				kzrjson_any_write_canonical(writer, *(any->elements + i));
+			}
+		}
+		canonical_put_char(writer, end_array);
+		break;
+	case kzrjson_member:
+		canonical_string(writer, any->key, any->key_length);
+		canonical_put_char(writer, name_separator);
+		kzrjson_any_write_canonical(writer, any->value);
+		break;
+	case kzrjson_string:
+		canonical_string(writer, any->string, strlen(any->string));
+		break;
+	case kzrjson_number:
+		switch (any->number_type) {
+		case kzrjson_int:
+			canonical_number(writer, (double)any->number_int);
+			break;
+		case kzrjson_uint:
+			canonical_number(writer, (double)any->number_uint);
+			break;
+		default:
+			canonical_number(writer, any->number_double);
+			break;
+		}
+		break;
+	case kzrjson_bool:
+	case kzrjson_null:
+		canonical_put(writer, any->string, strlen(any->string));
+		break;
+	}
+}
+
+typedef struct {
+	char *text;
+	size_t length;
+	size_t capacity;
+} growing_buffer;
+
+static bool write_growing_buffer(const char *data, const size_t length, void *context) {
+	growing_buffer *buffer = context;
+	if (buffer->length + length + 1 > buffer->capacity) {
+		size_t capacity = buffer->capacity == 0 ? 256 : buffer->capacity;
+		while (buffer->length + length + 1 > capacity) capacity *= 2;
+		char *text = realloc(buffer->text, capacity);
+		if (text == NULL) return false;
+		buffer->text = text;
+		buffer->capacity = capacity;
+	}
+	memcpy(buffer->text + buffer->length, data, length);
+	buffer->length += length;
+	buffer->text[buffer->length] = '\0';
+	return true;
+}
+
+/*****************************************************************************
+ * Intefaces
+ *****************************************************************************/
+void kzrjson_print(kzrjson_t any) {
+	kzrjson_set_success();
+	g_indent = 0;
+	kzrjson_any_print(any);
+	printf("\n");
+	g_indent = 0;
+}
+
+void kzrjson_free(kzrjson_t any) {
+	kzrjson_set_success();
+	if (any == NULL) return;
+	kzrjson_any_free(any);
+}
+
+/*
+ * Parse json_text into the document, or onto heap memory when doc is NULL.
+ */
+static kzrjson_result_t parse_result(struct kzrjson_doc *doc, const char *json_text, const unsigned options) {
+	kzrjson_set_success();
+	kzrjson_result_t result = {
+		.value = NULL,
+		.code = kzrjson_success,
+		.offset = 0,
+		.line = 0,
+		.column = 0,
+	};
+
+	struct scratch heap_scratch = {
+		.data = NULL,
+		.size = 0,
+		.capacity = 0,
+		.values = NULL,
+		.values_capacity = 0,
+	};
+	g_doc = doc;
+	g_options = options;
+	if (g_options & kzrjson_option_predict_keys) g_options |= kzrjson_option_share_shapes;
+	if (doc != NULL && (g_options & kzrjson_option_predict_keys)) g_predicted_shape = doc->root_shape;
+	g_scratch = doc != NULL ? &doc->scratch : &heap_scratch;
+	set_lexer(json_text);
+	kzrjson_t any = parse_json_text();
+	lexer.pos = NULL;
+	lexer.text = NULL;
+	g_doc = NULL;
+	g_scratch = NULL;
+	g_options = 0;
+	g_predicted_shape = NULL;
+	free(heap_scratch.data);
+	free(heap_scratch.values);
+
+	result.code = kzrjson_errno();
+	if (result.code != kzrjson_success) {
+		kzrjson_any_free(any);
+		result.offset = g_error_offset;
+		set_error_position(&result, json_text);
+		return result;
+	}
+	if (doc != NULL) {
+		doc->root_shape = any != NULL && any->type == kzrjson_object ? any->shape : NULL;
+	}
+	result.value = any;
+	return result;
+}
+
+kzrjson_t kzrjson_parse(const char *json_text) {
+	return kzrjson_parse_result(json_text).value;
+}
+
+kzrjson_result_t kzrjson_parse_result(const char *json_text) {
+	return parse_result(NULL, json_text, 0);
+}
+
+kzrjson_result_t kzrjson_parse_with_options(const char *json_text, const unsigned options) {
+	return parse_result(NULL, json_text, options);
+}
+
+kzrjson_doc_t kzrjson_doc_make(void) {
+	const kzrjson_allocator_t allocator = {
+		.allocate = default_allocate,
+		.deallocate = default_deallocate,
+		.context = NULL,
+	};
+	return kzrjson_doc_make_with_allocator(&allocator);
+}
+
+kzrjson_doc_t kzrjson_doc_make_with_allocator(const kzrjson_allocator_t *allocator) {
+	kzrjson_set_success();
+	kzrjson_doc_t doc = allocator->allocate(sizeof(struct kzrjson_doc), allocator->context);
+	if (doc == NULL) {
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return NULL;
+	}
+	memset(doc, 0, sizeof(struct kzrjson_doc));
+	doc->allocator = *allocator;
+	return doc;
+}
+
+kzrjson_t kzrjson_doc_parse(kzrjson_doc_t doc, const char *json_text) {
+	return kzrjson_doc_parse_result(doc, json_text).value;
+}
+
+kzrjson_result_t kzrjson_doc_parse_result(kzrjson_doc_t doc, const char *json_text) {
+	return parse_result(doc, json_text, 0);
+}
+
+kzrjson_result_t kzrjson_doc_parse_with_options(kzrjson_doc_t doc, const char *json_text, const unsigned options) {
+	return parse_result(doc, json_text, options);
+}
+
+void kzrjson_doc_reset(kzrjson_doc_t doc) {
+	kzrjson_set_success();
+	if (doc == NULL) return;
+	doc->scratch.size = 0;
+	doc_table_clear(&doc->keys);
+	doc_table_clear(&doc->shapes);
+	doc->root_shape = NULL;
+	if (doc->chunks == NULL) return;
+
+	// Merge chunks into one, so the next parse of the same size fits in it.
+	if (doc->chunks->next != NULL) {
+		size_t capacity = 0;
+		for (struct arena_chunk *chunk = doc->chunks; chunk != NULL; chunk = chunk->next) {
+			capacity += chunk->capacity;
+		}
+		free_arena_chunks(doc);
+		doc->chunks = make_arena_chunk(doc, capacity);
+		if (doc->chunks == NULL) {
+			set_kzrjson_errno(kzrjson_err_calloc);
+			return;
+		}
+	}
+	doc->chunks->used = 0;
+	doc->current = doc->chunks;
+	doc->compacted = NULL;
+}
+
+void kzrjson_doc_free(kzrjson_doc_t doc) {
+	kzrjson_set_success();
+	if (doc == NULL) return;
+	free_arena_chunks(doc);
+	doc_deallocate(doc, doc->scratch.data, doc->scratch.capacity * sizeof(kzrjson_t));
+	doc_deallocate(doc, doc->scratch.values, doc->scratch.values_capacity);
+	doc_deallocate(doc, doc->keys.slots, doc->keys.capacity * sizeof(struct doc_table_slot));
+	doc_deallocate(doc, doc->shapes.slots, doc->shapes.capacity * sizeof(struct doc_table_slot));
+	const kzrjson_allocator_t allocator = doc->allocator;
+	allocator.deallocate(doc, sizeof(struct kzrjson_doc), allocator.context);
+}
+
+/*
+ * Layout of kzrjson_compact. The same walk measures the block
+ * while block is NULL, and then copies the tree into it.
+ */
+struct compactor {
+	struct kzrjson_doc *doc;
+	char *block;
+	size_t used;
+};
+
+static void *compact_take(struct compactor *compactor, const size_t size, const size_t align) {
+	compactor->used = (compactor->used + align - 1) / align * align;
+	void *memory = compactor->block != NULL ? compactor->block + compactor->used : NULL;
+	compactor->used += size;
+	return memory;
+}
+
+static char *compact_string(struct compactor *compactor, const char *string, const size_t length) {
+	char *copy = compact_take(compactor, length + 1, 1);
+	if (copy != NULL) {
+		memcpy(copy, string, length);
+		copy[length] = '\0';
+	}
+	return copy;
+}
+
+/*
+ * Copy the tree depth-first: each node is followed by its elements array,
+ * index and strings, and then by its children.
+ * Shapes are not copied; an index of a shape is dropped with it.
+ */
+static kzrjson_t compact_node(struct compactor *compactor, kzrjson_t any) {
+	kzrjson_t node = compact_take(compactor, sizeof(*node), _Alignof(struct KZRJSON_NODE));
+	if (node != NULL) {
+		*node = *any;
+		node->shape = NULL;
+		node->index = NULL;
+		node->elements_capacity = any->elements_size;
+	}
+	switch (any->type) {
+	case kzrjson_array:
+	case kzrjson_object: {
+		if (any->elements_size == 0) {
+			if (node != NULL) node->elements = NULL;
+			break;
+		}
+		if (any->packed_type != kzrjson_packed_none) {
+			const size_t size = any->elements_size * packed_size(any->packed_type);
+			void *values = compact_take(compactor, size, _Alignof(uint64_t));
+			if (node != NULL) node->elements = memcpy(values, any->elements, size);
+			break;
+		}
+		kzrjson_t *elements = compact_take(compactor, any->elements_size * sizeof(kzrjson_t), _Alignof(kzrjson_t));
+		if (any->index != NULL && any->shape == NULL) {
+			const size_t size = sizeof(struct kzrjson_index) + (any->index->mask + 1) * sizeof(size_t);
+			struct kzrjson_index *index = compact_take(compactor, size, _Alignof(struct kzrjson_index));
+			if (node != NULL) node->index = memcpy(index, any->index, size);
+		}
+		if (node != NULL) node->elements = elements;
+		for (size_t i = 0; i < any->elements_size; i++) {
+			kzrjson_t element = compact_node(compactor, any->elements[i]);
+			if (node != NULL) elements[i] = element;
+		}
+		break;
+	}
+	case kzrjson_member: {
+		char *key = compact_string(compactor, any->key, any->key_length);
+		kzrjson_t value = compact_node(compactor, any->value);
+		if (node != NULL) {
+			node->key = key;
+			node->value = value;
+		}
+		break;
+	}
+	case kzrjson_string:
+	case kzrjson_number: {
+		char *string = compact_string(compactor, any->string, strlen(any->string));
+		if (node != NULL) node->string = string;
+		break;
+	}
+	case kzrjson_bool:
+	case kzrjson_null:
+		break; // string is a literal
+	}
+	return node;
+}
+
+size_t kzrjson_compact(kzrjson_doc_t doc, kzrjson_t *root) {
+	kzrjson_set_success();
+	if (doc == NULL || root == NULL || *root == NULL) return 0;
+	if ((*root)->doc != doc) {
+		set_kzrjson_errno(kzrjson_err_foreign_data);
+		return 0;
+	}
+	struct compactor compactor = {doc, NULL, 0};
+	compact_node(&compactor, *root);
+	struct arena_chunk *block = make_arena_chunk(doc, compactor.used);
+	if (block == NULL) {
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return 0;
+	}
+	compactor.block = (char *)block->data;
+	compactor.used = 0;
+	kzrjson_t compacted = compact_node(&compactor, *root);
+	block->used = block->capacity;
+
+	size_t before = 0;
+	for (struct arena_chunk *chunk = doc->chunks; chunk != NULL; chunk = chunk->next) {
+		before += sizeof(struct arena_chunk) + chunk->capacity;
+	}
+	free_arena_chunks(doc);
+	doc_table_clear(&doc->keys);
+	doc_table_clear(&doc->shapes);
+	doc->root_shape = NULL;
+	doc->chunks = block;
+	doc->current = block;
+	doc->compacted = block;
+	*root = compacted;
+
+	const size_t after = sizeof(struct arena_chunk) + block->capacity;
+	return before > after ? before - after : 0;
+}
+
+/*
+ * Find the member with the key in the object.
+ * Use the index if the object has it, otherwise compare lengths first.
+ *
+ * [exception] kzrjson_err_object_key_not_found
+ */
+static kzrjson_t find_member(kzrjson_t object, const char *key, const size_t length, const uint32_t hash) {
+	if (object->index != NULL) {
+		const size_t slot = index_find_slot(object, key, length, hash);
+		const size_t position = object->index->slots[slot];
+		if (position != 0) return object->elements[position - 1];
+	} else {
+		for (size_t i = 0; i < object->elements_size; i++) {
+			kzrjson_t member = object->elements[i];
+			if (member_key_equals(member, key, length)) return member;
+		}
+	}
+	set_kzrjson_errno(kzrjson_err_object_key_not_found);
+	return NULL;
+}
+
+kzrjson_t kzrjson_get_member(kzrjson_t object, const char *key) {
+	return kzrjson_get_member_n(object, key, strlen(key));
+}
+
+kzrjson_t kzrjson_get_member_n(kzrjson_t object, const char *key, const size_t length) {
+	kzrjson_set_success();
+	if (object->type != kzrjson_object) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return NULL;
+	}
+	const uint32_t hash = object->index != NULL ? kzrjson_hash_key(key, length) : 0;
+	return find_member(object, key, length, hash);
+}
+
+kzrjson_t kzrjson_get_member_hashed(kzrjson_t object, const char *key, const size_t length, const uint32_t hash) {
+	kzrjson_set_success();
+	if (object->type != kzrjson_object) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return NULL;
+	}
+	return find_member(object, key, length, hash);
+}
+
+/*
+ * Find the member with the key of the cache, and remember its position.
+ * A hit on an object of another shape is not trusted, since the index
+ * of the shape may find an earlier member with the same key.
+ *
+ * [no exception]
+ */
+static kzrjson_t find_member_cached(kzrjson_t object, kzrjson_lookup_cache_t *cache) {
+	if (cache->position != 0 && cache->position <= object->elements_size
+		&& (object->shape == NULL || object->shape == cache->shape)) {
+		kzrjson_t member = object->elements[cache->position - 1];
+		if (member_key_equals(member, cache->key, cache->length)) return member;
+	}
+	size_t position = 0;
+	if (object->index != NULL) {
+		position = object->index->slots[index_find_slot(object, cache->key, cache->length, cache->hash)];
+	} else {
+		for (size_t i = 0; i < object->elements_size; i++) {
+			if (member_key_equals(object->elements[i], cache->key, cache->length)) {
+				position = i + 1;
+				break;
+			}
+		}
+	}
+	if (position == 0) return NULL;
+	cache->shape = object->shape;
+	cache->position = position;
+	return object->elements[position - 1];
+}
+
+static void lookup_cache_init(kzrjson_lookup_cache_t *cache, const char *key) {
+	cache->key = key;
+	cache->length = strlen(key);
+	cache->hash = kzrjson_hash_key(key, cache->length);
+	cache->shape = NULL;
+	cache->position = 0;
+}
+
+kzrjson_t kzrjson_get_member_cached(kzrjson_t object, const char *key, kzrjson_lookup_cache_t *cache) {
+	if (!object || !key || !cache) return NULL;
+	kzrjson_set_success();
+	if (object->type != kzrjson_object) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return NULL;
+	}
+	if (cache->key != key) lookup_cache_init(cache, key);
+	kzrjson_t member = find_member_cached(object, cache);
+	if (member == NULL) set_kzrjson_errno(kzrjson_err_object_key_not_found);
+	return member;
+}
+
+bool kzrjson_object_make_index(kzrjson_t object) {
+	if (!object) return false;
+	kzrjson_set_success();
+	if (object->type != kzrjson_object) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return false;
+	}
+	if (object->shape != NULL) return true; // indexed by the shape
+	return index_build(object);
+}
+
+kzrjson_result_t kzrjson_get_member_result(kzrjson_t object, const char *key) {
+	kzrjson_result_t result = {
+		.value = kzrjson_get_member(object, key),
+		.code = kzrjson_errno(),
+		.offset = 0,
+		.line = 0,
+		.column = 0,
+	};
+	return result;
+}
+
+kzrjson_result_t kzrjson_get_value_result(kzrjson_t object, const char *key) {
+	kzrjson_result_t result = {
+		.value = kzrjson_get_value_from_key(object, key),
+		.code = kzrjson_errno(),
+		.offset = 0,
+		.line = 0,
+		.column = 0,
+	};
+	return result;
+}
+
+kzrjson_t kzrjson_get_value_from_key(kzrjson_t object, const char *key) {
+	kzrjson_set_success();
+	if (object->type != kzrjson_object) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return NULL;
+	}
+	kzrjson_t member = kzrjson_get_member(object, key);
+	if (kzrjson_errno() != kzrjson_success) {
+		return NULL;
+	}
+	return member->value;
+}
+
+kzrjson_t kzrjson_make_object(void) {
+	kzrjson_set_success();
+	kzrjson_t json = make_object();
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+	return json;
+}
+
+kzrjson_t kzrjson_make_array(void) {
+	kzrjson_set_success();
+	kzrjson_t json = make_array();
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+	return json;
+}
+
+/*
+ * Whether data is in the tree, or is the tree itself.
+ *
+ * [no exception]
+ */
+static bool tree_contains(kzrjson_t tree, kzrjson_t data) {
+	if (tree == data) return true;
+	switch (tree->type) {
+	case kzrjson_array:
+	case kzrjson_object:
+		if (tree->packed_type != kzrjson_packed_none) return false;
+		for (size_t i = 0; i < tree->elements_size; i++) {
+			if (tree_contains(tree->elements[i], data)) return true;
+		}
+		return false;
+	case kzrjson_member:
+		return tree_contains(tree->value, data);
+	default:
+		return false;
+	}
+}
+
+/*
+ * Check that the container has the type and the data can be stored in it:
+ * the data is in the same document, and does not have the container in it.
+ * A packed array is unpacked, so that its elements can be modified.
+ *
+ * [exception] kzrjson_err_illegal_type
+ * [exception] kzrjson_err_foreign_data
+ * [exception] kzrjson_err_calloc
+ */
+static bool can_store(kzrjson_t container, const kzrjson_type type, kzrjson_t data, const kzrjson_type data_type) {
+	if (container->type != type) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return false;
+	}
+	if (data == NULL) return unpack(container);
+	if (type == kzrjson_object && data->type != data_type) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return false;
+	}
+	if (data->doc != container->doc) {
+		set_kzrjson_errno(kzrjson_err_foreign_data);
+		return false;
+	}
+	// a container can not be stored in itself
+	if (tree_contains(data, container)) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return false;
+	}
+	return unpack(container);
+}
+
+bool kzrjson_object_add_member(kzrjson_t object, kzrjson_t member) {
+	if (!object || !member) return false;
+	kzrjson_set_success();
+	if (!can_store(object, kzrjson_object, member, kzrjson_member)) return false;
+	add_element(object, member);
+	return true;
+}
+
+bool kzrjson_array_add_element(kzrjson_t array, kzrjson_t element) {
+	if (!array || !element) return false;
+	kzrjson_set_success();
+	if (!can_store(array, kzrjson_array, element, element->type)) return false;
+	add_element(array, element);
+	return true;
+}
+
+bool kzrjson_array_append_many(kzrjson_t array, const kzrjson_t *elements, const size_t size) {
+	if (!array || (!elements && size > 0)) return false;
+	kzrjson_set_success();
+	if (array->type != kzrjson_array) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return false;
+	}
+	for (size_t i = 0; i < size; i++) {
+		if (elements[i] == NULL || tree_contains(elements[i], array)) {
+			set_kzrjson_errno(kzrjson_err_illegal_type);
+			return false;
+		}
+		if (elements[i]->doc != array->doc) {
+			set_kzrjson_errno(kzrjson_err_foreign_data);
+			return false;
+		}
+	}
+	if (!unpack(array)) return false;
+	if (!reserve_elements(array, array->elements_size + size)) return false;
+	if (size > 0) {
+		memcpy(array->elements + array->elements_size, elements, size * sizeof(kzrjson_t));
+	}
+	array->elements_size += size;
+	return true;
+}
+
+/*
+ * Find the index of the member with the key in the object.
+ *
+ * [exception] kzrjson_err_object_key_not_found
+ */
+static bool find_member_index(kzrjson_t object, const char *key, size_t *index) {
+	const size_t length = strlen(key);
+	const uint32_t hash = object->index != NULL ? kzrjson_hash_key(key, length) : 0;
+	kzrjson_t member = find_member(object, key, length, hash);
+	if (member == NULL) return false;
+	if (object->index != NULL) {
+		*index = object->index->slots[index_find_slot(object, key, length, hash)] - 1;
+		return true;
+	}
+	for (size_t i = 0; ; i++) {
+		if (object->elements[i] == member) {
+			*index = i;
+			return true;
+		}
+	}
+}
+
+bool kzrjson_array_insert_element(kzrjson_t array, const size_t index, kzrjson_t element) {
+	if (!array || !element) return false;
+	kzrjson_set_success();
+	if (!can_store(array, kzrjson_array, element, element->type)) return false;
+	if (index > array->elements_size) {
+		set_kzrjson_errno(kzrjson_err_index_out_of_range);
+		return false;
+	}
+	return insert_element(array, index, element);
+}
+
+kzrjson_t kzrjson_array_remove_element(kzrjson_t array, const size_t index) {
+	if (!array) return NULL;
+	kzrjson_set_success();
+	if (!can_store(array, kzrjson_array, NULL, kzrjson_null)) return NULL;
+	if (index >= array->elements_size) {
+		set_kzrjson_errno(kzrjson_err_index_out_of_range);
+		return NULL;
+	}
+	return remove_element(array, index);
+}
+
+kzrjson_t kzrjson_array_swap_remove_element(kzrjson_t array, const size_t index) {
+	if (!array) return NULL;
+	kzrjson_set_success();
+	if (!can_store(array, kzrjson_array, NULL, kzrjson_null)) return NULL;
+	if (index >= array->elements_size) {
+		set_kzrjson_errno(kzrjson_err_index_out_of_range);
+		return NULL;
+	}
+	return swap_remove_element(array, index);
+}
+
+kzrjson_t kzrjson_array_replace_element(kzrjson_t array, const size_t index, kzrjson_t element) {
+	if (!array || !element) return NULL;
+	kzrjson_set_success();
+	if (!can_store(array, kzrjson_array, element, element->type)) return NULL;
+	if (index >= array->elements_size) {
+		set_kzrjson_errno(kzrjson_err_index_out_of_range);
+		return NULL;
+	}
+	kzrjson_t old = array->elements[index];
+	array->elements[index] = element;
+	return old;
+}
+
+bool kzrjson_object_insert_member(kzrjson_t object, const size_t index, kzrjson_t member) {
+	if (!object || !member) return false;
+	kzrjson_set_success();
+	if (!can_store(object, kzrjson_object, member, kzrjson_member)) return false;
+	if (index > object->elements_size) {
+		set_kzrjson_errno(kzrjson_err_index_out_of_range);
+		return false;
+	}
+	return insert_element(object, index, member);
+}
+
+kzrjson_t kzrjson_object_remove_member(kzrjson_t object, const char *key) {
+	if (!object || !key) return NULL;
+	kzrjson_set_success();
+	if (!can_store(object, kzrjson_object, NULL, kzrjson_member)) return NULL;
+	size_t index;
+	if (!find_member_index(object, key, &index)) return NULL;
+	return remove_element(object, index);
+}
+
+kzrjson_t kzrjson_object_swap_remove_member(kzrjson_t object, const char *key) {
+	if (!object || !key) return NULL;
+	kzrjson_set_success();
+	if (!can_store(object, kzrjson_object, NULL, kzrjson_member)) return NULL;
+	size_t index;
+	if (!find_member_index(object, key, &index)) return NULL;
+	return swap_remove_element(object, index);
+}
+
+kzrjson_t kzrjson_object_replace_value(kzrjson_t object, const char *key, kzrjson_t value) {
+	if (!object || !key || !value) return NULL;
+	kzrjson_set_success();
+	if (!can_store(object, kzrjson_object, NULL, kzrjson_member)) return NULL;
+	if (value->type == kzrjson_member) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return NULL;
+	}
+	if (value->doc != object->doc) {
+		set_kzrjson_errno(kzrjson_err_foreign_data);
+		return NULL;
+	}
+	if (tree_contains(value, object)) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return NULL;
+	}
+	size_t index;
+	if (!find_member_index(object, key, &index)) return NULL;
+	kzrjson_t member = object->elements[index];
+	kzrjson_t old = member->value;
+	member->value = value;
+	return old;
+}
+
+bool kzrjson_move_element(kzrjson_t from, const size_t from_index, kzrjson_t to, const size_t to_index) {
+	if (!from || !to) return false;
+	kzrjson_set_success();
+	if (from->type != kzrjson_array && from->type != kzrjson_object) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return false;
+	}
+	if (from_index >= from->elements_size) {
+		set_kzrjson_errno(kzrjson_err_index_out_of_range);
+		return false;
+	}
+	if (!unpack(from)) return false;
+	kzrjson_t element = from->elements[from_index];
+	if (!can_store(to, from->type, element, element->type)) return false;
+	const size_t to_size = from == to ? to->elements_size - 1 : to->elements_size;
+	if (to_index > to_size) {
+		set_kzrjson_errno(kzrjson_err_index_out_of_range);
+		return false;
+	}
+	// allocate first, so that a failure leaves both containers unchanged
+	if (!shape_leave(to) || !reserve_elements(to, to->elements_size + 1)) return false;
+	remove_element(from, from_index);
+	return insert_element(to, to_index, element);
+}
+
+bool kzrjson_array_pack(kzrjson_t array) {
+	if (!array) return false;
+	kzrjson_set_success();
+	if (array->type != kzrjson_array) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return false;
+	}
+	if (array->packed_type != kzrjson_packed_none) return true;
+	const size_t size = array->elements_size;
+	const kzrjson_packed_type type = size == 0
+		? kzrjson_packed_int64 : packable_type(array->elements, size);
+	if (type == kzrjson_packed_none) {
+		set_kzrjson_errno(kzrjson_err_not_number);
+		return false;
+	}
+	void *values = NULL;
+	if (size > 0) {
+		values = allocate(array->doc, size * packed_size(type));
+		if (values == NULL) return false;
+		pack_values(array->elements, size, type, values);
+	}
+	for (size_t i = 0; i < size; i++) {
+		kzrjson_any_free(array->elements[i]);
+	}
+	release(array->doc, array->elements);
+	array->packed_type = type;
+	array->packed_int64 = values;
+	array->elements_capacity = size;
+	return true;
+}
+
+bool kzrjson_array_unpack(kzrjson_t array) {
+	if (!array) return false;
+	kzrjson_set_success();
+	if (array->type != kzrjson_array) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return false;
+	}
+	return unpack(array);
+}
+
+/*
+ * [exception] kzrjson_err_illegal_type
+ */
+static bool is_packed_as(kzrjson_t array, const kzrjson_packed_type type) {
+	if (array->type != kzrjson_array || array->packed_type != type) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return false;
+	}
+	return true;
+}
+
+bool kzrjson_array_as_int64(kzrjson_t array, const int64_t **values, size_t *size) {
+	if (!array || !values || !size) return false;
+	kzrjson_set_success();
+	if (!is_packed_as(array, kzrjson_packed_int64)) return false;
+	*values = array->packed_int64;
+	*size = array->elements_size;
+	return true;
+}
+
+bool kzrjson_array_as_uint64(kzrjson_t array, const uint64_t **values, size_t *size) {
+	if (!array || !values || !size) return false;
+	kzrjson_set_success();
+	if (!is_packed_as(array, kzrjson_packed_uint64)) return false;
+	*values = array->packed_uint64;
+	*size = array->elements_size;
+	return true;
+}
+
+bool kzrjson_array_as_double(kzrjson_t array, const double **values, size_t *size) {
+	if (!array || !values || !size) return false;
+	kzrjson_set_success();
+	if (!is_packed_as(array, kzrjson_packed_double)) return false;
+	*values = array->packed_double;
+	*size = array->elements_size;
+	return true;
+}
+
+/*
+ * Value of the element at the index of an array, packed or not.
+ *
+ * [exception] kzrjson_err_illegal_type
+ * [exception] kzrjson_err_index_out_of_range
+ * [exception] kzrjson_err_not_number
+ */
+static bool array_value_at(kzrjson_t array, const size_t index, packed_value *value) {
+	if (array->type != kzrjson_array) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return false;
+	}
+	if (index >= array->elements_size) {
+		set_kzrjson_errno(kzrjson_err_index_out_of_range);
+		return false;
+	}
+	if (array->packed_type != kzrjson_packed_none) {
+		*value = packed_at(array, index);
+		return true;
+	}
+	kzrjson_t element = array->elements[index];
+	if (element->type != kzrjson_number) {
+		set_kzrjson_errno(kzrjson_err_not_number);
+		return false;
+	}
+	*value = number_value(element);
+	if (value->type == kzrjson_packed_none) {
+		// out of range of the integer types, or not finite
+		value->type = kzrjson_packed_double;
+		value->number = element->number_double;
+		if (element->number_type == kzrjson_int) value->number = (double)element->number_int;
+		if (element->number_type == kzrjson_uint) value->number = (double)element->number_uint;
+	}
+	return true;
+}
+
+double kzrjson_array_get_double(kzrjson_t array, const size_t index) {
+	if (!array) return 0;
+	kzrjson_set_success();
+	packed_value value;
+	if (!array_value_at(array, index, &value)) return 0;
+	return value_to_double(value);
+}
+
+int64_t kzrjson_array_get_int64(kzrjson_t array, const size_t index) {
+	if (!array) return 0;
+	kzrjson_set_success();
+	packed_value value;
+	if (!array_value_at(array, index, &value)) return 0;
+	int64_t number;
+	if (!value_to_int64(value, &number)) {
+		set_kzrjson_errno(kzrjson_err_not_number);
+		return 0;
+	}
+	return number;
+}
+
+uint64_t kzrjson_array_get_uint64(kzrjson_t array, const size_t index) {
+	if (!array) return 0;
+	kzrjson_set_success();
+	packed_value value;
+	if (!array_value_at(array, index, &value)) return 0;
+	uint64_t number;
+	if (!value_to_uint64(value, &number)) {
+		set_kzrjson_errno(kzrjson_err_not_number);
+		return 0;
+	}
+	return number;
+}
+
+kzrjson_t kzrjson_make_member(const char *key, const size_t key_length, kzrjson_t value) {
+	kzrjson_set_success();
+
+	char *buffer = copy_string(key, key_length);
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+
+	kzrjson_t member = make_member(buffer, key_length);
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+
+	add_value(member, value);
+	return member;
+}
+
+kzrjson_t kzrjson_make_string(const char *string, const size_t length) {
+	kzrjson_set_success();
+
+	char *buffer = copy_string(string, length);
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+
+	kzrjson_t json = make_string(buffer);
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+
+	return json;
+}
+
+kzrjson_t kzrjson_make_boolean(const bool boolean) {
+	kzrjson_set_success();
+	kzrjson_t json = make_boolean(boolean);
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+	return json;
+}
+
+kzrjson_t kzrjson_make_null(void) {
+	kzrjson_set_success();
+	kzrjson_t json = make_null();
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+	return json;
+}
+
+kzrjson_t kzrjson_make_number_double(const double number) {
+	kzrjson_set_success();
+	static const size_t double_max_digit = 16;
+	char *buffer = calloc(double_max_digit + 1, sizeof(char));
+	if (buffer == NULL) {
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return NULL;
+	}
+	snprintf(buffer, double_max_digit + 1, "%lf", number);
+	kzrjson_t json = make_number(buffer, kzrjson_double);
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+	return json;
+}
+
+kzrjson_t kzrjson_make_number_uint(const uint64_t number) {
+	kzrjson_set_success();
+	static const size_t uint64_max_digit = 20;
+	char *buffer = calloc(uint64_max_digit + 1, sizeof(char));
+	if (buffer == NULL) {
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return NULL;
+	}
+	snprintf(buffer, uint64_max_digit + 1, "%llu", number);
+	kzrjson_t json = make_number(buffer, kzrjson_uint);
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+	return json;
+}
+
+kzrjson_t kzrjson_make_number_int(const int64_t number) {
+	kzrjson_set_success();
+	static const size_t int64_t_max_digit = 19;
+	char *buffer = calloc(int64_t_max_digit + 1, sizeof(char));
+	if (buffer == NULL) {
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return NULL;
+	}
+	snprintf(buffer, int64_t_max_digit + 1, "%lld", number);
+	kzrjson_t json = make_number(buffer, kzrjson_int);
+	if (kzrjson_errno() != kzrjson_success) return NULL;
+	return json;
+}
+
+kzrjson_t kzrjson_make_number_exp(const char *exp, const size_t length) {
+	kzrjson_set_success();
+
+	char *end;
+	(void) strtod(exp, &end);
+	if (exp == end) {
+		set_kzrjson_errno(kzrjson_err_not_number);
+		return NULL;
+	}
+
+	char *buffer = copy_string(exp, length);
+	if (kzrjson_errno() != kzrjson_success) {
+		return NULL;
+	}
+	kzrjson_t json = make_number(buffer, kzrjson_exp);
+	if (kzrjson_errno() != kzrjson_success) {
+		return NULL;
+	}
+	return json;
+}
+
+/*
+ * Make a packed array of a copy of the values.
+ *
+ * [exception] kzrjson_err_calloc
+ */
+static kzrjson_t make_packed_array(const void *values, const size_t size, const kzrjson_packed_type type) {
+	kzrjson_t array = make_array();
+	if (array == NULL) return NULL;
+	if (size > 0) {
+		void *buffer = allocate(g_doc, size * packed_size(type));
+		if (buffer == NULL) {
+			kzrjson_any_free(array);
+			return NULL;
+		}
+		memcpy(buffer, values, size * packed_size(type));
+		array->packed_int64 = buffer;
+	}
+	array->packed_type = type;
+	array->elements_size = size;
+	array->elements_capacity = size;
+	return array;
+}
+
+kzrjson_t kzrjson_make_array_int64(const int64_t *values, const size_t size) {
+	kzrjson_set_success();
+	if (!values && size > 0) return NULL;
+	return make_packed_array(values, size, kzrjson_packed_int64);
+}
+
+kzrjson_t kzrjson_make_array_uint64(const uint64_t *values, const size_t size) {
+	kzrjson_set_success();
+	if (!values && size > 0) return NULL;
+	return make_packed_array(values, size, kzrjson_packed_uint64);
+}
+
+kzrjson_t kzrjson_make_array_double(const double *values, const size_t size) {
+	kzrjson_set_success();
+	if (!values && size > 0) return NULL;
+	for (size_t i = 0; i < size; i++) {
+		if (!isfinite(values[i])) {
+			set_kzrjson_errno(kzrjson_err_not_number);
+			return NULL;
+		}
+	}
+	return make_packed_array(values, size, kzrjson_packed_double);
+}
+
+kzrjson_t kzrjson_make_array_strings(const char *const *strings, const size_t *lengths, const size_t size) {
+	kzrjson_set_success();
+	if (!strings && size > 0) return NULL;
+	kzrjson_t array = make_array();
+	if (array == NULL) return NULL;
+	if (size > 0) {
+		array->elements = allocate(g_doc, size * sizeof(kzrjson_t));
+		if (array->elements == NULL) goto throw_exp;
+		array->elements_capacity = size;
+	}
+	for (size_t i = 0; i < size; i++) {
+		const size_t length = lengths != NULL ? lengths[i] : strlen(strings[i]);
+		char *buffer = copy_string(strings[i], length);
+		if (buffer == NULL) goto throw_exp;
+		kzrjson_t string = make_string(buffer);
+		if (string == NULL) {
+			release(g_doc, buffer);
+			goto throw_exp;
+		}
+		array->elements[array->elements_size++] = string;
+	}
+	return array;
+
+throw_exp:
+	kzrjson_any_free(array);
+	return NULL;
+}
+
+kzrjson_text_t kzrjson_to_string(kzrjson_t data) {
+	kzrjson_set_success();
+	g_converter.length = 0;
+
+	kzrjson_text_t json;
+	json.length = kzrjson_any_length(data);
+	g_converter.begin = calloc(g_converter.length + 1, sizeof(char));
+	if (g_converter.begin == NULL) {
+		set_kzrjson_errno(kzrjson_err_calloc);
+		kzrjson_text_t fail = {
+			.text = NULL, 
+			.length = 0
+		};
+		return fail;
+	}
+	g_converter.pos = g_converter.begin;
+	kzrjson_any_to_string(data);
+	json.text = g_converter.begin;
+
+	g_converter.begin = NULL;
+	g_converter.length = 0;
+
+	return json;
+}
+
+bool kzrjson_write_canonical(kzrjson_t data, const kzrjson_sink_t sink) {
+	kzrjson_set_success();
+	canonical_writer *writer = calloc(1, sizeof(canonical_writer));
+	if (writer == NULL) {
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return false;
+	}
+	writer->sink = sink;
+	writer->error = kzrjson_success;
+	kzrjson_any_write_canonical(writer, data);
+	canonical_flush(writer);
+	const kzrjson_errno_t error = writer->error;
+	free(writer);
+	if (error != kzrjson_success) {
+		set_kzrjson_errno(error);
+		return false;
+	}
+	return true;
+}
+
+kzrjson_text_t kzrjson_to_string_canonical(kzrjson_t data) {
+	growing_buffer buffer = {NULL, 0, 0};
+	const kzrjson_sink_t sink = {write_growing_buffer, &buffer};
+	kzrjson_text_t json = {NULL, 0};
+	if (!kzrjson_write_canonical(data, sink)) {
+		free(buffer.text);
+		// the buffer could not grow
+		if (kzrjson_errno() == kzrjson_err_sink) {
+			kzrjson_set_success();
+			set_kzrjson_errno(kzrjson_err_calloc);
+		}
+		return json;
+	}
+	if (buffer.text == NULL) return json;
+	json.text = buffer.text;
+	json.length = buffer.length;
+	return json;
+}
+
+/*****************************************************************************
+ * Reader
+ *****************************************************************************/
+/*
+ * What the reader expects next.
+ */
+enum {
+	reader_expect_value = 0,
+	reader_expect_first_value, // value or end-array
+	reader_expect_first_key,   // key or end-object
+	reader_expect_key,
+	reader_expect_name_separator,
+	reader_expect_separator,   // value-separator, end-array or end-object
+	reader_expect_end_of_text,
+};
+
+static bool is_white_space(const char c) {
+	return c == ' ' || c == 0x09 || c == 0x0A || c == 0x0D;
+}
+
+static bool is_digit(const char c) {
+	return c >= '0' && c <= '9';
+}
+
+static bool is_hex_digit(const char c) {
+	return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static bool reader_in_object(const kzrjson_reader_t *reader) {
+	const size_t level = reader->depth - 1;
+	return (reader->stack[level / 8] >> (level % 8)) & 1;
+}
+
+static kzrjson_event_type reader_error(kzrjson_reader_t *reader, const kzrjson_errno_t error, const size_t pos) {
+	reader->error = error;
+	reader->pos = pos;
+	return kzrjson_event_error;
+}
+
+/*
+ * The text ended at pos before the token was complete.
+ */
+static kzrjson_event_type reader_end(kzrjson_reader_t *reader, const kzrjson_errno_t error, const size_t pos) {
+	if (!reader->final) return kzrjson_event_need_more;
+	return reader_error(reader, error, pos);
+}
+
+/*
+ * [no exception]
+ */
+static kzrjson_event_type reader_push(kzrjson_reader_t *reader, const bool object, const size_t pos) {
+	if (reader->depth == KZRJSON_READER_MAX_DEPTH) {
+		return reader_error(reader, kzrjson_err_too_deep, pos);
+	}
+	const size_t level = reader->depth++;
+	if (object) {
+		reader->stack[level / 8] |= (uint8_t)(1u << (level % 8));
+	} else {
+		reader->stack[level / 8] &= (uint8_t)~(1u << (level % 8));
+	}
+	reader->state = object ? reader_expect_first_key : reader_expect_first_value;
+	reader->pos = pos + 1;
+	return object ? kzrjson_event_begin_object : kzrjson_event_begin_array;
+}
+
+static kzrjson_event_type reader_pop(kzrjson_reader_t *reader, const size_t pos) {
+	const bool object = reader_in_object(reader);
+	reader->depth--;
+	reader->state = reader->depth == 0 ? reader_expect_end_of_text : reader_expect_separator;
+	reader->pos = pos + 1;
+	return object ? kzrjson_event_end_object : kzrjson_event_end_array;
+}
+
+/*
+ * Scan a string beginning with quotation-mark at pos.
+ * Set the token to the characters between quotation-marks.
+ */
+static kzrjson_event_type reader_string(kzrjson_reader_t *reader, size_t pos, const kzrjson_event_type event) {
+	const char *text = reader->text;
+	const size_t begin = ++pos;
+	for (;;) {
+		if (pos >= reader->length) return reader_end(reader, kzrjson_err_tokenize, pos);
+		const unsigned char c = (unsigned char)text[pos];
+		if (c == quotation_mark) break;
+		if (c < 0x20) return reader_error(reader, kzrjson_err_tokenize, pos);
+		if (c == escape) {
+			pos++;
+			if (pos >= reader->length) return reader_end(reader, kzrjson_err_tokenize, pos);
+			switch (text[pos]) {
+			case 0x22: case 0x5C: case 0x2F: case 0x62:
+			case 0x66: case 0x6E: case 0x72: case 0x74:
+				break;
+			case 0x75:
+				for (int i = 0; i < 4; i++) {
+					pos++;
+					if (pos >= reader->length) return reader_end(reader, kzrjson_err_tokenize, pos);
+					if (!is_hex_digit(text[pos])) return reader_error(reader, kzrjson_err_tokenize, pos);
+				}
+				break;
+			default:
+				return reader_error(reader, kzrjson_err_tokenize, pos);
+			}
+		}
+		pos++;
+	}
+	reader->token = text + begin;
+	reader->token_length = pos - begin;
+	reader->pos = pos + 1;
+	return event;
+}
+
+/*
+ * number = [ minus ] int [ frac ] [ exp ]
+ */
+static kzrjson_event_type reader_number(kzrjson_reader_t *reader, size_t pos) {
+	const char *text = reader->text;
+	const size_t length = reader->length;
+	const size_t begin = pos;
+	kzrjson_number_type type = kzrjson_uint;
+	if (text[pos] == minus) {
+		type = kzrjson_int;
+		pos++;
+	}
+	// int = zero / ( digit1-9 *DIGIT )
+	if (pos >= length) return reader_end(reader, kzrjson_err_tokenize, pos);
+	if (!is_digit(text[pos])) return reader_error(reader, kzrjson_err_tokenize, pos);
+	if (text[pos] == zero) {
+		pos++;
+	} else {
+		while (pos < length && is_digit(text[pos])) pos++;
+	}
+	// frac = decimal-point 1*DIGIT
+	if (pos < length && text[pos] == decimal_point) {
+		type = kzrjson_double;
+		pos++;
+		if (pos >= length) return reader_end(reader, kzrjson_err_tokenize, pos);
+		if (!is_digit(text[pos])) return reader_error(reader, kzrjson_err_tokenize, pos);
+		while (pos < length && is_digit(text[pos])) pos++;
+	}
+	// exp = e [ minus / plus ] 1*DIGIT
+	if (pos < length && (text[pos] == 'e' || text[pos] == 'E')) {
+		type = kzrjson_exp;
+		pos++;
+		if (pos < length && (text[pos] == minus || text[pos] == plus)) pos++;
+		if (pos >= length) return reader_end(reader, kzrjson_err_tokenize, pos);
+		if (!is_digit(text[pos])) return reader_error(reader, kzrjson_err_tokenize, pos);
+		while (pos < length && is_digit(text[pos])) pos++;
+	}
+	// more digits may follow in the next text
+	if (pos >= length && !reader->final) return kzrjson_event_need_more;
+	reader->token = text + begin;
+	reader->token_length = pos - begin;
+	reader->number_type = type;
+	reader->pos = pos;
+	return kzrjson_event_number;
+}
+
+static kzrjson_event_type reader_literal(kzrjson_reader_t *reader, const size_t pos,
+	const char *literal, const kzrjson_event_type event)
+{
+	const size_t length = strlen(literal);
+	const size_t rest = reader->length - pos;
+	if (rest < length) {
+		if (memcmp(reader->text + pos, literal, rest) == 0) {
+			return reader_end(reader, kzrjson_err_tokenize, pos);
+		}
+		return reader_error(reader, kzrjson_err_tokenize, pos);
+	}
+	if (memcmp(reader->text + pos, literal, length) != 0) {
+		return reader_error(reader, kzrjson_err_tokenize, pos);
+	}
+	reader->token = reader->text + pos;
+	reader->token_length = length;
+	reader->pos = pos + length;
+	return event;
+}
+
+/*
+ * value = false / null / true / string / object / array / number
+ */
+static kzrjson_event_type reader_value(kzrjson_reader_t *reader, const size_t pos) {
+	if (pos >= reader->length) return reader_end(reader, kzrjson_err_parse, pos);
+	reader->state = reader->depth == 0 ? reader_expect_end_of_text : reader_expect_separator;
+	switch (reader->text[pos]) {
+	case '{':
+		return reader_push(reader, true, pos);
+	case '[':
+		return reader_push(reader, false, pos);
+	case '"':
+		return reader_string(reader, pos, kzrjson_event_string);
+	case 't':
+		return reader_literal(reader, pos, literal_true, kzrjson_event_true);
+	case 'f':
+		return reader_literal(reader, pos, literal_false, kzrjson_event_false);
+	case 'n':
+		return reader_literal(reader, pos, literal_null, kzrjson_event_null);
+	default:
+		return reader_number(reader, pos);
+	}
+}
+
+static kzrjson_event_type reader_key(kzrjson_reader_t *reader, const size_t pos) {
+	if (pos >= reader->length) return reader_end(reader, kzrjson_err_parse, pos);
+	if (reader->text[pos] != quotation_mark) return reader_error(reader, kzrjson_err_parse, pos);
+	reader->state = reader_expect_name_separator;
+	return reader_string(reader, pos, kzrjson_event_key);
+}
+
+void kzrjson_reader_init(kzrjson_reader_t *reader, const char *json_text, const size_t length) {
+	memset(reader, 0, sizeof(kzrjson_reader_t));
+	reader->text = json_text;
+	reader->length = length;
+	reader->state = reader_expect_value;
+	reader->error = kzrjson_success;
+	reader->final = true;
+}
+
+void kzrjson_reader_init_stream(kzrjson_reader_t *reader) {
+	kzrjson_reader_init(reader, NULL, 0);
+	reader->final = false;
+}
+
+void kzrjson_reader_feed(kzrjson_reader_t *reader, const char *json_text, const size_t length, const bool final) {
+	reader->offset += reader->pos;
+	reader->text = json_text;
+	reader->length = length;
+	reader->pos = 0;
+	reader->final = final;
+}
+
+static kzrjson_event_type reader_next(kzrjson_reader_t *reader) {
+	const char *text = reader->text;
+	const size_t length = reader->length;
+	size_t pos = reader->pos;
+	while (pos < length && is_white_space(text[pos])) pos++;
+
+	switch (reader->state) {
+	case reader_expect_value:
+		return reader_value(reader, pos);
+	case reader_expect_first_value:
+		if (pos < length && text[pos] == end_array) return reader_pop(reader, pos);
+		return reader_value(reader, pos);
+	case reader_expect_first_key:
+		if (pos < length && text[pos] == end_object) return reader_pop(reader, pos);
+		return reader_key(reader, pos);
+	case reader_expect_key:
+		return reader_key(reader, pos);
+	case reader_expect_name_separator:
+		if (pos >= length) return reader_end(reader, kzrjson_err_parse, pos);
+		if (text[pos] != name_separator) return reader_error(reader, kzrjson_err_parse, pos);
+		pos++;
+		while (pos < length && is_white_space(text[pos])) pos++;
+		return reader_value(reader, pos);
+	case reader_expect_separator: {
+		if (pos >= length) return reader_end(reader, kzrjson_err_parse, pos);
+		const bool object = reader_in_object(reader);
+		if (text[pos] == (object ? end_object : end_array)) return reader_pop(reader, pos);
+		if (text[pos] != value_separator) return reader_error(reader, kzrjson_err_parse, pos);
+		pos++;
+		while (pos < length && is_white_space(text[pos])) pos++;
+		return object ? reader_key(reader, pos) : reader_value(reader, pos);
+	}
+	case reader_expect_end_of_text:
+	default:
+		if (pos < length) return reader_error(reader, kzrjson_err_parse, pos);
+		reader->pos = pos;
+		if (!reader->final) return kzrjson_event_need_more;
+		return kzrjson_event_end_of_text;
+	}
+}
+
+kzrjson_event_type kzrjson_reader_next(kzrjson_reader_t *reader) {
+	if (reader->error != kzrjson_success) return kzrjson_event_error;
+	// the token is read again with the next text
+	const int state = reader->state;
+	const kzrjson_event_type event = reader_next(reader);
+	if (event == kzrjson_event_need_more) reader->state = state;
+	return event;
+}
+
+bool kzrjson_reader_skip(kzrjson_reader_t *reader, const kzrjson_event_type event) {
+	if (event == kzrjson_event_error) return false;
+	if (event != kzrjson_event_begin_object && event != kzrjson_event_begin_array) return true;
+	const size_t depth = reader->depth - 1;
+	while (reader->depth != depth) {
+		const kzrjson_event_type next = kzrjson_reader_next(reader);
+		if (next == kzrjson_event_error || next == kzrjson_event_need_more) return false;
+	}
+	return true;
+}
+
+/*
+ * Append the code point to out as UTF-8, and return the number of bytes.
+ */
+static size_t put_utf8(char *out, const uint32_t code_point) {
+	if (code_point < 0x80) {
+		out[0] = (char)code_point;
+		return 1;
+	} else if (code_point < 0x800) {
+		out[0] = (char)(0xC0 | (code_point >> 6));
+		out[1] = (char)(0x80 | (code_point & 0x3F));
+		return 2;
+	} else if (code_point < 0x10000) {
+		out[0] = (char)(0xE0 | (code_point >> 12));
+		out[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+		out[2] = (char)(0x80 | (code_point & 0x3F));
+		return 3;
+	}
+	out[0] = (char)(0xF0 | (code_point >> 18));
+	out[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+	out[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+	out[3] = (char)(0x80 | (code_point & 0x3F));
+	return 4;
+}
+
+static uint32_t read_hex4(const char *hex) {
+	uint32_t value = 0;
+	for (int i = 0; i < 4; i++) {
+		const char c = hex[i];
+		value <<= 4;
+		if (is_digit(c)) {
+			value |= (uint32_t)(c - '0');
+		} else if (c >= 'a' && c <= 'f') {
+			value |= (uint32_t)(c - 'a' + 10);
+		} else {
+			value |= (uint32_t)(c - 'A' + 10);
+		}
+	}
+	return value;
+}
+
+size_t kzrjson_unescape(const char *string, const size_t length, char *out) {
+	size_t o = 0;
+	for (size_t i = 0; i < length; i++) {
+		if (string[i] != escape || i + 1 >= length) {
+			out[o++] = string[i];
+			continue;
+		}
+		const char c = string[++i];
+		switch (c) {
+		case 0x62: out[o++] = 0x08; break;
+		case 0x66: out[o++] = 0x0C; break;
+		case 0x6E: out[o++] = 0x0A; break;
+		case 0x72: out[o++] = 0x0D; break;
+		case 0x74: out[o++] = 0x09; break;
+		case 0x75: {
+			if (i + 4 >= length) {
+				out[o++] = c;
+				break;
+			}
+			uint32_t code_point = read_hex4(string + i + 1);
+			i += 4;
+			// surrogate pair
+			if (code_point >= 0xD800 && code_point <= 0xDBFF && i + 6 < length
+				&& string[i + 1] == escape && string[i + 2] == 0x75)
+			{
+				const uint32_t low = read_hex4(string + i + 3);
+				if (low >= 0xDC00 && low <= 0xDFFF) {
+					code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+					i += 6;
+				}
+			}
+			o += put_utf8(out + o, code_point);
+			break;
+		}
+		default:
+			out[o++] = c;
+			break;
+		}
+	}
+	return o;
+}
+
+/*****************************************************************************
+ * Validate
+ *****************************************************************************/
+static const uint64_t ones = 0x0101010101010101ull;
+static const uint64_t highs = 0x8080808080808080ull;
+
+/*
+ * True if any of 8 bytes is quotation-mark, escape, a control character
+ * or not ASCII. It may be true for a byte next to such a byte.
+ */
+static bool has_special_byte(const uint64_t x) {
+	const uint64_t quote = x ^ (ones * 0x22);
+	const uint64_t backslash = x ^ (ones * 0x5C);
+	const uint64_t found = ((quote - ones) & ~quote)
+		| ((backslash - ones) & ~backslash)
+		| ((x - ones * 0x20) & ~x)
+		| x;
+	return (found & highs) != 0;
+}
+
+/*
+ * Check a UTF-8 sequence beginning with a byte 0x80 or more (RFC 3629).
+ * Overlong forms, surrogates and code points over U+10FFFF are errors.
+ */
+static bool validate_utf8(const unsigned char **pos, const unsigned char *end) {
+	const unsigned char *p = *pos;
+	const unsigned char c = *p;
+	unsigned char low = 0x80;
+	unsigned char high = 0xBF;
+	size_t length;
+	if (c >= 0xC2 && c <= 0xDF) {
+		length = 2;
+	} else if (c >= 0xE0 && c <= 0xEF) {
+		length = 3;
+		if (c == 0xE0) low = 0xA0;
+		if (c == 0xED) high = 0x9F;
+	} else if (c >= 0xF0 && c <= 0xF4) {
+		length = 4;
+		if (c == 0xF0) low = 0x90;
+		if (c == 0xF4) high = 0x8F;
+	} else {
+		return false;
+	}
+	if ((size_t)(end - p) < length) return false;
+	if (p[1] < low || p[1] > high) return false;
+	for (size_t i = 2; i < length; i++) {
+		if ((p[i] & 0xC0) != 0x80) return false;
+	}
+	*pos = p + length;
+	return true;
+}
+
+/*
+ * *pos is next to the opening quotation-mark.
+ * On success, *pos is next to the closing quotation-mark,
+ * otherwise it is the position of the error.
+ */
+static bool validate_string(const unsigned char **pos, const unsigned char *end) {
+	const unsigned char *p = *pos;
+	for (;;) {
+		// 8 bytes at once while there is nothing to look into
+		while (end - p >= 8) {
+			uint64_t x;
+			memcpy(&x, p, sizeof(x));
+			if (has_special_byte(x)) break;
+			p += 8;
+		}
+		if (p >= end) break;
+		const unsigned char c = *p;
+		if (c == quotation_mark) {
+			*pos = p + 1;
+			return true;
+		} else if (c == escape) {
+			p++;
+			if (p >= end) break;
+			switch (*p) {
+			case 0x22: case 0x5C: case 0x2F: case 0x62:
+			case 0x66: case 0x6E: case 0x72: case 0x74:
+				p++;
+				break;
+			case 0x75:
+				if (end - p < 5 || !is_hex_digit(p[1]) || !is_hex_digit(p[2])
+					|| !is_hex_digit(p[3]) || !is_hex_digit(p[4]))
+				{
+					*pos = p;
+					return false;
+				}
+				p += 5;
+				break;
+			default:
+				*pos = p;
+				return false;
+			}
+		} else if (c < 0x20) {
+			break;
+		} else if (c < 0x80) {
+			p++;
+		} else if (!validate_utf8(&p, end)) {
+			break;
+		}
+	}
+	*pos = p;
+	return false;
+}
+
+/*
+ * number = [ minus ] int [ frac ] [ exp ]
+ */
+static bool validate_number(const unsigned char **pos, const unsigned char *end) {
+	const unsigned char *p = *pos;
+	bool valid = false;
+	if (*p == minus) p++;
+	if (p >= end || !is_digit(*p)) goto finally;
+	if (*p == zero) {
+		p++;
+	} else {
+		while (p < end && is_digit(*p)) p++;
+	}
+	if (p < end && *p == decimal_point) {
+		p++;
+		if (p >= end || !is_digit(*p)) goto finally;
+		while (p < end && is_digit(*p)) p++;
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		if (p < end && (*p == minus || *p == plus)) p++;
+		if (p >= end || !is_digit(*p)) goto finally;
+		while (p < end && is_digit(*p)) p++;
+	}
+	valid = true;
+
+finally:
+	*pos = p;
+	return valid;
+}
+
+static bool validate_literal(const unsigned char **pos, const unsigned char *end, const char *literal) {
+	const size_t length = strlen(literal);
+	if ((size_t)(end - *pos) < length || memcmp(*pos, literal, length) != 0) return false;
+	*pos += length;
+	return true;
+}
+
+bool kzrjson_validate(const char *json_text, const size_t length, kzrjson_result_t *err) {
+	kzrjson_set_success();
+	const unsigned char *p = (const unsigned char *)json_text;
+	const unsigned char *const end = p + length;
+	// a bit per level, 1 for object
+	uint8_t stack[KZRJSON_READER_MAX_DEPTH / 8];
+	size_t depth = 0;
+	kzrjson_errno_t error = kzrjson_err_parse;
+
+value:
+	while (p < end && is_white_space(*p)) p++;
+	if (p >= end) goto throw_exp;
+	switch (*p) {
+	case '{':
+	case '[': {
+		const bool object = *p == begin_object;
+		if (depth == KZRJSON_READER_MAX_DEPTH) {
+			error = kzrjson_err_too_deep;
+			goto throw_exp;
+		}
+		if (object) {
+			stack[depth / 8] |= (uint8_t)(1u << (depth % 8));
+		} else {
+			stack[depth / 8] &= (uint8_t)~(1u << (depth % 8));
+		}
+		depth++;
+		p++;
+		while (p < end && is_white_space(*p)) p++;
+		if (p < end && *p == (object ? end_object : end_array)) {
+			depth--;
+			p++;
+			goto separator;
+		}
+		if (object) goto key;
+		goto value;
+	}
+	case '"':
+		p++;
+		if (!validate_string(&p, end)) {
+			error = kzrjson_err_tokenize;
+			goto throw_exp;
+		}
+		goto separator;
+	case 't':
+	case 'f':
+	case 'n': {
+		const char *literal = *p == 't' ? literal_true : *p == 'f' ? literal_false : literal_null;
+		if (!validate_literal(&p, end, literal)) {
+			error = kzrjson_err_tokenize;
+			goto throw_exp;
+		}
+		goto separator;
+	}
+	default:
+		if (!validate_number(&p, end)) {
+			error = kzrjson_err_tokenize;
+			goto throw_exp;
+		}
+		goto separator;
+	}
+
+key:
+	if (p >= end || *p != quotation_mark) goto throw_exp;
+	p++;
+	if (!validate_string(&p, end)) {
+		error = kzrjson_err_tokenize;
+		goto throw_exp;
+	}
+	while (p < end && is_white_space(*p)) p++;
+	if (p >= end || *p != name_separator) goto throw_exp;
+	p++;
+	goto value;
+
+separator:
+	while (p < end && is_white_space(*p)) p++;
+	if (depth == 0) {
+		if (p != end) goto throw_exp;
+		if (err != NULL) {
+			memset(err, 0, sizeof(kzrjson_result_t));
+			err->code = kzrjson_success;
+		}
+		return true;
+	}
+	if (p >= end) goto throw_exp;
+	{
+		const bool object = (stack[(depth - 1) / 8] >> ((depth - 1) % 8)) & 1;
+		if (*p == value_separator) {
+			p++;
+			while (p < end && is_white_space(*p)) p++;
+			if (object) goto key;
+			goto value;
+		}
+		if (*p != (object ? end_object : end_array)) goto throw_exp;
+		depth--;
+		p++;
+		goto separator;
+	}
+
+throw_exp:
+	g_errno = error;
+	g_error_offset = (size_t)((const char *)p - json_text);
+	if (err != NULL) {
+		err->value = NULL;
+		err->code = error;
+		err->offset = g_error_offset;
+		set_error_position(err, json_text);
+	}
+	return false;
+}
+
+/*****************************************************************************
+ * Reformat
+ *****************************************************************************/
+enum {
+	reformat_value = 0,
+	reformat_open,   // next to begin-object or begin-array
+	reformat_string,
+	reformat_escape,
+	reformat_scalar, // in or next to a literal, a number or a string
+	reformat_spaced, // white spaces after a scalar
+};
+
+static bool reformat_write(kzrjson_reformat_t *reformat, const char *data, const size_t length) {
+	if (length == 0 || reformat->error != kzrjson_success) return reformat->error == kzrjson_success;
+	if (!reformat->sink.write(data, length, reformat->sink.context)) {
+		reformat->error = kzrjson_err_sink;
+		return false;
+	}
+	return true;
+}
+
+static bool reformat_newline(kzrjson_reformat_t *reformat) {
+	static const char spaces[] = "\n                                                               ";
+	if (!reformat_write(reformat, spaces, 1)) return false;
+	size_t rest = reformat->depth * (size_t)reformat->indent;
+	while (rest > 0) {
+		const size_t length = rest < sizeof(spaces) - 2 ? rest : sizeof(spaces) - 2;
+		if (!reformat_write(reformat, spaces + 1, length)) return false;
+		rest -= length;
+	}
+	return true;
+}
+
+void kzrjson_reformat_init(kzrjson_reformat_t *reformat, const int indent, const kzrjson_sink_t sink) {
+	memset(reformat, 0, sizeof(kzrjson_reformat_t));
+	reformat->sink = sink;
+	reformat->indent = indent < 0 ? 0 : indent;
+	reformat->error = kzrjson_success;
+	reformat->state = reformat_value;
+}
+
+/*
+ * Bytes are written in runs: a run ends at a byte to drop or
+ * where white spaces are inserted.
+ */
+bool kzrjson_reformat_feed(kzrjson_reformat_t *reformat, const char *chunk, const size_t length) {
+	if (reformat->error != kzrjson_success) return false;
+	const bool pretty = reformat->indent > 0;
+	const char *p = chunk;
+	const char *const end = chunk + length;
+	const char *run = p;
+	while (p < end) {
+		if (reformat->state == reformat_string) {
+			// 8 bytes at once in the body of a string
+			while (end - p >= 8) {
+				uint64_t x;
+				memcpy(&x, p, sizeof(x));
+				if (has_special_byte(x)) break;
+				p += 8;
+			}
+			if (p >= end) break;
+			if (*p == quotation_mark) {
+				reformat->state = reformat_scalar;
+			} else if (*p == escape) {
+				reformat->state = reformat_escape;
+			}
+			p++;
+			continue;
+		}
+		if (reformat->state == reformat_escape) {
+			reformat->state = reformat_string;
+			p++;
+			continue;
+		}
+
+		const char c = *p;
+		if (is_white_space(c)) {
+			if (reformat->state == reformat_scalar) reformat->state = reformat_spaced;
+			if (!reformat_write(reformat, run, (size_t)(p - run))) return false;
+			run = ++p;
+			continue;
+		}
+		const bool close = c == end_object || c == end_array;
+		if (reformat->state == reformat_scalar || reformat->state == reformat_spaced) {
+			// removing the white spaces would join two tokens, as [1 2] or tru e
+			if (reformat->state == reformat_spaced && !close && c != ',' && c != ':') {
+				reformat->error = kzrjson_err_parse;
+				return false;
+			}
+			reformat->state = reformat_value;
+		}
+		if (reformat->state == reformat_open) {
+			reformat->state = reformat_value;
+			// {} and [] stay on a line
+			if (pretty && !close) {
+				if (!reformat_write(reformat, run, (size_t)(p - run))) return false;
+				if (!reformat_newline(reformat)) return false;
+				run = p;
+			}
+		} else if (close && pretty) {
+			if (!reformat_write(reformat, run, (size_t)(p - run))) return false;
+			run = p;
+			if (reformat->depth > 0) {
+				reformat->depth--;
+				if (!reformat_newline(reformat)) return false;
+				reformat->depth++;
+			}
+		}
+		p++;
+		switch (c) {
+		case '{':
+		case '[':
+			reformat->depth++;
+			reformat->state = reformat_open;
+			break;
+		case '}':
+		case ']':
+			if (reformat->depth == 0) {
+				reformat->error = kzrjson_err_parse;
+				return false;
+			}
+			reformat->depth--;
+			break;
+		case '"':
+			reformat->state = reformat_string;
+			break;
+		case ',':
+			if (pretty) {
+				if (!reformat_write(reformat, run, (size_t)(p - run))) return false;
+				if (!reformat_newline(reformat)) return false;
+				run = p;
+			}
+			break;
+		case ':':
+			if (pretty) {
+				if (!reformat_write(reformat, run, (size_t)(p - run))) return false;
+				if (!reformat_write(reformat, " ", 1)) return false;
+				run = p;
+			}
+			break;
+		default:
+			reformat->state = reformat_scalar;
+			break;
+		}
+	}
+	return reformat_write(reformat, run, (size_t)(p - run));
+}
+
+bool kzrjson_reformat_finish(kzrjson_reformat_t *reformat) {
+	if (reformat->error != kzrjson_success) return false;
+	if (reformat->state == reformat_string || reformat->state == reformat_escape) {
+		reformat->error = kzrjson_err_tokenize;
+		return false;
+	}
+	if (reformat->depth != 0) {
+		reformat->error = kzrjson_err_parse;
+		return false;
+	}
+	return true;
+}
+
+typedef struct {
+	char *out;
+	size_t length;
+} buffer_sink;
+
+static bool write_buffer(const char *data, const size_t length, void *context) {
+	buffer_sink *buffer = context;
+	memcpy(buffer->out + buffer->length, data, length);
+	buffer->length += length;
+	return true;
+}
+
+size_t kzrjson_minify(const char *json_text, const size_t length, char *out) {
+	kzrjson_set_success();
+	buffer_sink buffer = {out, 0};
+	const kzrjson_sink_t sink = {write_buffer, &buffer};
+	kzrjson_reformat_t reformat;
+	kzrjson_reformat_init(&reformat, 0, sink);
+	if (!kzrjson_reformat_feed(&reformat, json_text, length) || !kzrjson_reformat_finish(&reformat)) {
+		g_errno = reformat.error;
+		return 0;
+	}
+	// only white spaces
+	if (buffer.length == 0) {
+		g_errno = kzrjson_err_parse;
+		return 0;
+	}
+	return buffer.length;
+}
+
+/*****************************************************************************
+ * Columnar extraction
+ *****************************************************************************/
+static void column_set_valid(kzrjson_column_t *column, const size_t row) {
+	column->validity[row / 8] |= (uint8_t)(1u << (row % 8));
+}
+
+/*
+ * Store the value in the row.
+ * A string is only measured in offsets[row + 1], and copied later.
+ */
+static void column_set(kzrjson_column_t *column, const size_t row, kzrjson_t value) {
+	switch (column->type) {
+	case kzrjson_column_int64:
+		if (value->type != kzrjson_number) return;
+		if (value->number_type == kzrjson_int) {
+			column->int64s[row] = value->number_int;
+		} else if (value->number_type == kzrjson_uint && value->number_uint <= INT64_MAX) {
+			column->int64s[row] = (int64_t)value->number_uint;
+		} else {
+			return;
+		}
+		break;
+	case kzrjson_column_double:
+		if (value->type != kzrjson_number) return;
+		if (value->number_type == kzrjson_int) {
+			column->doubles[row] = (double)value->number_int;
+		} else if (value->number_type == kzrjson_uint) {
+			column->doubles[row] = (double)value->number_uint;
+		} else {
+			column->doubles[row] = value->number_double;
+		}
+		break;
+	case kzrjson_column_bool:
+		if (value->type != kzrjson_bool) return;
+		column->bools[row] = value->boolean;
+		break;
+	case kzrjson_column_string:
+		if (value->type != kzrjson_string) return;
+		column->offsets[row + 1] = strlen(value->string);
+		break;
+	}
+	column_set_valid(column, row);
+}
+
+/*
+ * Rows [begin, end) of an array, extracted by a thread.
+ * begin is a multiple of 8, so no byte of validity is shared by threads.
+ */
+typedef struct {
+	kzrjson_t array;
+	const kzrjson_field_t *fields;
+	size_t field_count;
+	kzrjson_column_t *columns;
+	size_t begin;
+	size_t end;
+	bool copy_strings;
+	kzrjson_errno_t error;
+} column_task;
+
+static int run_column_task(void *argument) {
+	column_task *task = argument;
+	kzrjson_lookup_cache_t *caches = calloc(task->field_count, sizeof(kzrjson_lookup_cache_t));
+	if (caches == NULL) {
+		task->error = kzrjson_err_calloc;
+		return 0;
+	}
+	for (size_t f = 0; f < task->field_count; f++) {
+		lookup_cache_init(caches + f, task->fields[f].key);
+	}
+	for (size_t row = task->begin; row < task->end; row++) {
+		kzrjson_t object = task->array->elements[row];
+		if (object->type != kzrjson_object) continue;
+		for (size_t f = 0; f < task->field_count; f++) {
+			kzrjson_column_t *column = task->columns + f;
+			if (task->copy_strings && column->type != kzrjson_column_string) continue;
+			kzrjson_t member = find_member_cached(object, caches + f);
+			if (member == NULL) continue;
+			if (!task->copy_strings) {
+				column_set(column, row, member->value);
+			} else if (kzrjson_column_valid(column, row)) {
+				const size_t offset = column->offsets[row];
+				memcpy(column->data + offset, member->value->string, column->offsets[row + 1] - offset);
+			}
+		}
+	}
+	free(caches);
+	return 0;
+}
+
+/*
+ * Run the tasks, in threads if available.
+ */
+static void run_column_tasks(column_task *tasks, const size_t count) {
+#ifdef KZRJSON_THREADS
+	thrd_t *threads = count > 1 ? calloc(count, sizeof(thrd_t)) : NULL;
+	bool *started = count > 1 ? calloc(count, sizeof(bool)) : NULL;
+	if (threads != NULL && started != NULL) {
+		for (size_t i = 1; i < count; i++) {
+			started[i] = thrd_create(threads + i, run_column_task, tasks + i) == thrd_success;
+		}
+		run_column_task(tasks);
+		for (size_t i = 1; i < count; i++) {
+			if (started[i]) {
+				thrd_join(threads[i], NULL);
+			} else {
+				run_column_task(tasks + i);
+			}
+		}
+		free(threads);
+		free(started);
+		return;
+	}
+	free(threads);
+	free(started);
+#endif
+	for (size_t i = 0; i < count; i++) {
+		run_column_task(tasks + i);
+	}
+}
+
+/*
+ * Allocate buffers of rows, filled with 0.
+ */
+static bool column_reserve(kzrjson_column_t *column, const size_t rows, const size_t capacity) {
+	const size_t bytes = (capacity + 7) / 8;
+	uint8_t *validity = realloc(column->validity, bytes);
+	if (validity == NULL) return false;
+	column->validity = validity;
+	const size_t used = (rows + 7) / 8;
+	memset(validity + used, 0, bytes - used);
+
+	size_t size = 0;
+	size_t count = capacity;
+	void *values = NULL;
+	switch (column->type) {
+	case kzrjson_column_int64:
+		size = sizeof(int64_t);
+		values = column->int64s;
+		break;
+	case kzrjson_column_double:
+		size = sizeof(double);
+		values = column->doubles;
+		break;
+	case kzrjson_column_bool:
+		size = sizeof(bool);
+		values = column->bools;
+		break;
+	case kzrjson_column_string:
+		size = sizeof(size_t);
+		values = column->offsets;
+		count = capacity + 1;
+		break;
+	}
+	char *grown = realloc(values, count * size);
+	if (grown == NULL) return false;
+	size_t used_count = column->type == kzrjson_column_string ? rows + 1 : rows;
+	if (values == NULL) used_count = 0;
+	memset(grown + used_count * size, 0, (count - used_count) * size);
+	switch (column->type) {
+	case kzrjson_column_int64: column->int64s = (int64_t *)grown; break;
+	case kzrjson_column_double: column->doubles = (double *)grown; break;
+	case kzrjson_column_bool: column->bools = (bool *)grown; break;
+	case kzrjson_column_string: column->offsets = (size_t *)grown; break;
+	}
+	return true;
+}
+
+static bool columns_init(const kzrjson_field_t *fields, const size_t field_count,
+	kzrjson_column_t *columns, const size_t rows)
+{
+	memset(columns, 0, sizeof(kzrjson_column_t) * field_count);
+	for (size_t f = 0; f < field_count; f++) {
+		columns[f].type = fields[f].type;
+		columns[f].length = rows;
+		// capacity of at least a row, so no buffer is NULL
+		if (!column_reserve(columns + f, 0, rows > 0 ? rows : 1)) {
+			kzrjson_column_free(columns, field_count);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool columnarize(kzrjson_t array, const kzrjson_field_t *fields,
+	const size_t field_count, kzrjson_column_t *columns, size_t threads)
+{
+	kzrjson_set_success();
+	column_task *tasks = NULL;
+	if (array->type != kzrjson_array) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return false;
+	}
+	const size_t rows = array->elements_size;
+	if (!columns_init(fields, field_count, columns, rows)) {
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return false;
+	}
+	if (array->packed_type != kzrjson_packed_none) return true; // no row is an object
+
+	// rows of a task in multiple of 8
+	const size_t blocks = (rows + 7) / 8;
+	if (threads == 0) threads = 1;
+	if (threads > blocks) threads = blocks > 0 ? blocks : 1;
+	tasks = calloc(threads, sizeof(column_task));
+	if (tasks == NULL) goto throw_exp;
+	for (size_t i = 0; i < threads; i++) {
+		column_task *task = tasks + i;
+		task->array = array;
+		task->fields = fields;
+		task->field_count = field_count;
+		task->columns = columns;
+		task->begin = blocks * i / threads * 8;
+		task->end = blocks * (i + 1) / threads * 8;
+		if (task->end > rows) task->end = rows;
+		task->error = kzrjson_success;
+	}
+	run_column_tasks(tasks, threads);
+	for (size_t i = 0; i < threads; i++) {
+		if (tasks[i].error != kzrjson_success) goto throw_exp;
+	}
+
+	// lengths of strings to offsets, then copy strings
+	bool strings = false;
+	for (size_t f = 0; f < field_count; f++) {
+		kzrjson_column_t *column = columns + f;
+		if (column->type != kzrjson_column_string) continue;
+		strings = true;
+		for (size_t row = 0; row < rows; row++) {
+			column->offsets[row + 1] += column->offsets[row];
+		}
+		column->data = calloc(column->offsets[rows] + 1, sizeof(char));
+		if (column->data == NULL) goto throw_exp;
+	}
+	if (strings) {
+		for (size_t i = 0; i < threads; i++) {
+			tasks[i].copy_strings = true;
+		}
+		run_column_tasks(tasks, threads);
+		for (size_t i = 0; i < threads; i++) {
+			if (tasks[i].error != kzrjson_success) goto throw_exp;
+		}
+	}
+	free(tasks);
+	return true;
+
+throw_exp:
+	free(tasks);
+	kzrjson_column_free(columns, field_count);
+	set_kzrjson_errno(kzrjson_err_calloc);
+	return false;
+}
+
+bool kzrjson_columnarize(kzrjson_t array, const kzrjson_field_t *fields,
+	const size_t field_count, kzrjson_column_t *columns)
+{
+	return columnarize(array, fields, field_count, columns, 1);
+}
+
+bool kzrjson_columnarize_parallel(kzrjson_t array, const kzrjson_field_t *fields,
+	const size_t field_count, kzrjson_column_t *columns, const size_t threads)
+{
+	return columnarize(array, fields, field_count, columns, threads);
+}
+
+/*
+ * Store a value token of the reader in the row.
+ */
+static bool column_set_token(kzrjson_column_t *column, const size_t row,
+	const kzrjson_reader_t *reader, const kzrjson_event_type event, size_t *data_capacity)
+{
+	char number[128];
+	switch (column->type) {
+	case kzrjson_column_int64:
+	case kzrjson_column_double: {
+		if (event != kzrjson_event_number || reader->token_length >= sizeof(number)) return true;
+		memcpy(number, reader->token, reader->token_length);
+		number[reader->token_length] = '\0';
+		if (column->type == kzrjson_column_double) {
+			column->doubles[row] = strtod(number, NULL);
+			break;
+		}
+		if (reader->number_type != kzrjson_int && reader->number_type != kzrjson_uint) return true;
+		char *end;
+		errno = 0;
+		const long long value = strtoll(number, &end, 10);
+		if (errno != 0) return true;
+		column->int64s[row] = value;
+		break;
+	}
+	case kzrjson_column_bool:
+		if (event != kzrjson_event_true && event != kzrjson_event_false) return true;
+		column->bools[row] = event == kzrjson_event_true;
+		break;
+	case kzrjson_column_string: {
+		if (event != kzrjson_event_string) return true;
+		const size_t length = column->offsets[row + 1];
+		if (length + reader->token_length + 1 > *data_capacity) {
+			size_t capacity = *data_capacity == 0 ? 256 : *data_capacity;
+			while (length + reader->token_length + 1 > capacity) capacity *= 2;
+			char *data = realloc(column->data, capacity);
+			if (data == NULL) return false;
+			column->data = data;
+			*data_capacity = capacity;
+		}
+		memcpy(column->data + length, reader->token, reader->token_length);
+		column->offsets[row + 1] = length + reader->token_length;
+		column->data[column->offsets[row + 1]] = '\0';
+		break;
+	}
+	}
+	column_set_valid(column, row);
+	return true;
+}
+
+bool kzrjson_columnarize_text(const char *json_text, const size_t length,
+	const kzrjson_field_t *fields, const size_t field_count, kzrjson_column_t *columns)
+{
+	kzrjson_set_success();
+	size_t *lengths = NULL;
+	size_t *data_capacities = NULL;
+	kzrjson_errno_t error = kzrjson_err_calloc;
+	if (!columns_init(fields, field_count, columns, 0)) {
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return false;
+	}
+	lengths = calloc(field_count + 1, sizeof(size_t));
+	data_capacities = calloc(field_count + 1, sizeof(size_t));
+	if (lengths == NULL || data_capacities == NULL) goto throw_exp;
+	for (size_t f = 0; f < field_count; f++) {
+		lengths[f] = strlen(fields[f].key);
+	}
+
+	kzrjson_reader_t reader;
+	kzrjson_reader_init(&reader, json_text, length);
+	kzrjson_event_type event = kzrjson_reader_next(&reader);
+	if (event != kzrjson_event_begin_array) {
+		error = event == kzrjson_event_error ? reader.error : kzrjson_err_illegal_type;
+		goto throw_exp;
+	}
+	size_t rows = 0;
+	size_t capacity = 1;
+	// the field next to the last key is likely to be the next key
+	size_t next_field = 0;
+	while ((event = kzrjson_reader_next(&reader)) != kzrjson_event_end_array) {
+		if (event == kzrjson_event_error) goto throw_reader;
+		if (rows == capacity) {
+			capacity *= 2;
+			for (size_t f = 0; f < field_count; f++) {
+				if (!column_reserve(columns + f, rows, capacity)) goto throw_exp;
+			}
+		}
+		for (size_t f = 0; f < field_count; f++) {
+			if (columns[f].type == kzrjson_column_string) columns[f].offsets[rows + 1] = columns[f].offsets[rows];
+		}
+		if (event != kzrjson_event_begin_object) {
+			if (!kzrjson_reader_skip(&reader, event)) goto throw_reader;
+			rows++;
+			continue;
+		}
+		while ((event = kzrjson_reader_next(&reader)) == kzrjson_event_key) {
+			size_t field = field_count;
+			for (size_t i = 0; i < field_count; i++) {
+				const size_t f = (next_field + i) % field_count;
+				if (lengths[f] == reader.token_length && memcmp(fields[f].key, reader.token, lengths[f]) == 0) {
+					field = f;
+					break;
+				}
+			}
+			event = kzrjson_reader_next(&reader);
+			if (event == kzrjson_event_error) goto throw_reader;
+			if (field != field_count) {
+				next_field = field + 1 == field_count ? 0 : field + 1;
+				if (!kzrjson_column_valid(columns + field, rows)
+					&& !column_set_token(columns + field, rows, &reader, event, data_capacities + field))
+				{
+					goto throw_exp;
+				}
+			}
+			if (!kzrjson_reader_skip(&reader, event)) goto throw_reader;
+		}
+		if (event != kzrjson_event_end_object) goto throw_reader;
+		rows++;
+	}
+	if (kzrjson_reader_next(&reader) != kzrjson_event_end_of_text) goto throw_reader;
+
+	for (size_t f = 0; f < field_count; f++) {
+		columns[f].length = rows;
+		if (columns[f].type == kzrjson_column_string && columns[f].data == NULL) {
+			columns[f].data = calloc(1, sizeof(char));
+			if (columns[f].data == NULL) goto throw_exp;
+		}
+	}
+	free(lengths);
+	free(data_capacities);
+	return true;
+
+throw_reader:
+	error = reader.error;
+throw_exp:
+	free(lengths);
+	free(data_capacities);
+	kzrjson_column_free(columns, field_count);
+	set_kzrjson_errno(error);
+	return false;
+}
+
+bool kzrjson_column_valid(const kzrjson_column_t *column, const size_t row) {
+	return (column->validity[row / 8] >> (row % 8)) & 1;
+}
+
+void kzrjson_column_free(kzrjson_column_t *columns, const size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		free(columns[i].validity);
+		switch (columns[i].type) {
+		case kzrjson_column_int64: free(columns[i].int64s); break;
+		case kzrjson_column_double: free(columns[i].doubles); break;
+		case kzrjson_column_bool: free(columns[i].bools); break;
+		case kzrjson_column_string: free(columns[i].offsets); break;
+		}
+		free(columns[i].data);
+		memset(columns + i, 0, sizeof(kzrjson_column_t));
+	}
+}
+
+/*****************************************************************************
+ * Relocatable image
+ *****************************************************************************/
+/*
+ * Layout:
+ *    image_header, with the root node
+ *    then for each array: its element nodes side by side,
+ *    for each object: its members side by side and its index,
+ *    for each string and number: its string presentation.
+ * Every part is reached by an offset from the node or member which has it,
+ * so no pointer is stored.
+ */
+static const char image_magic[8] = {'K', 'Z', 'R', 'J', 'I', 'M', 'G', '1'};
+
+struct image_header {
+	char magic[8];
+	uint64_t size;
+	struct kzrjson_image_node root;
+};
+
+struct image_member {
+	// from this member to its key
+	int64_t key;
+	uint64_t key_length;
+	struct kzrjson_image_node value;
+};
+
+// objects with fewer members are searched from the first member
+static const size_t image_index_min_members = 8;
+
+/*
+ * Number of slots in the index of an object, 0 for no index.
+ * A slot holds the position of the member + 1, or 0 if empty.
+ */
+static size_t image_index_capacity(const size_t members) {
+	if (members < image_index_min_members) return 0;
+	size_t capacity = 16;
+	while (capacity < members * 2) capacity *= 2;
+	return capacity;
+}
+
+/*
+ * Image being written. The same walk measures the image
+ * while base is NULL, and then writes it.
+ */
+struct image_writer {
+	char *base;
+	size_t used;
+};
+
+static size_t image_take(struct image_writer *writer, const size_t size, const size_t align) {
+	writer->used = (writer->used + align - 1) / align * align;
+	const size_t position = writer->used;
+	writer->used += size;
+	return position;
+}
+
+static int64_t image_offset(const void *from, const void *to) {
+	return (int64_t)((const char *)to - (const char *)from);
+}
+
+/*
+ * Write the string with null terminator, and return its position.
+ */
+static size_t image_put_string(struct image_writer *writer, const char *string, const size_t length) {
+	const size_t position = image_take(writer, length + 1, 1);
+	if (writer->base != NULL) {
+		memcpy(writer->base + position, string, length);
+		writer->base[position + length] = '\0';
+	}
+	return position;
+}
+
+static void image_put_node(struct image_writer *writer, const size_t position, kzrjson_t any);
+
+/*
+ * Number at the index of a packed array as a node.
+ */
+static void image_put_packed(struct image_writer *writer, const size_t position, kzrjson_t array, const size_t index) {
+	char text[PACKED_FORMAT_SIZE];
+	const size_t length = format_packed(text, array, index);
+	const size_t string = image_put_string(writer, text, length);
+	if (writer->base == NULL) return;
+	struct kzrjson_image_node *node = (struct kzrjson_image_node *)(writer->base + position);
+	const packed_value value = packed_at(array, index);
+	node->type = kzrjson_number;
+	node->size = length;
+	node->offset = image_offset(node, writer->base + string);
+	switch (value.type) {
+	case kzrjson_packed_int64:
+		node->number_type = kzrjson_int;
+		node->number_int = value.int64;
+		break;
+	case kzrjson_packed_uint64:
+		node->number_type = kzrjson_uint;
+		node->number_uint = value.uint64;
+		break;
+	default:
+		node->number_type = kzrjson_double;
+		node->number_double = value.number;
+		break;
+	}
+}
+
+static void image_put_elements(struct image_writer *writer, struct kzrjson_image_node *node, kzrjson_t array) {
+	const size_t size = array->elements_size;
+	const size_t first = image_take(writer, size * sizeof(struct kzrjson_image_node),
+		_Alignof(struct kzrjson_image_node));
+	if (node != NULL) node->offset = image_offset(node, writer->base + first);
+	for (size_t i = 0; i < size; i++) {
+		const size_t position = first + i * sizeof(struct kzrjson_image_node);
+		if (array->packed_type != kzrjson_packed_none) {
+			image_put_packed(writer, position, array, i);
+		} else {
+			image_put_node(writer, position, array->elements[i]);
+		}
+	}
+}
+
+static void image_put_members(struct image_writer *writer, struct kzrjson_image_node *node, kzrjson_t object) {
+	const size_t size = object->elements_size;
+	const size_t first = image_take(writer, size * sizeof(struct image_member), _Alignof(struct image_member));
+	const size_t capacity = image_index_capacity(size);
+	const size_t index = image_take(writer, capacity * sizeof(uint64_t), _Alignof(uint64_t));
+	if (node != NULL) node->offset = image_offset(node, writer->base + first);
+	for (size_t i = 0; i < size; i++) {
+		kzrjson_t member = object->elements[i];
+		const size_t position = first + i * sizeof(struct image_member);
+		const size_t key = image_put_string(writer, member->key, member->key_length);
+		if (writer->base != NULL) {
+			struct image_member *image = (struct image_member *)(writer->base + position);
+			image->key = image_offset(image, writer->base + key);
+			image->key_length = member->key_length;
+		}
+		image_put_node(writer, position + offsetof(struct image_member, value), member->value);
+	}
+	if (writer->base == NULL || capacity == 0) return;
+	uint64_t *slots = (uint64_t *)(writer->base + index);
+	memset(slots, 0, capacity * sizeof(uint64_t));
+	for (size_t i = 0; i < size; i++) {
+		kzrjson_t member = object->elements[i];
+		size_t slot = kzrjson_hash_key(member->key, member->key_length) & (capacity - 1);
+		bool duplicate = false;
+		while (slots[slot] != 0 && !duplicate) {
+			kzrjson_t indexed = object->elements[slots[slot] - 1];
+			duplicate = indexed->key_length == member->key_length
+				&& memcmp(indexed->key, member->key, member->key_length) == 0;
+			if (!duplicate) slot = (slot + 1) & (capacity - 1);
+		}
+		if (!duplicate) slots[slot] = i + 1;
+	}
+}
+
+/*
+ * Write the node of any at position, then what it refers to.
+ */
+static void image_put_node(struct image_writer *writer, const size_t position, kzrjson_t any) {
+	struct kzrjson_image_node *node = NULL;
+	if (writer->base != NULL) {
+		node = (struct kzrjson_image_node *)(writer->base + position);
+		memset(node, 0, sizeof(*node));
+		node->type = any->type;
+	}
+	switch (any->type) {
+	case kzrjson_array:
+		if (node != NULL) node->size = any->elements_size;
+		image_put_elements(writer, node, any);
+		break;
+	case kzrjson_object:
+		if (node != NULL) node->size = any->elements_size;
+		image_put_members(writer, node, any);
+		break;
+	case kzrjson_string:
+	case kzrjson_number: {
+		const size_t length = strlen(any->string);
+		const size_t string = image_put_string(writer, any->string, length);
+		if (node == NULL) break;
+		node->size = length;
+		node->offset = image_offset(node, writer->base + string);
+		node->number_type = any->type == kzrjson_number ? any->number_type : 0;
+		if (any->type == kzrjson_number) node->number_uint = any->number_uint;
+		break;
+	}
+	case kzrjson_bool:
+		if (node == NULL) break;
+		node->boolean = any->boolean;
+		node->size = strlen(any->boolean ? literal_true : literal_false);
+		break;
+	case kzrjson_null:
+		if (node != NULL) node->size = strlen(literal_null);
+		break;
+	case kzrjson_member:
+		// the image of a member is the image of its value
+		image_put_node(writer, position, any->value);
+		break;
+	}
+}
+
+size_t kzrjson_image_size(kzrjson_t any) {
+	kzrjson_set_success();
+	if (any == NULL) return 0;
+	struct image_writer writer = {NULL, 0};
+	const size_t root = image_take(&writer, sizeof(struct image_header), _Alignof(struct image_header))
+		+ offsetof(struct image_header, root);
+	image_put_node(&writer, root, any);
+	return writer.used;
+}
+
+bool kzrjson_image_write(kzrjson_t any, void *block, const size_t size) {
+	if (any == NULL || block == NULL) return false;
+	const size_t image_size = kzrjson_image_size(any);
+	if (size < image_size) {
+		set_kzrjson_errno(kzrjson_err_index_out_of_range);
+		return false;
+	}
+	struct image_writer writer = {block, 0};
+	struct image_header *header = block;
+	image_take(&writer, sizeof(struct image_header), _Alignof(struct image_header));
+	image_put_node(&writer, offsetof(struct image_header, root), any);
+	memcpy(header->magic, image_magic, sizeof(image_magic));
+	header->size = image_size;
+	return true;
+}
+
+kzrjson_image_t kzrjson_image_root(const void *block, const size_t size) {
+	kzrjson_set_success();
+	if (block == NULL) return NULL;
+	const struct image_header *header = block;
+	if (size < sizeof(struct image_header) || memcmp(header->magic, image_magic, sizeof(image_magic)) != 0
+		|| header->size > size)
+	{
+		set_kzrjson_errno(kzrjson_err_parse);
+		return NULL;
+	}
+	return &header->root;
+}
+
+static const struct image_member *image_members(kzrjson_image_t object) {
+	return (const struct image_member *)((const char *)object + object->offset);
+}
+
+kzrjson_image_t kzrjson_image_element(kzrjson_image_t container, const size_t index) {
+	kzrjson_set_success();
+	if (container == NULL) return NULL;
+	if (container->type != kzrjson_array && container->type != kzrjson_object) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return NULL;
+	}
+	if (index >= container->size) {
+		set_kzrjson_errno(kzrjson_err_index_out_of_range);
+		return NULL;
+	}
+	if (container->type == kzrjson_object) return &image_members(container)[index].value;
+	return (kzrjson_image_t)((const char *)container + container->offset) + index;
+}
+
+const char *kzrjson_image_key(kzrjson_image_t object, const size_t index, size_t *length) {
+	kzrjson_set_success();
+	if (object == NULL) return NULL;
+	if (object->type != kzrjson_object) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return NULL;
+	}
+	if (index >= object->size) {
+		set_kzrjson_errno(kzrjson_err_index_out_of_range);
+		return NULL;
+	}
+	const struct image_member *member = &image_members(object)[index];
+	if (length != NULL) *length = (size_t)member->key_length;
+	return (const char *)member + member->key;
+}
+
+static bool image_key_is(const struct image_member *member, const char *key, const size_t length) {
+	return member->key_length == length && memcmp((const char *)member + member->key, key, length) == 0;
+}
+
+kzrjson_image_t kzrjson_image_get(kzrjson_image_t object, const char *key) {
+	kzrjson_set_success();
+	if (object == NULL || key == NULL) return NULL;
+	if (object->type != kzrjson_object) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return NULL;
+	}
+	const size_t length = strlen(key);
+	const struct image_member *members = image_members(object);
+	const size_t capacity = image_index_capacity((size_t)object->size);
+	if (capacity == 0) {
+		for (size_t i = 0; i < object->size; i++) {
+			if (image_key_is(members + i, key, length)) return &members[i].value;
+		}
+	} else {
+		// the index follows the members, which keep it aligned
+		const uint64_t *slots = (const uint64_t *)(members + object->size);
+		size_t slot = kzrjson_hash_key(key, length) & (capacity - 1);
+		for (; slots[slot] != 0; slot = (slot + 1) & (capacity - 1)) {
+			const struct image_member *member = members + slots[slot] - 1;
+			if (image_key_is(member, key, length)) return &member->value;
+		}
+	}
+	set_kzrjson_errno(kzrjson_err_object_key_not_found);
+	return NULL;
+}
+
+const char *kzrjson_image_string(kzrjson_image_t node) {
+	kzrjson_set_success();
+	if (node == NULL) return NULL;
+	switch (node->type) {
+	case kzrjson_string:
+	case kzrjson_number:
+		return (const char *)node + node->offset;
+	case kzrjson_bool:
+		return node->boolean ? literal_true : literal_false;
+	case kzrjson_null:
+		return literal_null;
+	default:
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return NULL;
+	}
+}
+
+/*****************************************************************************
+ * Parse cache
+ *****************************************************************************/
+/*
+ * Each entry holds a copy of the text and a document parsed from it.
+ * Entries are in a hash table with chains, and in a list from the most
+ * recently used. An evicted entry leaves both, and is released when
+ * its last reference is released. The cache itself is released when it is
+ * freed and no evicted entry is left.
+ */
+struct cache_entry {
+	struct kzrjson_cache *cache;
+	struct cache_entry *chain;
+	struct cache_entry *newer;
+	struct cache_entry *older;
+	uint64_t hash;
+	char *text;
+	size_t length;
+	struct kzrjson_doc *doc;
+	kzrjson_t root;
+	size_t bytes;
+
+	// results of kzrjson_cache_parse not released yet
+	size_t references;
+	bool cached;
+};
+
+struct kzrjson_cache {
+#ifdef KZRJSON_THREADS
+	mtx_t lock;
+#endif
+	struct cache_entry **buckets;
+	size_t bucket_count;
+	struct cache_entry *newest;
+	struct cache_entry *oldest;
+	size_t max_bytes;
+	kzrjson_cache_stats_t stats;
+
+	// entries which are evicted but still referenced
+	size_t evicted_alive;
+	bool freed;
+};
+
+static void cache_lock(struct kzrjson_cache *cache) {
+#ifdef KZRJSON_THREADS
+	mtx_lock(&cache->lock);
+#else
+	(void)cache;
+#endif
+}
+
+static void cache_unlock(struct kzrjson_cache *cache) {
+#ifdef KZRJSON_THREADS
+	mtx_unlock(&cache->lock);
+#else
+	(void)cache;
+#endif
+}
+
+static void cache_destroy(struct kzrjson_cache *cache) {
+#ifdef KZRJSON_THREADS
+	mtx_destroy(&cache->lock);
+#endif
+	free(cache->buckets);
+	free(cache);
+}
+
+/*
+ * Hash of the bytes, read 8 bytes at a time.
+ */
+static uint64_t hash_bytes(const char *bytes, size_t length) {
+	uint64_t hash = 0x9E3779B97F4A7C15ull ^ length;
+	for (; length >= 8; bytes += 8, length -= 8) {
+		uint64_t word;
+		memcpy(&word, bytes, sizeof(word));
+		hash ^= word * 0x87C37B91114253D5ull;
+		hash = ((hash << 31) | (hash >> 33)) * 0x4CF5AD432745937Full;
+	}
+	uint64_t tail = 0;
+	memcpy(&tail, bytes, length);
+	hash ^= tail * 0x87C37B91114253D5ull;
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+/*
+ * Memory of the document in bytes.
+ */
+static size_t doc_bytes(const struct kzrjson_doc *doc) {
+	size_t bytes = sizeof(struct kzrjson_doc)
+		+ doc->scratch.capacity * sizeof(kzrjson_t) + doc->scratch.values_capacity
+		+ (doc->keys.capacity + doc->shapes.capacity) * sizeof(struct doc_table_slot);
+	for (const struct arena_chunk *chunk = doc->chunks; chunk != NULL; chunk = chunk->next) {
+		bytes += sizeof(struct arena_chunk) + chunk->capacity;
+	}
+	return bytes;
+}
+
+static void cache_entry_free(struct cache_entry *entry) {
+	kzrjson_doc_free(entry->doc);
+	free(entry->text);
+	free(entry);
+}
+
+static struct cache_entry **cache_bucket(struct kzrjson_cache *cache, const uint64_t hash) {
+	return cache->buckets + (hash & (cache->bucket_count - 1));
+}
+
+static void cache_unlink(struct kzrjson_cache *cache, struct cache_entry *entry) {
+	if (entry->newer != NULL) {
+		entry->newer->older = entry->older;
+	} else {
+		cache->newest = entry->older;
+	}
+	if (entry->older != NULL) {
+		entry->older->newer = entry->newer;
+	} else {
+		cache->oldest = entry->newer;
+	}
+	entry->newer = NULL;
+	entry->older = NULL;
+}
+
+static void cache_push_newest(struct kzrjson_cache *cache, struct cache_entry *entry) {
+	entry->older = cache->newest;
+	if (cache->newest != NULL) cache->newest->newer = entry;
+	cache->newest = entry;
+	if (cache->oldest == NULL) cache->oldest = entry;
+}
+
+/*
+ * Take the entry out of the table and the list.
+ * It is released now if no one refers to it.
+ */
+static void cache_evict(struct kzrjson_cache *cache, struct cache_entry *entry) {
+	struct cache_entry **link = cache_bucket(cache, entry->hash);
+	while (*link != entry) link = &(*link)->chain;
+	*link = entry->chain;
+	cache_unlink(cache, entry);
+	entry->cached = false;
+	cache->stats.entries--;
+	cache->stats.bytes -= entry->bytes;
+	if (entry->references == 0) {
+		cache_entry_free(entry);
+	} else {
+		cache->evicted_alive++;
+	}
+}
+
+/*
+ * Double the buckets when there are more entries than buckets.
+ * If the buckets can not be allocated, the chains just get longer.
+ */
+static void cache_grow(struct kzrjson_cache *cache) {
+	if (cache->stats.entries < cache->bucket_count) return;
+	const size_t count = cache->bucket_count * 2;
+	struct cache_entry **buckets = calloc(count, sizeof(struct cache_entry *));
+	if (buckets == NULL) return;
+	for (size_t i = 0; i < cache->bucket_count; i++) {
+		struct cache_entry *entry = cache->buckets[i];
+		while (entry != NULL) {
+			struct cache_entry *chain = entry->chain;
+			struct cache_entry **bucket = buckets + (entry->hash & (count - 1));
+			entry->chain = *bucket;
+			*bucket = entry;
+			entry = chain;
+		}
+	}
+	free(cache->buckets);
+	cache->buckets = buckets;
+	cache->bucket_count = count;
+}
+
+static struct cache_entry *cache_find(struct kzrjson_cache *cache, const uint64_t hash,
+	const char *json_text, const size_t length)
+{
+	for (struct cache_entry *entry = *cache_bucket(cache, hash); entry != NULL; entry = entry->chain) {
+		if (entry->hash == hash && entry->length == length && memcmp(entry->text, json_text, length) == 0) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Copy the text and parse it into a new entry, without the lock.
+ * All length bytes must be the text, without a null character.
+ *
+ * [exception] kzrjson_err_calloc
+ * [exception] kzrjson_err_tokenize
+ * [exception] kzrjson_err_parse
+ */
+static struct cache_entry *cache_entry_make(struct kzrjson_cache *cache, const uint64_t hash,
+	const char *json_text, const size_t length, kzrjson_result_t *result)
+{
+	// the copy is parsed as a null terminated string, which would end early
+	const char *null_character = memchr(json_text, '\0', length);
+	if (null_character != NULL) {
+		result->code = kzrjson_err_parse;
+		result->offset = (size_t)(null_character - json_text);
+		set_error_position(result, json_text);
+		set_kzrjson_errno(kzrjson_err_parse);
+		return NULL;
+	}
+	struct cache_entry *entry = calloc(1, sizeof(struct cache_entry));
+	char *text = malloc(length + 1);
+	kzrjson_doc_t doc = entry != NULL && text != NULL ? kzrjson_doc_make() : NULL;
+	if (doc == NULL) {
+		free(entry);
+		free(text);
+		set_kzrjson_errno(kzrjson_err_calloc);
+		result->code = kzrjson_err_calloc;
+		return NULL;
+	}
+	memcpy(text, json_text, length);
+	text[length] = '\0';
+	*result = kzrjson_doc_parse_result(doc, text);
+	if (result->code != kzrjson_success) {
+		kzrjson_doc_free(doc);
+		free(text);
+		free(entry);
+		set_kzrjson_errno(result->code); // kzrjson_doc_free resets it
+		return NULL;
+	}
+	entry->cache = cache;
+	entry->hash = hash;
+	entry->text = text;
+	entry->length = length;
+	entry->doc = doc;
+	entry->root = result->value;
+	entry->bytes = sizeof(struct cache_entry) + length + 1 + doc_bytes(doc);
+	entry->references = 1;
+	doc->cache_entry = entry;
+	return entry;
+}
+
+kzrjson_cache_t kzrjson_cache_make(const size_t max_bytes) {
+	kzrjson_set_success();
+	struct kzrjson_cache *cache = calloc(1, sizeof(struct kzrjson_cache));
+	if (cache == NULL) {
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return NULL;
+	}
+	cache->bucket_count = 16;
+	cache->buckets = calloc(cache->bucket_count, sizeof(struct cache_entry *));
+	if (cache->buckets == NULL) {
+		free(cache);
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return NULL;
+	}
+#ifdef KZRJSON_THREADS
+	if (mtx_init(&cache->lock, mtx_plain) != thrd_success) {
+		free(cache->buckets);
+		free(cache);
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return NULL;
+	}
+#endif
+	cache->max_bytes = max_bytes;
+	return cache;
+}
+
+kzrjson_result_t kzrjson_cache_parse(kzrjson_cache_t cache, const char *json_text, const size_t length) {
+	kzrjson_set_success();
+	kzrjson_result_t result = {NULL, kzrjson_success, 0, 0, 0};
+	if (cache == NULL || json_text == NULL) return result;
+	const uint64_t hash = hash_bytes(json_text, length);
+
+	cache_lock(cache);
+	struct cache_entry *entry = cache_find(cache, hash, json_text, length);
+	if (entry != NULL) {
+		entry->references++;
+		cache_unlink(cache, entry);
+		cache_push_newest(cache, entry);
+		cache->stats.hits++;
+		cache_unlock(cache);
+		result.value = entry->root;
+		return result;
+	}
+	cache->stats.misses++;
+	cache_unlock(cache);
+
+	entry = cache_entry_make(cache, hash, json_text, length, &result);
+	if (entry == NULL) return result;
+
+	cache_lock(cache);
+	struct cache_entry *found = cache_find(cache, hash, json_text, length);
+	if (found != NULL) {
+		// another thread parsed the same text meanwhile
+		found->references++;
+		cache_unlock(cache);
+		cache_entry_free(entry);
+		result.value = found->root;
+		return result;
+	}
+	if (entry->bytes <= cache->max_bytes) {
+		while (cache->stats.bytes + entry->bytes > cache->max_bytes) {
+			cache_evict(cache, cache->oldest);
+			cache->stats.evictions++;
+		}
+		struct cache_entry **bucket = cache_bucket(cache, hash);
+		entry->chain = *bucket;
+		*bucket = entry;
+		cache_push_newest(cache, entry);
+		entry->cached = true;
+		cache->stats.entries++;
+		cache->stats.bytes += entry->bytes;
+		cache_grow(cache);
+	} else {
+		cache->evicted_alive++;
+	}
+	cache_unlock(cache);
+	return result;
+}
+
+void kzrjson_cache_release(kzrjson_t json) {
+	kzrjson_set_success();
+	if (json == NULL || json->doc == NULL || json->doc->cache_entry == NULL) return;
+	struct cache_entry *entry = json->doc->cache_entry;
+	struct kzrjson_cache *cache = entry->cache;
+	cache_lock(cache);
+	entry->references--;
+	const bool release_entry = entry->references == 0 && !entry->cached;
+	if (release_entry) cache->evicted_alive--;
+	const bool release_cache = cache->freed && cache->evicted_alive == 0 && cache->stats.entries == 0;
+	cache_unlock(cache);
+	if (release_entry) cache_entry_free(entry);
+	if (release_cache) cache_destroy(cache);
+}
+
+kzrjson_cache_stats_t kzrjson_cache_stats(kzrjson_cache_t cache) {
+	kzrjson_set_success();
+	kzrjson_cache_stats_t stats = {0, 0, 0, 0, 0};
+	if (cache == NULL) return stats;
+	cache_lock(cache);
+	stats = cache->stats;
+	cache_unlock(cache);
+	return stats;
+}
+
+void kzrjson_cache_free(kzrjson_cache_t cache) {
+	kzrjson_set_success();
+	if (cache == NULL) return;
+	cache_lock(cache);
+	while (cache->oldest != NULL) {
+		cache_evict(cache, cache->oldest);
+	}
+	cache->freed = true;
+	const bool release_cache = cache->evicted_alive == 0;
+	cache_unlock(cache);
+	if (release_cache) cache_destroy(cache);
+}
+
+/*****************************************************************************
+ * Templates
+ *****************************************************************************/
+/*
+ * The constant text is one string, cut into pieces at the slots.
+ * A piece is followed by the value of its slot, except the last piece.
+ */
+struct template_piece {
+	size_t offset;
+	size_t length;
+	size_t slot;
+};
+
+struct kzrjson_template {
+	char *text;
+	struct template_piece *pieces;
+	size_t pieces_size;
+	size_t slots;
+};
+
+typedef struct {
+	growing_buffer text;
+	struct template_piece *pieces;
+	size_t pieces_size;
+	size_t pieces_capacity;
+	size_t piece_offset;
+	size_t slots;
+	bool failed;
+} template_compiler;
+
+static void template_put(template_compiler *compiler, const char *data, const size_t length) {
+	if (compiler->failed) return;
+	if (!write_growing_buffer(data, length, &compiler->text)) compiler->failed = true;
+}
+
+static void template_put_char(template_compiler *compiler, const char c) {
+	template_put(compiler, &c, 1);
+}
+
+/*
+ * Close the constant piece before the slot, or the last piece if slot is SIZE_MAX.
+ */
+static void template_cut(template_compiler *compiler, const size_t slot) {
+	if (compiler->failed) return;
+	if (compiler->pieces_size == compiler->pieces_capacity) {
+		const size_t capacity = compiler->pieces_capacity == 0 ? 8 : compiler->pieces_capacity * 2;
+		struct template_piece *pieces = realloc(compiler->pieces, capacity * sizeof(struct template_piece));
+		if (pieces == NULL) {
+			compiler->failed = true;
+			return;
+		}
+		compiler->pieces = pieces;
+		compiler->pieces_capacity = capacity;
+	}
+	struct template_piece *piece = compiler->pieces + compiler->pieces_size++;
+	piece->offset = compiler->piece_offset;
+	piece->length = compiler->text.length - compiler->piece_offset;
+	piece->slot = slot;
+	compiler->piece_offset = compiler->text.length;
+	if (slot != SIZE_MAX && slot + 1 > compiler->slots) compiler->slots = slot + 1;
+}
+
+/*
+ * Index of the slot if the string is "{{N}}", otherwise SIZE_MAX.
+ * N has no leading zeros, and is less than SIZE_MAX.
+ */
+static size_t template_slot(const char *string) {
+	const size_t length = strlen(string);
+	if (length < 5 || length > 24 || memcmp(string, "{{", 2) != 0 || memcmp(string + length - 2, "}}", 2) != 0) {
+		return SIZE_MAX;
+	}
+	if (string[2] == '0' && length > 5) return SIZE_MAX;
+	size_t slot = 0;
+	for (size_t i = 2; i < length - 2; i++) {
+		if (!is_digit(string[i])) return SIZE_MAX;
+		const size_t digit = (size_t)(string[i] - '0');
+		if (slot > (SIZE_MAX - 1 - digit) / 10) return SIZE_MAX;
+		slot = slot * 10 + digit;
+	}
+	return slot;
+}
+
+/*
+ * Write the data as kzrjson_to_string does, cutting pieces at slots.
+ */
+static void template_compile(template_compiler *compiler, kzrjson_t any) {
 	switch (any->type) {
 	case kzrjson_object:
-		g_converter.length++; // begin-object
-		for (size_t i = 0; i < any->elements_size; i++) {
-			kzrjson_any_length(*(any->elements + i));
-			if (i + 1 != any->elements_size) {
-				g_converter.length++; // value-separator
-			}
-		}
-		g_converter.length++; // end-object
-		break;
 	case kzrjson_array:
-		g_converter.length++; // begin-array
+		template_put_char(compiler, any->type == kzrjson_object ? begin_object : begin_array);
 		for (size_t i = 0; i < any->elements_size; i++) {
-			kzrjson_any_length(*(any->elements + i));
+			if (any->packed_type != kzrjson_packed_none) {
+				char buffer[PACKED_FORMAT_SIZE];
+				template_put(compiler, buffer, format_packed(buffer, any, i));
+			} else {
+				template_compile(compiler, *(any->elements + i));
+			}
 			if (i + 1 != any->elements_size) {
-				g_converter.length++; // value-separator
+				template_put_char(compiler, value_separator);
 			}
 		}
-		g_converter.length++; // end-array
+		template_put_char(compiler, any->type == kzrjson_object ? end_object : end_array);
 		break;
 	case kzrjson_member:
-		g_converter.length++; // quatation-mark
-		g_converter.length += strlen(any->key);
-		g_converter.length++; // quatation-mark
-		g_converter.length++; // name-separator
-		kzrjson_any_length(any->value);
+		template_put_char(compiler, quotation_mark);
+		template_put(compiler, any->key, strlen(any->key));
+		template_put_char(compiler, quotation_mark);
+		template_put_char(compiler, name_separator);
+		template_compile(compiler, any->value);
 		break;
-	case kzrjson_string:
-		g_converter.length++; // quatation-mark
-		g_converter.length += strlen(any->string);
-		g_converter.length++; // quatation-mark
+	case kzrjson_string: {
+		const size_t slot = template_slot(any->string);
+		if (slot != SIZE_MAX) {
+			template_cut(compiler, slot);
+			break;
+		}
+		template_put_char(compiler, quotation_mark);
+		template_put(compiler, any->string, strlen(any->string));
+		template_put_char(compiler, quotation_mark);
 		break;
+	}
 	case kzrjson_number:
-		g_converter.length += strlen(any->string);
-		break;
 	case kzrjson_bool:
-		g_converter.length += strlen(any->string);
-		break;
 	case kzrjson_null:
-		g_converter.length += strlen(any->string);
+		template_put(compiler, any->string, strlen(any->string));
 		break;
 	}
-	return g_converter.length;
 }
 
-static void converter_add_char(const char c) {
-	*g_converter.pos = c;
-	g_converter.pos++;
+/*
+ * Output of kzrjson_template_render, which counts the bytes not written.
+ */
+typedef struct {
+	char *out;
+	size_t capacity;
+	size_t length;
+} template_output;
+
+static void render_put(template_output *output, const char *data, const size_t length) {
+	if (length == 0) return;
+	if (output->length < output->capacity) {
+		const size_t room = output->capacity - output->length;
+		memcpy(output->out + output->length, data, length < room ? length : room);
+	}
+	output->length += length;
 }
 
-static void converter_add_string(const char *string) {
-	const size_t remain = g_converter.length - (g_converter.pos - g_converter.begin);
-	strcpy_s(g_converter.pos, remain, string);
-	g_converter.pos += strlen(string);
+static bool needs_escape(const unsigned char c) {
+	return c < 0x20 || c == '"' || c == '\\';
 }
 
-static void kzrjson_any_to_string(kzrjson_t any) {
-	switch (any->type) {
-	case kzrjson_object:
-		converter_add_char(begin_object);
-		for (size_t i = 0; i < any->elements_size; i++) {
-			kzrjson_any_to_string(*(any->elements + i));
-			if (i + 1 != any->elements_size) {
-				converter_add_char(value_separator);
-			}
-		}
-		converter_add_char(end_object);
+/*
+ * Escape sequence of a character for which needs_escape is true.
+ */
+static size_t escape_char(char *out, const unsigned char c) {
+	static const char hex[] = "0123456789abcdef";
+	out[0] = '\\';
+	switch (c) {
+	case '"': out[1] = '"'; return 2;
+	case '\\': out[1] = '\\'; return 2;
+	case '\b': out[1] = 'b'; return 2;
+	case '\f': out[1] = 'f'; return 2;
+	case '\n': out[1] = 'n'; return 2;
+	case '\r': out[1] = 'r'; return 2;
+	case '\t': out[1] = 't'; return 2;
+	default:
+		memcpy(out + 1, "u00", 3);
+		out[4] = hex[c >> 4];
+		out[5] = hex[c & 0xF];
+		return 6;
+	}
+}
+
+/*
+ * Write the string between quotation marks, escaping '"', '\\' and control characters.
+ */
+static void render_string(template_output *output, const char *string, const size_t length) {
+	render_put(output, "\"", 1);
+	size_t begin = 0;
+	for (size_t i = 0; i < length; i++) {
+		if (!needs_escape((unsigned char)string[i])) continue;
+		render_put(output, string + begin, i - begin);
+		char escaped[6];
+		render_put(output, escaped, escape_char(escaped, (unsigned char)string[i]));
+		begin = i + 1;
+	}
+	render_put(output, string + begin, length - begin);
+	render_put(output, "\"", 1);
+}
+
+/*
+ * [exception] kzrjson_err_illegal_type
+ * [exception] kzrjson_err_not_number
+ */
+static void render_slot(template_output *output, const kzrjson_slot_t *value) {
+	char buffer[PACKED_FORMAT_SIZE];
+	switch (value->type) {
+	case kzrjson_slot_null:
+		render_put(output, "null", 4);
 		break;
-	case kzrjson_array:
-		converter_add_char(begin_array);
-		for (size_t i = 0; i < any->elements_size; i++) {
-			kzrjson_any_to_string(*(any->elements + i));
-			if (i + 1 != any->elements_size) {
-				converter_add_char(value_separator);
-			}
+	case kzrjson_slot_bool:
+		if (value->boolean) {
+			render_put(output, "true", 4);
+		} else {
+			render_put(output, "false", 5);
 		}
-		converter_add_char(end_array);
 		break;
-	case kzrjson_member:
-		converter_add_char(quotation_mark);
-		converter_add_string(any->key);
-		converter_add_char(quotation_mark);
-		converter_add_char(name_separator);
-		kzrjson_any_to_string(any->value);
+	case kzrjson_slot_int64:
+		render_put(output, buffer, (size_t)snprintf(buffer, sizeof(buffer), "%lld", (long long)value->int64));
 		break;
-	case kzrjson_string:
-		converter_add_char(quotation_mark);
-		converter_add_string(any->string);
-		converter_add_char(quotation_mark);
+	case kzrjson_slot_uint64:
+		render_put(output, buffer, (size_t)snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long)value->uint64));
 		break;
-	case kzrjson_number:
-		converter_add_string(any->string);
+	case kzrjson_slot_double:
+		if (!isfinite(value->number)) {
+			set_kzrjson_errno(kzrjson_err_not_number);
+			return;
+		}
+		render_put(output, buffer, format_double(buffer, value->number));
 		break;
-	case kzrjson_bool:
-		converter_add_string(any->string);
+	case kzrjson_slot_string:
+		render_string(output, value->string, value->length);
 		break;
-	case kzrjson_null:
-		converter_add_string(any->string);
+	case kzrjson_slot_raw:
+		render_put(output, value->string, value->length);
+		break;
+	default:
+		set_kzrjson_errno(kzrjson_err_illegal_type);
 		break;
 	}
 }
 
-/*****************************************************************************
- * Intefaces
- *****************************************************************************/
-void kzrjson_print(kzrjson_t any) {
+kzrjson_template_t kzrjson_template_compile(kzrjson_t data) {
 	kzrjson_set_success();
-	g_indent = 0;
-	kzrjson_any_print(any);
-	printf("\n");
-	g_indent = 0;
+	if (data == NULL) {
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return NULL;
+	}
+	template_compiler compiler = {{NULL, 0, 0}, NULL, 0, 0, 0, 0, false};
+	template_put(&compiler, "", 0); // the text is not NULL even if data is a slot
+	template_compile(&compiler, data);
+	template_cut(&compiler, SIZE_MAX);
+	struct kzrjson_template *tpl = compiler.failed ? NULL : calloc(1, sizeof(struct kzrjson_template));
+	if (tpl == NULL) {
+		free(compiler.text.text);
+		free(compiler.pieces);
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return NULL;
+	}
+	tpl->text = compiler.text.text;
+	tpl->pieces = compiler.pieces;
+	tpl->pieces_size = compiler.pieces_size;
+	tpl->slots = compiler.slots;
+	return tpl;
 }
 
-void kzrjson_free(kzrjson_t any) {
+size_t kzrjson_template_slots(kzrjson_template_t tpl) {
 	kzrjson_set_success();
-	if (any == NULL) return;
-	kzrjson_any_free(any);
+	if (tpl == NULL) return 0;
+	return tpl->slots;
+}
+
+size_t kzrjson_template_render(kzrjson_template_t tpl, const kzrjson_slot_t *values, char *out, const size_t capacity) {
+	kzrjson_set_success();
+	if (tpl == NULL) return 0;
+	template_output output = {out, capacity, 0};
+	for (size_t i = 0; i < tpl->pieces_size; i++) {
+		const struct template_piece *piece = tpl->pieces + i;
+		render_put(&output, tpl->text + piece->offset, piece->length);
+		if (piece->slot != SIZE_MAX) {
+			render_slot(&output, values + piece->slot);
+			if (kzrjson_errno() != kzrjson_success) return 0;
+		}
+	}
+	if (capacity > 0) {
+		out[output.length < capacity ? output.length : capacity - 1] = '\0';
+	}
+	return output.length;
+}
+
+void kzrjson_template_free(kzrjson_template_t tpl) {
+	kzrjson_set_success();
+	if (tpl == NULL) return;
+	free(tpl->text);
+	free(tpl->pieces);
+	free(tpl);
+}
+
+/*****************************************************************************
+ * Writer
+ *****************************************************************************/
+/*
+ * What the writer expects next.
+ */
+enum {
+	writer_first = 0, // first value, or first member or element
+	writer_next,      // value-separator before the next member or element
+	writer_value,     // value after a key
+	writer_done,      // end of text
+};
+
+static bool writer_fail(kzrjson_writer_t *writer, const kzrjson_errno_t error) {
+	if (writer->error == kzrjson_success) writer->error = error;
+	return false;
+}
+
+static bool writer_flush(kzrjson_writer_t *writer) {
+	if (writer->buffered == 0) return true;
+	const size_t length = writer->buffered;
+	writer->buffered = 0;
+	if (!writer->sink.write(writer->buffer, length, writer->sink.context)) {
+		return writer_fail(writer, kzrjson_err_sink);
+	}
+	return true;
+}
+
+/*
+ * Append to the text, or to the buffer before the sink.
+ */
+static bool writer_put(kzrjson_writer_t *writer, const char *data, const size_t length) {
+	if (length == 0) return true;
+	if (writer->sink.write == NULL) {
+		if (writer->length + length + 1 > writer->capacity) {
+			size_t capacity = writer->capacity == 0 ? 256 : writer->capacity;
+			while (writer->length + length + 1 > capacity) capacity *= 2;
+			char *text = realloc(writer->text, capacity);
+			if (text == NULL) return writer_fail(writer, kzrjson_err_calloc);
+			writer->text = text;
+			writer->capacity = capacity;
+		}
+		memcpy(writer->text + writer->length, data, length);
+		writer->length += length;
+		writer->text[writer->length] = '\0';
+		return true;
+	}
+	if (writer->buffered + length > sizeof(writer->buffer)) {
+		if (!writer_flush(writer)) return false;
+		if (length > sizeof(writer->buffer)) {
+			if (!writer->sink.write(data, length, writer->sink.context)) {
+				return writer_fail(writer, kzrjson_err_sink);
+			}
+			return true;
+		}
+	}
+	memcpy(writer->buffer + writer->buffered, data, length);
+	writer->buffered += length;
+	return true;
+}
+
+static bool writer_in_object(const kzrjson_writer_t *writer) {
+	const size_t level = writer->depth - 1;
+	return (writer->stack[level / 8] >> (level % 8)) & 1;
+}
+
+/*
+ * Check that a value can be written here, and write the separator before it.
+ */
+static bool writer_before_value(kzrjson_writer_t *writer) {
+	if (writer->error != kzrjson_success) return false;
+	switch (writer->state) {
+	case writer_value:
+		return true;
+	case writer_first:
+		if (writer->depth > 0 && writer_in_object(writer)) return writer_fail(writer, kzrjson_err_parse);
+		return true;
+	case writer_next:
+		if (writer_in_object(writer)) return writer_fail(writer, kzrjson_err_parse);
+		return writer_put(writer, &value_separator, 1);
+	default:
+		return writer_fail(writer, kzrjson_err_parse);
+	}
+}
+
+static void writer_after_value(kzrjson_writer_t *writer) {
+	writer->state = writer->depth == 0 ? writer_done : writer_next;
+}
+
+static bool writer_scalar(kzrjson_writer_t *writer, const char *text, const size_t length) {
+	if (!writer_before_value(writer) || !writer_put(writer, text, length)) return false;
+	writer_after_value(writer);
+	return true;
+}
+
+static bool writer_begin(kzrjson_writer_t *writer, const bool object) {
+	if (!writer_before_value(writer)) return false;
+	if (writer->depth == KZRJSON_WRITER_MAX_DEPTH) return writer_fail(writer, kzrjson_err_too_deep);
+	const size_t level = writer->depth++;
+	if (object) {
+		writer->stack[level / 8] |= (uint8_t)(1u << (level % 8));
+	} else {
+		writer->stack[level / 8] &= (uint8_t)~(1u << (level % 8));
+	}
+	writer->state = writer_first;
+	return writer_put(writer, object ? &begin_object : &begin_array, 1);
+}
+
+static bool writer_end(kzrjson_writer_t *writer, const bool object) {
+	if (writer->error != kzrjson_success) return false;
+	if (writer->depth == 0 || writer->state == writer_value || writer_in_object(writer) != object) {
+		return writer_fail(writer, kzrjson_err_parse);
+	}
+	writer->depth--;
+	writer_after_value(writer);
+	return writer_put(writer, object ? &end_object : &end_array, 1);
+}
+
+/*
+ * Write the string between quotation marks, escaped.
+ * Runs of characters which need no escape are written at once.
+ */
+static bool writer_quoted(kzrjson_writer_t *writer, const char *string, const size_t length) {
+	if (!writer_put(writer, &quotation_mark, 1)) return false;
+	size_t begin = 0;
+	for (size_t i = 0; i < length; i++) {
+		if (!needs_escape((unsigned char)string[i])) continue;
+		char escaped[6];
+		if (!writer_put(writer, string + begin, i - begin)
+			|| !writer_put(writer, escaped, escape_char(escaped, (unsigned char)string[i]))) {
+			return false;
+		}
+		begin = i + 1;
+	}
+	return writer_put(writer, string + begin, length - begin) && writer_put(writer, &quotation_mark, 1);
+}
+
+/*
+ * Decimal digits of the number, written backward from end.
+ * 20 bytes before end are enough. Return the first digit.
+ */
+static char *format_uint64(char *end, uint64_t number) {
+	do {
+		*--end = (char)('0' + number % 10);
+		number /= 10;
+	} while (number != 0);
+	return end;
+}
+
+void kzrjson_writer_init(kzrjson_writer_t *writer, const kzrjson_sink_t sink) {
+	memset(writer, 0, sizeof(kzrjson_writer_t));
+	writer->sink = sink;
+	writer->error = kzrjson_success;
+	writer->state = writer_first;
+}
+
+void kzrjson_writer_init_text(kzrjson_writer_t *writer) {
+	const kzrjson_sink_t sink = {NULL, NULL};
+	kzrjson_writer_init(writer, sink);
+}
+
+bool kzrjson_writer_begin_object(kzrjson_writer_t *writer) {
+	return writer_begin(writer, true);
+}
+
+bool kzrjson_writer_end_object(kzrjson_writer_t *writer) {
+	return writer_end(writer, true);
+}
+
+bool kzrjson_writer_begin_array(kzrjson_writer_t *writer) {
+	return writer_begin(writer, false);
+}
+
+bool kzrjson_writer_end_array(kzrjson_writer_t *writer) {
+	return writer_end(writer, false);
+}
+
+bool kzrjson_writer_key(kzrjson_writer_t *writer, const char *key, const size_t length) {
+	if (writer->error != kzrjson_success) return false;
+	if (writer->depth == 0 || !writer_in_object(writer) || writer->state == writer_value) {
+		return writer_fail(writer, kzrjson_err_parse);
+	}
+	if (writer->state == writer_next && !writer_put(writer, &value_separator, 1)) return false;
+	if (!writer_quoted(writer, key, length) || !writer_put(writer, &name_separator, 1)) return false;
+	writer->state = writer_value;
+	return true;
+}
+
+bool kzrjson_writer_string(kzrjson_writer_t *writer, const char *string, const size_t length) {
+	if (!writer_before_value(writer) || !writer_quoted(writer, string, length)) return false;
+	writer_after_value(writer);
+	return true;
+}
+
+bool kzrjson_writer_int64(kzrjson_writer_t *writer, const int64_t number) {
+	char buffer[21];
+	char *end = buffer + sizeof(buffer);
+	char *begin = format_uint64(end, number < 0 ? 0 - (uint64_t)number : (uint64_t)number);
+	if (number < 0) *--begin = '-';
+	return writer_scalar(writer, begin, (size_t)(end - begin));
+}
+
+bool kzrjson_writer_uint64(kzrjson_writer_t *writer, const uint64_t number) {
+	char buffer[20];
+	char *end = buffer + sizeof(buffer);
+	char *begin = format_uint64(end, number);
+	return writer_scalar(writer, begin, (size_t)(end - begin));
+}
+
+bool kzrjson_writer_double(kzrjson_writer_t *writer, const double number) {
+	if (!isfinite(number)) return writer_fail(writer, kzrjson_err_not_number);
+	char buffer[PACKED_FORMAT_SIZE];
+	return writer_scalar(writer, buffer, format_double(buffer, number));
+}
+
+bool kzrjson_writer_bool(kzrjson_writer_t *writer, const bool boolean) {
+	return boolean ? writer_scalar(writer, "true", 4) : writer_scalar(writer, "false", 5);
 }
 
-kzrjson_t kzrjson_parse(const char *json_text) {
-	kzrjson_set_success();
+bool kzrjson_writer_null(kzrjson_writer_t *writer) {
+	return writer_scalar(writer, "null", 4);
+}
+
+bool kzrjson_writer_raw(kzrjson_writer_t *writer, const char *json_text, const size_t length) {
+	return writer_scalar(writer, json_text, length);
+}
+
+bool kzrjson_writer_finish(kzrjson_writer_t *writer) {
+	if (writer->error != kzrjson_success) return false;
+	if (writer->state != writer_done) return writer_fail(writer, kzrjson_err_parse);
+	if (writer->sink.write == NULL) return true;
+	return writer_flush(writer);
+}
+
+/*****************************************************************************
+ * Pack and unpack
+ *****************************************************************************/
+/*
+ * A format is compiled to a sequence of operations.
+ * A begin operation has the number of members or elements,
+ * so that kzrjson_pack allocates the container at once.
+ */
+enum {
+	pack_op_string = 0,
+	pack_op_string_length,
+	pack_op_int,
+	pack_op_int64,
+	pack_op_uint64,
+	pack_op_double,
+	pack_op_bool,
+	pack_op_null,
+	pack_op_begin_object,
+	pack_op_end_object,
+	pack_op_begin_array,
+	pack_op_end_array,
+};
+
+struct pack_op {
+	uint32_t code;
+	uint32_t size;
+};
+
+#define PACK_MAX_DEPTH 32
+#define PACK_CACHED_FORMAT_SIZE 128
+#define PACK_CACHE_SIZE 8
+
+/*
+ * Compiled format. A format has at most as many operations as characters.
+ */
+struct pack_program {
+	char format[PACK_CACHED_FORMAT_SIZE];
+	struct pack_op ops[PACK_CACHED_FORMAT_SIZE];
+};
+
+// programs of formats used recently, by the address of the format
+static KZRJSON_THREAD_LOCAL struct pack_program g_pack_programs[PACK_CACHE_SIZE];
 
-	set_lexer(json_text);
+/*
+ * Compile the format to ops. Return the number of operations, or 0 if it is wrong.
+ *
+ * [exception] kzrjson_err_parse
+ * [exception] kzrjson_err_too_deep
+ */
+static size_t pack_compile(const char *format, struct pack_op *ops) {
+	size_t stack[PACK_MAX_DEPTH]; // positions of begin operations
+	size_t depth = 0;
+	size_t size = 0;
+	bool key = false; // a key comes next in the object
+	bool done = false;
+	for (const char *p = format; *p != '\0'; p++) {
+		if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == ':' || *p == ',') continue;
+		if (done) goto throw_parse;
+		struct pack_op *parent = depth > 0 ? ops + stack[depth - 1] : NULL;
+		const bool in_object = parent != NULL && parent->code == pack_op_begin_object;
+		struct pack_op *op = ops + size++;
+		op->size = 0;
+		if (*p == '}' || *p == ']') {
+			if (parent == NULL || (*p == '}') != in_object || (in_object && !key)) goto throw_parse;
+			op->code = in_object ? pack_op_end_object : pack_op_end_array;
+			depth--;
+		} else if (in_object && key) {
+			if (*p != 's') goto throw_parse;
+			op->code = pack_op_string;
+			if (p[1] == '#') {
+				op->code = pack_op_string_length;
+				p++;
+			}
+			parent->size++;
+			key = false;
+			continue;
+		} else {
+			if (parent != NULL && !in_object) parent->size++;
+			switch (*p) {
+			case 's':
+				op->code = pack_op_string;
+				if (p[1] == '#') {
+					op->code = pack_op_string_length;
+					p++;
+				}
+				break;
+			case 'i': op->code = pack_op_int; break;
+			case 'I': op->code = pack_op_int64; break;
+			case 'U': op->code = pack_op_uint64; break;
+			case 'f': op->code = pack_op_double; break;
+			case 'b': op->code = pack_op_bool; break;
+			case 'n': op->code = pack_op_null; break;
+			case '{':
+			case '[':
+				if (depth == PACK_MAX_DEPTH) {
+					set_kzrjson_errno(kzrjson_err_too_deep);
+					return 0;
+				}
+				op->code = *p == '{' ? pack_op_begin_object : pack_op_begin_array;
+				stack[depth++] = size - 1;
+				key = *p == '{';
+				continue;
+			default:
+				goto throw_parse;
+			}
+		}
 
-	kzrjson_t any;
-	any = parse_json_text();
-	if (kzrjson_errno() != kzrjson_success) {
-		kzrjson_free(any);
-		return NULL;
+		// a value is complete
+		if (depth == 0) {
+			done = true;
+		} else {
+			key = ops[stack[depth - 1]].code == pack_op_begin_object;
+		}
 	}
+	if (!done) goto throw_parse;
+	return size;
 
-	lexer.pos = NULL;
-	lexer.text = NULL;
-
-	return any;
+throw_parse:
+	set_kzrjson_errno(kzrjson_err_parse);
+	return 0;
 }
 
-kzrjson_t kzrjson_get_member(kzrjson_t object, const char *key) {
-	kzrjson_set_success();
-	if (object->type != kzrjson_object) {
-		set_kzrjson_errno(kzrjson_err_illegal_type);
+/*
+ * Operations of the format, kept in the cache or compiled.
+ * If they are not kept, *allocated is set to them; release it by free.
+ *
+ * [exception] kzrjson_err_parse
+ * [exception] kzrjson_err_too_deep
+ * [exception] kzrjson_err_calloc
+ */
+static const struct pack_op *pack_program(const char *format, struct pack_op **allocated) {
+	*allocated = NULL;
+	const size_t length = format != NULL ? strlen(format) : 0;
+	if (length == 0) {
+		set_kzrjson_errno(kzrjson_err_parse);
 		return NULL;
 	}
-	for (size_t i = 0; i < object->elements_size; i++) {
-		kzrjson_t member = *(object->elements + i);
-		if (strcmp(key, member->key) == 0) {
-			return member;
-		}
+	if (length < PACK_CACHED_FORMAT_SIZE) {
+		struct pack_program *program = g_pack_programs + ((uintptr_t)format >> 3) % PACK_CACHE_SIZE;
+		if (memcmp(program->format, format, length + 1) == 0) return program->ops;
+		program->format[0] = '\0';
+		if (pack_compile(format, program->ops) == 0) return NULL;
+		memcpy(program->format, format, length + 1);
+		return program->ops;
 	}
-	set_kzrjson_errno(kzrjson_err_object_key_not_found);
-	return NULL;
+	*allocated = malloc(length * sizeof(struct pack_op));
+	if (*allocated == NULL) {
+		set_kzrjson_errno(kzrjson_err_calloc);
+		return NULL;
+	}
+	if (pack_compile(format, *allocated) == 0) {
+		free(*allocated);
+		*allocated = NULL;
+		return NULL;
+	}
+	return *allocated;
 }
 
-kzrjson_t kzrjson_get_value_from_key(kzrjson_t object, const char *key) {
-	kzrjson_set_success();
-	if (object->type != kzrjson_object) {
+/*
+ * Read a string argument of the operation, and its length.
+ *
+ * [exception] kzrjson_err_illegal_type
+ */
+static const char *pack_string_argument(const struct pack_op *op, va_list *args, size_t *length) {
+	const char *string = va_arg(*args, const char *);
+	*length = op->code == pack_op_string_length ? va_arg(*args, size_t) : 0;
+	if (string == NULL) {
 		set_kzrjson_errno(kzrjson_err_illegal_type);
 		return NULL;
 	}
-	kzrjson_t member = kzrjson_get_member(object, key);
-	if (kzrjson_errno() != kzrjson_success) {
-		return NULL;
-	}
-	return member->value;
+	if (op->code == pack_op_string) *length = strlen(string);
+	return string;
 }
 
-kzrjson_t kzrjson_make_object(void) {
-	kzrjson_set_success();
-	kzrjson_t json = make_object();
-	if (kzrjson_errno() != kzrjson_success) return NULL;
+/*
+ * Make a number of the text from text to end.
+ *
+ * [exception] kzrjson_err_calloc
+ */
+static kzrjson_t pack_number(const char *text, const char *end, const kzrjson_number_type type) {
+	char *buffer = copy_string(text, (size_t)(end - text));
+	if (buffer == NULL) return NULL;
+	kzrjson_t json = make_json(kzrjson_number, buffer);
+	if (json == NULL) {
+		release(g_doc, buffer);
+		return NULL;
+	}
+	json->number_type = type;
 	return json;
 }
 
-kzrjson_t kzrjson_make_array(void) {
-	kzrjson_set_success();
-	kzrjson_t json = make_array();
-	if (kzrjson_errno() != kzrjson_success) return NULL;
+static kzrjson_t pack_int64(const int64_t number) {
+	char buffer[21];
+	char *end = buffer + sizeof(buffer);
+	char *begin = format_uint64(end, number < 0 ? 0 - (uint64_t)number : (uint64_t)number);
+	if (number < 0) *--begin = '-';
+	kzrjson_t json = pack_number(begin, end, number < 0 ? kzrjson_int : kzrjson_uint);
+	if (json != NULL) json->number_int = number;
 	return json;
 }
 
-bool kzrjson_object_add_member(kzrjson_t object, kzrjson_t member) {
-	if (!object || !member) return false;
-	kzrjson_set_success();
-	if (object->type != kzrjson_object) {
-		set_kzrjson_errno(kzrjson_err_illegal_type);
-		return false;
+/*
+ * Copy the string to the document, escaped as in JSON text
+ * as kzrjson_writer_string does.
+ *
+ * [exception] kzrjson_err_calloc
+ */
+static char *pack_escaped(const char *string, const size_t length, size_t *escaped_length) {
+	char escaped[6];
+	size_t size = length;
+	for (size_t i = 0; i < length; i++) {
+		if (needs_escape((unsigned char)string[i])) size += escape_char(escaped, (unsigned char)string[i]) - 1;
 	}
-	if (member->type != kzrjson_member) {
-		set_kzrjson_errno(kzrjson_err_illegal_type);
-		return false;
+	if (size == length) {
+		*escaped_length = length;
+		return copy_string(string, length);
 	}
-	add_element(object, member);
-	return true;
-}
-
-bool kzrjson_array_add_element(kzrjson_t array, kzrjson_t element) {
-	if (!array || !element) return false;
-	kzrjson_set_success();
-	if (array->type != kzrjson_array) {
-		set_kzrjson_errno(kzrjson_err_illegal_type);
-		return false;
+	char *buffer = allocate(g_doc, size + 1);
+	if (buffer == NULL) return NULL;
+	char *out = buffer;
+	for (size_t i = 0; i < length; i++) {
+		if (needs_escape((unsigned char)string[i])) {
+			out += escape_char(out, (unsigned char)string[i]);
+		} else {
+			*out++ = string[i];
+		}
 	}
-	add_element(array, element);
-	return true;
+	*out = '\0';
+	*escaped_length = size;
+	return buffer;
 }
 
-kzrjson_t kzrjson_make_member(const char *key, const size_t key_length, kzrjson_t value) {
-	kzrjson_set_success();
-
-	char *buffer = copy_string(key, key_length);
-	if (kzrjson_errno() != kzrjson_success) return NULL;
+/*
+ * Make the value of the operations from *op, and move *op past them.
+ *
+ * [exception] kzrjson_err_illegal_type
+ * [exception] kzrjson_err_not_number
+ * [exception] kzrjson_err_calloc
+ */
+static kzrjson_t pack_value(const struct pack_op **op, va_list *args) {
+	const struct pack_op *current = (*op)++;
+	switch (current->code) {
+	case pack_op_string:
+	case pack_op_string_length: {
+		size_t length;
+		const char *string = pack_string_argument(current, args, &length);
+		if (string == NULL) return NULL;
+		char *buffer = pack_escaped(string, length, &length);
+		if (buffer == NULL) return NULL;
+		kzrjson_t json = make_string(buffer);
+		if (json == NULL) release(g_doc, buffer);
+		return json;
+	}
+	case pack_op_int:
+		return pack_int64(va_arg(*args, int));
+	case pack_op_int64:
+		return pack_int64(va_arg(*args, int64_t));
+	case pack_op_uint64: {
+		const uint64_t number = va_arg(*args, uint64_t);
+		char buffer[20];
+		char *end = buffer + sizeof(buffer);
+		kzrjson_t json = pack_number(format_uint64(end, number), end, kzrjson_uint);
+		if (json != NULL) json->number_uint = number;
+		return json;
+	}
+	case pack_op_double: {
+		const double number = va_arg(*args, double);
+		if (!isfinite(number)) {
+			set_kzrjson_errno(kzrjson_err_not_number);
+			return NULL;
+		}
+		char buffer[PACKED_FORMAT_SIZE];
+		kzrjson_t json = pack_number(buffer, buffer + format_double(buffer, number), kzrjson_double);
+		if (json != NULL) json->number_double = number;
+		return json;
+	}
+	case pack_op_bool:
+		return make_boolean(va_arg(*args, int) != 0);
+	case pack_op_null:
+		return make_null();
+	default:
+		break;
+	}
 
-	kzrjson_t member = make_member(buffer);
-	if (kzrjson_errno() != kzrjson_success) return NULL;
+	const bool object = current->code == pack_op_begin_object;
+	kzrjson_t container = object ? make_object() : make_array();
+	if (container == NULL) return NULL;
+	if (current->size > 0) {
+		container->elements = allocate(g_doc, current->size * sizeof(kzrjson_t));
+		if (container->elements == NULL) goto throw_exp;
+		container->elements_capacity = current->size;
+	}
+	for (size_t i = 0; i < current->size; i++) {
+		kzrjson_t member = NULL;
+		if (object) {
+			size_t length;
+			const char *key = pack_string_argument((*op)++, args, &length);
+			if (key == NULL) goto throw_exp;
+			char *buffer = pack_escaped(key, length, &length);
+			if (buffer == NULL) goto throw_exp;
+			member = make_member(buffer, length);
+			if (member == NULL) {
+				release(g_doc, buffer);
+				goto throw_exp;
+			}
+			container->elements[container->elements_size++] = member;
+		}
+		kzrjson_t value = pack_value(op, args);
+		if (value == NULL) goto throw_exp;
+		if (object) {
+			add_value(member, value);
+		} else {
+			container->elements[container->elements_size++] = value;
+		}
+	}
+	(*op)++; // end of the container
+	return container;
 
-	add_value(member, value);
-	return member;
+throw_exp:
+	kzrjson_any_free(container);
+	return NULL;
 }
 
-kzrjson_t kzrjson_make_string(const char *string, const size_t length) {
-	kzrjson_set_success();
-
-	char *buffer = copy_string(string, length);
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-
-	kzrjson_t json = make_string(buffer);
-	if (kzrjson_errno() != kzrjson_success) return NULL;
+/*
+ * Write the value of the operations from *op, and move *op past them.
+ *
+ * [exception] kzrjson_err_illegal_type
+ */
+static bool pack_write(kzrjson_writer_t *writer, const struct pack_op **op, va_list *args) {
+	const struct pack_op *current = (*op)++;
+	switch (current->code) {
+	case pack_op_string:
+	case pack_op_string_length: {
+		size_t length;
+		const char *string = pack_string_argument(current, args, &length);
+		if (string == NULL) return writer_fail(writer, kzrjson_err_illegal_type);
+		return kzrjson_writer_string(writer, string, length);
+	}
+	case pack_op_int:
+		return kzrjson_writer_int64(writer, va_arg(*args, int));
+	case pack_op_int64:
+		return kzrjson_writer_int64(writer, va_arg(*args, int64_t));
+	case pack_op_uint64:
+		return kzrjson_writer_uint64(writer, va_arg(*args, uint64_t));
+	case pack_op_double:
+		return kzrjson_writer_double(writer, va_arg(*args, double));
+	case pack_op_bool:
+		return kzrjson_writer_bool(writer, va_arg(*args, int) != 0);
+	case pack_op_null:
+		return kzrjson_writer_null(writer);
+	default:
+		break;
+	}
 
-	return json;
+	const bool object = current->code == pack_op_begin_object;
+	if (!writer_begin(writer, object)) return false;
+	for (size_t i = 0; i < current->size; i++) {
+		if (object) {
+			size_t length;
+			const char *key = pack_string_argument((*op)++, args, &length);
+			if (key == NULL) return writer_fail(writer, kzrjson_err_illegal_type);
+			if (!kzrjson_writer_key(writer, key, length)) return false;
+		}
+		if (!pack_write(writer, op, args)) return false;
+	}
+	(*op)++; // end of the container
+	return writer_end(writer, object);
 }
 
-kzrjson_t kzrjson_make_boolean(const bool boolean) {
-	kzrjson_set_success();
-	kzrjson_t json = make_boolean(boolean);
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	return json;
+/*
+ * Integer value of the number, if it fits in int64_t or uint64_t.
+ *
+ * [exception] kzrjson_err_not_number
+ */
+static bool unpack_int64(const packed_value value, int64_t *out) {
+	if (value.type == kzrjson_packed_int64) {
+		*out = value.int64;
+	} else if (value.type == kzrjson_packed_uint64 && value.uint64 <= INT64_MAX) {
+		*out = (int64_t)value.uint64;
+	} else {
+		set_kzrjson_errno(kzrjson_err_not_number);
+		return false;
+	}
+	return true;
 }
 
-kzrjson_t kzrjson_make_null(void) {
-	kzrjson_set_success();
-	kzrjson_t json = make_null();
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	return json;
+/*
+ * Read the number of the operation to the next argument.
+ * value is of number_value or packed_at.
+ *
+ * [exception] kzrjson_err_not_number
+ */
+static bool unpack_number(const struct pack_op *op, const packed_value value, va_list *args) {
+	int64_t number;
+	switch (op->code) {
+	case pack_op_int:
+		if (!unpack_int64(value, &number)) return false;
+		if (number < INT_MIN || number > INT_MAX) {
+			set_kzrjson_errno(kzrjson_err_not_number);
+			return false;
+		}
+		*va_arg(*args, int *) = (int)number;
+		return true;
+	case pack_op_int64:
+		return unpack_int64(value, va_arg(*args, int64_t *));
+	case pack_op_uint64:
+		if (value.type == kzrjson_packed_uint64) {
+			*va_arg(*args, uint64_t *) = value.uint64;
+		} else if (value.type == kzrjson_packed_int64 && value.int64 >= 0) {
+			*va_arg(*args, uint64_t *) = (uint64_t)value.int64;
+		} else {
+			set_kzrjson_errno(kzrjson_err_not_number);
+			return false;
+		}
+		return true;
+	default:
+		if (value.type == kzrjson_packed_none) {
+			set_kzrjson_errno(kzrjson_err_not_number);
+			return false;
+		}
+		*va_arg(*args, double *) = value.type == kzrjson_packed_int64 ? (double)value.int64
+			: value.type == kzrjson_packed_uint64 ? (double)value.uint64 : value.number;
+		return true;
+	}
 }
 
-kzrjson_t kzrjson_make_number_double(const double number) {
-	kzrjson_set_success();
-	static const size_t double_max_digit = 16;
-	char *buffer = calloc(double_max_digit + 1, sizeof(char));
-	if (buffer == NULL) {
-		set_kzrjson_errno(kzrjson_err_calloc);
-		return NULL;
-	}
-	snprintf(buffer, double_max_digit + 1, "%lf", number);
-	kzrjson_t json = make_number(buffer, kzrjson_double);
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	return json;
+static bool is_number_op(const struct pack_op *op) {
+	return op->code >= pack_op_int && op->code <= pack_op_double;
 }
 
-kzrjson_t kzrjson_make_number_uint(const uint64_t number) {
-	kzrjson_set_success();
-	static const size_t uint64_max_digit = 20;
-	char *buffer = calloc(uint64_max_digit + 1, sizeof(char));
-	if (buffer == NULL) {
-		set_kzrjson_errno(kzrjson_err_calloc);
-		return NULL;
+/*
+ * Read the value of the operations from *op, and move *op past them.
+ *
+ * [exception] kzrjson_err_illegal_type
+ * [exception] kzrjson_err_object_key_not_found
+ * [exception] kzrjson_err_index_out_of_range
+ * [exception] kzrjson_err_not_number
+ */
+static bool unpack_value(kzrjson_t json, const struct pack_op **op, va_list *args) {
+	const struct pack_op *current = (*op)++;
+	switch (current->code) {
+	case pack_op_string:
+	case pack_op_string_length:
+		if (json->type != kzrjson_string) goto throw_illegal_type;
+		*va_arg(*args, const char **) = json->string;
+		if (current->code == pack_op_string_length) *va_arg(*args, size_t *) = strlen(json->string);
+		return true;
+	case pack_op_int:
+	case pack_op_int64:
+	case pack_op_uint64:
+	case pack_op_double:
+		if (json->type != kzrjson_number) goto throw_illegal_type;
+		return unpack_number(current, number_value(json), args);
+	case pack_op_bool:
+		if (json->type != kzrjson_bool) goto throw_illegal_type;
+		*va_arg(*args, bool *) = json->boolean;
+		return true;
+	case pack_op_null:
+		if (json->type != kzrjson_null) goto throw_illegal_type;
+		return true;
+	case pack_op_begin_object:
+		if (json->type != kzrjson_object) goto throw_illegal_type;
+		for (size_t i = 0; i < current->size; i++) {
+			size_t length;
+			const char *key = pack_string_argument((*op)++, args, &length);
+			if (key == NULL) return false;
+			kzrjson_t member = kzrjson_get_member_n(json, key, length);
+			if (member == NULL) return false;
+			if (!unpack_value(member->value, op, args)) return false;
+		}
+		break;
+	default:
+		if (json->type != kzrjson_array) goto throw_illegal_type;
+		if (json->elements_size < current->size) {
+			set_kzrjson_errno(kzrjson_err_index_out_of_range);
+			return false;
+		}
+		for (size_t i = 0; i < current->size; i++) {
+			if (json->packed_type == kzrjson_packed_none) {
+				if (!unpack_value(json->elements[i], op, args)) return false;
+				continue;
+			}
+			const struct pack_op *element = (*op)++;
+			if (!is_number_op(element)) goto throw_illegal_type;
+			if (!unpack_number(element, packed_at(json, i), args)) return false;
+		}
+		break;
 	}
-	snprintf(buffer, uint64_max_digit + 1, "%llu", number);
-	kzrjson_t json = make_number(buffer, kzrjson_uint);
-	if (kzrjson_errno() != kzrjson_success) return NULL;
-	return json;
+	(*op)++; // end of the container
+	return true;
+
+throw_illegal_type:
+	set_kzrjson_errno(kzrjson_err_illegal_type);
+	return false;
 }
 
-kzrjson_t kzrjson_make_number_int(const int64_t number) {
+kzrjson_t kzrjson_pack(const char *format, ...) {
 	kzrjson_set_success();
-	static const size_t int64_t_max_digit = 19;
-	char *buffer = calloc(int64_t_max_digit + 1, sizeof(char));
-	if (buffer == NULL) {
-		set_kzrjson_errno(kzrjson_err_calloc);
-		return NULL;
-	}
-	snprintf(buffer, int64_t_max_digit + 1, "%lld", number);
-	kzrjson_t json = make_number(buffer, kzrjson_int);
-	if (kzrjson_errno() != kzrjson_success) return NULL;
+	struct pack_op *allocated;
+	const struct pack_op *op = pack_program(format, &allocated);
+	if (op == NULL) return NULL;
+	va_list args;
+	va_start(args, format);
+	kzrjson_t json = pack_value(&op, &args);
+	va_end(args);
+	free(allocated);
 	return json;
 }
 
-kzrjson_t kzrjson_make_number_exp(const char *exp, const size_t length) {
+bool kzrjson_writer_pack(kzrjson_writer_t *writer, const char *format, ...) {
 	kzrjson_set_success();
-
-	char *end;
-	(void) strtod(exp, &end);
-	if (exp == end) {
-		set_kzrjson_errno(kzrjson_err_not_number);
-		return NULL;
-	}
-
-	char *buffer = copy_string(exp, length);
-	if (kzrjson_errno() != kzrjson_success) {
-		return NULL;
-	}
-	kzrjson_t json = make_number(buffer, kzrjson_exp);
-	if (kzrjson_errno() != kzrjson_success) {
-		return NULL;
-	}
-	return json;
+	if (writer->error != kzrjson_success) return false;
+	struct pack_op *allocated;
+	const struct pack_op *op = pack_program(format, &allocated);
+	if (op == NULL) return writer_fail(writer, kzrjson_errno());
+	va_list args;
+	va_start(args, format);
+	const bool written = pack_write(writer, &op, &args);
+	va_end(args);
+	free(allocated);
+	return written;
 }
 
-kzrjson_text_t kzrjson_to_string(kzrjson_t data) {
+bool kzrjson_unpack(kzrjson_t data, const char *format, ...) {
 	kzrjson_set_success();
-	g_converter.length = 0;
-
-	kzrjson_text_t json;
-	json.length = kzrjson_any_length(data);
-	g_converter.begin = calloc(g_converter.length + 1, sizeof(char));
-	if (g_converter.begin == NULL) {
-		set_kzrjson_errno(kzrjson_err_calloc);
-		kzrjson_text_t fail = {
-			.text = NULL, 
-			.length = 0
-		};
-		return fail;
+	struct pack_op *allocated;
+	const struct pack_op *op = pack_program(format, &allocated);
+	if (op == NULL) return false;
+	if (data == NULL) {
+		free(allocated);
+		set_kzrjson_errno(kzrjson_err_illegal_type);
+		return false;
 	}
-	g_converter.pos = g_converter.begin;
-	kzrjson_any_to_string(data);
-	json.text = g_converter.begin;
-
-	g_converter.begin = NULL;
-	g_converter.length = 0;
-
-	return json;
+	va_list args;
+	va_start(args, format);
+	const bool unpacked = unpack_value(data, &op, &args);
+	va_end(args);
+	free(allocated);
+	return unpacked;
 }
@@ -1,13 +1,19 @@
 #ifndef KZRJSON_H
 #define KZRJSON_H
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /*****************************************************************************
  * error
  *****************************************************************************/
 /*
  * When error occurred, kzrjson functions set kzrjson_errno.
+ * kzrjson_errno is thread local, so each thread sees only its own errors.
  *
  * example)
  *    kzrjson_t json = kzrjson_parse(json_text);
@@ -33,6 +39,10 @@ typedef enum {
 	kzrjson_err_not_number,
 	kzrjson_err_illegal_type,
 	kzrjson_err_object_key_not_found,
+	kzrjson_err_foreign_data,
+	kzrjson_err_index_out_of_range,
+	kzrjson_err_too_deep,
+	kzrjson_err_sink,
 } kzrjson_errno_t;
 
 kzrjson_errno_t kzrjson_errno(void);
@@ -64,16 +74,56 @@ typedef enum {
 	kzrjson_exp,
 } kzrjson_number_type;
 
- typedef struct kzrjson_t *kzrjson_t;
-struct kzrjson_t {
+/*
+ * Type of values of a packed array (see kzrjson_array_pack).
+ */
+typedef enum {
+	kzrjson_packed_none = 0,
+	kzrjson_packed_int64,
+	kzrjson_packed_uint64,
+	kzrjson_packed_double,
+} kzrjson_packed_type;
+
+/*
+ * In C++, a typedef name can not be the same as the name of another struct,
+ * so the struct is named kzrjson_node there. The layout is the same.
+ */
+#ifdef __cplusplus
+#define KZRJSON_NODE kzrjson_node
+#else
+#define KZRJSON_NODE kzrjson_t
+#endif
+
+typedef struct KZRJSON_NODE *kzrjson_t;
+struct KZRJSON_NODE {
 	kzrjson_type type;
 
+	// document which owns this data, NULL if allocated by itself
+	struct kzrjson_doc *doc;
+
 	// elements of array or object
-	kzrjson_t *elements;
+	union {
+		kzrjson_t *elements;
+
+		// values of a packed array, instead of elements
+		int64_t *packed_int64;
+		uint64_t *packed_uint64;
+		double *packed_double;
+	};
 	size_t elements_size;
+	size_t elements_capacity;
+	kzrjson_packed_type packed_type;
+
+	// lookup index of object, NULL if the object has no index
+	struct kzrjson_index *index;
+
+	// shape of object shared with objects of the same keys, or NULL
+	// (see kzrjson_option_share_shapes). index is the index of the shape.
+	struct kzrjson_shape *shape;
 
 	// key, value of member
 	char *key;
+	size_t key_length;
 	kzrjson_t value;
 
 	// string presentation for string, number, boolean, null
@@ -100,10 +150,44 @@ typedef struct {
 	size_t length;
 } kzrjson_text_t;
 
+/*
+ * Destination of text written piece by piece.
+ * write returns false if it failed, then the writer stops with kzrjson_err_sink.
+ */
+typedef struct {
+	bool (*write)(const char *data, size_t length, void *context);
+	void *context;
+} kzrjson_sink_t;
+
+/*
+ * Result of kzrjson functions with the "_result" suffix.
+ * These return the value and the error code together,
+ * so the caller does not have to read kzrjson_errno() after each call.
+ *
+ * offset, line and column point to the position where parsing failed.
+ * offset is 0-origin in bytes, line and column are 1-origin
+ * (column is counted in bytes). They are 0 when code is kzrjson_success
+ * or the function does not parse text.
+ *
+ * example)
+ *    kzrjson_result_t result = kzrjson_parse_result(json_text);
+ *    if (result.code != kzrjson_success) {
+ *        fprintf(stderr, "%zu:%zu: error %d\n", result.line, result.column, result.code);
+ *    }
+ */
+typedef struct {
+	kzrjson_t value;
+	kzrjson_errno_t code;
+	size_t offset;
+	size_t line;
+	size_t column;
+} kzrjson_result_t;
+
 /*
  * Free kzrjson_t.
  * All memory in the kzrjson_t given as an argument is released,
  * so data retrieved from that kzrjson_t (object members, array elements, etc.) are also released.
+ * kzrjson_t owned by a document is not released; use kzrjson_doc_reset or kzrjson_doc_free.
  */
 void kzrjson_free(kzrjson_t any);
 
@@ -121,6 +205,194 @@ void kzrjson_free(kzrjson_t any);
  */
 kzrjson_t kzrjson_parse(const char *json_text);
 
+/*
+ * Same as kzrjson_parse, but return the error code and the failure position
+ * with the value. kzrjson_errno is also set.
+ */
+kzrjson_result_t kzrjson_parse_result(const char *json_text);
+
+/*
+ * Options of parse, combined by |.
+ */
+typedef enum {
+	// store arrays of only numbers as packed arrays (see kzrjson_array_pack)
+	kzrjson_option_pack_arrays = 1 << 0,
+
+	// in a document, intern keys and share one shape among objects with
+	// the same sequence of keys (ignored when not parsing into a document)
+	kzrjson_option_share_shapes = 1 << 1,
+
+	// with kzrjson_option_share_shapes (implied), expect an object in an array
+	// or a document to have the keys of the previous one, and only compare them
+	kzrjson_option_predict_keys = 1 << 2,
+} kzrjson_parse_option;
+
+kzrjson_result_t kzrjson_parse_with_options(const char *json_text, const unsigned options);
+
+/*
+ * Check that the text of length bytes is a JSON text, without making kzrjson_t.
+ * No memory is allocated; strings are checked for escape sequences and UTF-8.
+ * The text does not need to be null terminated.
+ * If err is not NULL, the error code and position are set to it
+ * (err->value is always NULL). kzrjson_errno is also set.
+ *
+ * [errno] kzrjson_err_tokenize
+ * [errno] kzrjson_err_parse
+ * [errno] kzrjson_err_too_deep (nested deeper than KZRJSON_READER_MAX_DEPTH)
+ */
+bool kzrjson_validate(const char *json_text, const size_t length, kzrjson_result_t *err);
+
+/*****************************************************************************
+ * Document
+ *****************************************************************************/
+/*
+ * Memory allocator used by a document.
+ * deallocate receives the size given to allocate.
+ * allocate must return memory aligned for any type, like malloc.
+ */
+typedef struct {
+	void *(*allocate)(size_t size, void *context);
+	void (*deallocate)(void *pointer, size_t size, void *context);
+	void *context;
+} kzrjson_allocator_t;
+
+/*
+ * A document owns all kzrjson_t parsed into it.
+ * They are allocated from an arena of the document instead of calloc per data,
+ * and released all at once by kzrjson_doc_reset or kzrjson_doc_free.
+ *
+ * kzrjson_doc_reset keeps the memory of the document, so parsing text of
+ * a size seen before makes no call to the allocator.
+ *
+ * example)
+ *    kzrjson_doc_t doc = kzrjson_doc_make();
+ *    while (receive(&message)) {
+ *        kzrjson_t json = kzrjson_doc_parse(doc, message);
+ *        // use json
+ *        kzrjson_doc_reset(doc);
+ *    }
+ *    kzrjson_doc_free(doc);
+ */
+typedef struct kzrjson_doc *kzrjson_doc_t;
+
+/*
+ * Make a document which allocates memory by malloc and free.
+ *
+ * [errno] kzrjson_err_calloc
+ */
+kzrjson_doc_t kzrjson_doc_make(void);
+
+/*
+ * Make a document which allocates memory by the allocator.
+ * The allocator is copied.
+ *
+ * [errno] kzrjson_err_calloc
+ */
+kzrjson_doc_t kzrjson_doc_make_with_allocator(const kzrjson_allocator_t *allocator);
+
+/*
+ * Parse JSON text into the document.
+ * The returned kzrjson_t is valid until the document is reset or freed.
+ * Members and elements added to it must be owned by the same document.
+ *
+ * [errno] kzrjson_err_tokenize
+ * [errno] kzrjson_err_parse
+ * [errno] kzrjson_err_calloc
+ */
+kzrjson_t kzrjson_doc_parse(kzrjson_doc_t doc, const char *json_text);
+kzrjson_result_t kzrjson_doc_parse_result(kzrjson_doc_t doc, const char *json_text);
+kzrjson_result_t kzrjson_doc_parse_with_options(kzrjson_doc_t doc, const char *json_text, const unsigned options);
+
+/*
+ * Release all kzrjson_t in the document, but keep its memory for reuse.
+ *
+ * [errno] kzrjson_err_calloc
+ */
+void kzrjson_doc_reset(kzrjson_doc_t doc);
+
+/*
+ * Release the document and all kzrjson_t in it.
+ */
+void kzrjson_doc_free(kzrjson_doc_t doc);
+
+/*
+ * Move *root into one block of memory in depth-first order, each node
+ * followed by its own strings and elements and then by its children,
+ * and release the rest of the document. *root is set to the moved root.
+ * Any other kzrjson_t of the document, and pointers into the old tree,
+ * are invalid after this.
+ * Shared shapes are not kept (see kzrjson_option_share_shapes);
+ * kzrjson_object_make_index makes an index again if it is needed.
+ * Return the number of bytes released.
+ *
+ * [errno] kzrjson_err_foreign_data (*root is not owned by the document)
+ * [errno] kzrjson_err_calloc
+ */
+size_t kzrjson_compact(kzrjson_doc_t doc, kzrjson_t *root);
+
+/*****************************************************************************
+ * Parse cache
+ *****************************************************************************/
+/*
+ * Cache of parsed JSON text keyed by its bytes, for texts received again
+ * and again (health checks, retries, the same configuration pushed).
+ * Parsing a text in the cache costs one hash and one compare of the bytes.
+ * Entries are evicted least recently used first to keep the memory
+ * under the limit. A cache can be used by threads at the same time.
+ *
+ * example)
+ *    kzrjson_cache_t cache = kzrjson_cache_make(64 * 1024 * 1024);
+ *    while (receive(&body, &length)) {
+ *        kzrjson_t json = kzrjson_cache_parse(cache, body, length).value;
+ *        // read json, but do not modify it
+ *        kzrjson_cache_release(json);
+ *    }
+ *    kzrjson_cache_free(cache);
+ */
+typedef struct kzrjson_cache *kzrjson_cache_t;
+
+typedef struct {
+	size_t hits;
+	size_t misses;
+	size_t evictions;
+
+	// texts in the cache, and memory for them in bytes
+	size_t entries;
+	size_t bytes;
+} kzrjson_cache_stats_t;
+
+/*
+ * Make a cache which keeps at most max_bytes of texts and parsed data.
+ *
+ * [errno] kzrjson_err_calloc
+ */
+kzrjson_cache_t kzrjson_cache_make(const size_t max_bytes);
+
+/*
+ * Parse JSON text of length bytes (not necessarily null terminated),
+ * or return the data parsed from the same bytes before.
+ * The data is shared and must not be modified. Release it by
+ * kzrjson_cache_release; it stays valid until then, even if it is evicted.
+ * A text larger than the limit is parsed, but not kept.
+ *
+ * [errno] kzrjson_err_tokenize
+ * [errno] kzrjson_err_parse (also a null character in the length)
+ * [errno] kzrjson_err_calloc
+ */
+kzrjson_result_t kzrjson_cache_parse(kzrjson_cache_t cache, const char *json_text, const size_t length);
+
+/*
+ * Release data returned by kzrjson_cache_parse.
+ */
+void kzrjson_cache_release(kzrjson_t json);
+
+kzrjson_cache_stats_t kzrjson_cache_stats(kzrjson_cache_t cache);
+
+/*
+ * Release the cache. Data not released yet stays valid until it is.
+ */
+void kzrjson_cache_free(kzrjson_cache_t cache);
+
 /*****************************************************************************
  * Print JSON
  *****************************************************************************/
@@ -141,6 +413,77 @@ void kzrjson_print(kzrjson_t any);
  */
 kzrjson_t kzrjson_get_member(kzrjson_t object, const char *key);
 
+/*
+ * Get a member from the object by key of the length.
+ * The key does not need to be null terminated.
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_object_key_not_found
+ */
+kzrjson_t kzrjson_get_member_n(kzrjson_t object, const char *key, const size_t length);
+
+/*
+ * Hash of a key used by object indexes (32-bit FNV-1a of the bytes).
+ * It can be computed at compile time, see kzr::key in kzrjson.hpp.
+ */
+uint32_t kzrjson_hash_key(const char *key, const size_t length);
+
+/*
+ * Get a member from the object by key with its precomputed hash.
+ * If the object has an index, the key is not hashed again.
+ * Otherwise members are compared by length first, and the hash is not used.
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_object_key_not_found
+ */
+kzrjson_t kzrjson_get_member_hashed(kzrjson_t object, const char *key, const size_t length, const uint32_t hash);
+
+/*
+ * Cache of lookups by one key, kept at a call site which looks up
+ * the key in many similar objects. Initialize it with {0}.
+ */
+typedef struct {
+	const char *key;
+	size_t length;
+	uint32_t hash;
+
+	// shape of the object of the last lookup, or NULL
+	const struct kzrjson_shape *shape;
+
+	// position of the member found last time + 1, or 0
+	size_t position;
+} kzrjson_lookup_cache_t;
+
+/*
+ * Get a member from the object by key, trying the position where
+ * the key was found last time first. On a hit, no key is hashed or scanned.
+ * The cache is reset when another key pointer is given, so the string
+ * of the key must not change while the cache is used with it.
+ * When an object without shape has members with the same key,
+ * the member may not be the first one.
+ *
+ * example)
+ *    kzrjson_lookup_cache_t city = {0};
+ *    for (size_t i = 0; i < zips->elements_size; i++) {
+ *        kzrjson_t member = kzrjson_get_member_cached(zips->elements[i], "City", &city);
+ *    }
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_object_key_not_found
+ */
+kzrjson_t kzrjson_get_member_cached(kzrjson_t object, const char *key, kzrjson_lookup_cache_t *cache);
+
+/*
+ * Build a hash index of the members of the object.
+ * Lookups on the object become O(1), and the index is kept up to date
+ * by the functions which add, insert, remove or move members.
+ * Worth it for objects with many members which are looked up repeatedly.
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_calloc
+ */
+bool kzrjson_object_make_index(kzrjson_t object);
+
 /*
  * Get a key of the member.
  *
@@ -156,6 +499,174 @@ const char *kzrjson_get_member_key(kzrjson_t member);
  */
 kzrjson_t kzrjson_get_value_from_key(kzrjson_t object, const char *key);
 
+/*
+ * Same as kzrjson_get_member and kzrjson_get_value_from_key,
+ * but return the error code with the value.
+ */
+kzrjson_result_t kzrjson_get_member_result(kzrjson_t object, const char *key);
+kzrjson_result_t kzrjson_get_value_result(kzrjson_t object, const char *key);
+
+/*****************************************************************************
+ * Modify JSON
+ *****************************************************************************/
+/*
+ * Functions in this section change arrays and objects in place.
+ * Removed or replaced data is returned to the caller and is no longer
+ * a part of the container; release it by kzrjson_free.
+ * Inserted data must be owned by the same document as the container,
+ * and must not have the container in it (kzrjson_err_illegal_type).
+ * Removing the member by key finds the first member with the key.
+ */
+
+/*
+ * Insert the element to the array at index (0 <= index <= elements_size).
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_foreign_data
+ * [errno] kzrjson_err_index_out_of_range
+ * [errno] kzrjson_err_calloc
+ */
+bool kzrjson_array_insert_element(kzrjson_t array, const size_t index, kzrjson_t element);
+
+/*
+ * Remove the element at index from the array, keeping the order of the rest.
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_index_out_of_range
+ */
+kzrjson_t kzrjson_array_remove_element(kzrjson_t array, const size_t index);
+
+/*
+ * Remove the element at index from the array in O(1).
+ * The last element is moved to index.
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_index_out_of_range
+ */
+kzrjson_t kzrjson_array_swap_remove_element(kzrjson_t array, const size_t index);
+
+/*
+ * Replace the element at index, and return the old element.
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_foreign_data
+ * [errno] kzrjson_err_index_out_of_range
+ */
+kzrjson_t kzrjson_array_replace_element(kzrjson_t array, const size_t index, kzrjson_t element);
+
+/*
+ * Insert the member to the object at index (0 <= index <= elements_size).
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_foreign_data
+ * [errno] kzrjson_err_index_out_of_range
+ * [errno] kzrjson_err_calloc
+ */
+bool kzrjson_object_insert_member(kzrjson_t object, const size_t index, kzrjson_t member);
+
+/*
+ * Remove the member with the key from the object, keeping the order of the rest.
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_object_key_not_found
+ */
+kzrjson_t kzrjson_object_remove_member(kzrjson_t object, const char *key);
+
+/*
+ * Remove the member with the key from the object.
+ * The last member is moved to the position of the removed member.
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_object_key_not_found
+ */
+kzrjson_t kzrjson_object_swap_remove_member(kzrjson_t object, const char *key);
+
+/*
+ * Replace the value of the member with the key, and return the old value.
+ * The value can not be a member.
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_foreign_data
+ * [errno] kzrjson_err_object_key_not_found
+ */
+kzrjson_t kzrjson_object_replace_value(kzrjson_t object, const char *key, kzrjson_t value);
+
+/*
+ * Move the element at from_index of from to to_index of to without copying.
+ * from and to are both arrays or both objects, and may be the same one.
+ * to_index is the index after the element is removed from from.
+ *
+ * [errno] kzrjson_err_illegal_type (also when to is in the element)
+ * [errno] kzrjson_err_foreign_data
+ * [errno] kzrjson_err_index_out_of_range
+ * [errno] kzrjson_err_calloc
+ */
+bool kzrjson_move_element(kzrjson_t from, const size_t from_index, kzrjson_t to, const size_t to_index);
+
+/*****************************************************************************
+ * Packed arrays
+ *****************************************************************************/
+/*
+ * A packed array stores its numbers in a buffer of int64_t, uint64_t or double
+ * (packed_int64, packed_uint64 or packed_double) instead of kzrjson_t per element.
+ * elements_size is the number of values, and elements is not valid.
+ * Print, to_string, kzrjson_array_get_* and kzrjson_array_as_* read
+ * the values directly. Functions which modify elements of an array unpack it.
+ *
+ * example)
+ *    kzrjson_result_t result = kzrjson_parse_with_options(text, kzrjson_option_pack_arrays);
+ *    kzrjson_t ids = kzrjson_get_value_from_key(image, "IDs");
+ *    const int64_t *values;
+ *    size_t size;
+ *    if (kzrjson_array_as_int64(ids, &values, &size)) {
+ *        // values[0] to values[size - 1]
+ *    }
+ */
+
+/*
+ * Pack an array of only numbers. The type of the values is
+ * int64 if all numbers are integers in int64_t, uint64 if they are in uint64_t,
+ * otherwise double if all numbers are exact in double.
+ * Return false if the array can not be packed.
+ *
+ * [errno] kzrjson_err_illegal_type (not an array)
+ * [errno] kzrjson_err_not_number (an element is not a number, or can not be packed)
+ * [errno] kzrjson_err_calloc
+ */
+bool kzrjson_array_pack(kzrjson_t array);
+
+/*
+ * Make kzrjson_t of each value of a packed array.
+ * An array which is not packed is not changed.
+ *
+ * [errno] kzrjson_err_illegal_type (not an array)
+ * [errno] kzrjson_err_calloc
+ */
+bool kzrjson_array_unpack(kzrjson_t array);
+
+/*
+ * Get the values of a packed array without copy.
+ * The pointer is valid until the array is modified.
+ *
+ * [errno] kzrjson_err_illegal_type (not a packed array of the type)
+ */
+bool kzrjson_array_as_int64(kzrjson_t array, const int64_t **values, size_t *size);
+bool kzrjson_array_as_uint64(kzrjson_t array, const uint64_t **values, size_t *size);
+bool kzrjson_array_as_double(kzrjson_t array, const double **values, size_t *size);
+
+/*
+ * Get a number element of an array, packed or not.
+ * kzrjson_array_get_int64 and kzrjson_array_get_uint64 need an integer
+ * in the range of the type.
+ *
+ * [errno] kzrjson_err_illegal_type (not an array)
+ * [errno] kzrjson_err_index_out_of_range
+ * [errno] kzrjson_err_not_number
+ */
+double kzrjson_array_get_double(kzrjson_t array, const size_t index);
+int64_t kzrjson_array_get_int64(kzrjson_t array, const size_t index);
+uint64_t kzrjson_array_get_uint64(kzrjson_t array, const size_t index);
+
 /*****************************************************************************
  * Make JSON
  ****************************************************************************/
@@ -171,18 +682,34 @@ kzrjson_t kzrjson_make_array(void);
 
 /*
  * Add the member to the object.
+ * The member must be owned by the same document as the object,
+ * and must not have the object in it.
  *
  * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_foreign_data
  */
 bool kzrjson_object_add_member(kzrjson_t object, kzrjson_t member);
 
 /*
  * Add the element to the array.
+ * The element must be owned by the same document as the array,
+ * and must not have the array in it.
  *
  * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_foreign_data
  */
 bool kzrjson_array_add_element(kzrjson_t array, kzrjson_t element);
 
+/*
+ * Add the elements to the array, making room for all of them at once.
+ * Nothing is added if any of the elements can not be added.
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_foreign_data
+ * [errno] kzrjson_err_calloc
+ */
+bool kzrjson_array_append_many(kzrjson_t array, const kzrjson_t *elements, const size_t size);
+
 /*
  * Make member from key and value.
  *
@@ -231,9 +758,705 @@ kzrjson_t kzrjson_make_number_int(const int64_t number);
  */
 kzrjson_t kzrjson_make_number_exp(const char *exp, const size_t length);
 
+/*
+ * Make a packed array (see kzrjson_array_pack) of a copy of the values.
+ * Numbers are formatted only when the array is written as text.
+ *
+ * [errno] kzrjson_err_not_number (a double is not finite)
+ * [errno] kzrjson_err_calloc
+ */
+kzrjson_t kzrjson_make_array_int64(const int64_t *values, const size_t size);
+kzrjson_t kzrjson_make_array_uint64(const uint64_t *values, const size_t size);
+kzrjson_t kzrjson_make_array_double(const double *values, const size_t size);
+
+/*
+ * Make an array of strings with the elements allocated at once.
+ * lengths may be NULL when the strings are null-terminated.
+ *
+ * [errno] kzrjson_err_calloc
+ */
+kzrjson_t kzrjson_make_array_strings(const char *const *strings, const size_t *lengths, const size_t size);
+
  /*
   * [errno] kzrjson_err_calloc
   */
 kzrjson_text_t kzrjson_to_string(kzrjson_t data);
 
+/*
+ * Canonical JSON text of RFC 8785 (JSON Canonicalization Scheme).
+ * The text is the same for equal data regardless of member order:
+ * - members are sorted by keys compared as UTF-16 code units
+ * - numbers are in the shortest form of ECMAScript (as double)
+ * - strings are escaped as ECMAScript JSON.stringify does
+ * - no white space
+ *
+ * [errno] kzrjson_err_tokenize (a string has an unpaired surrogate escape)
+ * [errno] kzrjson_err_calloc
+ */
+kzrjson_text_t kzrjson_to_string_canonical(kzrjson_t data);
+
+/*
+ * Write the canonical JSON text to the sink piece by piece,
+ * e.g. to feed a hash function without making the whole text.
+ * Return false if an error occurred.
+ *
+ * [errno] kzrjson_err_tokenize (a string has an unpaired surrogate escape)
+ * [errno] kzrjson_err_calloc
+ * [errno] kzrjson_err_sink
+ */
+bool kzrjson_write_canonical(kzrjson_t data, const kzrjson_sink_t sink);
+
+/*****************************************************************************
+ * Templates
+ *****************************************************************************/
+/*
+ * Text of JSON data with slots for values given at each rendering,
+ * for responses which differ only in a few values.
+ * A slot is a string "{{N}}" in the data, where N is the index of the value
+ * in the array given to kzrjson_template_render. Keys can not be slots.
+ * N is written without leading zeros; other strings, as "{{03}}" or an N
+ * which does not fit in size_t, are copied as they are.
+ * The other parts are converted to text once by kzrjson_template_compile,
+ * and copied as they are.
+ *
+ * example)
+ *    kzrjson_template_t response = kzrjson_template_compile(
+ *        kzrjson_parse("{\"id\": \"{{0}}\", \"status\": \"ok\", \"count\": \"{{1}}\"}"));
+ *    const kzrjson_slot_t values[] = {
+ *        {.type = kzrjson_slot_string, .string = id, .length = id_length},
+ *        {.type = kzrjson_slot_uint64, .uint64 = count},
+ *    };
+ *    size_t length = kzrjson_template_render(response, values, buffer, sizeof(buffer));
+ *    // {"id":"...","status":"ok","count":3}
+ */
+typedef struct kzrjson_template *kzrjson_template_t;
+
+typedef enum {
+	kzrjson_slot_null = 0,
+	kzrjson_slot_bool,
+	kzrjson_slot_int64,
+	kzrjson_slot_uint64,
+	kzrjson_slot_double,
+
+	// string, escaped when it is rendered
+	kzrjson_slot_string,
+
+	// JSON text, copied as it is
+	kzrjson_slot_raw,
+} kzrjson_slot_type;
+
+typedef struct {
+	kzrjson_slot_type type;
+	union {
+		bool boolean;
+		int64_t int64;
+		uint64_t uint64;
+		double number;
+		const char *string;
+	};
+
+	// length of string, for kzrjson_slot_string and kzrjson_slot_raw
+	size_t length;
+} kzrjson_slot_t;
+
+/*
+ * Compile the data into a template. The data is not used after this,
+ * and can be released.
+ *
+ * [errno] kzrjson_err_illegal_type (data is NULL)
+ * [errno] kzrjson_err_calloc
+ */
+kzrjson_template_t kzrjson_template_compile(kzrjson_t data);
+
+/*
+ * Number of values which kzrjson_template_render reads (the largest N + 1).
+ */
+size_t kzrjson_template_slots(kzrjson_template_t tpl);
+
+/*
+ * Render the template with the values to out, as snprintf does:
+ * at most capacity bytes are written, including the terminating null
+ * character, and the length of the whole text is returned.
+ * If it is capacity or more, render again with a larger buffer.
+ * 0 is returned if an error occurred.
+ *
+ * [errno] kzrjson_err_illegal_type (unknown type of a value)
+ * [errno] kzrjson_err_not_number (a double is not finite)
+ */
+size_t kzrjson_template_render(kzrjson_template_t tpl, const kzrjson_slot_t *values, char *out, const size_t capacity);
+
+void kzrjson_template_free(kzrjson_template_t tpl);
+
+/*****************************************************************************
+ * Write JSON
+ *****************************************************************************/
+/*
+ * kzrjson_writer_t writes JSON text value by value without making kzrjson_t.
+ * Separators are inserted by the writer, strings are escaped and numbers
+ * are formatted as they are written. Nesting is tracked by a bit per level.
+ * Calls which do not make JSON (e.g. a value in an object without a key)
+ * stop the writer with kzrjson_err_parse.
+ *
+ * The text is written to a sink, or to memory which the writer allocates.
+ *
+ * example)
+ *    kzrjson_writer_t writer;
+ *    kzrjson_writer_init_text(&writer);
+ *    kzrjson_writer_begin_object(&writer);
+ *    kzrjson_writer_key(&writer, "id", 2);
+ *    kzrjson_writer_uint64(&writer, 42);
+ *    kzrjson_writer_key(&writer, "tags", 4);
+ *    kzrjson_writer_begin_array(&writer);
+ *    kzrjson_writer_string(&writer, "a", 1);
+ *    kzrjson_writer_end_array(&writer);
+ *    kzrjson_writer_end_object(&writer);
+ *    if (kzrjson_writer_finish(&writer)) {
+ *        // writer.text is {"id":42,"tags":["a"]}
+ *    }
+ *    free(writer.text);
+ */
+#define KZRJSON_WRITER_MAX_DEPTH 1024
+
+typedef struct {
+	kzrjson_sink_t sink;
+
+	// the text written by kzrjson_writer_init_text, null terminated
+	char *text;
+	size_t length;
+	size_t capacity;
+
+	// kzrjson_success, or the error which stopped the writer
+	kzrjson_errno_t error;
+
+	// internal state
+	int state;
+	size_t depth;
+	uint8_t stack[KZRJSON_WRITER_MAX_DEPTH / 8];
+	size_t buffered;
+	char buffer[256];
+} kzrjson_writer_t;
+
+/*
+ * Initialize a writer to the sink. The text is buffered, and written
+ * to the sink when the buffer is full and by kzrjson_writer_finish.
+ */
+void kzrjson_writer_init(kzrjson_writer_t *writer, const kzrjson_sink_t sink);
+
+/*
+ * Initialize a writer to memory. writer->text is allocated to heap memory
+ * and grows as needed; release it by free even if an error occurred.
+ */
+void kzrjson_writer_init_text(kzrjson_writer_t *writer);
+
+/*
+ * Functions to write a value, a key, or a bracket.
+ * They return false if the writer stopped by an error.
+ *
+ * [error] kzrjson_err_parse (the call does not make JSON)
+ * [error] kzrjson_err_too_deep (more than KZRJSON_WRITER_MAX_DEPTH levels)
+ * [error] kzrjson_err_not_number (a double is not finite)
+ * [error] kzrjson_err_calloc
+ * [error] kzrjson_err_sink
+ */
+bool kzrjson_writer_begin_object(kzrjson_writer_t *writer);
+bool kzrjson_writer_end_object(kzrjson_writer_t *writer);
+bool kzrjson_writer_begin_array(kzrjson_writer_t *writer);
+bool kzrjson_writer_end_array(kzrjson_writer_t *writer);
+bool kzrjson_writer_key(kzrjson_writer_t *writer, const char *key, const size_t length);
+bool kzrjson_writer_string(kzrjson_writer_t *writer, const char *string, const size_t length);
+bool kzrjson_writer_int64(kzrjson_writer_t *writer, const int64_t number);
+bool kzrjson_writer_uint64(kzrjson_writer_t *writer, const uint64_t number);
+bool kzrjson_writer_double(kzrjson_writer_t *writer, const double number);
+bool kzrjson_writer_bool(kzrjson_writer_t *writer, const bool boolean);
+bool kzrjson_writer_null(kzrjson_writer_t *writer);
+
+/*
+ * Write JSON text of a value as it is. The text is not checked.
+ */
+bool kzrjson_writer_raw(kzrjson_writer_t *writer, const char *json_text, const size_t length);
+
+/*
+ * Write the buffered text to the sink, and check that one value is complete.
+ * Return false if an error occurred.
+ *
+ * [error] kzrjson_err_parse (no value, or brackets are not closed)
+ * [error] kzrjson_err_sink
+ */
+bool kzrjson_writer_finish(kzrjson_writer_t *writer);
+
+/*****************************************************************************
+ * Pack and unpack
+ *****************************************************************************/
+/*
+ * Make or read JSON data of the shape given by a format string,
+ * with the values as the following arguments.
+ *
+ *    {  }     object; keys and values alternate in it
+ *    [  ]     array
+ *    s        string (const char *), null terminated
+ *    s#       string (const char *) and its length (size_t)
+ *    i        int
+ *    I        int64_t
+ *    U        uint64_t
+ *    f        double
+ *    b        bool (int in the arguments)
+ *    n        null, no argument
+ *
+ * Keys are "s" or "s#". White spaces, ':' and ',' are ignored.
+ * Strings and keys are given as they are, and are escaped in both
+ * kzrjson_pack and kzrjson_writer_pack, so the same text is written.
+ * A format is compiled at the first call, and kept for the next calls
+ * with the same format. Formats of less than 128 characters are kept.
+ *
+ * example)
+ *    kzrjson_t json = kzrjson_pack("{s:i, s:[f, f], s:s}",
+ *        "id", 42, "point", 1.5, -0.5, "name", name);
+ *
+ *    int id;
+ *    double x, y;
+ *    const char *name;
+ *    kzrjson_unpack(json, "{s:i, s:[f, f], s:s}", "id", &id, "point", &x, &y, "name", &name);
+ */
+
+/*
+ * Make kzrjson_t. Arrays and objects are allocated at their sizes.
+ *
+ * [errno] kzrjson_err_parse (the format is wrong)
+ * [errno] kzrjson_err_too_deep (more than 32 levels in the format)
+ * [errno] kzrjson_err_illegal_type (a string is NULL)
+ * [errno] kzrjson_err_not_number (a double is not finite)
+ * [errno] kzrjson_err_calloc
+ */
+kzrjson_t kzrjson_pack(const char *format, ...);
+
+/*
+ * Write the values by the writer. Return false if an error occurred,
+ * which is also set to writer->error.
+ *
+ * [error] kzrjson_err_parse (the format is wrong)
+ * [error] kzrjson_err_too_deep (more than 32 levels in the format)
+ * [error] kzrjson_err_illegal_type (a string is NULL)
+ * [error] errors of kzrjson_writer_t
+ */
+bool kzrjson_writer_pack(kzrjson_writer_t *writer, const char *format, ...);
+
+/*
+ * Read values from the data to the pointers following the format.
+ * Keys are given as arguments (const char *, and size_t for "s#"), and
+ * the other arguments are pointers to the types above (bool * for "b").
+ * "s" and "s#" get the string of the data, which must not be released.
+ * It is the content of the JSON string with escape sequences as they are,
+ * and "s#" gets its length; decode it by kzrjson_unescape if needed.
+ * Keys are compared with the keys of the data in the same escaped form.
+ * Numbers are converted if the value fits the type.
+ * Elements of an array after the ones in the format are ignored.
+ * Return false if an error occurred; some values may be read.
+ *
+ * [errno] kzrjson_err_parse (the format is wrong)
+ * [errno] kzrjson_err_too_deep (more than 32 levels in the format)
+ * [errno] kzrjson_err_illegal_type (the data has another type)
+ * [errno] kzrjson_err_object_key_not_found
+ * [errno] kzrjson_err_index_out_of_range (the array is shorter)
+ * [errno] kzrjson_err_not_number (the number does not fit the type)
+ */
+bool kzrjson_unpack(kzrjson_t data, const char *format, ...);
+
+/*****************************************************************************
+ * Read JSON as events
+ *****************************************************************************/
+/*
+ * kzrjson_reader_t reads JSON text token by token without making kzrjson_t.
+ * It allocates no memory; nesting is tracked by a bit per level.
+ * The grammar is checked strictly (RFC 8259), and the text does not need
+ * to be null terminated.
+ *
+ * For key, string and number events, token and token_length point to the text.
+ * A key or string token is the characters between quotation-marks,
+ * with escape sequences as they are (see kzrjson_unescape).
+ *
+ * example)
+ *    kzrjson_reader_t reader;
+ *    kzrjson_reader_init(&reader, text, length);
+ *    kzrjson_event_type event;
+ *    while ((event = kzrjson_reader_next(&reader)) != kzrjson_event_end_of_text) {
+ *        if (event == kzrjson_event_error) {
+ *            // reader.error, reader.pos
+ *            break;
+ *        }
+ *    }
+ *
+ * The text can also be given in chunks (see kzrjson_reader_feed).
+ * Then kzrjson_event_need_more is returned when a token runs past
+ * the end of the current chunk.
+ */
+typedef enum {
+	kzrjson_event_error = 0,
+	kzrjson_event_begin_object,
+	kzrjson_event_end_object,
+	kzrjson_event_begin_array,
+	kzrjson_event_end_array,
+	kzrjson_event_key,
+	kzrjson_event_string,
+	kzrjson_event_number,
+	kzrjson_event_true,
+	kzrjson_event_false,
+	kzrjson_event_null,
+	kzrjson_event_end_of_text,
+	kzrjson_event_need_more,
+} kzrjson_event_type;
+
+#define KZRJSON_READER_MAX_DEPTH 1024
+
+typedef struct {
+	const char *text;
+	size_t length;
+
+	// offset of the next token, or of the error
+	size_t pos;
+
+	// offset of text from the beginning of the whole text
+	size_t offset;
+
+	// true if no text follows text[length - 1]
+	bool final;
+
+	// the last key, string or number
+	const char *token;
+	size_t token_length;
+	kzrjson_number_type number_type;
+
+	// kzrjson_success, or the error which stopped the reader
+	kzrjson_errno_t error;
+
+	// internal state
+	int state;
+	size_t depth;
+	uint8_t stack[KZRJSON_READER_MAX_DEPTH / 8];
+} kzrjson_reader_t;
+
+void kzrjson_reader_init(kzrjson_reader_t *reader, const char *json_text, const size_t length);
+
+/*
+ * Initialize a reader which gets the text in chunks by kzrjson_reader_feed.
+ */
+void kzrjson_reader_init_stream(kzrjson_reader_t *reader);
+
+/*
+ * Give the reader the next text.
+ * json_text must begin with the text which is not read yet,
+ * i.e. reader->text + reader->pos to reader->text + reader->length,
+ * followed by the new chunk. Tokens read before are invalidated.
+ * final is true if the text ends with json_text[length - 1].
+ *
+ * example)
+ *    kzrjson_reader_init_stream(&reader);
+ *    while (receive(buffer + unread, &received)) {
+ *        kzrjson_reader_feed(&reader, buffer, unread + received, false);
+ *        while ((event = kzrjson_reader_next(&reader)) != kzrjson_event_need_more) {
+ *            ...
+ *        }
+ *        unread = reader.length - reader.pos;
+ *        memmove(buffer, reader.text + reader.pos, unread);
+ *    }
+ *    kzrjson_reader_feed(&reader, buffer, unread, true);
+ */
+void kzrjson_reader_feed(kzrjson_reader_t *reader, const char *json_text, const size_t length, const bool final);
+
+/*
+ * Read the next token.
+ * After kzrjson_event_error or kzrjson_event_end_of_text,
+ * the same event is returned again.
+ * If the reader is not final and the text ends in the middle of a token,
+ * return kzrjson_event_need_more and read the token again after
+ * kzrjson_reader_feed.
+ *
+ * [error] kzrjson_err_tokenize
+ * [error] kzrjson_err_parse
+ * [error] kzrjson_err_too_deep
+ */
+kzrjson_event_type kzrjson_reader_next(kzrjson_reader_t *reader);
+
+/*
+ * Skip the rest of the value which began with the event just read.
+ * If event is begin-object or begin-array, read until its end.
+ * Return false if an error occurred, or if more text is needed
+ * (then the value is read only partway).
+ */
+bool kzrjson_reader_skip(kzrjson_reader_t *reader, const kzrjson_event_type event);
+
+/*
+ * Decode escape sequences in a string token to UTF-8.
+ * out needs length bytes at most. Return the length of the decoded string.
+ * out is not null terminated.
+ */
+size_t kzrjson_unescape(const char *string, const size_t length, char *out);
+
+/*****************************************************************************
+ * Reformat JSON text
+ *****************************************************************************/
+/*
+ * Rewrite JSON text to JSON text without making kzrjson_t.
+ * White spaces out of strings are removed (indent is 0) or normalized
+ * to the format of kzrjson_print (indent spaces per level), and tokens
+ * are copied as they are. No memory is allocated.
+ *
+ * The grammar is not checked except for unterminated strings,
+ * unbalanced brackets and white spaces between two tokens which would be
+ * joined without them (as [1 2] or tru e); check the text by
+ * kzrjson_validate if needed.
+ *
+ * The text can be given in chunks split at any byte.
+ *
+ * example)
+ *    kzrjson_reformat_t reformat;
+ *    kzrjson_sink_t sink = {write_to_file, file};
+ *    kzrjson_reformat_init(&reformat, 2, sink);
+ *    while (receive(&chunk)) {
+ *        kzrjson_reformat_feed(&reformat, chunk.text, chunk.length);
+ *    }
+ *    if (!kzrjson_reformat_finish(&reformat)) {
+ *        // reformat.error
+ *    }
+ */
+typedef struct {
+	kzrjson_sink_t sink;
+	int indent;
+
+	// kzrjson_success, or the error which stopped reformatting
+	kzrjson_errno_t error;
+
+	// internal state
+	int state;
+	size_t depth;
+} kzrjson_reformat_t;
+
+void kzrjson_reformat_init(kzrjson_reformat_t *reformat, const int indent, const kzrjson_sink_t sink);
+
+/*
+ * Reformat the next chunk of the text. Return false if an error occurred.
+ *
+ * [error] kzrjson_err_parse (a closing bracket without the opening one,
+ *                            or white spaces after a token which can not be removed)
+ * [error] kzrjson_err_sink
+ */
+bool kzrjson_reformat_feed(kzrjson_reformat_t *reformat, const char *chunk, const size_t length);
+
+/*
+ * Tell that the text ended. Return false if an error occurred.
+ *
+ * [error] kzrjson_err_tokenize (in a string)
+ * [error] kzrjson_err_parse (brackets are not closed)
+ */
+bool kzrjson_reformat_finish(kzrjson_reformat_t *reformat);
+
+/*
+ * Remove white spaces out of strings.
+ * out needs length bytes at most. Return the length of the minified text,
+ * or 0 if an error occurred. out is not null terminated.
+ * Empty text or text of only white spaces is an error as in kzrjson_validate.
+ *
+ * [errno] kzrjson_err_tokenize
+ * [errno] kzrjson_err_parse
+ */
+size_t kzrjson_minify(const char *json_text, const size_t length, char *out);
+
+/*****************************************************************************
+ * Columnar extraction
+ *****************************************************************************/
+/*
+ * Extract fields of an array of objects into a typed buffer per field,
+ * e.g. for analytics of homogeneous records.
+ * Row i of a column is the member of the field in element i.
+ * If the element is not an object, the member is missing, or its value is
+ * not of the column type, the bit of validity is 0 and the value is 0.
+ *
+ * Strings are as in JSON text, with escape sequences (see kzrjson_unescape).
+ * String i is data[offsets[i]] to data[offsets[i + 1]], and data is
+ * null terminated at data[offsets[length]].
+ *
+ * example)
+ *    const kzrjson_field_t fields[] = {
+ *        {"city", kzrjson_column_string},
+ *        {"pop", kzrjson_column_int64},
+ *        {"loc", kzrjson_column_double},
+ *    };
+ *    kzrjson_column_t columns[3];
+ *    if (kzrjson_columnarize(zips, fields, 3, columns)) {
+ *        for (size_t i = 0; i < columns[1].length; i++) {
+ *            if (kzrjson_column_valid(&columns[1], i)) total += columns[1].int64s[i];
+ *        }
+ *        kzrjson_column_free(columns, 3);
+ *    }
+ */
+typedef enum {
+	kzrjson_column_int64,  // integers in int64_t
+	kzrjson_column_double, // numbers
+	kzrjson_column_bool,   // true, false
+	kzrjson_column_string,
+} kzrjson_column_type;
+
+typedef struct {
+	const char *key;
+	kzrjson_column_type type;
+} kzrjson_field_t;
+
+typedef struct {
+	kzrjson_column_type type;
+
+	// number of rows
+	size_t length;
+
+	// bit (i % 8) of validity[i / 8] is 1 if row i has a value
+	uint8_t *validity;
+
+	union {
+		int64_t *int64s;
+		double *doubles;
+		bool *bools;
+		size_t *offsets; // length + 1 offsets in data
+	};
+	char *data;
+} kzrjson_column_t;
+
+/*
+ * Extract from kzrjson_t of array.
+ * Where a key was found in an element is remembered for each field,
+ * so elements with the same member order need no lookup.
+ * columns[field_count] are filled, release them by kzrjson_column_free.
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_calloc
+ */
+bool kzrjson_columnarize(kzrjson_t array, const kzrjson_field_t *fields,
+	const size_t field_count, kzrjson_column_t *columns);
+
+/*
+ * Same as kzrjson_columnarize, but elements are split to the threads.
+ * Without C11 threads, the elements are read in the calling thread.
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_calloc
+ */
+bool kzrjson_columnarize_parallel(kzrjson_t array, const kzrjson_field_t *fields,
+	const size_t field_count, kzrjson_column_t *columns, const size_t threads);
+
+/*
+ * Extract directly from JSON text of an array, without making kzrjson_t.
+ *
+ * [errno] kzrjson_err_tokenize
+ * [errno] kzrjson_err_parse
+ * [errno] kzrjson_err_too_deep
+ * [errno] kzrjson_err_illegal_type (the text is not an array)
+ * [errno] kzrjson_err_calloc
+ */
+bool kzrjson_columnarize_text(const char *json_text, const size_t length,
+	const kzrjson_field_t *fields, const size_t field_count, kzrjson_column_t *columns);
+
+bool kzrjson_column_valid(const kzrjson_column_t *column, const size_t row);
+
+void kzrjson_column_free(kzrjson_column_t *columns, const size_t count);
+
+/*****************************************************************************
+ * Relocatable image
+ *****************************************************************************/
+/*
+ * A read-only encoding of kzrjson_t in one block of memory.
+ * Its parts refer to each other by offsets relative to themselves,
+ * so the block works at any address: it can be built in shared memory
+ * (shm_open, memfd_create) and mapped read-only by other processes,
+ * which read it in place without parsing.
+ * A new version is published by building another block and swapping
+ * the mapping (e.g. rename of the file).
+ *
+ * example)
+ *    size_t size = kzrjson_image_size(root);
+ *    ftruncate(fd, size);
+ *    void *block = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+ *    kzrjson_image_write(root, block, size);
+ *
+ *    // in a worker process
+ *    const void *block = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+ *    kzrjson_image_t city = kzrjson_image_get(kzrjson_image_root(block, size), "city");
+ *    printf("%s\n", kzrjson_image_string(city));
+ */
+struct kzrjson_image_node {
+	// kzrjson_type, except kzrjson_member
+	uint32_t type;
+
+	// kzrjson_number_type of number
+	uint32_t number_type;
+
+	// length of string presentation, or number of elements of array or object
+	uint64_t size;
+
+	// from this node to its string presentation, elements or members
+	int64_t offset;
+
+	union {
+		int64_t number_int;
+		uint64_t number_uint;
+		double number_double;
+		bool boolean;
+	};
+};
+
+typedef const struct kzrjson_image_node *kzrjson_image_t;
+
+/*
+ * Size of the image of any in bytes.
+ */
+size_t kzrjson_image_size(kzrjson_t any);
+
+/*
+ * Write the image of any to block, which is aligned like malloc.
+ *
+ * [errno] kzrjson_err_index_out_of_range (size is less than kzrjson_image_size)
+ */
+bool kzrjson_image_write(kzrjson_t any, void *block, const size_t size);
+
+/*
+ * Root of the image in block of size bytes. The block is not copied.
+ *
+ * [errno] kzrjson_err_parse (block is not an image of this version)
+ */
+kzrjson_image_t kzrjson_image_root(const void *block, const size_t size);
+
+/*
+ * Element of array, or value of the member of object at index.
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_index_out_of_range
+ */
+kzrjson_image_t kzrjson_image_element(kzrjson_image_t container, const size_t index);
+
+/*
+ * Key of the member of object at index, and its length to *length
+ * if length is not NULL.
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_index_out_of_range
+ */
+const char *kzrjson_image_key(kzrjson_image_t object, const size_t index, size_t *length);
+
+/*
+ * Value of the first member with the key in object.
+ * Objects with many members have a hash index in the image.
+ *
+ * [errno] kzrjson_err_illegal_type
+ * [errno] kzrjson_err_object_key_not_found
+ */
+kzrjson_image_t kzrjson_image_get(kzrjson_image_t object, const char *key);
+
+/*
+ * String presentation of string, number, boolean and null,
+ * null terminated. Its length is node->size.
+ *
+ * [errno] kzrjson_err_illegal_type
+ */
+const char *kzrjson_image_string(kzrjson_image_t node);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // KZRJSON_H
@@ -0,0 +1,1151 @@
+#ifndef KZRJSON_HPP
+#define KZRJSON_HPP
+#include "kzrjson.h"
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__cpp_consteval)
+#define KZR_CONSTEVAL consteval
+#else
+#define KZR_CONSTEVAL constexpr
+#endif
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define KZR_COROUTINE 1
+#endif
+#endif
+
+/*****************************************************************************
+ * C++ interface
+ *****************************************************************************/
+/*
+ * Thin C++17 wrapper of kzrjson.
+ * kzr::document owns parsed JSON data and releases it in the destructor.
+ * kzr::value and kzr::member are non-owning views of kzrjson_t,
+ * valid while the document is alive. They are as cheap as a pointer.
+ * Strings are returned as std::string_view of the data in kzrjson_t,
+ * so nothing is copied.
+ *
+ * example)
+ *    kzr::document doc = kzr::document::parse(json_text);
+ *    if (!doc) {
+ *        std::cerr << doc.line() << ":" << doc.column() << ": error\n";
+ *        return;
+ *    }
+ *    std::string_view title = doc.root()["Image"]["Title"].as_string_view();
+ *    for (kzr::value id : doc.root()["Image"]["IDs"]) {
+ *        uint64_t number = id.as_uint64();
+ *    }
+ *    for (kzr::member member : doc.root()["Image"].members()) {
+ *        std::string_view key = member.key();
+ *    }
+ */
+namespace kzr {
+
+/*
+ * Same as kzrjson_hash_key, usable at compile time.
+ */
+constexpr uint32_t hash_key(const char *key, std::size_t length) noexcept {
+	uint32_t hash = 2166136261u; // FNV-1a
+	for (std::size_t i = 0; i < length; i++) {
+		hash ^= static_cast<unsigned char>(key[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/*
+ * Key of a member with its length and hash.
+ * Made from a literal by the _k suffix, both are computed at compile time,
+ * so a lookup by kzr::key calls neither strlen nor the hash function.
+ *
+ * example)
+ *    using namespace kzr::literals;
+ *    kzr::value width = image["Width"_k];
+ */
+struct key {
+	const char *data;
+	std::size_t length;
+	uint32_t hash;
+
+	constexpr key(const char *data, std::size_t length) noexcept
+		: data(data), length(length), hash(hash_key(data, length)) {}
+};
+
+namespace literals {
+
+KZR_CONSTEVAL key operator""_k(const char *data, std::size_t length) noexcept {
+	return key(data, length);
+}
+
+} // namespace literals
+
+/*
+ * Random access iterator over elements of an array or object.
+ * T is constructed from each kzrjson_t.
+ */
+template <typename T>
+class iterator {
+public:
+	using iterator_category = std::random_access_iterator_tag;
+	using value_type = T;
+	using difference_type = std::ptrdiff_t;
+	using pointer = void;
+	using reference = T;
+
+	iterator() noexcept = default;
+	explicit iterator(kzrjson_t *position) noexcept : position_(position) {}
+
+	T operator*() const noexcept { return T(*position_); }
+	T operator[](difference_type n) const noexcept { return T(position_[n]); }
+
+	iterator &operator++() noexcept { ++position_; return *this; }
+	iterator operator++(int) noexcept { iterator it = *this; ++position_; return it; }
+	iterator &operator--() noexcept { --position_; return *this; }
+	iterator operator--(int) noexcept { iterator it = *this; --position_; return it; }
+	iterator &operator+=(difference_type n) noexcept { position_ += n; return *this; }
+	iterator &operator-=(difference_type n) noexcept { position_ -= n; return *this; }
+	friend iterator operator+(iterator it, difference_type n) noexcept { return it += n; }
+	friend iterator operator+(difference_type n, iterator it) noexcept { return it += n; }
+	friend iterator operator-(iterator it, difference_type n) noexcept { return it -= n; }
+	friend difference_type operator-(iterator a, iterator b) noexcept { return a.position_ - b.position_; }
+
+	friend bool operator==(iterator a, iterator b) noexcept { return a.position_ == b.position_; }
+	friend bool operator!=(iterator a, iterator b) noexcept { return a.position_ != b.position_; }
+	friend bool operator<(iterator a, iterator b) noexcept { return a.position_ < b.position_; }
+	friend bool operator>(iterator a, iterator b) noexcept { return a.position_ > b.position_; }
+	friend bool operator<=(iterator a, iterator b) noexcept { return a.position_ <= b.position_; }
+	friend bool operator>=(iterator a, iterator b) noexcept { return a.position_ >= b.position_; }
+
+private:
+	kzrjson_t *position_ = nullptr;
+};
+
+/*
+ * Pair of iterators usable in range-for.
+ */
+template <typename T>
+class range {
+public:
+	range() noexcept = default;
+	range(kzrjson_t *begin, kzrjson_t *end) noexcept : begin_(begin), end_(end) {}
+
+	iterator<T> begin() const noexcept { return begin_; }
+	iterator<T> end() const noexcept { return end_; }
+	std::size_t size() const noexcept { return static_cast<std::size_t>(end_ - begin_); }
+	bool empty() const noexcept { return begin_ == end_; }
+
+private:
+	iterator<T> begin_;
+	iterator<T> end_;
+};
+
+class member;
+
+/*
+ * Non-owning view of a JSON value.
+ * A default constructed value, or a value returned by a failed lookup,
+ * is empty and evaluates to false. Operations on an empty value return
+ * empty values, zero or empty strings, so lookups can be chained.
+ */
+class value {
+public:
+	value() noexcept = default;
+	explicit value(kzrjson_t node) noexcept : node_(node) {}
+
+	kzrjson_t get() const noexcept { return node_; }
+	explicit operator bool() const noexcept { return node_ != nullptr; }
+
+	/*
+	 * Type of the value. An empty value has kzrjson_null, but is_null()
+	 * is false for it; tell them apart by operator bool.
+	 */
+	kzrjson_type type() const noexcept { return node_ != nullptr ? node_->type : kzrjson_null; }
+
+	bool is_object() const noexcept { return node_ != nullptr && node_->type == kzrjson_object; }
+	bool is_array() const noexcept { return node_ != nullptr && node_->type == kzrjson_array; }
+	bool is_string() const noexcept { return node_ != nullptr && node_->type == kzrjson_string; }
+	bool is_number() const noexcept { return node_ != nullptr && node_->type == kzrjson_number; }
+	bool is_bool() const noexcept { return node_ != nullptr && node_->type == kzrjson_bool; }
+	bool is_null() const noexcept { return node_ != nullptr && node_->type == kzrjson_null; }
+
+	/*
+	 * Text of string, number, boolean or null as it is in kzrjson_t.
+	 * Escape sequences in a string are not decoded.
+	 */
+	std::string_view as_string_view() const noexcept {
+		if (node_ == nullptr || node_->string == nullptr) return {};
+		return node_->string;
+	}
+
+	bool as_bool() const noexcept { return is_bool() && node_->boolean; }
+
+	int64_t as_int64() const noexcept {
+		if (!is_number()) return 0;
+		switch (node_->number_type) {
+		case kzrjson_int: return node_->number_int;
+		case kzrjson_uint: return static_cast<int64_t>(node_->number_uint);
+		default: return static_cast<int64_t>(node_->number_double);
+		}
+	}
+
+	uint64_t as_uint64() const noexcept {
+		if (!is_number()) return 0;
+		switch (node_->number_type) {
+		case kzrjson_int: return static_cast<uint64_t>(node_->number_int);
+		case kzrjson_uint: return node_->number_uint;
+		default: return static_cast<uint64_t>(node_->number_double);
+		}
+	}
+
+	double as_double() const noexcept {
+		if (!is_number()) return 0;
+		switch (node_->number_type) {
+		case kzrjson_int: return static_cast<double>(node_->number_int);
+		case kzrjson_uint: return static_cast<double>(node_->number_uint);
+		default: return node_->number_double;
+		}
+	}
+
+	/*
+	 * Number of elements of an array or members of an object.
+	 */
+	std::size_t size() const noexcept {
+		if (!is_array() && !is_object()) return 0;
+		return node_->elements_size;
+	}
+
+	/*
+	 * True if an array is packed (see kzrjson_array_pack).
+	 * A packed array has no element values: operator[](std::size_t) and
+	 * elements() are empty. Read it by kzrjson_array_as_* or kzrjson_array_get_*.
+	 */
+	bool is_packed() const noexcept {
+		return is_array() && node_->packed_type != kzrjson_packed_none;
+	}
+
+	/*
+	 * Element of an array. Empty if out of range or packed.
+	 */
+	value operator[](std::size_t index) const noexcept {
+		if (!is_array() || is_packed() || index >= node_->elements_size) return value();
+		return value(node_->elements[index]);
+	}
+
+	/*
+	 * Value of the member with the key in an object. Empty if not found.
+	 */
+	value operator[](std::string_view key) const noexcept;
+	value operator[](const char *key) const noexcept { return (*this)[std::string_view(key)]; }
+	value operator[](const kzr::key &key) const noexcept;
+
+	/*
+	 * Elements of an array, usable in range-for.
+	 */
+	iterator<value> begin() const noexcept { return elements().begin(); }
+	iterator<value> end() const noexcept { return elements().end(); }
+	range<value> elements() const noexcept {
+		if (!is_array() || is_packed() || node_->elements_size == 0) return {};
+		return {node_->elements, node_->elements + node_->elements_size};
+	}
+
+	/*
+	 * Members of an object, usable in range-for.
+	 */
+	range<member> members() const noexcept {
+		if (!is_object() || node_->elements_size == 0) return {};
+		return {node_->elements, node_->elements + node_->elements_size};
+	}
+
+	friend bool operator==(value a, value b) noexcept { return a.node_ == b.node_; }
+	friend bool operator!=(value a, value b) noexcept { return a.node_ != b.node_; }
+
+private:
+	kzrjson_t node_ = nullptr;
+};
+
+/*
+ * Non-owning view of a member of an object.
+ */
+class member {
+public:
+	member() noexcept = default;
+	explicit member(kzrjson_t node) noexcept : node_(node) {}
+
+	kzrjson_t get() const noexcept { return node_; }
+	explicit operator bool() const noexcept { return node_ != nullptr; }
+
+	std::string_view key() const noexcept {
+		if (node_ == nullptr) return {};
+		return node_->key;
+	}
+	kzr::value value() const noexcept {
+		if (node_ == nullptr) return kzr::value();
+		return kzr::value(node_->value);
+	}
+
+private:
+	kzrjson_t node_ = nullptr;
+};
+
+inline value value::operator[](std::string_view key) const noexcept {
+	if (!is_object()) return value();
+	kzrjson_t member = kzrjson_get_member_n(node_, key.data(), key.size());
+	return member != nullptr ? value(member->value) : value();
+}
+
+inline value value::operator[](const kzr::key &key) const noexcept {
+	if (!is_object()) return value();
+	kzrjson_t member = kzrjson_get_member_hashed(node_, key.data, key.length, key.hash);
+	return member != nullptr ? value(member->value) : value();
+}
+
+/*
+ * Owner of parsed JSON data. Move only.
+ * A document which failed to parse is empty and holds the error.
+ *
+ * A document parsed with a std::pmr::memory_resource allocates all of its
+ * data (nodes, element arrays and strings) through the resource,
+ * via a kzrjson_doc_t. With a std::pmr::monotonic_buffer_resource on a stack
+ * buffer or a per-request arena, parsing calls no global allocator.
+ *
+ * example)
+ *    std::byte buffer[16384];
+ *    std::pmr::monotonic_buffer_resource resource(buffer, sizeof(buffer));
+ *    kzr::document doc = kzr::document::parse(json_text, &resource);
+ */
+class document {
+public:
+	document() noexcept = default;
+
+	/*
+	 * Take ownership of data made by kzrjson_parse or kzrjson_make_*.
+	 */
+	explicit document(kzrjson_t root) noexcept : root_(root) {}
+
+	document(const document &) = delete;
+	document &operator=(const document &) = delete;
+
+	document(document &&other) noexcept
+		: root_(std::exchange(other.root_, nullptr)),
+		doc_(std::exchange(other.doc_, nullptr)),
+		error_(other.error_) {}
+
+	document &operator=(document &&other) noexcept {
+		if (this != &other) {
+			destroy();
+			root_ = std::exchange(other.root_, nullptr);
+			doc_ = std::exchange(other.doc_, nullptr);
+			error_ = other.error_;
+		}
+		return *this;
+	}
+
+	~document() { destroy(); }
+
+	static document parse(const char *json_text) noexcept {
+		document doc;
+		doc.error_ = kzrjson_parse_result(json_text);
+		doc.root_ = std::exchange(doc.error_.value, nullptr);
+		return doc;
+	}
+
+	static document parse(const std::string &json_text) noexcept {
+		return parse(json_text.c_str());
+	}
+
+	/*
+	 * Parse with all memory allocated from the resource.
+	 * The resource must outlive the document.
+	 */
+	static document parse(const char *json_text, std::pmr::memory_resource *resource) noexcept {
+		document doc;
+		const kzrjson_allocator_t allocator = {
+			&document::allocate,
+			&document::deallocate,
+			resource,
+		};
+		doc.doc_ = kzrjson_doc_make_with_allocator(&allocator);
+		if (doc.doc_ == nullptr) {
+			doc.error_.code = kzrjson_errno();
+			return doc;
+		}
+		doc.error_ = kzrjson_doc_parse_result(doc.doc_, json_text);
+		doc.root_ = std::exchange(doc.error_.value, nullptr);
+		return doc;
+	}
+
+	static document parse(const std::string &json_text, std::pmr::memory_resource *resource) noexcept {
+		return parse(json_text.c_str(), resource);
+	}
+
+	explicit operator bool() const noexcept { return root_ != nullptr; }
+	value root() const noexcept { return value(root_); }
+	value operator[](std::string_view key) const noexcept { return root()[key]; }
+	value operator[](const char *key) const noexcept { return root()[key]; }
+	value operator[](const kzr::key &key) const noexcept { return root()[key]; }
+	value operator[](std::size_t index) const noexcept { return root()[index]; }
+
+	kzrjson_errno_t error() const noexcept { return error_.code; }
+	std::size_t offset() const noexcept { return error_.offset; }
+	std::size_t line() const noexcept { return error_.line; }
+	std::size_t column() const noexcept { return error_.column; }
+
+	/*
+	 * Give up ownership. The caller releases the data by kzrjson_free,
+	 * or by kzrjson_doc_free(root->doc) if it was parsed with a memory resource.
+	 */
+	kzrjson_t release() noexcept {
+		doc_ = nullptr;
+		return std::exchange(root_, nullptr);
+	}
+
+private:
+	static void *allocate(std::size_t size, void *context) noexcept {
+		try {
+			return static_cast<std::pmr::memory_resource *>(context)->allocate(size, alignof(std::max_align_t));
+		} catch (...) {
+			return nullptr;
+		}
+	}
+
+	static void deallocate(void *pointer, std::size_t size, void *context) noexcept {
+		static_cast<std::pmr::memory_resource *>(context)->deallocate(pointer, size, alignof(std::max_align_t));
+	}
+
+	void destroy() noexcept {
+		if (doc_ != nullptr) {
+			kzrjson_doc_free(doc_);
+		} else {
+			kzrjson_free(root_);
+		}
+		root_ = nullptr;
+		doc_ = nullptr;
+	}
+
+	kzrjson_t root_ = nullptr;
+	kzrjson_doc_t doc_ = nullptr;
+	kzrjson_result_t error_ = {};
+};
+
+} // namespace kzr
+
+/*****************************************************************************
+ * Struct mapping
+ *****************************************************************************/
+/*
+ * KZR_REFLECT(Type, field1, field2, ...) lists data members of Type,
+ * then kzr::read parses JSON text directly into Type and kzr::write
+ * serializes Type to JSON text. Neither makes kzrjson_t.
+ *
+ * Supported member types are bool, integers, floating points, std::string,
+ * std::optional, std::vector, std::map with std::string keys,
+ * and other reflected structs. Use KZR_REFLECT in the global namespace.
+ * Members missing in the text keep their values, and unknown keys are skipped.
+ *
+ * A key is matched by comparing it with the member expected next,
+ * and otherwise by a perfect hash table built at compile time.
+ *
+ * example)
+ *    struct thumbnail { std::string Url; int Height; int Width; };
+ *    KZR_REFLECT(thumbnail, Url, Height, Width)
+ *
+ *    thumbnail t;
+ *    kzr::read_result result = kzr::read(text, t);
+ *    std::string json = kzr::write(t);
+ */
+#define KZR_EXPAND(x) x
+#define KZR_FOR_EACH_1(f, x) f(x)
+#define KZR_FOR_EACH_2(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_1(f, __VA_ARGS__))
+#define KZR_FOR_EACH_3(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_2(f, __VA_ARGS__))
+#define KZR_FOR_EACH_4(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_3(f, __VA_ARGS__))
+#define KZR_FOR_EACH_5(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_4(f, __VA_ARGS__))
+#define KZR_FOR_EACH_6(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_5(f, __VA_ARGS__))
+#define KZR_FOR_EACH_7(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_6(f, __VA_ARGS__))
+#define KZR_FOR_EACH_8(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_7(f, __VA_ARGS__))
+#define KZR_FOR_EACH_9(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_8(f, __VA_ARGS__))
+#define KZR_FOR_EACH_10(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_9(f, __VA_ARGS__))
+#define KZR_FOR_EACH_11(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_10(f, __VA_ARGS__))
+#define KZR_FOR_EACH_12(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_11(f, __VA_ARGS__))
+#define KZR_FOR_EACH_13(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_12(f, __VA_ARGS__))
+#define KZR_FOR_EACH_14(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_13(f, __VA_ARGS__))
+#define KZR_FOR_EACH_15(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_14(f, __VA_ARGS__))
+#define KZR_FOR_EACH_16(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_15(f, __VA_ARGS__))
+#define KZR_FOR_EACH_17(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_16(f, __VA_ARGS__))
+#define KZR_FOR_EACH_18(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_17(f, __VA_ARGS__))
+#define KZR_FOR_EACH_19(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_18(f, __VA_ARGS__))
+#define KZR_FOR_EACH_20(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_19(f, __VA_ARGS__))
+#define KZR_FOR_EACH_21(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_20(f, __VA_ARGS__))
+#define KZR_FOR_EACH_22(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_21(f, __VA_ARGS__))
+#define KZR_FOR_EACH_23(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_22(f, __VA_ARGS__))
+#define KZR_FOR_EACH_24(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_23(f, __VA_ARGS__))
+#define KZR_FOR_EACH_25(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_24(f, __VA_ARGS__))
+#define KZR_FOR_EACH_26(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_25(f, __VA_ARGS__))
+#define KZR_FOR_EACH_27(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_26(f, __VA_ARGS__))
+#define KZR_FOR_EACH_28(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_27(f, __VA_ARGS__))
+#define KZR_FOR_EACH_29(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_28(f, __VA_ARGS__))
+#define KZR_FOR_EACH_30(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_29(f, __VA_ARGS__))
+#define KZR_FOR_EACH_31(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_30(f, __VA_ARGS__))
+#define KZR_FOR_EACH_32(f, x, ...) f(x), KZR_EXPAND(KZR_FOR_EACH_31(f, __VA_ARGS__))
+#define KZR_FOR_EACH_N(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, name, ...) name
+#define KZR_FOR_EACH(f, ...) \
+	KZR_EXPAND(KZR_FOR_EACH_N(__VA_ARGS__, KZR_FOR_EACH_32, KZR_FOR_EACH_31, KZR_FOR_EACH_30, KZR_FOR_EACH_29, KZR_FOR_EACH_28, KZR_FOR_EACH_27, KZR_FOR_EACH_26, KZR_FOR_EACH_25, KZR_FOR_EACH_24, KZR_FOR_EACH_23, KZR_FOR_EACH_22, KZR_FOR_EACH_21, KZR_FOR_EACH_20, KZR_FOR_EACH_19, KZR_FOR_EACH_18, KZR_FOR_EACH_17, KZR_FOR_EACH_16, KZR_FOR_EACH_15, KZR_FOR_EACH_14, KZR_FOR_EACH_13, KZR_FOR_EACH_12, KZR_FOR_EACH_11, KZR_FOR_EACH_10, KZR_FOR_EACH_9, KZR_FOR_EACH_8, KZR_FOR_EACH_7, KZR_FOR_EACH_6, KZR_FOR_EACH_5, KZR_FOR_EACH_4, KZR_FOR_EACH_3, KZR_FOR_EACH_2, KZR_FOR_EACH_1, unused)(f, __VA_ARGS__))
+
+#define KZR_REFLECT_FIELD(name) kzr::make_field(#name, &reflected_type::name)
+
+#define KZR_REFLECT(Type, ...) \
+	template <> \
+	struct kzr::reflect<Type> { \
+		using reflected_type = Type; \
+		static constexpr auto fields = std::make_tuple(KZR_FOR_EACH(KZR_REFLECT_FIELD, __VA_ARGS__)); \
+	};
+
+namespace kzr {
+
+template <typename T>
+struct reflect;
+
+template <typename T, typename M>
+struct field {
+	std::string_view name;
+	M T::*pointer;
+	uint32_t hash;
+};
+
+template <typename T, typename M>
+constexpr field<T, M> make_field(std::string_view name, M T::*pointer) noexcept {
+	return {name, pointer, hash_key(name.data(), name.size())};
+}
+
+template <typename T, typename = void>
+struct is_reflected : std::false_type {};
+
+template <typename T>
+struct is_reflected<T, std::void_t<decltype(reflect<T>::fields)>> : std::true_type {};
+
+/*
+ * Result of kzr::read. offset is where reading stopped on error.
+ */
+struct read_result {
+	kzrjson_errno_t code = kzrjson_success;
+	std::size_t offset = 0;
+
+	explicit operator bool() const noexcept { return code == kzrjson_success; }
+};
+
+namespace detail {
+
+template <typename T>
+struct is_optional : std::false_type {};
+template <typename T>
+struct is_optional<std::optional<T>> : std::true_type {};
+
+template <typename T>
+struct is_vector : std::false_type {};
+template <typename T, typename A>
+struct is_vector<std::vector<T, A>> : std::true_type {};
+
+template <typename T>
+struct is_string_map : std::false_type {};
+template <typename T, typename C, typename A>
+struct is_string_map<std::map<std::string, T, C, A>> : std::true_type {};
+
+/*
+ * Perfect hash from member names to their positions, built at compile time.
+ * slot = ((hash ^ seed) * golden) >> shift, and slots[slot] is the position,
+ * or the number of members if the slot is empty.
+ */
+constexpr std::size_t dispatch_table_size(std::size_t n) noexcept {
+	std::size_t size = 8;
+	while (size < n * 8) size *= 2;
+	return size;
+}
+
+template <std::size_t N>
+struct dispatch_table {
+	static constexpr std::size_t size = dispatch_table_size(N);
+	uint32_t seed = 0;
+	unsigned shift = 32;
+	std::array<uint16_t, size> slots{};
+
+	constexpr std::size_t slot(uint32_t hash) const noexcept {
+		return static_cast<std::size_t>(((hash ^ seed) * 2654435761u) >> shift);
+	}
+};
+
+template <typename Fields, std::size_t... I>
+constexpr auto make_dispatch_table(const Fields &fields, std::index_sequence<I...>) {
+	constexpr std::size_t n = sizeof...(I);
+	dispatch_table<n> table;
+	const uint32_t hashes[] = {std::get<I>(fields).hash..., 0};
+	unsigned bits = 0;
+	while ((std::size_t{1} << bits) < table.size) bits++;
+	table.shift = 32 - bits;
+	for (uint32_t seed = 0; ; seed++) {
+		table.seed = seed;
+		for (auto &slot : table.slots) slot = n;
+		bool collided = false;
+		for (std::size_t i = 0; i < n && !collided; i++) {
+			const std::size_t slot = table.slot(hashes[i]);
+			if (table.slots[slot] != n) {
+				collided = true;
+			} else {
+				table.slots[slot] = static_cast<uint16_t>(i);
+			}
+		}
+		if (!collided) return table;
+	}
+}
+
+template <typename T>
+bool read_value(kzrjson_reader_t &reader, kzrjson_event_type event, T &out);
+
+inline bool read_string(const kzrjson_reader_t &reader, std::string &out) {
+	if (std::memchr(reader.token, '\\', reader.token_length) == nullptr) {
+		out.assign(reader.token, reader.token_length);
+		return true;
+	}
+	out.resize(reader.token_length);
+	out.resize(kzrjson_unescape(reader.token, reader.token_length, out.data()));
+	return true;
+}
+
+template <typename T>
+bool read_number(const kzrjson_reader_t &reader, T &out) {
+	const char *end = reader.token + reader.token_length;
+	if constexpr (std::is_integral_v<T>) {
+		const auto result = std::from_chars(reader.token, end, out);
+		return result.ec == std::errc() && result.ptr == end;
+	} else {
+#if defined(__cpp_lib_to_chars)
+		double number = 0;
+		const auto result = std::from_chars(reader.token, end, number);
+		if (result.ec != std::errc() || result.ptr != end) return false;
+#else
+		const double number = std::strtod(reader.token, nullptr);
+#endif
+		out = static_cast<T>(number);
+		return true;
+	}
+}
+
+template <typename T, std::size_t I>
+bool read_field(kzrjson_reader_t &reader, kzrjson_event_type event, T &out) {
+	return read_value(reader, event, out.*(std::get<I>(reflect<T>::fields).pointer));
+}
+
+template <typename T, std::size_t... I>
+bool read_struct(kzrjson_reader_t &reader, T &out, std::index_sequence<I...> sequence) {
+	using reader_function = bool (*)(kzrjson_reader_t &, kzrjson_event_type, T &);
+	static constexpr std::size_t n = sizeof...(I);
+	static constexpr reader_function readers[] = {read_field<T, I>..., nullptr};
+	static constexpr std::string_view names[] = {std::get<I>(reflect<T>::fields).name..., {}};
+	static constexpr auto table = make_dispatch_table(reflect<T>::fields, sequence);
+
+	std::size_t expected = 0;
+	for (;;) {
+		kzrjson_event_type event = kzrjson_reader_next(&reader);
+		if (event == kzrjson_event_end_object) return true;
+		if (event != kzrjson_event_key) return false;
+		const std::string_view key(reader.token, reader.token_length);
+		std::size_t position = expected;
+		if (position >= n || names[position] != key) {
+			position = table.slots[table.slot(hash_key(key.data(), key.size()))];
+			if (position < n && names[position] != key) position = n;
+		}
+		event = kzrjson_reader_next(&reader);
+		if (position == n) {
+			if (!kzrjson_reader_skip(&reader, event)) return false;
+			continue;
+		}
+		if (!readers[position](reader, event, out)) return false;
+		expected = position + 1;
+	}
+}
+
+template <typename T>
+bool read_value(kzrjson_reader_t &reader, kzrjson_event_type event, T &out) {
+	if constexpr (std::is_same_v<T, bool>) {
+		if (event != kzrjson_event_true && event != kzrjson_event_false) return false;
+		out = event == kzrjson_event_true;
+		return true;
+	} else if constexpr (std::is_arithmetic_v<T>) {
+		return event == kzrjson_event_number && read_number(reader, out);
+	} else if constexpr (std::is_same_v<T, std::string>) {
+		return event == kzrjson_event_string && read_string(reader, out);
+	} else if constexpr (is_optional<T>::value) {
+		if (event == kzrjson_event_null) {
+			out.reset();
+			return true;
+		}
+		return read_value(reader, event, out.emplace());
+	} else if constexpr (is_vector<T>::value) {
+		if (event != kzrjson_event_begin_array) return false;
+		out.clear();
+		for (;;) {
+			event = kzrjson_reader_next(&reader);
+			if (event == kzrjson_event_end_array) return true;
+			if (!read_value(reader, event, out.emplace_back())) return false;
+		}
+	} else if constexpr (is_string_map<T>::value) {
+		if (event != kzrjson_event_begin_object) return false;
+		out.clear();
+		std::string key;
+		for (;;) {
+			event = kzrjson_reader_next(&reader);
+			if (event == kzrjson_event_end_object) return true;
+			if (event != kzrjson_event_key) return false;
+			read_string(reader, key);
+			if (!read_value(reader, kzrjson_reader_next(&reader), out[key])) return false;
+		}
+	} else if constexpr (is_reflected<T>::value) {
+		if (event != kzrjson_event_begin_object) return false;
+		constexpr std::size_t n = std::tuple_size_v<std::decay_t<decltype(reflect<T>::fields)>>;
+		return read_struct(reader, out, std::make_index_sequence<n>());
+	} else {
+		static_assert(is_reflected<T>::value, "kzr::read: unsupported type, use KZR_REFLECT");
+		return false;
+	}
+}
+
+inline void write_string(std::string &out, std::string_view string) {
+	static constexpr char hex[] = "0123456789abcdef";
+	out.push_back('"');
+	std::size_t begin = 0;
+	for (std::size_t i = 0; i < string.size(); i++) {
+		const unsigned char c = static_cast<unsigned char>(string[i]);
+		if (c >= 0x20 && c != '"' && c != '\\') continue;
+		out.append(string.data() + begin, i - begin);
+		begin = i + 1;
+		switch (c) {
+		case '"': out.append("\\\""); break;
+		case '\\': out.append("\\\\"); break;
+		case 0x08: out.append("\\b"); break;
+		case 0x0C: out.append("\\f"); break;
+		case 0x0A: out.append("\\n"); break;
+		case 0x0D: out.append("\\r"); break;
+		case 0x09: out.append("\\t"); break;
+		default:
+			out.append("\\u00");
+			out.push_back(hex[c >> 4]);
+			out.push_back(hex[c & 0xF]);
+			break;
+		}
+	}
+	out.append(string.data() + begin, string.size() - begin);
+	out.push_back('"');
+}
+
+template <typename T>
+void write_number(std::string &out, T number) {
+	char buffer[32];
+	if constexpr (std::is_floating_point_v<T>) {
+		if (number != number || number - number != 0) {
+			out.append("null"); // NaN and infinity are not JSON numbers
+			return;
+		}
+	}
+#if defined(__cpp_lib_to_chars)
+	const auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+	out.append(buffer, result.ptr);
+#else
+	if constexpr (std::is_floating_point_v<T>) {
+		out.append(buffer, std::snprintf(buffer, sizeof(buffer), "%.17g", static_cast<double>(number)));
+	} else if constexpr (std::is_signed_v<T>) {
+		out.append(buffer, std::snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(number)));
+	} else {
+		out.append(buffer, std::snprintf(buffer, sizeof(buffer), "%llu", static_cast<unsigned long long>(number)));
+	}
+#endif
+}
+
+template <typename T>
+void write_value(std::string &out, const T &in);
+
+template <typename T, std::size_t... I>
+void write_struct(std::string &out, const T &in, std::index_sequence<I...>) {
+	out.push_back('{');
+	std::size_t i = 0;
+	((out.append(i++ == 0 ? "\"" : ",\"")
+		.append(std::get<I>(reflect<T>::fields).name)
+		.append("\":"),
+		write_value(out, in.*(std::get<I>(reflect<T>::fields).pointer))), ...);
+	out.push_back('}');
+}
+
+template <typename T>
+void write_value(std::string &out, const T &in) {
+	if constexpr (std::is_same_v<T, bool>) {
+		out.append(in ? "true" : "false");
+	} else if constexpr (std::is_arithmetic_v<T>) {
+		write_number(out, in);
+	} else if constexpr (std::is_convertible_v<const T &, std::string_view>) {
+		write_string(out, in);
+	} else if constexpr (is_optional<T>::value) {
+		if (in) {
+			write_value(out, *in);
+		} else {
+			out.append("null");
+		}
+	} else if constexpr (is_vector<T>::value) {
+		out.push_back('[');
+		for (std::size_t i = 0; i < in.size(); i++) {
+			if (i != 0) out.push_back(',');
+			write_value(out, in[i]);
+		}
+		out.push_back(']');
+	} else if constexpr (is_string_map<T>::value) {
+		out.push_back('{');
+		bool first = true;
+		for (const auto &[key, value] : in) {
+			if (!first) out.push_back(',');
+			first = false;
+			write_string(out, key);
+			out.push_back(':');
+			write_value(out, value);
+		}
+		out.push_back('}');
+	} else {
+		static_assert(is_reflected<T>::value, "kzr::write: unsupported type, use KZR_REFLECT");
+		constexpr std::size_t n = std::tuple_size_v<std::decay_t<decltype(reflect<T>::fields)>>;
+		write_struct(out, in, std::make_index_sequence<n>());
+	}
+}
+
+} // namespace detail
+
+/*
+ * Parse JSON text into out.
+ */
+template <typename T>
+read_result read(std::string_view json_text, T &out) {
+	kzrjson_reader_t reader;
+	kzrjson_reader_init(&reader, json_text.data(), json_text.size());
+	read_result result;
+	if (!detail::read_value(reader, kzrjson_reader_next(&reader), out)
+		|| kzrjson_reader_next(&reader) != kzrjson_event_end_of_text)
+	{
+		result.code = reader.error != kzrjson_success ? reader.error : kzrjson_err_illegal_type;
+		result.offset = reader.pos;
+	}
+	return result;
+}
+
+/*
+ * Serialize in to JSON text, appending it to out.
+ */
+template <typename T>
+void write(const T &in, std::string &out) {
+	detail::write_value(out, in);
+}
+
+template <typename T>
+std::string write(const T &in) {
+	std::string out;
+	detail::write_value(out, in);
+	return out;
+}
+
+} // namespace kzr
+
+#if defined(KZR_COROUTINE)
+/*****************************************************************************
+ * Streaming parse
+ *****************************************************************************/
+/*
+ * kzr::stream_parser parses JSON text which arrives in chunks,
+ * e.g. from a socket, without waiting for the whole text (C++20).
+ *
+ * events() and elements() are generators which run until more input
+ * is needed, and the next call continues where the last one stopped.
+ * Use either of them for a parser.
+ * elements() yields each element of the top-level array as soon as
+ * it is complete, so a large array is processed while bytes are arriving.
+ * Only the element being read is kept in the buffer.
+ *
+ * example)
+ *    kzr::stream_parser parser;
+ *    while (receive(chunk)) {
+ *        parser.feed(chunk);
+ *        for (kzr::document element : parser.elements()) {
+ *            element["id"].as_uint64();
+ *        }
+ *    }
+ *    parser.finish();
+ *    for (kzr::document element : parser.elements()) {
+ *        ...
+ *    }
+ *    if (parser.error() != kzrjson_success) ...
+ *
+ * A coroutine can also wait for events by co_await parser.next().
+ * It is suspended while more input is needed, and resumed by feed or finish
+ * on the caller's thread, so no executor thread is blocked.
+ *
+ * example)
+ *    task consume(kzr::stream_parser &parser) {
+ *        for (;;) {
+ *            kzr::event event = co_await parser.next();
+ *            if (event.type == kzrjson_event_end_of_text) break;
+ *            ...
+ *        }
+ *    }
+ */
+namespace kzr {
+
+/*
+ * Minimal synchronous generator, as std::generator is C++23.
+ */
+template <typename T>
+class generator {
+public:
+	struct promise_type {
+		std::optional<T> current;
+
+		generator get_return_object() noexcept {
+			return generator(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		std::suspend_always yield_value(T value) noexcept {
+			current = std::move(value);
+			return {};
+		}
+		void return_void() noexcept {}
+		void unhandled_exception() { throw; }
+	};
+
+	class iterator {
+	public:
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+
+		iterator() noexcept = default;
+		explicit iterator(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+		T &operator*() const noexcept { return *handle_.promise().current; }
+		iterator &operator++() { handle_.resume(); return *this; }
+		void operator++(int) { handle_.resume(); }
+		bool operator==(std::default_sentinel_t) const noexcept { return !handle_ || handle_.done(); }
+
+	private:
+		std::coroutine_handle<promise_type> handle_;
+	};
+
+	generator(const generator &) = delete;
+	generator &operator=(const generator &) = delete;
+	generator(generator &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+
+	generator &operator=(generator &&other) noexcept {
+		if (this != &other) {
+			if (handle_) handle_.destroy();
+			handle_ = std::exchange(other.handle_, nullptr);
+		}
+		return *this;
+	}
+
+	~generator() {
+		if (handle_) handle_.destroy();
+	}
+
+	iterator begin() {
+		handle_.resume();
+		return iterator(handle_);
+	}
+
+	std::default_sentinel_t end() const noexcept { return {}; }
+
+private:
+	explicit generator(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+	std::coroutine_handle<promise_type> handle_;
+};
+
+/*
+ * Event of kzr::stream_parser.
+ * token is set for key, string and number events as in kzrjson_reader_t,
+ * and is valid until the next feed or finish.
+ */
+struct event {
+	kzrjson_event_type type = kzrjson_event_need_more;
+	std::string_view token;
+	kzrjson_number_type number_type = kzrjson_uint;
+};
+
+class stream_parser {
+public:
+	stream_parser() noexcept { kzrjson_reader_init_stream(&reader_); }
+
+	stream_parser(const stream_parser &) = delete;
+	stream_parser &operator=(const stream_parser &) = delete;
+
+	/*
+	 * Append the next chunk of the text.
+	 * A coroutine waiting in next() is resumed if an event is ready.
+	 */
+	void feed(std::string_view chunk) {
+		// drop the text already read
+		const std::size_t read = (in_element_ ? element_begin_ : reader_.offset + reader_.pos) - base_;
+		buffer_.erase(0, read);
+		base_ += read;
+		buffer_.append(chunk);
+		update(false);
+	}
+
+	/*
+	 * Tell that no more text follows.
+	 */
+	void finish() { update(true); }
+
+	generator<event> events() {
+		for (;;) {
+			const event next = read();
+			if (next.type == kzrjson_event_need_more) co_return;
+			co_yield next;
+			if (next.type == kzrjson_event_end_of_text || next.type == kzrjson_event_error) co_return;
+		}
+	}
+
+	/*
+	 * Yield elements of the top-level array.
+	 * If the top-level value is not an array, it is yielded as a whole.
+	 */
+	generator<document> elements() {
+		for (;;) {
+			const event next = read();
+			switch (next.type) {
+			case kzrjson_event_need_more:
+			case kzrjson_event_end_of_text:
+			case kzrjson_event_error:
+				co_return;
+			default:
+				break;
+			}
+			if (!root_read_) {
+				root_read_ = true;
+				if (next.type == kzrjson_event_begin_array) {
+					element_depth_ = 1;
+					continue;
+				}
+			}
+
+			std::size_t begin = 0;
+			std::size_t end = 0;
+			switch (next.type) {
+			case kzrjson_event_begin_object:
+			case kzrjson_event_begin_array:
+				if (reader_.depth - 1 == element_depth_) {
+					in_element_ = true;
+					element_begin_ = reader_.offset + reader_.pos - 1;
+				}
+				continue;
+			case kzrjson_event_end_object:
+			case kzrjson_event_end_array:
+				if (reader_.depth != element_depth_ || !in_element_) continue;
+				in_element_ = false;
+				begin = element_begin_;
+				end = reader_.offset + reader_.pos;
+				break;
+			case kzrjson_event_string:
+				if (reader_.depth != element_depth_) continue;
+				begin = position(next.token.data()) - 1;
+				end = reader_.offset + reader_.pos;
+				break;
+			case kzrjson_event_number:
+			case kzrjson_event_true:
+			case kzrjson_event_false:
+			case kzrjson_event_null:
+				if (reader_.depth != element_depth_) continue;
+				begin = position(reader_.token);
+				end = begin + reader_.token_length;
+				break;
+			default:
+				continue;
+			}
+			co_yield document::parse(std::string(buffer_, begin - base_, end - begin));
+		}
+	}
+
+	/*
+	 * Awaitable of the next event.
+	 * The coroutine is suspended while more input is needed.
+	 */
+	auto next() noexcept {
+		struct awaiter {
+			stream_parser &parser;
+
+			bool await_ready() noexcept {
+				parser.pending_ = parser.read();
+				return parser.pending_.type != kzrjson_event_need_more;
+			}
+			void await_suspend(std::coroutine_handle<> handle) noexcept { parser.waiting_ = handle; }
+			event await_resume() noexcept { return parser.pending_; }
+		};
+		return awaiter{*this};
+	}
+
+	kzrjson_errno_t error() const noexcept { return reader_.error; }
+
+	// offset of the error from the beginning of the whole text
+	std::size_t offset() const noexcept { return reader_.offset + reader_.pos; }
+
+private:
+	event read() noexcept {
+		event next;
+		next.type = kzrjson_reader_next(&reader_);
+		if (next.type == kzrjson_event_key || next.type == kzrjson_event_string
+			|| next.type == kzrjson_event_number)
+		{
+			next.token = std::string_view(reader_.token, reader_.token_length);
+			next.number_type = reader_.number_type;
+		}
+		return next;
+	}
+
+	std::size_t position(const char *p) const noexcept {
+		return reader_.offset + static_cast<std::size_t>(p - reader_.text);
+	}
+
+	void update(bool final) {
+		const std::size_t unread = reader_.offset + reader_.pos - base_;
+		kzrjson_reader_feed(&reader_, buffer_.data() + unread, buffer_.size() - unread, final);
+		if (waiting_) {
+			pending_ = read();
+			if (pending_.type != kzrjson_event_need_more) std::exchange(waiting_, nullptr).resume();
+		}
+	}
+
+	kzrjson_reader_t reader_;
+	std::string buffer_;
+	// offset of buffer_ from the beginning of the whole text
+	std::size_t base_ = 0;
+
+	bool root_read_ = false;
+	std::size_t element_depth_ = 0;
+	bool in_element_ = false;
+	std::size_t element_begin_ = 0;
+
+	std::coroutine_handle<> waiting_;
+	event pending_;
+};
+
+} // namespace kzr
+#endif // KZR_COROUTINE
+
+#endif // KZRJSON_HPP
@@ -1,5 +1,6 @@
 #include "kzrjson.h"
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -108,6 +109,215 @@ static void test_parse_sample3(void) {
 	puts("test_parse_sample3 done");
 }
 
+static void test_parse_result(void) {
+	kzrjson_result_t ok = kzrjson_parse_result(sample3);
+	assert(ok.code == kzrjson_success);
+	assert(ok.value != NULL);
+	assert(ok.value->elements_size == 2);
+	kzrjson_free(ok.value);
+
+	kzrjson_result_t ng = kzrjson_parse_result("{\n  \"a\": 1,\n  \"b\": tru\n}");
+	assert(ng.code == kzrjson_err_tokenize);
+	assert(ng.value == NULL);
+	assert(ng.offset == 19);
+	assert(ng.line == 3);
+	assert(ng.column == 8);
+	assert(kzrjson_errno() == kzrjson_err_tokenize);
+
+	kzrjson_t object = kzrjson_parse("{\"a\": 1}");
+	kzrjson_result_t found = kzrjson_get_value_result(object, "a");
+	assert(found.code == kzrjson_success);
+	assert(found.value->number_uint == 1);
+	kzrjson_result_t missing = kzrjson_get_member_result(object, "b");
+	assert(missing.code == kzrjson_err_object_key_not_found);
+	assert(missing.value == NULL);
+	kzrjson_free(object);
+
+	// a number at the end of text
+	kzrjson_t number = kzrjson_parse("-45");
+	assert(number != NULL);
+	assert(number->number_int == -45);
+	kzrjson_free(number);
+	number = kzrjson_parse("[1.5e3 ,22]");
+	assert(number->elements[0]->number_double == 1500.0);
+	assert(number->elements[1]->number_uint == 22);
+	kzrjson_free(number);
+	puts("test_parse_result done");
+}
+
+// kzrjson.c is built without KZRJSON_RELAXED and KZRJSON_VALIDATE_UTF8
+static void test_parse_strict(void) {
+	const struct {
+		const char *text;
+		size_t offset;
+	} invalid[] = {
+		{"[01]", 2},
+		{"[-]", 2},
+		{"[1.]", 3},
+		{"[.5]", 1},
+		{"[1e+]", 4},
+		{"[+1]", 1},
+		{"\"a\tb\"", 2},
+		{"\"\\u12g4\"", 5},
+		{"[\"\\u12\"]", 6},
+	};
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+		kzrjson_result_t result = kzrjson_parse_result(invalid[i].text);
+		assert(result.code == kzrjson_err_tokenize);
+		assert(result.offset == invalid[i].offset);
+	}
+
+	kzrjson_t numbers = kzrjson_parse(" [0, -0.25, 1E+2, -12e-1, 18446744073709551615] ");
+	assert(numbers->elements[0]->number_type == kzrjson_uint);
+	assert(numbers->elements[1]->number_type == kzrjson_double);
+	assert(numbers->elements[1]->number_double == -0.25);
+	assert(numbers->elements[2]->number_type == kzrjson_exp);
+	assert(numbers->elements[2]->number_double == 100.0);
+	assert(numbers->elements[3]->number_double == -1.2);
+	assert(numbers->elements[4]->number_uint == UINT64_MAX);
+	kzrjson_free(numbers);
+
+	// not ASCII is not checked
+	kzrjson_t string = kzrjson_parse("\"\xc3\xa9\\u00e9\"");
+	assert(strcmp(string->string, "\xc3\xa9\\u00e9") == 0);
+	kzrjson_free(string);
+	puts("test_parse_strict done");
+}
+
+static void test_validate(void) {
+	const char *valid[] = {
+		sample1, sample2, sample3, "0", "-0.5e+10", "\"\"", "[]", "{}", " [ {} , [ ] ] ",
+		"\"\\u00e9\\ud83d\\ude00 \\\" \\\\ \\/ \\b \\f \\n \\r \\t\"",
+		"\"\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 \xef\xbf\xbf \xf4\x8f\xbf\xbf\"",
+	};
+	for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+		assert(kzrjson_validate(valid[i], strlen(valid[i]), NULL));
+	}
+
+	const struct {
+		const char *text;
+		kzrjson_errno_t code;
+		size_t offset;
+	} invalid[] = {
+		{"", kzrjson_err_parse, 0},
+		{"[1,]", kzrjson_err_tokenize, 3},
+		{"[01]", kzrjson_err_parse, 2},
+		{"{\"a\" 1}", kzrjson_err_parse, 5},
+		{"{\"a\":1,}", kzrjson_err_parse, 7},
+		{"[1] 2", kzrjson_err_parse, 4},
+		{"[\"a]", kzrjson_err_tokenize, 4},
+		{"[\"\\x\"]", kzrjson_err_tokenize, 3},
+		{"\"\\u12g4\"", kzrjson_err_tokenize, 2},
+		{"\"a\tb\"", kzrjson_err_tokenize, 2},
+		{"[tru]", kzrjson_err_tokenize, 1},
+		{"[1.]", kzrjson_err_tokenize, 3},
+		{"\"\xc0\x80\"", kzrjson_err_tokenize, 1},         // overlong
+		{"\"\xed\xa0\x80\"", kzrjson_err_tokenize, 1},     // surrogate
+		{"\"\xf4\x90\x80\x80\"", kzrjson_err_tokenize, 1}, // over U+10FFFF
+		{"\"\xe2\x82\"", kzrjson_err_tokenize, 1},         // truncated
+		{"\"abcdefghijklmnop\xff\"", kzrjson_err_tokenize, 17},
+	};
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+		kzrjson_result_t err;
+		assert(!kzrjson_validate(invalid[i].text, strlen(invalid[i].text), &err));
+		assert(err.code == invalid[i].code);
+		assert(err.offset == invalid[i].offset);
+		assert(kzrjson_errno() == invalid[i].code);
+	}
+
+	// line and column, and the length limits the text
+	kzrjson_result_t err;
+	const char *text = "{\n  \"a\": 1,\n  \"b\": tru\n}";
+	assert(!kzrjson_validate(text, strlen(text), &err));
+	assert(err.line == 3 && err.column == 8);
+	assert(kzrjson_validate("[1, 2] garbage", 6, &err));
+	assert(err.code == kzrjson_success);
+
+	// long strings are scanned in words; an escape at every alignment
+	char string[64];
+	for (size_t i = 1; i < 40; i++) {
+		memset(string, 'a', sizeof(string));
+		string[0] = '"';
+		string[i] = '\\';
+		string[i + 1] = 'n';
+		string[50] = '"';
+		assert(kzrjson_validate(string, 51, NULL));
+		string[i + 1] = 'x';
+		assert(!kzrjson_validate(string, 51, &err));
+		assert(err.offset == i + 1);
+	}
+
+	// nesting
+	static char deep[KZRJSON_READER_MAX_DEPTH * 2 + 2];
+	memset(deep, '[', KZRJSON_READER_MAX_DEPTH);
+	memset(deep + KZRJSON_READER_MAX_DEPTH, ']', KZRJSON_READER_MAX_DEPTH);
+	assert(kzrjson_validate(deep, KZRJSON_READER_MAX_DEPTH * 2, NULL));
+	deep[KZRJSON_READER_MAX_DEPTH] = '[';
+	assert(!kzrjson_validate(deep, KZRJSON_READER_MAX_DEPTH * 2, &err));
+	assert(err.code == kzrjson_err_too_deep);
+	puts("test_validate done");
+}
+
+static size_t g_allocate_count;
+
+static void *counting_allocate(size_t size, void *context) {
+	(void)context;
+	g_allocate_count++;
+	return malloc(size);
+}
+
+static void counting_deallocate(void *pointer, size_t size, void *context) {
+	(void)size;
+	(void)context;
+	free(pointer);
+}
+
+static void test_doc_reuse(void) {
+	const kzrjson_allocator_t allocator = {
+		.allocate = counting_allocate,
+		.deallocate = counting_deallocate,
+		.context = NULL,
+	};
+	kzrjson_doc_t doc = kzrjson_doc_make_with_allocator(&allocator);
+	assert(doc != NULL);
+
+	// warm up
+	for (int i = 0; i < 2; i++) {
+		kzrjson_t json = kzrjson_doc_parse(doc, sample2);
+		assert(json != NULL);
+		kzrjson_doc_reset(doc);
+	}
+
+	// steady state
+	const size_t count = g_allocate_count;
+	for (int i = 0; i < 100; i++) {
+		kzrjson_t json = kzrjson_doc_parse(doc, i % 2 == 0 ? sample2 : sample3);
+		assert(json != NULL);
+		assert(json->doc == doc);
+		kzrjson_doc_reset(doc);
+	}
+	assert(g_allocate_count == count);
+
+	kzrjson_t json = kzrjson_doc_parse(doc, sample1);
+	kzrjson_t object = kzrjson_get_value_from_key(json, "Image");
+	kzrjson_t ids = kzrjson_get_value_from_key(object, "IDs");
+	kzrjson_t other = kzrjson_doc_parse(doc, "[1, {}, []]");
+	assert(other->elements_size == 3);
+	assert(other->elements[1]->elements_size == 0);
+	assert(kzrjson_array_add_element(ids, other->elements[0]));
+	assert(ids->elements_size == 5);
+	assert(ids->elements[4]->number_uint == 1);
+
+	kzrjson_t heap = kzrjson_make_null();
+	assert(!kzrjson_array_add_element(ids, heap));
+	assert(kzrjson_errno() == kzrjson_err_foreign_data);
+	kzrjson_free(heap);
+	kzrjson_free(json); // no effect, owned by doc
+
+	kzrjson_doc_free(doc);
+	puts("test_doc_reuse done");
+}
+
 static void test_make_json(void) {
 	kzrjson_t object = kzrjson_make_object();
 	assert(object->type == kzrjson_object);
@@ -153,6 +363,1069 @@ static void test_make_json(void) {
 	puts("test_make_json done");
 }
 
+static void assert_json_text(kzrjson_t json, const char *expected) {
+	kzrjson_text_t text = kzrjson_to_string(json);
+	assert(strcmp(text.text, expected) == 0);
+	free(text.text);
+}
+
+static void test_make_array_bulk(void) {
+	const int64_t int64s[] = {1, -2, INT64_MIN};
+	kzrjson_t array = kzrjson_make_array_int64(int64s, 3);
+	assert(array->packed_type == kzrjson_packed_int64 && array->elements_size == 3);
+	kzrjson_text_t json_text = kzrjson_to_string(array);
+	assert(strcmp(json_text.text, "[1,-2,-9223372036854775808]") == 0);
+	free(json_text.text);
+	kzrjson_free(array);
+
+	const double doubles[] = {0.5, 1e300, -3};
+	array = kzrjson_make_array_double(doubles, 3);
+	json_text = kzrjson_to_string(array);
+	assert(strcmp(json_text.text, "[0.5,1e+300,-3]") == 0);
+	free(json_text.text);
+	kzrjson_free(array);
+	const double infinity[] = {HUGE_VAL};
+	assert(kzrjson_make_array_double(infinity, 1) == NULL);
+	assert(kzrjson_errno() == kzrjson_err_not_number);
+
+	const uint64_t uint64s[] = {UINT64_MAX};
+	array = kzrjson_make_array_uint64(uint64s, 1);
+	assert(kzrjson_array_get_uint64(array, 0) == UINT64_MAX);
+	kzrjson_free(array);
+
+	const char *strings[] = {"a", "bc", "def"};
+	const size_t lengths[] = {1, 1, 3};
+	array = kzrjson_make_array_strings(strings, lengths, 3);
+	assert(array->elements_size == 3 && array->elements_capacity == 3);
+	assert(strcmp(array->elements[1]->string, "b") == 0);
+	kzrjson_t more = kzrjson_make_array_strings(strings, NULL, 3);
+	assert(strcmp(more->elements[2]->string, "def") == 0);
+
+	// append to a packed array unpacks it
+	kzrjson_t numbers = kzrjson_make_array_int64(int64s, 2);
+	assert(kzrjson_array_append_many(numbers, more->elements, 3));
+	more->elements_size = 0; // moved to numbers
+	kzrjson_free(more);
+	json_text = kzrjson_to_string(numbers);
+	assert(strcmp(json_text.text, "[1,-2,\"a\",\"bc\",\"def\"]") == 0);
+	free(json_text.text);
+	kzrjson_free(numbers);
+
+	kzrjson_doc_t doc = kzrjson_doc_make();
+	kzrjson_t foreign[] = {kzrjson_doc_parse(doc, "1")};
+	assert(!kzrjson_array_append_many(array, foreign, 1));
+	assert(kzrjson_errno() == kzrjson_err_foreign_data);
+	assert(array->elements_size == 3);
+	assert(!kzrjson_array_append_many(foreign[0], array->elements, 3));
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	kzrjson_doc_free(doc);
+	kzrjson_free(array);
+	puts("test_make_array_bulk done");
+}
+
+static void test_modify_json(void) {
+	kzrjson_t array = kzrjson_parse("[0, 1, 2, 3, 4]");
+	kzrjson_t removed = kzrjson_array_remove_element(array, 1);
+	assert(removed->number_uint == 1);
+	assert_json_text(array, "[0,2,3,4]");
+	kzrjson_free(removed);
+
+	removed = kzrjson_array_swap_remove_element(array, 0);
+	assert(removed->number_uint == 0);
+	assert_json_text(array, "[4,2,3]");
+	kzrjson_free(removed);
+
+	assert(kzrjson_array_insert_element(array, 0, kzrjson_make_null()));
+	assert(kzrjson_array_insert_element(array, 4, kzrjson_make_boolean(true)));
+	assert_json_text(array, "[null,4,2,3,true]");
+	kzrjson_t element = kzrjson_make_null();
+	assert(!kzrjson_array_insert_element(array, 6, element));
+	assert(kzrjson_errno() == kzrjson_err_index_out_of_range);
+
+	kzrjson_t replaced = kzrjson_array_replace_element(array, 2, element);
+	assert(replaced->number_uint == 2);
+	assert_json_text(array, "[null,4,null,3,true]");
+	kzrjson_free(replaced);
+
+	kzrjson_t object = kzrjson_parse("{\"a\":1,\"b\":2,\"c\":3,\"d\":4}");
+	kzrjson_t member = kzrjson_object_remove_member(object, "b");
+	assert(strcmp(member->key, "b") == 0);
+	assert_json_text(object, "{\"a\":1,\"c\":3,\"d\":4}");
+	assert(kzrjson_object_insert_member(object, 0, member));
+	assert_json_text(object, "{\"b\":2,\"a\":1,\"c\":3,\"d\":4}");
+
+	member = kzrjson_object_swap_remove_member(object, "b");
+	assert_json_text(object, "{\"d\":4,\"a\":1,\"c\":3}");
+	kzrjson_free(member);
+	assert(kzrjson_object_remove_member(object, "b") == NULL);
+	assert(kzrjson_errno() == kzrjson_err_object_key_not_found);
+
+	kzrjson_t value = kzrjson_object_replace_value(object, "a", kzrjson_make_string("x", 1));
+	assert(value->number_uint == 1);
+	assert_json_text(object, "{\"d\":4,\"a\":\"x\",\"c\":3}");
+	kzrjson_free(value);
+
+	// move between containers and within a container
+	kzrjson_t target = kzrjson_make_object();
+	assert(kzrjson_move_element(object, 0, target, 0));
+	assert(kzrjson_move_element(object, 1, object, 0));
+	assert_json_text(object, "{\"c\":3,\"a\":\"x\"}");
+	assert_json_text(target, "{\"d\":4}");
+	assert(!kzrjson_move_element(object, 0, array, 0));
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+
+	// not into the element itself or its descendants
+	kzrjson_t nested = kzrjson_parse("[[1], [[2]]]");
+	assert(!kzrjson_move_element(nested, 0, nested->elements[0], 0));
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	assert(!kzrjson_move_element(nested, 1, nested->elements[1]->elements[0], 0));
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	assert_json_text(nested, "[[1],[[2]]]");
+	assert(kzrjson_move_element(nested, 0, nested->elements[1]->elements[0], 1));
+	assert_json_text(nested, "[[[2,[1]]]]");
+	kzrjson_free(nested);
+
+	// a container can not be added or put into itself or its descendants
+	kzrjson_t cycle = kzrjson_parse("[[1], {\"k\": [2]}]");
+	assert(!kzrjson_array_add_element(cycle, cycle));
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	assert(!kzrjson_array_add_element(cycle->elements[0], cycle));
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	assert(kzrjson_array_replace_element(cycle->elements[0], 0, cycle) == NULL);
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	kzrjson_t inner = cycle->elements[1];
+	assert(kzrjson_object_replace_value(inner, "k", cycle) == NULL);
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	assert(kzrjson_object_replace_value(inner, "k", inner) == NULL);
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	// and the value of a member can not be a member
+	assert(kzrjson_object_replace_value(inner, "k", inner->elements[0]) == NULL);
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	assert_json_text(cycle, "[[1],{\"k\":[2]}]");
+	kzrjson_free(cycle);
+
+	kzrjson_free(array);
+	kzrjson_free(object);
+	kzrjson_free(target);
+	puts("test_modify_json done");
+}
+
+static void assert_index_consistent(kzrjson_t object) {
+	for (size_t i = 0; i < object->elements_size; i++) {
+		kzrjson_t member = object->elements[i];
+		assert(kzrjson_get_member(object, member->key) == member);
+		assert(kzrjson_get_member_hashed(object, member->key, member->key_length,
+			kzrjson_hash_key(member->key, member->key_length)) == member);
+	}
+}
+
+static void test_object_index(void) {
+	kzrjson_t object = kzrjson_make_object();
+	char key[16];
+	for (int i = 0; i < 40; i++) {
+		const int length = snprintf(key, sizeof(key), "key%d", i);
+		kzrjson_object_add_member(object, kzrjson_make_member(key, length, kzrjson_make_number_int(i)));
+	}
+	assert(kzrjson_object_make_index(object));
+	assert(object->index != NULL);
+	assert_index_consistent(object);
+	assert(kzrjson_get_member(object, "key4") == object->elements[4]);
+	assert(kzrjson_get_member_n(object, "key40", 4) == object->elements[4]);
+	assert(kzrjson_get_member(object, "key40") == NULL);
+	assert(kzrjson_errno() == kzrjson_err_object_key_not_found);
+
+	uint32_t random = 1;
+	kzrjson_t other = kzrjson_make_object();
+	for (int i = 0; i < 200; i++) {
+		random = random * 1103515245u + 12345u;
+		const size_t at = (random >> 8) % object->elements_size;
+		switch ((random >> 4) % 4) {
+		case 0:
+			assert(kzrjson_array_swap_remove_element(object, at) == NULL);
+			assert(kzrjson_errno() == kzrjson_err_illegal_type);
+			kzrjson_free(kzrjson_object_swap_remove_member(object, object->elements[at]->key));
+			break;
+		case 1:
+			kzrjson_free(kzrjson_object_remove_member(object, object->elements[at]->key));
+			break;
+		case 2: {
+			const int length = snprintf(key, sizeof(key), "new%d", i);
+			kzrjson_object_insert_member(object, at, kzrjson_make_member(key, length, kzrjson_make_null()));
+			break;
+		}
+		case 3: {
+			const int length = snprintf(key, sizeof(key), "add%d", i);
+			kzrjson_object_add_member(object, kzrjson_make_member(key, length, kzrjson_make_null()));
+			assert(kzrjson_move_element(object, at, other, 0));
+			assert(kzrjson_move_element(other, 0, object, object->elements_size));
+			break;
+		}
+		}
+		assert_index_consistent(object);
+	}
+	kzrjson_free(object);
+	kzrjson_free(other);
+	puts("test_object_index done");
+}
+
+static void test_lookup_cache(void) {
+	char text[4096];
+	size_t length = 0;
+	text[length++] = '[';
+	for (int i = 0; i < 40; i++) {
+		length += snprintf(text + length, sizeof(text) - length, i % 10 == 9
+			? "%s{\"State\": \"s\", \"City\": \"c%d\"}"
+			: "%s{\"City\": \"c%d\", \"State\": \"s\"}", i == 0 ? "" : ",", i);
+	}
+	length += snprintf(text + length, sizeof(text) - length, ",{\"State\": \"s\"}]");
+
+	kzrjson_doc_t doc = kzrjson_doc_make();
+	for (int round = 0; round < 2; round++) {
+		kzrjson_t zips = round == 0
+			? kzrjson_doc_parse(doc, text)
+			: kzrjson_doc_parse_with_options(doc, text, kzrjson_option_share_shapes).value;
+		kzrjson_lookup_cache_t cache = {0};
+		char expected[8];
+		for (int i = 0; i < 40; i++) {
+			kzrjson_t city = kzrjson_get_member_cached(zips->elements[i], "City", &cache);
+			snprintf(expected, sizeof(expected), "c%d", i);
+			assert(city != NULL && strcmp(city->value->string, expected) == 0);
+			assert(cache.position == (i % 10 == 9 ? 2u : 1u));
+		}
+		assert(kzrjson_get_member_cached(zips->elements[40], "City", &cache) == NULL);
+		assert(kzrjson_errno() == kzrjson_err_object_key_not_found);
+		assert(kzrjson_get_member_cached(zips->elements[40], "State", &cache) != NULL);
+		assert(cache.position == 1);
+		assert(kzrjson_get_member_cached(zips, "State", &cache) == NULL);
+		assert(kzrjson_errno() == kzrjson_err_illegal_type);
+		kzrjson_doc_reset(doc);
+	}
+	kzrjson_doc_free(doc);
+	puts("test_lookup_cache done");
+}
+
+static void test_packed_array(void) {
+	const char *text = "{\"i\": [1, -2, 3], \"u\": [1, 18446744073709551615], \"d\": [1, 0.1, -2.5e10],"
+		" \"mixed\": [1, \"a\"], \"nested\": [[1, 2], []], \"big\": [-1, 18446744073709551615]}";
+	const char *packed_text = "{\"i\":[1,-2,3],\"u\":[1,18446744073709551615],\"d\":[1,0.1,-2.5e+10],"
+		"\"mixed\":[1,\"a\"],\"nested\":[[1,2],[]],\"big\":[-1,18446744073709551615]}";
+	kzrjson_doc_t doc = kzrjson_doc_make();
+	for (int i = 0; i < 2; i++) {
+		kzrjson_result_t result = i == 0
+			? kzrjson_parse_with_options(text, kzrjson_option_pack_arrays)
+			: kzrjson_doc_parse_with_options(doc, text, kzrjson_option_pack_arrays);
+		assert(result.code == kzrjson_success);
+		kzrjson_t json = result.value;
+
+		const int64_t *int64s;
+		const uint64_t *uint64s;
+		const double *doubles;
+		size_t size;
+		assert(kzrjson_array_as_int64(kzrjson_get_value_from_key(json, "i"), &int64s, &size));
+		assert(size == 3 && int64s[0] == 1 && int64s[1] == -2 && int64s[2] == 3);
+		assert(kzrjson_array_as_uint64(kzrjson_get_value_from_key(json, "u"), &uint64s, &size));
+		assert(size == 2 && uint64s[1] == UINT64_MAX);
+		assert(kzrjson_array_as_double(kzrjson_get_value_from_key(json, "d"), &doubles, &size));
+		assert(size == 3 && doubles[1] == 0.1 && doubles[2] == -2.5e10);
+		assert(!kzrjson_array_as_int64(kzrjson_get_value_from_key(json, "d"), &int64s, &size));
+		assert(kzrjson_errno() == kzrjson_err_illegal_type);
+		assert(kzrjson_get_value_from_key(json, "mixed")->packed_type == kzrjson_packed_none);
+		assert(kzrjson_get_value_from_key(json, "big")->packed_type == kzrjson_packed_none);
+		kzrjson_t nested = kzrjson_get_value_from_key(json, "nested");
+		assert(nested->packed_type == kzrjson_packed_none);
+		assert(nested->elements[0]->packed_type == kzrjson_packed_int64);
+		assert(nested->elements[1]->packed_type == kzrjson_packed_none);
+
+		kzrjson_text_t json_text = kzrjson_to_string(json);
+		assert(strcmp(json_text.text, packed_text) == 0);
+		free(json_text.text);
+
+		// getters read packed and unpacked arrays alike
+		kzrjson_t d = kzrjson_get_value_from_key(json, "d");
+		assert(kzrjson_array_get_int64(d, 0) == 1);
+		assert(kzrjson_array_get_int64(d, 1) == 0);
+		assert(kzrjson_errno() == kzrjson_err_not_number);
+		assert(kzrjson_array_get_double(d, 3) == 0);
+		assert(kzrjson_errno() == kzrjson_err_index_out_of_range);
+		kzrjson_t mixed = kzrjson_get_value_from_key(json, "mixed");
+		assert(kzrjson_array_get_uint64(mixed, 0) == 1);
+		kzrjson_array_get_double(mixed, 1);
+		assert(kzrjson_errno() == kzrjson_err_not_number);
+
+		// modifying unpacks
+		kzrjson_t removed = kzrjson_array_remove_element(d, 2);
+		assert(removed->number_double == -2.5e10);
+		kzrjson_free(removed);
+		assert(d->packed_type == kzrjson_packed_none);
+		assert(d->elements_size == 2 && d->elements[1]->number_double == 0.1);
+		assert(kzrjson_array_pack(d));
+		assert(d->packed_type == kzrjson_packed_double);
+		assert(kzrjson_array_get_double(d, 1) == 0.1);
+		assert(!kzrjson_array_pack(mixed));
+		assert(kzrjson_errno() == kzrjson_err_not_number);
+
+		if (i == 0) kzrjson_free(json);
+	}
+	kzrjson_doc_free(doc);
+
+	// in a document, memory of the released numbers is reused by the next values
+	char big[8192];
+	size_t length = 0;
+	big[length++] = '[';
+	for (int i = 0; i < 3; i++) {
+		length += snprintf(big + length, sizeof(big) - length, i == 0 ? "[" : ",[");
+		for (int n = 0; n < 500; n++) {
+			length += snprintf(big + length, sizeof(big) - length, n == 0 ? "%d" : ",%d", n * (i + 1));
+		}
+		big[length++] = ']';
+	}
+	length += snprintf(big + length, sizeof(big) - length, ",\"tail\"]");
+	doc = kzrjson_doc_make();
+	kzrjson_t json = kzrjson_doc_parse_with_options(doc, big, kzrjson_option_pack_arrays).value;
+	assert(json->packed_type == kzrjson_packed_none && json->elements_size == 4);
+	for (int i = 0; i < 3; i++) {
+		kzrjson_t packed = json->elements[i];
+		assert(packed->packed_type == kzrjson_packed_int64 && packed->elements_size == 500);
+		for (int n = 0; n < 500; n++) {
+			assert(packed->packed_int64[n] == n * (i + 1));
+		}
+	}
+	assert(strcmp(json->elements[3]->string, "tail") == 0);
+	kzrjson_doc_free(doc);
+
+	// kzrjson_make_* values
+	kzrjson_t array = kzrjson_make_array();
+	assert(kzrjson_array_pack(array));
+	assert(array->packed_type == kzrjson_packed_int64 && array->elements_size == 0);
+	assert(kzrjson_array_add_element(array, kzrjson_make_number_double(0.5)));
+	assert(kzrjson_array_add_element(array, kzrjson_make_number_int(-3)));
+	assert(kzrjson_array_pack(array));
+	assert(array->packed_type == kzrjson_packed_double);
+	assert(kzrjson_array_unpack(array));
+	assert(array->packed_type == kzrjson_packed_none);
+	assert(array->elements[1]->number_type == kzrjson_double && array->elements[1]->number_double == -3);
+	assert(array->elements[0]->number_double == 0.5);
+	kzrjson_free(array);
+	puts("test_packed_array done");
+}
+
+static void test_shapes(void) {
+	const char *text = "{\"zips\": [{\"id\": 1, \"city\": \"a\"}, {\"id\": 2, \"city\": \"b\"},"
+		" {\"city\": \"c\", \"id\": 3}, {\"id\": 4, \"city\": \"d\", \"zip\": 5}]}";
+	kzrjson_doc_t doc = kzrjson_doc_make();
+	for (int round = 0; round < 2; round++) {
+		kzrjson_t json = kzrjson_doc_parse_with_options(doc, text, kzrjson_option_share_shapes).value;
+		kzrjson_t zips = kzrjson_get_value_from_key(json, "zips");
+		kzrjson_t *rows = zips->elements;
+		assert(rows[0]->shape != NULL && rows[0]->shape == rows[1]->shape);
+		assert(rows[2]->shape != rows[0]->shape && rows[3]->shape != rows[0]->shape);
+		assert(rows[0]->index == rows[1]->index);
+		assert(rows[0]->elements[0]->key == rows[2]->elements[1]->key);
+		for (int i = 0; i < 4; i++) {
+			assert(kzrjson_get_value_from_key(rows[i], "id")->number_uint == (uint64_t)i + 1);
+		}
+		assert(kzrjson_get_member(rows[1], "zip") == NULL);
+		assert(kzrjson_errno() == kzrjson_err_object_key_not_found);
+
+		// moved into an object of a shared shape
+		assert(kzrjson_move_element(rows[3], 2, rows[1], 2));
+		assert(rows[1]->shape == NULL && rows[0]->shape != NULL);
+		assert(kzrjson_get_value_from_key(rows[1], "zip")->number_uint == 5);
+		assert(kzrjson_get_value_from_key(rows[1], "id")->number_uint == 2);
+		assert(kzrjson_get_member(rows[0], "zip") == NULL);
+		assert(kzrjson_get_member(rows[3], "zip") == NULL);
+
+		// a changed object leaves the shape, and the others keep it
+		kzrjson_t removed = kzrjson_object_swap_remove_member(rows[1], "id");
+		assert(removed != NULL && rows[1]->shape == NULL);
+		assert(kzrjson_get_member(rows[1], "id") == NULL);
+		assert(kzrjson_get_value_from_key(rows[1], "city") != NULL);
+		assert(kzrjson_get_value_from_key(rows[0], "id")->number_uint == 1);
+		assert(kzrjson_object_add_member(rows[0], kzrjson_doc_parse_with_options(doc, "{\"x\": 0}",
+			kzrjson_option_share_shapes).value->elements[0]));
+		assert(rows[0]->shape == NULL);
+		assert(kzrjson_get_value_from_key(rows[0], "x")->number_uint == 0);
+		assert(kzrjson_get_value_from_key(rows[0], "city") != NULL);
+		kzrjson_doc_reset(doc);
+	}
+
+	// without the option, nothing is shared
+	kzrjson_t json = kzrjson_doc_parse(doc, text);
+	kzrjson_t zips = kzrjson_get_value_from_key(json, "zips");
+	assert(zips->elements[0]->shape == NULL);
+	assert(zips->elements[0]->elements[0]->key != zips->elements[1]->elements[0]->key);
+	kzrjson_doc_free(doc);
+	puts("test_shapes done");
+}
+
+static void test_predict_keys(void) {
+	const char *text = "[{\"id\": 1, \"city\": \"a\"}, { \"id\" : 2 ,\n \"city\": \"b\"},"
+		" {\"idx\": 3, \"city\": \"c\"}, {\"id\": 4}, {\"id\": 5, \"city\": \"e\", \"zip\": 6},"
+		" {\"id\": 7, \"city\": {\"id\": 8, \"city\": \"h\"}}]";
+	kzrjson_doc_t doc = kzrjson_doc_make();
+	kzrjson_t json = kzrjson_doc_parse_with_options(doc, text, kzrjson_option_predict_keys).value;
+	kzrjson_t *rows = json->elements;
+	assert(rows[0]->shape != NULL && rows[1]->shape == rows[0]->shape);
+	assert(rows[2]->shape != rows[0]->shape && rows[3]->shape != rows[0]->shape);
+	assert(rows[4]->shape != rows[0]->shape && rows[5]->shape == rows[0]->shape);
+	assert(rows[5]->elements[1]->value->shape == rows[0]->shape);
+	assert(rows[1]->elements[1]->key == rows[0]->elements[1]->key);
+	assert(strcmp(rows[2]->elements[0]->key, "idx") == 0);
+	assert(kzrjson_get_value_from_key(rows[1], "city") == rows[1]->elements[1]->value);
+	kzrjson_text_t json_text = kzrjson_to_string(json);
+	kzrjson_t heap = kzrjson_parse(text);
+	kzrjson_text_t expected = kzrjson_to_string(heap);
+	assert(strcmp(json_text.text, expected.text) == 0);
+	free(json_text.text);
+	free(expected.text);
+	kzrjson_free(heap);
+
+	// each root object of a stream is predicted from the previous one
+	kzrjson_doc_reset(doc);
+	kzrjson_t first = kzrjson_doc_parse_with_options(doc, "{\"id\": 1, \"city\": \"a\"}", kzrjson_option_predict_keys).value;
+	kzrjson_t second = kzrjson_doc_parse_with_options(doc, "{\"id\": 2, \"city\": \"b\"}", kzrjson_option_predict_keys).value;
+	assert(first->shape != NULL && second->shape == first->shape);
+
+	// a predicted key at the end of text
+	kzrjson_result_t result = kzrjson_doc_parse_with_options(doc, "{\"id\"", kzrjson_option_predict_keys);
+	assert(result.code != kzrjson_success);
+	result = kzrjson_doc_parse_with_options(doc, "{\"i", kzrjson_option_predict_keys);
+	assert(result.code == kzrjson_err_tokenize);
+	kzrjson_doc_free(doc);
+	puts("test_predict_keys done");
+}
+
+static bool in_block(const void *p, const char *begin, const char *end) {
+	return (const char *)p >= begin && (const char *)p < end;
+}
+
+static void test_compact(void) {
+	kzrjson_doc_t doc = kzrjson_doc_make();
+	kzrjson_t garbage = kzrjson_doc_parse(doc, "[\"garbage to be released by compaction\", 1, 2, 3]");
+	kzrjson_t json = kzrjson_doc_parse_with_options(doc,
+		"{\"name\": \"config\", \"values\": [1, 2, 3], \"rows\": [{\"id\": 1, \"on\": true},"
+		" {\"id\": 2, \"on\": false}], \"empty\": {}, \"none\": null, \"pi\": 3.14}",
+		kzrjson_option_pack_arrays).value;
+	assert(kzrjson_get_value_from_key(json, "values")->packed_type == kzrjson_packed_int64);
+	kzrjson_t rows = kzrjson_get_value_from_key(json, "rows");
+	assert(kzrjson_array_add_element(rows, kzrjson_array_remove_element(garbage, 0)));
+	assert(kzrjson_object_make_index(json));
+	kzrjson_text_t before = kzrjson_to_string(json);
+
+	assert(kzrjson_compact(doc, &json) > 0);
+	kzrjson_text_t after = kzrjson_to_string(json);
+	assert(strcmp(before.text, after.text) == 0);
+	free(before.text);
+	free(after.text);
+
+	// the root comes first, and everything of the tree follows it
+	const char *begin = (const char *)json;
+	const char *end = begin + 4096;
+	rows = kzrjson_get_value_from_key(json, "rows");
+	assert(in_block(json->elements, begin, end) && in_block(json->index, begin, end));
+	assert(in_block(rows, begin, end) && (const char *)rows->elements > (const char *)rows);
+	assert(in_block(rows->elements[2]->string, begin, end));
+	assert(strcmp(json->elements[0]->key, "name") == 0 && json->elements[0]->key_length == 4);
+	assert(kzrjson_get_value_from_key(json, "values")->packed_int64[2] == 3);
+	assert(kzrjson_get_value_from_key(rows->elements[1], "id")->number_uint == 2);
+	assert(kzrjson_get_value_from_key(json, "none")->type == kzrjson_null);
+
+	// the document and the tree can grow again
+	assert(kzrjson_array_add_element(rows, kzrjson_array_remove_element(rows, 0)));
+	assert(kzrjson_doc_parse(doc, "{\"more\": [1, 2, 3]}") != NULL);
+	assert(kzrjson_get_value_from_key(rows->elements[2], "on")->boolean);
+
+	// shapes are not kept
+	kzrjson_doc_reset(doc);
+	json = kzrjson_doc_parse_with_options(doc, "[{\"a\": 1}, {\"a\": 2}]", kzrjson_option_share_shapes).value;
+	assert(json->elements[0]->shape != NULL && json->elements[0]->index != NULL);
+	kzrjson_compact(doc, &json);
+	assert(json->elements[1]->shape == NULL && json->elements[1]->index == NULL);
+	assert(kzrjson_get_value_from_key(json->elements[1], "a")->number_uint == 2);
+
+	// a tree not in the document
+	kzrjson_t heap = kzrjson_parse("[]");
+	assert(kzrjson_compact(doc, &heap) == 0);
+	assert(kzrjson_errno() == kzrjson_err_foreign_data);
+	kzrjson_free(heap);
+	kzrjson_doc_free(doc);
+	puts("test_compact done");
+}
+
+static void test_image(void) {
+	kzrjson_t json = kzrjson_parse_with_options(
+		"{\"name\": \"a\\\"b\", \"values\": [1, -2, 3.5], \"ints\": [1, 2], \"on\": true, \"none\": null,"
+		" \"nested\": {\"k0\": 0, \"k1\": 1, \"k2\": 2, \"k3\": 3, \"k4\": 4, \"k5\": 5, \"k6\": 6,"
+		" \"k7\": 7, \"k8\": 8, \"k1\": 9, \"\": {}}, \"list\": [[], {\"x\": false}]}",
+		kzrjson_option_pack_arrays).value;
+	assert(kzrjson_get_value_from_key(json, "ints")->packed_type != kzrjson_packed_none);
+	const size_t size = kzrjson_image_size(json);
+	char *block = malloc(size);
+	assert(!kzrjson_image_write(json, block, size - 1));
+	assert(kzrjson_errno() == kzrjson_err_index_out_of_range);
+	assert(kzrjson_image_write(json, block, size));
+	kzrjson_free(json);
+
+	// the image works at another address
+	char *moved = malloc(size);
+	memcpy(moved, block, size);
+	memset(block, 0, size);
+	free(block);
+	kzrjson_image_t root = kzrjson_image_root(moved, size);
+	assert(root != NULL && root->type == kzrjson_object && root->size == 7);
+
+	size_t length;
+	assert(strcmp(kzrjson_image_key(root, 0, &length), "name") == 0 && length == 4);
+	kzrjson_image_t name = kzrjson_image_element(root, 0);
+	assert(strcmp(kzrjson_image_string(name), "a\\\"b") == 0 && name->size == 4);
+	kzrjson_image_t values = kzrjson_image_get(root, "values");
+	assert(values->type == kzrjson_array && values->size == 3);
+	// a packed array of doubles
+	assert(kzrjson_image_element(values, 1)->number_type == kzrjson_double);
+	assert(kzrjson_image_element(values, 1)->number_double == -2.0);
+	assert(strcmp(kzrjson_image_string(kzrjson_image_element(values, 1)), "-2") == 0);
+	assert(kzrjson_image_element(values, 2)->number_double == 3.5);
+	kzrjson_image_t ints = kzrjson_image_get(root, "ints");
+	assert(kzrjson_image_element(ints, 1)->number_uint == 2);
+	assert(strcmp(kzrjson_image_string(kzrjson_image_element(ints, 1)), "2") == 0);
+	assert(kzrjson_image_get(root, "on")->boolean);
+	assert(strcmp(kzrjson_image_string(kzrjson_image_get(root, "on")), "true") == 0);
+	assert(kzrjson_image_get(root, "none")->type == kzrjson_null);
+
+	// looked up through the index, and the first one of the same keys
+	kzrjson_image_t nested = kzrjson_image_get(root, "nested");
+	assert(nested->size == 11);
+	assert(kzrjson_image_get(nested, "k8")->number_uint == 8);
+	assert(kzrjson_image_get(nested, "k1")->number_uint == 1);
+	assert(kzrjson_image_get(nested, "")->type == kzrjson_object);
+	assert(kzrjson_image_get(nested, "k9") == NULL);
+	assert(kzrjson_errno() == kzrjson_err_object_key_not_found);
+	kzrjson_image_t list = kzrjson_image_get(root, "list");
+	assert(kzrjson_image_element(list, 0)->size == 0);
+	assert(!kzrjson_image_get(kzrjson_image_element(list, 1), "x")->boolean);
+
+	// errors
+	assert(kzrjson_image_element(list, 2) == NULL);
+	assert(kzrjson_errno() == kzrjson_err_index_out_of_range);
+	assert(kzrjson_image_get(list, "x") == NULL);
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	assert(kzrjson_image_string(list) == NULL);
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	assert(kzrjson_image_root(moved, 16) == NULL);
+	assert(kzrjson_errno() == kzrjson_err_parse);
+	moved[0] = 'X';
+	assert(kzrjson_image_root(moved, size) == NULL);
+	free(moved);
+	puts("test_image done");
+}
+
+static void test_cache(void) {
+	kzrjson_cache_t cache = kzrjson_cache_make(64 * 1024);
+	assert(cache != NULL);
+
+	// the same bytes at another address hit, and get the same data
+	const char text[] = "{\"a\": [1, 2, 3], \"b\": \"x\"} trailing";
+	const size_t length = strlen("{\"a\": [1, 2, 3], \"b\": \"x\"}");
+	char copy[sizeof(text)];
+	memcpy(copy, text, sizeof(text));
+	kzrjson_t first = kzrjson_cache_parse(cache, text, length).value;
+	kzrjson_t second = kzrjson_cache_parse(cache, copy, length).value;
+	assert(first != NULL && first == second);
+	assert(strcmp(kzrjson_get_value_from_key(first, "b")->string, "x") == 0);
+	kzrjson_cache_stats_t stats = kzrjson_cache_stats(cache);
+	assert(stats.hits == 1 && stats.misses == 1 && stats.entries == 1 && stats.bytes > length);
+
+	// a different length is a different text
+	kzrjson_t shorter = kzrjson_cache_parse(cache, "[1, 2]", 4).value;
+	assert(shorter == NULL);
+	assert(kzrjson_errno() == kzrjson_err_parse);
+	assert(kzrjson_cache_stats(cache).entries == 1);
+
+	// all bytes of the length are the text
+	kzrjson_result_t nul = kzrjson_cache_parse(cache, "{}\0garbage", 10);
+	assert(nul.value == NULL && nul.code == kzrjson_err_parse);
+	assert(nul.offset == 2 && nul.line == 1 && nul.column == 3);
+	assert(kzrjson_errno() == kzrjson_err_parse);
+	assert(kzrjson_cache_stats(cache).entries == 1);
+
+	// least recently used texts are evicted to keep the limit
+	char numbers[32];
+	for (int i = 0; i < 1000; i++) {
+		snprintf(numbers, sizeof(numbers), "[%d]", i);
+		kzrjson_t json = kzrjson_cache_parse(cache, numbers, strlen(numbers)).value;
+		assert(json->elements[0]->number_uint == (uint64_t)i);
+		kzrjson_cache_release(json);
+		if (i % 4 == 0) {
+			kzrjson_cache_release(kzrjson_cache_parse(cache, text, length).value);
+		}
+	}
+	stats = kzrjson_cache_stats(cache);
+	assert(stats.evictions > 0);
+	assert(stats.bytes <= 64 * 1024);
+	assert(stats.entries + stats.evictions == 1001);
+	assert(stats.hits == 1 + 250);
+	kzrjson_t again = kzrjson_cache_parse(cache, "[999]", 5).value;
+	kzrjson_t evicted = kzrjson_cache_parse(cache, "[0]", 3).value;
+	assert(kzrjson_cache_stats(cache).hits == stats.hits + 1);
+	assert(again->elements[0]->number_uint == 999 && evicted->elements[0]->number_uint == 0);
+	kzrjson_cache_release(again);
+
+	// a text larger than the limit is not kept
+	kzrjson_cache_t small = kzrjson_cache_make(16);
+	kzrjson_t large = kzrjson_cache_parse(small, text, length).value;
+	assert(large != NULL && kzrjson_cache_stats(small).entries == 0);
+	kzrjson_cache_free(small);
+	assert(kzrjson_get_value_from_key(large, "a")->elements_size == 3);
+	kzrjson_cache_release(large);
+
+	// data stays valid after the cache is freed
+	kzrjson_cache_free(cache);
+	assert(first->elements_size == 2);
+	kzrjson_cache_release(first);
+	assert(evicted->elements[0]->number_uint == 0);
+	kzrjson_cache_release(evicted);
+	kzrjson_cache_release(second);
+	puts("test_cache done");
+}
+
+static void test_template(void) {
+	kzrjson_t skeleton = kzrjson_parse(
+		"{\"id\": \"{{1}}\", \"status\": \"ok\", \"data\": {\"items\": \"{{0}}\", \"count\": \"{{2}}\"},"
+		" \"flags\": [\"{{3}}\", \"{{4}}\", \"{{5}}\", \"{{6}}\", 1], \"literal\": \"{{x}}\"}");
+	kzrjson_template_t tpl = kzrjson_template_compile(skeleton);
+	kzrjson_free(skeleton);
+	assert(tpl != NULL);
+	assert(kzrjson_template_slots(tpl) == 7);
+
+	const char *id = "a\"b\\c\n\x01";
+	const kzrjson_slot_t values[] = {
+		{.type = kzrjson_slot_raw, .string = "[1,2]", .length = 5},
+		{.type = kzrjson_slot_string, .string = id, .length = strlen(id)},
+		{.type = kzrjson_slot_uint64, .uint64 = 18446744073709551615u},
+		{.type = kzrjson_slot_int64, .int64 = -3},
+		{.type = kzrjson_slot_double, .number = 0.1},
+		{.type = kzrjson_slot_bool, .boolean = false},
+		{.type = kzrjson_slot_null},
+	};
+	const char *expected = "{\"id\":\"a\\\"b\\\\c\\n\\u0001\",\"status\":\"ok\","
+		"\"data\":{\"items\":[1,2],\"count\":18446744073709551615},"
+		"\"flags\":[-3,0.1,false,null,1],\"literal\":\"{{x}}\"}";
+	char out[256];
+	size_t length = kzrjson_template_render(tpl, values, out, sizeof(out));
+	assert(length == strlen(expected));
+	assert(strcmp(out, expected) == 0);
+
+	// the rendered text is JSON
+	kzrjson_t parsed = kzrjson_parse(out);
+	assert(parsed != NULL);
+	assert(kzrjson_get_value_from_key(kzrjson_get_value_from_key(parsed, "data"), "items")->elements_size == 2);
+	kzrjson_free(parsed);
+
+	// a short buffer gets the beginning, and the length tells the size needed
+	char short_out[8];
+	assert(kzrjson_template_render(tpl, values, short_out, sizeof(short_out)) == length);
+	assert(strcmp(short_out, "{\"id\":\"") == 0);
+	assert(kzrjson_template_render(tpl, values, NULL, 0) == length);
+
+	// errors
+	kzrjson_slot_t bad[7];
+	memcpy(bad, values, sizeof(bad));
+	bad[4].number = INFINITY;
+	assert(kzrjson_template_render(tpl, bad, out, sizeof(out)) == 0);
+	assert(kzrjson_errno() == kzrjson_err_not_number);
+	bad[4].type = (kzrjson_slot_type)100;
+	assert(kzrjson_template_render(tpl, bad, out, sizeof(out)) == 0);
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	assert(kzrjson_template_compile(NULL) == NULL);
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	kzrjson_template_free(tpl);
+
+	// the whole data is a slot
+	kzrjson_t slot = kzrjson_make_string("{{0}}", 5);
+	tpl = kzrjson_template_compile(slot);
+	kzrjson_free(slot);
+	assert(kzrjson_template_render(tpl, values + 3, out, sizeof(out)) == 2);
+	assert(strcmp(out, "-3") == 0);
+	kzrjson_template_free(tpl);
+
+	// leading zeros and too large indexes are not slots
+	kzrjson_t literals = kzrjson_parse("[\"{{03}}\", \"{{99999999999999999999}}\", \"{{0}}\"]");
+	tpl = kzrjson_template_compile(literals);
+	kzrjson_free(literals);
+	assert(kzrjson_template_slots(tpl) == 1);
+	const char *expected_literals = "[\"{{03}}\",\"{{99999999999999999999}}\",-3]";
+	assert(kzrjson_template_render(tpl, values + 3, out, sizeof(out)) == strlen(expected_literals));
+	assert(strcmp(out, expected_literals) == 0);
+	kzrjson_template_free(tpl);
+	puts("test_template done");
+}
+
+static bool write_to_text(const char *data, size_t length, void *context) {
+	kzrjson_text_t *text = context;
+	memcpy(text->text + text->length, data, length);
+	text->length += length;
+	text->text[text->length] = '\0';
+	return true;
+}
+
+static bool write_failing(const char *data, size_t length, void *context) {
+	(void)data;
+	(void)length;
+	(void)context;
+	return false;
+}
+
+static void test_writer(void) {
+	kzrjson_writer_t writer;
+	kzrjson_writer_init_text(&writer);
+	kzrjson_writer_begin_object(&writer);
+	kzrjson_writer_key(&writer, "id", 2);
+	kzrjson_writer_int64(&writer, INT64_MIN);
+	kzrjson_writer_key(&writer, "u", 1);
+	kzrjson_writer_uint64(&writer, UINT64_MAX);
+	kzrjson_writer_key(&writer, "zero", 4);
+	kzrjson_writer_int64(&writer, 0);
+	kzrjson_writer_key(&writer, "d", 1);
+	kzrjson_writer_double(&writer, 0.1);
+	kzrjson_writer_key(&writer, "q\"", 2);
+	kzrjson_writer_string(&writer, "a\\\t\x1f", 4);
+	kzrjson_writer_key(&writer, "list", 4);
+	kzrjson_writer_begin_array(&writer);
+	kzrjson_writer_bool(&writer, true);
+	kzrjson_writer_bool(&writer, false);
+	kzrjson_writer_null(&writer);
+	kzrjson_writer_begin_object(&writer);
+	kzrjson_writer_end_object(&writer);
+	kzrjson_writer_begin_array(&writer);
+	kzrjson_writer_end_array(&writer);
+	kzrjson_writer_raw(&writer, "{\"r\":1}", 7);
+	kzrjson_writer_end_array(&writer);
+	kzrjson_writer_end_object(&writer);
+	assert(kzrjson_writer_finish(&writer));
+	const char *expected = "{\"id\":-9223372036854775808,\"u\":18446744073709551615,\"zero\":0,\"d\":0.1,"
+		"\"q\\\"\":\"a\\\\\\t\\u001f\",\"list\":[true,false,null,{},[],{\"r\":1}]}";
+	assert(strcmp(writer.text, expected) == 0);
+	assert(writer.length == strlen(expected));
+	kzrjson_t parsed = kzrjson_parse(writer.text);
+	assert(parsed != NULL);
+	kzrjson_free(parsed);
+	free(writer.text);
+
+	// a sink gets the text in pieces of the buffer
+	char sunk[4096];
+	kzrjson_text_t text = {sunk, 0};
+	kzrjson_writer_init(&writer, (kzrjson_sink_t){write_to_text, &text});
+	kzrjson_writer_begin_array(&writer);
+	for (int i = 0; i < 300; i++) {
+		kzrjson_writer_uint64(&writer, (uint64_t)i);
+	}
+	char long_string[600];
+	memset(long_string, 'x', sizeof(long_string));
+	kzrjson_writer_string(&writer, long_string, sizeof(long_string));
+	kzrjson_writer_end_array(&writer);
+	assert(text.length > 0 && writer.buffered > 0);
+	assert(kzrjson_writer_finish(&writer));
+	parsed = kzrjson_parse(sunk);
+	assert(parsed->elements_size == 301);
+	assert(parsed->elements[299]->number_uint == 299);
+	assert(strlen(parsed->elements[300]->string) == 600);
+	kzrjson_free(parsed);
+
+	// calls which do not make JSON
+	kzrjson_writer_init_text(&writer);
+	kzrjson_writer_begin_object(&writer);
+	assert(!kzrjson_writer_null(&writer));
+	assert(writer.error == kzrjson_err_parse);
+	assert(!kzrjson_writer_key(&writer, "a", 1));
+	free(writer.text);
+
+	kzrjson_writer_init_text(&writer);
+	kzrjson_writer_begin_array(&writer);
+	assert(!kzrjson_writer_key(&writer, "a", 1));
+	free(writer.text);
+
+	kzrjson_writer_init_text(&writer);
+	kzrjson_writer_begin_object(&writer);
+	kzrjson_writer_key(&writer, "a", 1);
+	assert(!kzrjson_writer_end_object(&writer));
+	free(writer.text);
+
+	kzrjson_writer_init_text(&writer);
+	kzrjson_writer_begin_array(&writer);
+	assert(!kzrjson_writer_end_object(&writer));
+	free(writer.text);
+
+	kzrjson_writer_init_text(&writer);
+	kzrjson_writer_begin_array(&writer);
+	assert(!kzrjson_writer_finish(&writer));
+	assert(writer.error == kzrjson_err_parse);
+	free(writer.text);
+
+	kzrjson_writer_init_text(&writer);
+	kzrjson_writer_null(&writer);
+	assert(!kzrjson_writer_null(&writer));
+	free(writer.text);
+
+	kzrjson_writer_init_text(&writer);
+	assert(!kzrjson_writer_double(&writer, NAN));
+	assert(writer.error == kzrjson_err_not_number);
+	free(writer.text);
+
+	kzrjson_writer_init_text(&writer);
+	for (int i = 0; i < KZRJSON_WRITER_MAX_DEPTH; i++) {
+		assert(kzrjson_writer_begin_array(&writer));
+	}
+	assert(!kzrjson_writer_begin_array(&writer));
+	assert(writer.error == kzrjson_err_too_deep);
+	free(writer.text);
+
+	kzrjson_writer_init(&writer, (kzrjson_sink_t){write_failing, NULL});
+	kzrjson_writer_null(&writer);
+	assert(!kzrjson_writer_finish(&writer));
+	assert(writer.error == kzrjson_err_sink);
+	puts("test_writer done");
+}
+
+static void test_pack(void) {
+	const char *format = "{s:i, s:[f, f], s:s, s#:s#, s:{s:I, s:U, s:b, s:n}, s:[]}";
+	kzrjson_t json = NULL;
+	for (int i = 0; i < 2; i++) {
+		// the second call uses the compiled format
+		kzrjson_free(json);
+		json = kzrjson_pack(format,
+			"id", -42, "point", 1.5, -0.25, "name", "a\"b", "keyx", (size_t)3, "valuex", (size_t)5,
+			"nested", "big", INT64_MIN, "huge", UINT64_MAX, "on", true, "none", "empty");
+		assert(json != NULL);
+	}
+	kzrjson_text_t text = kzrjson_to_string(json);
+	assert(strcmp(text.text, "{\"id\":-42,\"point\":[1.5,-0.25],\"name\":\"a\\\"b\",\"key\":\"value\","
+		"\"nested\":{\"big\":-9223372036854775808,\"huge\":18446744073709551615,\"on\":true,\"none\":null},"
+		"\"empty\":[]}") == 0);
+	free(text.text);
+	assert(json->elements_size == 6 && json->elements_capacity == 6);
+
+	int id;
+	double x, y;
+	const char *name;
+	const char *value;
+	size_t value_length;
+	int64_t big;
+	uint64_t huge;
+	bool on;
+	assert(kzrjson_unpack(json, format,
+		"id", &id, "point", &x, &y, "name", &name, "keyx", (size_t)3, &value, &value_length,
+		"nested", "big", &big, "huge", &huge, "on", &on, "none", "empty"));
+	assert(id == -42 && x == 1.5 && y == -0.25 && strcmp(name, "a\\\"b") == 0);
+	assert(strcmp(value, "value") == 0 && value_length == 5);
+	assert(big == INT64_MIN && huge == UINT64_MAX && on);
+
+	// numbers are converted if they fit
+	double id_double;
+	uint64_t huge_again;
+	assert(kzrjson_unpack(json, "{s:f, s:{s:U}}", "id", &id_double, "nested", "huge", &huge_again));
+	assert(id_double == -42 && huge_again == UINT64_MAX);
+	assert(!kzrjson_unpack(json, "{s:U}", "id", &huge_again));
+	assert(kzrjson_errno() == kzrjson_err_not_number);
+	assert(!kzrjson_unpack(json, "{s:{s:i}}", "nested", "big", &id));
+	assert(kzrjson_errno() == kzrjson_err_not_number);
+	assert(!kzrjson_unpack(json, "{s:s}", "id", &name));
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	assert(!kzrjson_unpack(json, "{s:i}", "missing", &id));
+	assert(kzrjson_errno() == kzrjson_err_object_key_not_found);
+	assert(!kzrjson_unpack(json, "{s:[f, f, f]}", "point", &x, &y, &x));
+	assert(kzrjson_errno() == kzrjson_err_index_out_of_range);
+	assert(kzrjson_unpack(json, "{s:[f]}", "point", &x) && x == 1.5);
+	kzrjson_free(json);
+
+	// strings are escaped content, as in parsed data
+	json = kzrjson_parse("[\"caf\\u00e9\"]");
+	assert(kzrjson_unpack(json, "[s#]", &value, &value_length));
+	assert(value_length == 9 && strncmp(value, "caf\\u00e9", value_length) == 0);
+	char decoded[9];
+	assert(kzrjson_unescape(value, value_length, decoded) == 5 && memcmp(decoded, "caf\xc3\xa9", 5) == 0);
+	kzrjson_free(json);
+
+	// packed arrays
+	json = kzrjson_parse_with_options("[[1, 2, 3], [0.5]]", kzrjson_option_pack_arrays).value;
+	int64_t first;
+	uint64_t second;
+	double half;
+	assert(kzrjson_unpack(json, "[[I, U], [f]]", &first, &second, &half));
+	assert(first == 1 && second == 2 && half == 0.5);
+	assert(!kzrjson_unpack(json, "[[s]]", &name));
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	kzrjson_free(json);
+
+	// to a writer, escaped as in the data
+	const char *escaped = "[\"x\\\"y\",\"a\\nb\",{\"\\u0001\":1}]";
+	json = kzrjson_pack("[s, s#, {s:i}]", "x\"y", "a\nb", (size_t)3, "\x01", 1);
+	text = kzrjson_to_string(json);
+	assert(strcmp(text.text, escaped) == 0);
+	free(text.text);
+	kzrjson_free(json);
+	kzrjson_writer_t writer;
+	kzrjson_writer_init_text(&writer);
+	assert(kzrjson_writer_pack(&writer, "[s, s#, {s:i}]", "x\"y", "a\nb", (size_t)3, "\x01", 1));
+	assert(kzrjson_writer_finish(&writer));
+	assert(strcmp(writer.text, escaped) == 0);
+	free(writer.text);
+
+	kzrjson_writer_init_text(&writer);
+	assert(kzrjson_writer_pack(&writer, "[s, {s:i}, U]", "x\n", "k", 7, (uint64_t)8));
+	assert(kzrjson_writer_finish(&writer));
+	assert(strcmp(writer.text, "[\"x\\n\",{\"k\":7},8]") == 0);
+	free(writer.text);
+
+	kzrjson_writer_init_text(&writer);
+	kzrjson_writer_begin_array(&writer);
+	assert(kzrjson_writer_pack(&writer, "i", 1));
+	assert(kzrjson_writer_pack(&writer, "{}"));
+	kzrjson_writer_end_array(&writer);
+	assert(kzrjson_writer_finish(&writer));
+	assert(strcmp(writer.text, "[1,{}]") == 0);
+	assert(!kzrjson_writer_pack(&writer, "{s}", "a"));
+	assert(writer.error == kzrjson_err_parse);
+	free(writer.text);
+
+	// a format of 128 characters or more is compiled each time
+	char long_format[400] = "[";
+	for (int i = 0; i < 100; i++) strcat(long_format, "i,");
+	strcat(long_format, "n]");
+	json = kzrjson_pack(long_format,
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19,
+		20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39,
+		40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59,
+		60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78, 79,
+		80, 81, 82, 83, 84, 85, 86, 87, 88, 89, 90, 91, 92, 93, 94, 95, 96, 97, 98, 99);
+	assert(json->elements_size == 101);
+	assert(json->elements[99]->number_uint == 99 && json->elements[100]->type == kzrjson_null);
+	kzrjson_free(json);
+
+	// wrong formats and values
+	const char *wrong[] = {"", "{", "{s}", "{i:i}", "[i}", "i i", "x", "[]]", "{s:}"};
+	for (size_t i = 0; i < sizeof(wrong) / sizeof(wrong[0]); i++) {
+		assert(kzrjson_pack(wrong[i], "a", 1) == NULL);
+		assert(kzrjson_errno() == kzrjson_err_parse);
+	}
+	assert(kzrjson_pack("[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]") == NULL);
+	assert(kzrjson_errno() == kzrjson_err_too_deep);
+	assert(kzrjson_pack("[f]", NAN) == NULL);
+	assert(kzrjson_errno() == kzrjson_err_not_number);
+	assert(kzrjson_pack("{s:s}", "a", (const char *)NULL) == NULL);
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	puts("test_pack done");
+}
+
+static void test_reader(void) {
+	const char *text = " {\"a\": [1, -2.5e3, \"x\\ty\"], \"b\": {}, \"c\": [true, false, null]} ";
+	const kzrjson_event_type expected[] = {
+		kzrjson_event_begin_object,
+		kzrjson_event_key, kzrjson_event_begin_array,
+		kzrjson_event_number, kzrjson_event_number, kzrjson_event_string,
+		kzrjson_event_end_array,
+		kzrjson_event_key, kzrjson_event_begin_object, kzrjson_event_end_object,
+		kzrjson_event_key, kzrjson_event_begin_array,
+		kzrjson_event_true, kzrjson_event_false, kzrjson_event_null,
+		kzrjson_event_end_array,
+		kzrjson_event_end_object,
+		kzrjson_event_end_of_text,
+	};
+	kzrjson_reader_t reader;
+	kzrjson_reader_init(&reader, text, strlen(text));
+	for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+		const kzrjson_event_type event = kzrjson_reader_next(&reader);
+		assert(event == expected[i]);
+		if (i == 4) {
+			assert(reader.number_type == kzrjson_exp);
+			assert(reader.token_length == 6);
+			assert(strncmp(reader.token, "-2.5e3", 6) == 0);
+		}
+		if (i == 5) {
+			char decoded[8];
+			assert(reader.token_length == 4);
+			assert(kzrjson_unescape(reader.token, reader.token_length, decoded) == 3);
+			assert(memcmp(decoded, "x\ty", 3) == 0);
+		}
+	}
+
+	// skip a nested value
+	kzrjson_reader_init(&reader, text, strlen(text));
+	assert(kzrjson_reader_next(&reader) == kzrjson_event_begin_object);
+	assert(kzrjson_reader_next(&reader) == kzrjson_event_key);
+	assert(kzrjson_reader_skip(&reader, kzrjson_reader_next(&reader)));
+	assert(kzrjson_reader_next(&reader) == kzrjson_event_key);
+	assert(strncmp(reader.token, "b", 1) == 0);
+
+	const char *errors[] = {"[1,]", "[01]", "{\"a\" 1}", "[\"a]", "[1] 2", "{\"a\":1,}", "[\"\\x\"]", "-", ""};
+	for (size_t i = 0; i < sizeof(errors) / sizeof(errors[0]); i++) {
+		kzrjson_reader_init(&reader, errors[i], strlen(errors[i]));
+		kzrjson_event_type event;
+		do {
+			event = kzrjson_reader_next(&reader);
+		} while (event != kzrjson_event_error && event != kzrjson_event_end_of_text);
+		assert(event == kzrjson_event_error);
+	}
+
+	char unicode[16];
+	const char *escaped = "\\u00e9\\ud83d\\ude00";
+	const size_t length = kzrjson_unescape(escaped, strlen(escaped), unicode);
+	assert(length == 6);
+	assert(memcmp(unicode, "\xc3\xa9\xf0\x9f\x98\x80", 6) == 0);
+	puts("test_reader done");
+}
+
+static void test_reader_stream(void) {
+	const char *text = " {\"a\": [1, -2.5e3, \"x\\ty\"], \"b\": {}, \"c\": [true, false, null]} 10";
+	kzrjson_reader_t whole;
+	kzrjson_reader_init(&whole, text, strlen(text) - 3);
+
+	// feed one byte at a time
+	char buffer[64];
+	size_t unread = 0;
+	size_t fed = 0;
+	kzrjson_reader_t reader;
+	kzrjson_reader_init_stream(&reader);
+	kzrjson_event_type event = kzrjson_event_need_more;
+	while (event != kzrjson_event_end_of_text) {
+		assert(event != kzrjson_event_error);
+		if (event == kzrjson_event_need_more) {
+			unread = reader.length - reader.pos;
+			if (unread > 0) memmove(buffer, reader.text + reader.pos, unread);
+			const bool final = fed == strlen(text) - 3;
+			if (!final) buffer[unread++] = text[fed++];
+			kzrjson_reader_feed(&reader, buffer, unread, final);
+		} else {
+			assert(event == kzrjson_reader_next(&whole));
+			assert(reader.offset + reader.pos == whole.pos);
+			if (event == kzrjson_event_number || event == kzrjson_event_string || event == kzrjson_event_key) {
+				assert(reader.token_length == whole.token_length);
+				assert(memcmp(reader.token, whole.token, reader.token_length) == 0);
+			}
+		}
+		event = kzrjson_reader_next(&reader);
+	}
+	assert(kzrjson_reader_next(&whole) == kzrjson_event_end_of_text);
+
+	// a number is complete only when the text ends
+	kzrjson_reader_init_stream(&reader);
+	kzrjson_reader_feed(&reader, "10", 2, false);
+	assert(kzrjson_reader_next(&reader) == kzrjson_event_need_more);
+	kzrjson_reader_feed(&reader, "10", 2, true);
+	assert(kzrjson_reader_next(&reader) == kzrjson_event_number);
+	assert(reader.token_length == 2);
+	assert(kzrjson_reader_next(&reader) == kzrjson_event_end_of_text);
+
+	// errors are found without the rest of the text
+	kzrjson_reader_init_stream(&reader);
+	kzrjson_reader_feed(&reader, "[tru", 4, false);
+	assert(kzrjson_reader_next(&reader) == kzrjson_event_begin_array);
+	assert(kzrjson_reader_next(&reader) == kzrjson_event_need_more);
+	kzrjson_reader_feed(&reader, "trx", 3, false);
+	assert(kzrjson_reader_next(&reader) == kzrjson_event_error);
+	assert(reader.offset + reader.pos == 1);
+	puts("test_reader_stream done");
+}
+
 static void test_kzrjson_to_string(void) {
 	const char *text = "{\"member1\":100,\"member2\":[100,\"abc\",true],\"object\":{\"member2\":\"string\",\"member3\":null,\"member4\":-4.7}}";
 	kzrjson_t json = kzrjson_parse(text);
@@ -164,6 +1437,258 @@ static void test_kzrjson_to_string(void) {
 	puts("test_kzrjson_to_string done");
 }
 
+typedef struct {
+	char text[1024];
+	size_t length;
+	size_t writes;
+} test_sink;
+
+static bool write_test_sink(const char *data, size_t length, void *context) {
+	test_sink *sink = context;
+	if (sink->length + length > sizeof(sink->text)) return false;
+	memcpy(sink->text + sink->length, data, length);
+	sink->length += length;
+	sink->writes++;
+	return true;
+}
+
+static void assert_columns_equal(const kzrjson_column_t *a, const kzrjson_column_t *b, size_t count) {
+	for (size_t f = 0; f < count; f++) {
+		assert(a[f].type == b[f].type);
+		assert(a[f].length == b[f].length);
+		const size_t rows = a[f].length;
+		assert(memcmp(a[f].validity, b[f].validity, (rows + 7) / 8) == 0);
+		switch (a[f].type) {
+		case kzrjson_column_int64:
+			assert(memcmp(a[f].int64s, b[f].int64s, rows * sizeof(int64_t)) == 0);
+			break;
+		case kzrjson_column_double:
+			assert(memcmp(a[f].doubles, b[f].doubles, rows * sizeof(double)) == 0);
+			break;
+		case kzrjson_column_bool:
+			assert(memcmp(a[f].bools, b[f].bools, rows * sizeof(bool)) == 0);
+			break;
+		case kzrjson_column_string:
+			assert(memcmp(a[f].offsets, b[f].offsets, (rows + 1) * sizeof(size_t)) == 0);
+			assert(memcmp(a[f].data, b[f].data, a[f].offsets[rows] + 1) == 0);
+			break;
+		}
+	}
+}
+
+static void test_columnarize(void) {
+	static char text[16384];
+	size_t length = 0;
+	const size_t rows = 100;
+	text[length++] = '[';
+	for (size_t i = 0; i < rows; i++) {
+		if (i != 0) text[length++] = ',';
+		if (i == 13) {
+			length += snprintf(text + length, sizeof(text) - length, "13");
+		} else if (i % 7 == 0) { // another member order, and a nested value
+			length += snprintf(text + length, sizeof(text) - length,
+				"{\"ok\": %s, \"extra\": [1, {\"id\": 0}], \"score\": %zu.5, \"name\": \"n%zu\", \"id\": %zu}",
+				i % 2 == 0 ? "true" : "false", i, i, i);
+		} else if (i % 10 == 0) { // types do not match
+			length += snprintf(text + length, sizeof(text) - length,
+				"{\"id\": \"%zu\", \"name\": null, \"score\": \"x\", \"ok\": 1}", i);
+		} else {
+			length += snprintf(text + length, sizeof(text) - length,
+				"{\"id\": %zu, \"name\": \"n\\t%zu\", \"score\": %zu.5, \"ok\": %s}",
+				i, i, i, i % 2 == 0 ? "true" : "false");
+		}
+	}
+	text[length++] = ']';
+	text[length] = '\0';
+
+	const kzrjson_field_t fields[] = {
+		{"id", kzrjson_column_int64},
+		{"name", kzrjson_column_string},
+		{"score", kzrjson_column_double},
+		{"ok", kzrjson_column_bool},
+		{"missing", kzrjson_column_int64},
+	};
+	const size_t count = sizeof(fields) / sizeof(fields[0]);
+	kzrjson_t array = kzrjson_parse(text);
+	assert(array != NULL);
+	kzrjson_column_t columns[5];
+	assert(kzrjson_columnarize(array, fields, count, columns));
+	for (size_t i = 0; i < rows; i++) {
+		const bool object = i != 13;
+		const bool matched = object && (i % 7 == 0 || i % 10 != 0);
+		assert(kzrjson_column_valid(&columns[0], i) == matched);
+		assert(kzrjson_column_valid(&columns[1], i) == matched);
+		assert(kzrjson_column_valid(&columns[2], i) == matched);
+		assert(kzrjson_column_valid(&columns[3], i) == matched);
+		assert(!kzrjson_column_valid(&columns[4], i));
+		if (!matched) continue;
+		assert(columns[0].int64s[i] == (int64_t)i);
+		assert(columns[2].doubles[i] == i + 0.5);
+		assert(columns[3].bools[i] == (i % 2 == 0));
+		char name[16];
+		snprintf(name, sizeof(name), i % 7 == 0 ? "n%zu" : "n\\t%zu", i);
+		assert(columns[1].offsets[i + 1] - columns[1].offsets[i] == strlen(name));
+		assert(memcmp(columns[1].data + columns[1].offsets[i], name, strlen(name)) == 0);
+	}
+	assert(columns[0].length == rows);
+
+	// the same columns in threads, and from the text
+	kzrjson_column_t parallel[5];
+	assert(kzrjson_columnarize_parallel(array, fields, count, parallel, 4));
+	assert_columns_equal(columns, parallel, count);
+	kzrjson_column_t from_text[5];
+	assert(kzrjson_columnarize_text(text, length, fields, count, from_text));
+	assert_columns_equal(columns, from_text, count);
+	kzrjson_column_free(columns, count);
+	kzrjson_column_free(parallel, count);
+	kzrjson_column_free(from_text, count);
+	kzrjson_free(array);
+
+	// empty array and errors
+	assert(kzrjson_columnarize_text("[]", 2, fields, count, columns));
+	assert(columns[1].length == 0 && columns[1].offsets[0] == 0);
+	kzrjson_column_free(columns, count);
+	assert(!kzrjson_columnarize_text("{}", 2, fields, count, columns));
+	assert(kzrjson_errno() == kzrjson_err_illegal_type);
+	assert(!kzrjson_columnarize_text("[{\"id\": 1,}]", 13, fields, count, columns));
+	assert(kzrjson_errno() == kzrjson_err_parse);
+	puts("test_columnarize done");
+}
+
+static void test_reformat(void) {
+	// minify equals to_string of the parsed text
+	char out[1024];
+	kzrjson_t json = kzrjson_parse(sample1);
+	kzrjson_text_t json_text = kzrjson_to_string(json);
+	const size_t length = kzrjson_minify(sample1, strlen(sample1), out);
+	assert(length == json_text.length);
+	assert(memcmp(out, json_text.text, length) == 0);
+	kzrjson_free(json);
+	free(json_text.text);
+
+	// strings are copied as they are
+	const char *text = " { \"a b\" : [ \" x \\\" y \" , 1 ] , \"c\":{ }, \"d\" :[] } ";
+	const char *minified = "{\"a b\":[\" x \\\" y \",1],\"c\":{},\"d\":[]}";
+	assert(kzrjson_minify(text, strlen(text), out) == strlen(minified));
+	assert(memcmp(out, minified, strlen(minified)) == 0);
+
+	// indent, fed a byte at a time
+	const char *pretty =
+		"{\n"
+		"  \"a b\": [\n"
+		"    \" x \\\" y \",\n"
+		"    1\n"
+		"  ],\n"
+		"  \"c\": {},\n"
+		"  \"d\": []\n"
+		"}";
+	test_sink sink = {{0}, 0, 0};
+	kzrjson_reformat_t reformat;
+	kzrjson_reformat_init(&reformat, 2, (kzrjson_sink_t){write_test_sink, &sink});
+	for (size_t i = 0; i < strlen(text); i++) {
+		assert(kzrjson_reformat_feed(&reformat, text + i, 1));
+	}
+	assert(kzrjson_reformat_finish(&reformat));
+	assert(sink.length == strlen(pretty));
+	assert(memcmp(sink.text, pretty, sink.length) == 0);
+
+	// minified text is written in one piece
+	memset(&sink, 0, sizeof(sink));
+	kzrjson_reformat_init(&reformat, 0, (kzrjson_sink_t){write_test_sink, &sink});
+	assert(kzrjson_reformat_feed(&reformat, minified, strlen(minified)));
+	assert(kzrjson_reformat_finish(&reformat));
+	assert(sink.writes == 1);
+
+	// errors
+	assert(kzrjson_minify("[\"abc", 5, out) == 0);
+	assert(kzrjson_errno() == kzrjson_err_tokenize);
+	assert(kzrjson_minify("[[1]", 4, out) == 0);
+	assert(kzrjson_errno() == kzrjson_err_parse);
+	assert(kzrjson_minify("1]", 2, out) == 0);
+	assert(kzrjson_errno() == kzrjson_err_parse);
+
+	// white spaces which separate tokens can not be removed
+	const char *joined[] = {"[1 2]", "tru e", "[true false]", "[\"a\" 1]", "{\"a\" \"b\"}"};
+	for (size_t i = 0; i < sizeof(joined) / sizeof(joined[0]); i++) {
+		assert(kzrjson_minify(joined[i], strlen(joined[i]), out) == 0);
+		assert(kzrjson_errno() == kzrjson_err_parse);
+	}
+	assert(kzrjson_minify(" [ 1 , true ] ", 14, out) == 8);
+	assert(memcmp(out, "[1,true]", 8) == 0);
+	assert(kzrjson_minify("\"a\" ", 4, out) == 3);
+
+	// nothing to minify
+	assert(kzrjson_minify("", 0, out) == 0);
+	assert(kzrjson_errno() == kzrjson_err_parse);
+	assert(kzrjson_minify("   ", 3, out) == 0);
+	assert(kzrjson_errno() == kzrjson_err_parse);
+	puts("test_reformat done");
+}
+
+static void test_to_string_canonical(void) {
+	// member order and white spaces do not matter
+	const char *text1 = "{\"b\": [1, {\"y\": 1, \"x\": 2}], \"a\": \"s\", \"\": null}";
+	const char *text2 = "{\"\":null,\"a\":\"s\",\"b\":[1,{\"x\":2,\"y\":1}]}";
+	kzrjson_t json1 = kzrjson_parse(text1);
+	kzrjson_t json2 = kzrjson_parse(text2);
+	kzrjson_text_t canonical1 = kzrjson_to_string_canonical(json1);
+	kzrjson_text_t canonical2 = kzrjson_to_string_canonical(json2);
+	assert(strcmp(canonical1.text, text2) == 0);
+	assert(strcmp(canonical2.text, text2) == 0);
+	assert(canonical1.length == strlen(text2));
+	kzrjson_free(json1);
+	kzrjson_free(json2);
+	free(canonical1.text);
+	free(canonical2.text);
+
+	// examples of RFC 8785
+	const char *cases[][2] = {
+		{"[1E30, 4.50, 2e-3, 0.000001, 1e-7, 1e21, 1e20, -0, 333333333.33333329, 100, -12.5]",
+			"[1e+30,4.5,0.002,0.000001,1e-7,1e+21,100000000000000000000,0,333333333.3333333,100,-12.5]"},
+		{"[12345678901234567890, 9007199254740993, 0.1, 1.7976931348623157e308, 5e-324]",
+			"[12345678901234567000,9007199254740992,0.1,1.7976931348623157e+308,5e-324]"},
+		{"\"\\u20ac$\\u000F\\u000aA'\\u0042\\u0022\\u005c\\\\\\\"\\/\"",
+			"\"\xe2\x82\xac$\\u000f\\nA'B\\\"\\\\\\\\\\\"/\""},
+		// UTF-16 order: U+1F600 (D83D DE00) comes before U+FB33
+		{"{\"\xef\xac\xb3\": 1, \"\\ud83d\\ude00\": 2, \"\\u00e9\": 3, \"e\": 4, \"\\u000a\": 5}",
+			"{\"\\n\":5,\"e\":4,\"\xc3\xa9\":3,\"\xf0\x9f\x98\x80\":2,\"\xef\xac\xb3\":1}"},
+		{"{\"abcde\": 1, \"abcdd\": 2, \"abcd\": 3}", "{\"abcd\":3,\"abcdd\":2,\"abcde\":1}"},
+	};
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		kzrjson_t json = kzrjson_parse(cases[i][0]);
+		assert(json != NULL);
+		kzrjson_text_t canonical = kzrjson_to_string_canonical(json);
+		assert(strcmp(canonical.text, cases[i][1]) == 0);
+		kzrjson_free(json);
+		free(canonical.text);
+	}
+
+	// written to a sink in pieces
+	test_sink sink = {{0}, 0, 0};
+	kzrjson_t json = kzrjson_parse(sample1);
+	assert(kzrjson_write_canonical(json, (kzrjson_sink_t){write_test_sink, &sink}));
+	kzrjson_text_t canonical = kzrjson_to_string_canonical(json);
+	assert(sink.length == canonical.length);
+	assert(memcmp(sink.text, canonical.text, sink.length) == 0);
+	free(canonical.text);
+	kzrjson_free(json);
+
+	// unpaired surrogates are not characters
+	const char *lone[] = {"[\"\\ud800x\"]", "[\"\\udc00\"]", "{\"\\ud83d\\u0041\": 1}"};
+	for (size_t i = 0; i < sizeof(lone) / sizeof(lone[0]); i++) {
+		json = kzrjson_parse(lone[i]);
+		assert(json != NULL);
+		canonical = kzrjson_to_string_canonical(json);
+		assert(canonical.text == NULL);
+		assert(kzrjson_errno() == kzrjson_err_tokenize);
+		sink.length = 0;
+		assert(!kzrjson_write_canonical(json, (kzrjson_sink_t){write_test_sink, &sink}));
+		assert(kzrjson_errno() == kzrjson_err_tokenize);
+		kzrjson_free(json);
+	}
+	puts("test_to_string_canonical done");
+}
+
 static void test_kzrjson_print(void) {
 	kzrjson_t json = kzrjson_parse(sample1);
 	kzrjson_print(json);
@@ -175,8 +1700,30 @@ int main(void) {
 	test_parse_sample1();
 	test_parse_sample2();
 	test_parse_sample3();
+	test_parse_result();
+	test_parse_strict();
+	test_validate();
+	test_doc_reuse();
 	test_make_json();
+	test_make_array_bulk();
+	test_modify_json();
+	test_object_index();
+	test_lookup_cache();
+	test_packed_array();
+	test_shapes();
+	test_predict_keys();
+	test_compact();
+	test_image();
+	test_cache();
+	test_template();
+	test_writer();
+	test_pack();
+	test_reader();
+	test_reader_stream();
 	test_kzrjson_to_string();
+	test_columnarize();
+	test_reformat();
+	test_to_string_canonical();
 	test_kzrjson_print();
 	return 0;
 }
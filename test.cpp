@@ -0,0 +1,271 @@
+#include "kzrjson.hpp"
+#include <cassert>
+#include <cstdio>
+#include <memory_resource>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+static const char *sample1 = "\
+{\n \
+	\"Image\": {\n\
+		\"Width\":  800,\n \
+		\"Height\": 600,\n \
+		\"Title\":  \"View from 15th Floor\",\n \
+		\"Thumbnail\": {\n \
+			\"Url\":    \"http://www.example.com/image/481989943\",\n \
+			\"Height\": 125,\n \
+			\"Width\":  100\n \
+		},\n \
+		\"Animated\" : false,\n \
+		\"IDs\": [116, 943, 234, 38793]\n \
+	}\n \
+}\n";
+
+struct thumbnail {
+	std::string Url;
+	int Height = 0;
+	int Width = 0;
+};
+KZR_REFLECT(thumbnail, Url, Height, Width)
+
+struct image {
+	int Width = 0;
+	int Height = 0;
+	std::string Title;
+	thumbnail Thumbnail;
+	bool Animated = true;
+	std::vector<uint64_t> IDs;
+	std::optional<double> Ratio;
+	std::map<std::string, std::string> Tags;
+};
+KZR_REFLECT(image, Width, Height, Title, Thumbnail, Animated, IDs, Ratio, Tags)
+
+struct root {
+	image Image;
+};
+KZR_REFLECT(root, Image)
+
+static void test_document(void) {
+	static_assert(!std::is_copy_constructible_v<kzr::document>);
+	static_assert(std::is_nothrow_move_constructible_v<kzr::document>);
+
+	kzr::document doc = kzr::document::parse(sample1);
+	assert(doc);
+	assert(doc.error() == kzrjson_success);
+
+	kzr::value image = doc["Image"];
+	assert(image.is_object());
+	assert(image.size() == 6);
+	assert(image["Width"].as_uint64() == 800);
+	assert(image["Title"].as_string_view() == "View from 15th Floor");
+	assert(image["Title"].as_string_view().data() == image["Title"].get()->string);
+	assert(image["Thumbnail"]["Height"].as_int64() == 125);
+	assert(!image["Animated"].as_bool());
+	assert(image["Animated"].is_bool());
+	assert(!image["Missing"]);
+	assert(!image["Missing"]["Chained"]);
+	assert(image["Missing"].type() == kzrjson_null && !image["Missing"].is_null());
+	assert(!image["Wid"]);
+
+	std::vector<uint64_t> ids;
+	for (kzr::value id : image["IDs"]) {
+		ids.push_back(id.as_uint64());
+	}
+	assert((ids == std::vector<uint64_t>{116, 943, 234, 38793}));
+	assert(image["IDs"][3].as_double() == 38793.0);
+	assert(!image["IDs"][4]);
+
+	std::vector<std::string_view> keys;
+	for (kzr::member member : image.members()) {
+		keys.push_back(member.key());
+	}
+	assert(keys.size() == 6);
+	assert(keys[0] == "Width");
+	assert(keys[5] == "IDs");
+
+	kzr::document moved = std::move(doc);
+	assert(!doc);
+	assert(moved["Image"] == image);
+
+	kzr::document error = kzr::document::parse("[1, 2,\n x]");
+	assert(!error);
+	assert(error.error() == kzrjson_err_tokenize);
+	assert(error.line() == 2);
+	assert(error.column() == 2);
+	puts("test_document done");
+}
+
+static void test_key(void) {
+	using namespace kzr::literals;
+	constexpr kzr::key width = "Width"_k;
+	static_assert(width.length == 5);
+	static_assert(width.hash == kzr::hash_key("Width", 5));
+	assert(width.hash == kzrjson_hash_key("Width", 5));
+
+	kzr::document doc = kzr::document::parse(sample1);
+	kzr::value image = doc["Image"_k];
+	assert(image["Width"_k].as_uint64() == 800);
+	assert(image["Thumbnail"_k]["Width"_k].as_uint64() == 100);
+	assert(!image["Wid"_k]);
+
+	// with an index
+	assert(kzrjson_object_make_index(image.get()));
+	assert(image["Width"_k].as_uint64() == 800);
+	assert(image["IDs"_k].size() == 4);
+	assert(!image["Width2"_k]);
+	puts("test_key done");
+}
+
+static void test_memory_resource(void) {
+	// all memory comes from the buffer, the upstream refuses to allocate
+	alignas(std::max_align_t) std::byte buffer[16384];
+	std::pmr::monotonic_buffer_resource resource(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+	kzr::document doc = kzr::document::parse(sample1, &resource);
+	assert(doc);
+	kzr::value image = doc["Image"];
+	assert(image.get()->doc != nullptr);
+	assert(image["Width"].as_uint64() == 800);
+	assert(image["Title"].as_string_view() == "View from 15th Floor");
+	const std::byte *title = reinterpret_cast<const std::byte *>(image["Title"].get()->string);
+	assert(title >= buffer && title < buffer + sizeof(buffer));
+
+	kzr::document moved = std::move(doc);
+	assert(moved["Image"]["IDs"].size() == 4);
+
+	// not enough memory
+	std::byte small[256];
+	std::pmr::monotonic_buffer_resource small_resource(small, sizeof(small), std::pmr::null_memory_resource());
+	kzr::document failed = kzr::document::parse(sample1, &small_resource);
+	assert(!failed);
+	assert(failed.error() == kzrjson_err_calloc);
+	puts("test_memory_resource done");
+}
+
+static void test_reflect(void) {
+	root data;
+	kzr::read_result result = kzr::read(sample1, data);
+	assert(result);
+	assert(data.Image.Width == 800);
+	assert(data.Image.Height == 600);
+	assert(data.Image.Title == "View from 15th Floor");
+	assert(data.Image.Thumbnail.Url == "http://www.example.com/image/481989943");
+	assert(data.Image.Thumbnail.Height == 125);
+	assert(data.Image.Thumbnail.Width == 100);
+	assert(!data.Image.Animated);
+	assert((data.Image.IDs == std::vector<uint64_t>{116, 943, 234, 38793}));
+	assert(!data.Image.Ratio);
+
+	// keys out of order, unknown keys and escapes
+	image other;
+	result = kzr::read("{\"Ratio\": 1.5e0, \"Unknown\": [{\"a\": 1}], \"Title\": \"a\\\"b\\u00e9\","
+		" \"Tags\": {\"k\": \"v\"}, \"Width\": 3}", other);
+	assert(result);
+	assert(other.Width == 3);
+	assert(other.Title == "a\"b\xc3\xa9");
+	assert(other.Ratio && *other.Ratio == 1.5);
+	assert(other.Tags.at("k") == "v");
+
+	const std::string json = kzr::write(other);
+	assert(json == "{\"Width\":3,\"Height\":0,\"Title\":\"a\\\"b\xc3\xa9\",\"Thumbnail\":{\"Url\":\"\","
+		"\"Height\":0,\"Width\":0},\"Animated\":true,\"IDs\":[],\"Ratio\":1.5,\"Tags\":{\"k\":\"v\"}}");
+	image round_trip;
+	assert(kzr::read(json, round_trip));
+	assert(kzr::write(round_trip) == json);
+
+	// type mismatch
+	result = kzr::read("{\"Width\": \"800\"}", other);
+	assert(!result);
+	assert(result.code == kzrjson_err_illegal_type);
+	result = kzr::read("{\"Width\": 8.5}", other);
+	assert(result.code == kzrjson_err_illegal_type);
+	result = kzr::read("{\"Width\": 1,}", other);
+	assert(result.code == kzrjson_err_parse);
+	puts("test_reflect done");
+}
+
+#if defined(KZR_COROUTINE)
+// coroutine which starts at once and is resumed by the stream parser
+struct consumer {
+	struct promise_type {
+		consumer get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::abort(); }
+	};
+};
+
+static consumer count_numbers(kzr::stream_parser &parser, int &numbers, bool &done) {
+	for (;;) {
+		const kzr::event event = co_await parser.next();
+		if (event.type == kzrjson_event_number) numbers++;
+		if (event.type == kzrjson_event_end_of_text || event.type == kzrjson_event_error) break;
+	}
+	done = true;
+}
+
+static void test_stream_parser(void) {
+	const std::string text = "[{\"id\": 1, \"tags\": [\"a\", \"b\"]}, 22, \"three\", {\"id\": 4}, [5], null]";
+
+	// elements are yielded while the text is arriving
+	kzr::stream_parser parser;
+	std::vector<std::string> elements;
+	for (std::size_t i = 0; i < text.size(); i += 7) {
+		parser.feed(std::string_view(text).substr(i, 7));
+		for (kzr::document &element : parser.elements()) {
+			kzr::value root = element.root();
+			elements.push_back(root.is_object() ? std::to_string(root["id"].as_uint64())
+				: root.is_string() ? std::string(root.as_string_view())
+				: root.is_number() ? std::to_string(root.as_uint64())
+				: root.is_array() ? "array" : "null");
+		}
+		if (i == 0) assert(elements.empty());
+	}
+	parser.finish();
+	for (kzr::document &element : parser.elements()) {
+		(void)element;
+		assert(false);
+	}
+	assert(parser.error() == kzrjson_success);
+	assert((elements == std::vector<std::string>{"1", "22", "three", "4", "array", "null"}));
+
+	// a coroutine waits for more input
+	kzr::stream_parser waiting;
+	int numbers = 0;
+	bool done = false;
+	count_numbers(waiting, numbers, done);
+	for (char c : text) {
+		assert(!done);
+		waiting.feed(std::string_view(&c, 1));
+	}
+	waiting.finish();
+	assert(done);
+	assert(numbers == 4);
+
+	// error
+	kzr::stream_parser error;
+	error.feed("[1, 2,");
+	error.feed(" ]");
+	int events = 0;
+	for (const kzr::event &event : error.events()) {
+		events++;
+		if (event.type == kzrjson_event_error) break;
+	}
+	assert(events == 4);
+	assert(error.error() == kzrjson_err_tokenize);
+	assert(error.offset() == 7);
+	puts("test_stream_parser done");
+}
+#endif
+
+int main(void) {
+	test_document();
+	test_key();
+	test_memory_resource();
+	test_reflect();
+#if defined(KZR_COROUTINE)
+	test_stream_parser();
+#endif
+	return 0;
+}
@@ -0,0 +1,534 @@
+/*
+ * kzrjson_gen: generate a parser specialized to the shape of JSON.
+ *
+ * usage) kzrjson_gen <name> <input.json> <output directory>
+ *
+ * input.json is an example document, or a JSON Schema of an object
+ * (with "$schema", or "type": "object" and "properties").
+ * <name>.h and <name>.c are written to the output directory. They declare
+ *
+ *    typedef struct { ... } <name>_t;
+ *    bool <name>_parse(const char *json_text, const size_t length, <name>_t *out);
+ *
+ * The generated parser expects the members in the order of the input,
+ * compares each key with memcmp and writes values directly to the struct:
+ * - integer: int64_t
+ * - number with fraction or exponent: double
+ * - true / false: bool
+ * - string: pointer to the text and length, with escape sequences as they are
+ * - object: struct of its members
+ * - array, null: pointer to the text and length of the whole value
+ * When the text does not have the shape, <name>_parse returns false,
+ * and the text should be parsed by kzrjson_parse instead.
+ */
+#include "kzrjson.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+	field_int64,
+	field_double,
+	field_bool,
+	field_string,
+	field_object,
+	field_raw,
+} field_kind;
+
+typedef struct field {
+	// key as in JSON text, with escape sequences
+	const char *key;
+	size_t key_length;
+
+	// name of the member of the struct
+	char name[64];
+	field_kind kind;
+
+	// members of object, and the name of its struct type
+	struct field *fields;
+	size_t field_count;
+	char type[256];
+} field;
+
+static const char *c_keywords[] = {
+	"auto", "bool", "break", "case", "char", "const", "continue", "default",
+	"do", "double", "else", "enum", "extern", "float", "for", "goto", "if",
+	"inline", "int", "long", "register", "restrict", "return", "short",
+	"signed", "sizeof", "static", "struct", "switch", "typedef", "union",
+	"unsigned", "void", "volatile", "while", NULL,
+};
+
+static void *checked_calloc(const size_t count, const size_t size) {
+	void *memory = calloc(count == 0 ? 1 : count, size);
+	if (memory == NULL) {
+		fprintf(stderr, "kzrjson_gen: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	return memory;
+}
+
+/*
+ * Make a C identifier from the key, unique among the first count fields.
+ */
+static void make_name(field *fields, const size_t count) {
+	field *f = fields + count;
+	size_t length = 0;
+	for (size_t i = 0; i < f->key_length && length < 40; i++) {
+		const char c = f->key[i];
+		const bool alnum = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+		f->name[length++] = alnum ? c : '_';
+	}
+	if (length == 0 || (f->name[0] >= '0' && f->name[0] <= '9')) {
+		memmove(f->name + 1, f->name, length++);
+		f->name[0] = '_';
+	}
+	f->name[length] = '\0';
+	for (const char **keyword = c_keywords; *keyword != NULL; keyword++) {
+		if (strcmp(f->name, *keyword) == 0) {
+			f->name[length++] = '_';
+			f->name[length] = '\0';
+			break;
+		}
+	}
+	const size_t base = length;
+	for (int suffix = 2; ; suffix++) {
+		bool used = false;
+		for (size_t i = 0; i < count; i++) {
+			if (strcmp(fields[i].name, f->name) == 0) used = true;
+		}
+		if (!used) return;
+		snprintf(f->name + base, sizeof(f->name) - base, "_%d", suffix);
+	}
+}
+
+/*
+ * Names of the struct types made so far, which must not be made again.
+ * Different paths can make the same name, e.g. a.b and a_b.
+ */
+static const char **g_type_names;
+static size_t g_type_count;
+
+/*
+ * Make the name of the struct type of f unique in the document.
+ */
+static void make_type(field *f) {
+	const size_t base = strlen(f->type);
+	for (int suffix = 2; ; suffix++) {
+		bool used = false;
+		for (size_t i = 0; i < g_type_count; i++) {
+			if (strcmp(g_type_names[i], f->type) == 0) used = true;
+		}
+		if (!used) break;
+		snprintf(f->type + base, sizeof(f->type) - base, "_%d", suffix);
+	}
+	const char **names = realloc(g_type_names, (g_type_count + 1) * sizeof(const char *));
+	if (names == NULL) {
+		fprintf(stderr, "kzrjson_gen: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	g_type_names = names;
+	g_type_names[g_type_count++] = f->type;
+}
+
+static bool read_example(field *f, kzrjson_t value);
+static bool read_schema(field *f, kzrjson_t schema);
+
+/*
+ * Read members of an object, from an example or the properties of a schema.
+ */
+static bool read_members(field *f, kzrjson_t object, const bool schema) {
+	f->kind = field_object;
+	make_type(f);
+	f->field_count = object->elements_size;
+	f->fields = checked_calloc(f->field_count, sizeof(field));
+	for (size_t i = 0; i < f->field_count; i++) {
+		kzrjson_t member = object->elements[i];
+		field *child = f->fields + i;
+		child->key = member->key;
+		child->key_length = member->key_length;
+		make_name(f->fields, i);
+		snprintf(child->type, sizeof(child->type), "%.150s_%s", f->type, child->name);
+		if (!(schema ? read_schema(child, member->value) : read_example(child, member->value))) return false;
+	}
+	return true;
+}
+
+static bool read_example(field *f, kzrjson_t value) {
+	switch (value->type) {
+	case kzrjson_object:
+		return read_members(f, value, false);
+	case kzrjson_number:
+		f->kind = value->number_type == kzrjson_double || value->number_type == kzrjson_exp
+			? field_double : field_int64;
+		return true;
+	case kzrjson_bool:
+		f->kind = field_bool;
+		return true;
+	case kzrjson_string:
+		f->kind = field_string;
+		return true;
+	default:
+		f->kind = field_raw;
+		return true;
+	}
+}
+
+static kzrjson_t find_value(kzrjson_t object, const char *key) {
+	if (object->type != kzrjson_object) return NULL;
+	kzrjson_t member = kzrjson_get_member(object, key);
+	return member != NULL ? member->value : NULL;
+}
+
+static bool is_string(kzrjson_t value, const char *string) {
+	return value != NULL && value->type == kzrjson_string && strcmp(value->string, string) == 0;
+}
+
+static bool read_schema(field *f, kzrjson_t schema) {
+	kzrjson_t type = find_value(schema, "type");
+	if (is_string(type, "object")) {
+		kzrjson_t properties = find_value(schema, "properties");
+		if (properties == NULL || properties->type != kzrjson_object) {
+			f->kind = field_raw;
+			return true;
+		}
+		return read_members(f, properties, true);
+	}
+	if (is_string(type, "integer")) {
+		f->kind = field_int64;
+	} else if (is_string(type, "number")) {
+		f->kind = field_double;
+	} else if (is_string(type, "boolean")) {
+		f->kind = field_bool;
+	} else if (is_string(type, "string")) {
+		f->kind = field_string;
+	} else {
+		f->kind = field_raw;
+	}
+	return true;
+}
+
+static bool is_schema(kzrjson_t root) {
+	return find_value(root, "$schema") != NULL
+		|| (is_string(find_value(root, "type"), "object") && find_value(root, "properties") != NULL);
+}
+
+/*
+ * Write the key with quotation-marks as a C string literal.
+ */
+static void write_key_literal(FILE *out, const field *f) {
+	fputs("\"\\\"", out);
+	for (size_t i = 0; i < f->key_length; i++) {
+		const unsigned char c = (unsigned char)f->key[i];
+		if (c == '"' || c == '\\') {
+			fprintf(out, "\\%c", c);
+		} else if (c < 0x20 || c >= 0x7F || c == '?') {
+			fprintf(out, "\\%03o", c);
+		} else {
+			fputc(c, out);
+		}
+	}
+	fputs("\\\"\"", out);
+}
+
+static void write_struct(FILE *out, const field *f) {
+	for (size_t i = 0; i < f->field_count; i++) {
+		if (f->fields[i].kind == field_object) write_struct(out, f->fields + i);
+	}
+	fputs("typedef struct {\n", out);
+	for (size_t i = 0; i < f->field_count; i++) {
+		const field *child = f->fields + i;
+		switch (child->kind) {
+		case field_int64:
+			fprintf(out, "\tint64_t %s;\n", child->name);
+			break;
+		case field_double:
+			fprintf(out, "\tdouble %s;\n", child->name);
+			break;
+		case field_bool:
+			fprintf(out, "\tbool %s;\n", child->name);
+			break;
+		case field_string:
+		case field_raw:
+			fprintf(out, "\tconst char *%s;\n\tsize_t %s_length;\n", child->name, child->name);
+			break;
+		case field_object:
+			fprintf(out, "\t%s_t %s;\n", child->type, child->name);
+			break;
+		}
+	}
+	fprintf(out, "} %s_t;\n\n", f->type);
+}
+
+static void write_parse_function(FILE *out, const field *f) {
+	for (size_t i = 0; i < f->field_count; i++) {
+		if (f->fields[i].kind == field_object) write_parse_function(out, f->fields + i);
+	}
+	fprintf(out, "static bool parse_%s(const char **pos, const char *end, %s_t *out) {\n", f->type, f->type);
+	fputs("\tif (!gen_expect(pos, end, '{')) return false;\n", out);
+	for (size_t i = 0; i < f->field_count; i++) {
+		const field *child = f->fields + i;
+		if (i != 0) fputs("\tif (!gen_expect(pos, end, ',')) return false;\n", out);
+		fputs("\tif (!gen_key(pos, end, ", out);
+		write_key_literal(out, child);
+		fprintf(out, ", %zu)) return false;\n", child->key_length + 2);
+		switch (child->kind) {
+		case field_int64:
+			fprintf(out, "\tif (!gen_int64(pos, end, &out->%s)) return false;\n", child->name);
+			break;
+		case field_double:
+			fprintf(out, "\tif (!gen_double(pos, end, &out->%s)) return false;\n", child->name);
+			break;
+		case field_bool:
+			fprintf(out, "\tif (!gen_bool(pos, end, &out->%s)) return false;\n", child->name);
+			break;
+		case field_string:
+			fprintf(out, "\tif (!gen_string(pos, end, &out->%s, &out->%s_length)) return false;\n",
+				child->name, child->name);
+			break;
+		case field_raw:
+			fprintf(out, "\tif (!gen_raw(pos, end, &out->%s, &out->%s_length)) return false;\n",
+				child->name, child->name);
+			break;
+		case field_object:
+			fprintf(out, "\tif (!parse_%s(pos, end, &out->%s)) return false;\n", child->type, child->name);
+			break;
+		}
+	}
+	fputs("\treturn gen_expect(pos, end, '}');\n}\n\n", out);
+}
+
+// functions used by the generated parsers
+static const char *helpers =
+"static const char *gen_skip(const char *pos, const char *end) {\n"
+"\twhile (pos < end && (*pos == ' ' || *pos == '\\t' || *pos == '\\n' || *pos == '\\r')) pos++;\n"
+"\treturn pos;\n"
+"}\n"
+"\n"
+"static bool gen_is_digit(const char *pos, const char *end) {\n"
+"\treturn pos < end && *pos >= '0' && *pos <= '9';\n"
+"}\n"
+"\n"
+"static bool gen_expect(const char **pos, const char *end, const char c) {\n"
+"\tconst char *p = gen_skip(*pos, end);\n"
+"\tif (p == end || *p != c) return false;\n"
+"\t*pos = p + 1;\n"
+"\treturn true;\n"
+"}\n"
+"\n"
+"// key is with quotation-marks, and followed by name-separator\n"
+"static bool gen_key(const char **pos, const char *end, const char *key, const size_t length) {\n"
+"\tconst char *p = gen_skip(*pos, end);\n"
+"\tif ((size_t)(end - p) < length || memcmp(p, key, length) != 0) return false;\n"
+"\t*pos = p + length;\n"
+"\treturn gen_expect(pos, end, ':');\n"
+"}\n"
+"\n"
+"static bool gen_string(const char **pos, const char *end, const char **string, size_t *length) {\n"
+"\tconst char *p = gen_skip(*pos, end);\n"
+"\tif (p == end || *p != '\"') return false;\n"
+"\tconst char *begin = ++p;\n"
+"\tfor (; p < end && *p != '\"'; p++) {\n"
+"\t\tif ((unsigned char)*p < 0x20) return false;\n"
+"\t\tif (*p != '\\\\') continue;\n"
+"\t\tif (++p == end || *p == '\\0' || strchr(\"\\\"\\\\/bfnrtu\", *p) == NULL) return false;\n"
+"\t\tif (*p != 'u') continue;\n"
+"\t\tfor (int i = 0; i < 4; i++) {\n"
+"\t\t\tif (++p == end || !strchr(\"0123456789abcdefABCDEF\", *p) || *p == '\\0') return false;\n"
+"\t\t}\n"
+"\t}\n"
+"\tif (p == end) return false;\n"
+"\t*string = begin;\n"
+"\t*length = (size_t)(p - begin);\n"
+"\t*pos = p + 1;\n"
+"\treturn true;\n"
+"}\n"
+"\n"
+"// number = [ minus ] int [ frac ] [ exp ], copied to buffer with null terminator\n"
+"static bool gen_number(const char **pos, const char *end, char *buffer, const size_t size, bool *integer) {\n"
+"\tconst char *begin = gen_skip(*pos, end);\n"
+"\tconst char *p = begin;\n"
+"\t*integer = true;\n"
+"\tif (p < end && *p == '-') p++;\n"
+"\tif (!gen_is_digit(p, end)) return false;\n"
+"\tif (*p == '0') {\n"
+"\t\tp++;\n"
+"\t} else {\n"
+"\t\twhile (gen_is_digit(p, end)) p++;\n"
+"\t}\n"
+"\tif (p < end && *p == '.') {\n"
+"\t\t*integer = false;\n"
+"\t\tif (!gen_is_digit(++p, end)) return false;\n"
+"\t\twhile (gen_is_digit(p, end)) p++;\n"
+"\t}\n"
+"\tif (p < end && (*p == 'e' || *p == 'E')) {\n"
+"\t\t*integer = false;\n"
+"\t\tp++;\n"
+"\t\tif (p < end && (*p == '+' || *p == '-')) p++;\n"
+"\t\tif (!gen_is_digit(p, end)) return false;\n"
+"\t\twhile (gen_is_digit(p, end)) p++;\n"
+"\t}\n"
+"\tif ((size_t)(p - begin) >= size) return false;\n"
+"\tmemcpy(buffer, begin, (size_t)(p - begin));\n"
+"\tbuffer[p - begin] = '\\0';\n"
+"\t*pos = p;\n"
+"\treturn true;\n"
+"}\n"
+"\n"
+"static bool gen_int64(const char **pos, const char *end, int64_t *value) {\n"
+"\tchar buffer[24];\n"
+"\tbool integer;\n"
+"\tif (!gen_number(pos, end, buffer, sizeof(buffer), &integer) || !integer) return false;\n"
+"\terrno = 0;\n"
+"\t*value = strtoll(buffer, NULL, 10);\n"
+"\treturn errno != ERANGE;\n"
+"}\n"
+"\n"
+"static bool gen_double(const char **pos, const char *end, double *value) {\n"
+"\tchar buffer[64];\n"
+"\tbool integer;\n"
+"\tif (!gen_number(pos, end, buffer, sizeof(buffer), &integer)) return false;\n"
+"\t*value = strtod(buffer, NULL);\n"
+"\treturn true;\n"
+"}\n"
+"\n"
+"static bool gen_bool(const char **pos, const char *end, bool *value) {\n"
+"\tconst char *p = gen_skip(*pos, end);\n"
+"\tif (end - p >= 4 && memcmp(p, \"true\", 4) == 0) {\n"
+"\t\t*value = true;\n"
+"\t\t*pos = p + 4;\n"
+"\t\treturn true;\n"
+"\t}\n"
+"\tif (end - p >= 5 && memcmp(p, \"false\", 5) == 0) {\n"
+"\t\t*value = false;\n"
+"\t\t*pos = p + 5;\n"
+"\t\treturn true;\n"
+"\t}\n"
+"\treturn false;\n"
+"}\n"
+"\n"
+"// any value, checked by kzrjson_reader_t\n"
+"static bool gen_raw(const char **pos, const char *end, const char **raw, size_t *length) {\n"
+"\tconst char *p = gen_skip(*pos, end);\n"
+"\tkzrjson_reader_t reader;\n"
+"\tkzrjson_reader_init(&reader, p, (size_t)(end - p));\n"
+"\tif (!kzrjson_reader_skip(&reader, kzrjson_reader_next(&reader))) return false;\n"
+"\t*raw = p;\n"
+"\t*length = reader.pos;\n"
+"\t*pos = p + reader.pos;\n"
+"\treturn true;\n"
+"}\n"
+"\n";
+
+static FILE *open_output(const char *directory, const char *name, const char *extension) {
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s%s", directory, name, extension);
+	FILE *out = fopen(path, "w");
+	if (out == NULL) fprintf(stderr, "kzrjson_gen: can not write %s\n", path);
+	return out;
+}
+
+static bool write_header(const char *directory, const char *name, const field *root) {
+	FILE *out = open_output(directory, name, ".h");
+	if (out == NULL) return false;
+	fprintf(out, "// Generated by kzrjson_gen. Do not edit.\n");
+	fprintf(out, "#pragma once\n#include <stdbool.h>\n#include <stddef.h>\n#include <stdint.h>\n\n");
+	write_struct(out, root);
+	fprintf(out,
+		"/*\n"
+		" * Parse JSON text of the shape which %s_t was generated for.\n"
+		" * Strings and raw values point into json_text.\n"
+		" * Return false if the text does not have the shape;\n"
+		" * parse it by kzrjson_parse instead.\n"
+		" */\n"
+		"bool %s_parse(const char *json_text, const size_t length, %s_t *out);\n",
+		name, name, name);
+	return fclose(out) == 0;
+}
+
+static bool write_source(const char *directory, const char *name, const field *root) {
+	FILE *out = open_output(directory, name, ".c");
+	if (out == NULL) return false;
+	fprintf(out, "// Generated by kzrjson_gen. Do not edit.\n");
+	fprintf(out, "#include \"%s.h\"\n#include \"kzrjson.h\"\n", name);
+	fprintf(out, "#include <errno.h>\n#include <stdlib.h>\n#include <string.h>\n\n");
+	fputs(helpers, out);
+	write_parse_function(out, root);
+	fprintf(out,
+		"bool %s_parse(const char *json_text, const size_t length, %s_t *out) {\n"
+		"\tconst char *pos = json_text;\n"
+		"\tconst char *end = json_text + length;\n"
+		"\tmemset(out, 0, sizeof(%s_t));\n"
+		"\tif (!parse_%s(&pos, end, out)) return false;\n"
+		"\treturn gen_skip(pos, end) == end;\n"
+		"}\n",
+		name, name, name, name);
+	return fclose(out) == 0;
+}
+
+static void free_fields(field *f) {
+	for (size_t i = 0; i < f->field_count; i++) {
+		free_fields(f->fields + i);
+	}
+	free(f->fields);
+}
+
+static char *read_file(const char *path) {
+	FILE *in = fopen(path, "rb");
+	if (in == NULL) return NULL;
+	size_t capacity = 4096;
+	size_t length = 0;
+	char *text = checked_calloc(capacity, 1);
+	size_t read;
+	while ((read = fread(text + length, 1, capacity - length - 1, in)) > 0) {
+		length += read;
+		if (length + 1 == capacity) {
+			capacity *= 2;
+			char *grown = realloc(text, capacity);
+			if (grown == NULL) {
+				free(text);
+				fclose(in);
+				return NULL;
+			}
+			text = grown;
+		}
+	}
+	text[length] = '\0';
+	fclose(in);
+	return text;
+}
+
+int main(int argc, char **argv) {
+	if (argc != 4) {
+		fprintf(stderr, "usage: kzrjson_gen <name> <input.json> <output directory>\n");
+		return EXIT_FAILURE;
+	}
+	const char *name = argv[1];
+	char *text = read_file(argv[2]);
+	if (text == NULL) {
+		fprintf(stderr, "kzrjson_gen: can not read %s\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+	kzrjson_result_t result = kzrjson_parse_result(text);
+	if (result.code != kzrjson_success) {
+		fprintf(stderr, "kzrjson_gen: %s:%zu:%zu: invalid JSON\n", argv[2], result.line, result.column);
+		free(text);
+		return EXIT_FAILURE;
+	}
+
+	field root = {0};
+	snprintf(root.type, sizeof(root.type), "%s", name);
+	const bool schema = is_schema(result.value);
+	bool ok = schema ? read_schema(&root, result.value) : read_example(&root, result.value);
+	if (!ok || root.kind != field_object) {
+		fprintf(stderr, "kzrjson_gen: %s: the root must be an object\n", argv[2]);
+		ok = false;
+	} else {
+		ok = write_header(argv[3], name, &root) && write_source(argv[3], name, &root);
+	}
+	free_fields(&root);
+	free(g_type_names);
+	kzrjson_free(result.value);
+	free(text);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,84 @@
+/*
+ * Test of the parser generated by kzrjson_gen from example.json.
+ */
+#include "example.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+// members whose struct types would have the same name
+#define NESTED ",\"a\":{\"b\":{\"x\":1}},\"a_b\":{\"y\":true}"
+
+static bool parse(const char *text, example_t *out) {
+	return example_parse(text, strlen(text), out);
+}
+
+static void test_generated_parser(void) {
+	example_t e;
+	const char *text =
+		"{\"id\": -42, \"name\": \"a\\\"b\", \"score\": 1.5e2, \"active\": false,"
+		" \"tags\": [1, {\"x\": [true]}], \"owner\": {\"id\": 7, \"login\": \"\\u3042\"},"
+		" \"note\": {\"any\": null}, \"a\": {\"b\": {\"x\": 3}}, \"a_b\": {\"y\": false}}\n";
+	assert(parse(text, &e));
+	assert(e.id == -42);
+	assert(e.name_length == 4 && memcmp(e.name, "a\\\"b", 4) == 0);
+	assert(e.score == 150.0);
+	assert(!e.active);
+	assert(e.tags_length == 18 && memcmp(e.tags, "[1, {\"x\": [true]}]", 18) == 0);
+	assert(e.owner.id == 7);
+	assert(e.owner.login_length == 6 && memcmp(e.owner.login, "\\u3042", 6) == 0);
+	assert(e.note_length == 13 && memcmp(e.note, "{\"any\": null}", 13) == 0);
+	const example_a_b_t *ab = &e.a.b;
+	const example_a_b_2_t *a_b = &e.a_b;
+	assert(ab->x == 3 && !a_b->y);
+
+	// integer is accepted as number
+	assert(parse("{\"id\":1,\"name\":\"\",\"score\":3,\"active\":true,\"tags\":[],"
+		"\"owner\":{\"id\":0,\"login\":\"\"},\"note\":null" NESTED "}", &e));
+	assert(e.score == 3.0 && e.active && e.note_length == 4);
+	assert(e.a.b.x == 1 && e.a_b.y);
+	puts("test_generated_parser done");
+}
+
+static void test_generated_parser_fallback(void) {
+	example_t e;
+	const char *texts[] = {
+		// order of keys
+		"{\"name\":\"\",\"id\":1,\"score\":3,\"active\":true,\"tags\":[],"
+		"\"owner\":{\"id\":0,\"login\":\"\"},\"note\":null" NESTED "}",
+		// extra key
+		"{\"id\":1,\"name\":\"\",\"score\":3,\"active\":true,\"tags\":[],"
+		"\"owner\":{\"id\":0,\"login\":\"\"},\"note\":null" NESTED ",\"extra\":0}",
+		// missing key
+		"{\"id\":1,\"name\":\"\",\"score\":3,\"active\":true,\"tags\":[],"
+		"\"owner\":{\"id\":0},\"note\":null" NESTED "}",
+		// type of value
+		"{\"id\":1.5,\"name\":\"\",\"score\":3,\"active\":true,\"tags\":[],"
+		"\"owner\":{\"id\":0,\"login\":\"\"},\"note\":null" NESTED "}",
+		"{\"id\":1,\"name\":0,\"score\":3,\"active\":true,\"tags\":[],"
+		"\"owner\":{\"id\":0,\"login\":\"\"},\"note\":null" NESTED "}",
+		// invalid JSON
+		"{\"id\":01,\"name\":\"\",\"score\":3,\"active\":true,\"tags\":[],"
+		"\"owner\":{\"id\":0,\"login\":\"\"},\"note\":null" NESTED "}",
+		"{\"id\":1,\"name\":\"\\x\",\"score\":3,\"active\":true,\"tags\":[],"
+		"\"owner\":{\"id\":0,\"login\":\"\"},\"note\":null" NESTED "}",
+		"{\"id\":1,\"name\":\"\",\"score\":3,\"active\":true,\"tags\":[1,],"
+		"\"owner\":{\"id\":0,\"login\":\"\"},\"note\":null" NESTED "}",
+		"{\"id\":99999999999999999999,\"name\":\"\",\"score\":3,\"active\":true,\"tags\":[],"
+		"\"owner\":{\"id\":0,\"login\":\"\"},\"note\":null" NESTED "}",
+		"{\"id\":1,\"name\":\"\",\"score\":3,\"active\":true,\"tags\":[],"
+		"\"owner\":{\"id\":0,\"login\":\"\"},\"note\":null" NESTED "} 0",
+		"{\"id\":1,\"name\":\"\",\"score\":3,\"active\":true,\"tags\":[],"
+		"\"owner\":{\"id\":0,\"login\":\"\"},\"note\":null" NESTED,
+	};
+	for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+		assert(!parse(texts[i], &e));
+	}
+	puts("test_generated_parser_fallback done");
+}
+
+int main(void) {
+	test_generated_parser();
+	test_generated_parser_fallback();
+	return 0;
+}